@@ -37,6 +37,8 @@ struct fd_ops {
 	int (*split)(struct descriptor *d);
 	int (*read)(int fd, struct descriptor *d, char *buff, int sz);
 	int (*write)(int fd, struct descriptor *d, char *buff, int sz);
+	/* optional: write the first sz bytes of a cbuf without copying it */
+	int (*write_cbuf)(int fd, struct descriptor *d, cbuf_t cb, int sz);
 };
 
 struct descriptor {
@@ -160,6 +162,7 @@ static inline int fd_get_index(struct descriptor *d)
 
 static inline struct descriptor *fd_get_desc(int fd)
 {
+	if (fd < FD_POSIX_STD) return NULL;
 	return cos_map_lookup(&fds, fd);
 }
 
@@ -231,6 +234,16 @@ static int fd_net_write(int fd, struct descriptor *d, char *buf, int sz)
 	return net_send(cos_spd_id(), nc, buf, sz);
 }
 
+static int fd_net_write_cbuf(int fd, struct descriptor *d, cbuf_t cb, int sz)
+{
+	net_connection_t nc;
+
+	assert(d->type == DESC_NET);
+	nc = (net_connection_t)d->data;
+	FD_LOCK_RELEASE();
+	return net_send_cbuf(cos_spd_id(), nc, cb, sz);
+}
+
 int cos_socket(int domain, int type, int protocol)
 {
 	net_connection_t nc;
@@ -257,6 +270,7 @@ int cos_socket(int domain, int type, int protocol)
 	d->ops.close = fd_net_close;
 	d->ops.read  = fd_net_read;
 	d->ops.write = fd_net_write;
+	d->ops.write_cbuf = fd_net_write_cbuf;
 
 	switch (type) {
 	case SOCK_STREAM:
@@ -365,6 +379,7 @@ int cos_accept(int fd)
 	d_new->ops.close = fd_net_close;
 	d_new->ops.read  = fd_net_read;
 	d_new->ops.write = fd_net_write;
+	d_new->ops.write_cbuf = fd_net_write_cbuf;
 
 	fd = fd_get_index(d_new);
 	d_new->data = (void*)nc_new;
@@ -438,6 +453,7 @@ static int fd_app_split(struct descriptor *d)
 	d_new->ops.close = fd_app_close;
 	d_new->ops.read  = fd_app_read;
 	d_new->ops.write = fd_app_write;
+	d_new->ops.write_cbuf = NULL;
 	d_new->ops.split = fd_app_split;
 
 	if (0 > (evt_id = evt_create_cached(cos_spd_id()))) {
@@ -489,6 +505,7 @@ int cos_app_open(int type, struct cos_array *data)
 	d->ops.close = fd_app_close;
 	d->ops.read  = fd_app_read;
 	d->ops.write = fd_app_write;
+	d->ops.write_cbuf = NULL;
 	d->ops.split = fd_app_split;
 
 	conn_id = content_create(cos_spd_id(), evt_id, data);
@@ -565,6 +582,71 @@ err:
 	return -EBADFD;
 }
 
+/* 
+ * The vectored calls: the client stubs gather the iovecs into (or
+ * scatter them from) a single cbuf.
+ */
+int cos_fd_writev_cbuf(int fd, cbuf_t cb, int sz)
+{
+	struct descriptor *d;
+	char *buf;
+	int ret;
+
+	/* our reference to the client's cbuf, until we return */
+	buf = cbuf2buf(cb, sz);
+	if (NULL == buf) return -EFAULT;
+
+	FD_LOCK_TAKE();
+	d = fd_get_desc(fd);
+	if (NULL == d) {
+		FD_LOCK_RELEASE();
+		ret = -EBADFD;
+	} else if (d->ops.write_cbuf) {
+		/* network connections send the client's cbuf itself */
+		cbuf_send(cb);
+		ret = d->ops.write_cbuf(fd, d, cb, sz);
+	} else {
+		ret = d->ops.write(fd, d, buf, sz);
+	}
+	cbuf_free(cb);
+
+	return ret;
+}
+
+/* 
+ * Read into a new cbuf, returned in *cb for the client (or 0 without
+ * data); returns 0 or -errno.
+ */
+int cos_fd_readv_cbuf(int fd, int sz, cbuf_t *cb, int *off, int *len)
+{
+	struct descriptor *d;
+	char *buf;
+	int ret;
+
+	*off = *len = 0;
+	buf = cbuf_alloc(sz, cb);
+	if (!buf) return -ENOMEM;
+
+	FD_LOCK_TAKE();
+	d = fd_get_desc(fd);
+	if (NULL == d) {
+		FD_LOCK_RELEASE();
+		ret = -EBADFD;
+		goto err;
+	}
+	ret = d->ops.read(fd, d, buf, sz);
+	if (ret <= 0) goto err;
+	*len = ret;
+	cbuf_send(*cb);
+	cbuf_free(*cb);
+
+	return 0;
+err:
+	cbuf_free(*cb);
+	*cb = 0;
+	return ret;
+}
+
 int cos_wait(int fd)
 {
 	struct descriptor *d;
@@ -611,12 +693,54 @@ int cos_wait_all(void)
 	return fd;
 }
 
+/* 
+ * Return the descriptors of all of the events that are pending (at
+ * least one), with one invocation of the event component.
+ */
+int cos_wait_many(int *fds, int max)
+{
+	struct cos_array *data;
+	long *evts;
+	int amnt, i, n = 0;
+
+	if (max > FD_WAIT_MANY_MAX) max = FD_WAIT_MANY_MAX;
+	data = cos_argreg_alloc((sizeof(long) * max) + sizeof(struct cos_array));
+	assert(data);
+	evts = (long *)data->mem;
+
+	/* descriptors can be closed before we see their events */
+	while (0 == n) {
+		data->sz = max * sizeof(long);
+		amnt = evt_grp_mult_wait(cos_spd_id(), data);
+		if (amnt <= 0) BUG();
+		assert(amnt <= max);
+
+		FD_LOCK_TAKE();
+		for (i = 0 ; i < amnt ; i++) {
+			struct descriptor *d = evt2fd_lookup(evts[i]);
+
+			if (d) fds[n++] = d->fd_num;
+		}
+		FD_LOCK_RELEASE();
+	}
+	cos_argreg_free(data);
+
+	return n;
+}
+
 static void init(void) 
 {
+	static struct descriptor std;
 	int i;
 
 	lock_static_init(&fd_lock);
 	cos_map_init_static(&fds);
+	/* POSIX numbering: reserve the standard streams' descriptors */
+	for (i = 0 ; i < FD_POSIX_STD ; i++) {
+		long id = cos_map_add(&fds, &std);
+
+		assert(id == i);
+	}
 	cos_vect_init_static(&evt2fdesc);
 
 	for (i = 0 ; i < EVT_ID_CACHE_SZ ; i++) {
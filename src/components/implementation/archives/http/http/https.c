@@ -101,22 +101,50 @@ inline static int get_http_version(char *s, int len, char **ret, int *minor_vers
 	return 0;
 }
 
-static int http_find_next_line(char *s, int len, char **ret)
+/*
+ * Scan for the line endings a word at a time: a word has a '\r' iff
+ * it has a zero byte once xored with '\r' in each byte.  The test
+ * can be wrong only for the bytes after the first '\r', so the word
+ * is then scanned byte by byte.
+ */
+#define HTTP_WORD_ONES  (~0UL / 0xff)
+#define HTTP_WORD_HIGHS (HTTP_WORD_ONES * 0x80)
+#define HTTP_WORD_CR    (HTTP_WORD_ONES * '\r')
+
+static inline unsigned long http_word_has_cr(unsigned long w)
 {
-	char *r, *e;
+	w ^= HTTP_WORD_CR;
+	return (w - HTTP_WORD_ONES) & ~w & HTTP_WORD_HIGHS;
+}
 
-	for (e = s;
-	     len >= 2 && NULL == (r = http_end_line(e, len));
-	     e++, len--);
+static inline char *http_find_cr(char *s, char *e)
+{
+	for (; s < e && ((unsigned long)s & (sizeof(long)-1)); s++) {
+		if ('\r' == *s) return s;
+	}
+	for (; s + sizeof(long) <= e; s += sizeof(long)) {
+		if (http_word_has_cr(*(unsigned long *)s)) break;
+	}
+	for (; s < e; s++) {
+		if ('\r' == *s) return s;
+	}
+	return NULL;
+}
 
-	if (len >= 2) {
-		*ret = r;
-		return 0;
-	} else {
-		assert(len == 1 || len == 0);
-		*ret = e+len;
-		return 1;
+static int http_find_next_line(char *s, int len, char **ret)
+{
+	char *e = s + len, *cr = s;
+
+	while ((cr = http_find_cr(cr, e))) {
+		if (cr + 1 == e) break;
+		if ('\n' == cr[1]) {
+			*ret = cr + 2;
+			return 0;
+		}
+		cr++;
 	}
+	*ret = e;
+	return 1;
 }
 
 static int http_find_header_end(char *s, int len, char **curr, int flags)
@@ -201,6 +229,8 @@ struct connection {
 	int refcnt;
 	long conn_id, evt_id;
 	struct http_request *pending_reqs;
+	/* requests to reuse for the next ones pipelined on the connection */
+	struct http_request *free_reqs;
 };
 
 /*
@@ -318,6 +348,7 @@ static struct connection *http_new_connection(long conn_id, long evt_id)
 	c->conn_id = conn_id;
 	c->evt_id = evt_id;
 	c->pending_reqs = NULL;
+	c->free_reqs = NULL;
 	c->refcnt = 1;
 
 	return c;
@@ -345,6 +376,11 @@ static inline void conn_refcnt_dec(struct connection *c)
 				r = next;
 			} while (first != r);
 		}
+		while (c->free_reqs) {
+			r = c->free_reqs;
+			c->free_reqs = r->next;
+			free(r);
+		}
 		free(c);
 	}
 }
@@ -382,8 +418,10 @@ static inline void http_init_request(struct http_request *r, int buff_len, struc
 
 static struct http_request *http_new_request_flags(struct connection *c, char *req, int buff_len, int flags)
 {
-	struct http_request *r = malloc(sizeof(struct http_request));
+	struct http_request *r = c->free_reqs;
 
+	if (r) c->free_reqs = r->next;
+	else   r = malloc(sizeof(struct http_request));
 	if (NULL == r) return r;
 	http_init_request(r, buff_len, c, req);
 	r->flags = flags;
@@ -398,12 +436,15 @@ static struct http_request *http_new_request(struct connection *c, char *req, in
 
 static void __http_free_request(struct http_request *r)
 {
+	struct connection *c = r->c;
+
 	/* FIXME: don't free response if in arg. reg. */
 	if (r->resp.resp) free(r->resp.resp);
 	if (r->path) free(r->path);
 	assert(r->req);
 	if (r->flags & HTTP_REQ_MALLOC) free(r->req);
-	free(r);
+	r->next = c->free_reqs;
+	c->free_reqs = r;
 }
 
 static void http_free_request(struct http_request *r)
@@ -422,8 +463,9 @@ static void http_free_request(struct http_request *r)
 		c->pending_reqs = (r == next) ? NULL : next;
 	}
 	content_close(cos_spd_id(), r->content_id);
-	conn_refcnt_dec(c);
+	/* before our reference to the connection is dropped */
 	__http_free_request(r);
+	conn_refcnt_dec(c);
 }
 
 /* 
@@ -546,43 +588,45 @@ static int connection_parse_requests(struct connection *c, char *req, int req_sz
 	return 0;
 }
 
+/*
+ * The header of every response: only the content length differs, so
+ * it is written (right aligned) into the space reserved for it, and
+ * the header never has to be formatted.
+ */
 static const char success_head[] =
 	"HTTP/1.1 200 OK\r\n"
 	"Date: Sat, 14 Feb 2008 14:59:00 GMT\r\n"
 	"Content-Type: text/html\r\n"
 	"Connection: close\r\n"
-	"Content-Length: ";
+	"Content-Length:           \r\n\r\n";
 //static const char resp[] = "all your base are belong to us\r\n";
 
-#define MAX_SUPPORTED_DIGITS 20
+#define HTTP_HEAD_SZ      ((int)sizeof(success_head)-1)
+#define HTTP_HEAD_LEN_END (HTTP_HEAD_SZ - 4) /* the length ends before \r\n\r\n */
 
 /* Must prefix data by "content_length\r\n\r\n" */
 static int http_get_header(char *dest, int max_len, int content_len, int *resp_len)
 {
-	int resp_sz = content_len;
-	int head_sz = sizeof(success_head)-1;
-	int tot_sz, len_sz = 0;
-	char len_str[MAX_SUPPORTED_DIGITS];
-
-	len_sz = snprintf(len_str, MAX_SUPPORTED_DIGITS, "%d\r\n\r\n", resp_sz);
-	if (MAX_SUPPORTED_DIGITS == len_sz || len_sz < 1) {
-		printc("length of response body too large\n");
+	char *d;
+
+	if (content_len < 0) {
+		printc("length of response body invalid\n");
 		*resp_len = 0;
 		return -1;
 	}
-
-	tot_sz = head_sz + len_sz + resp_sz;
 	/* +1 for \0 so we can print the string */
-	if (tot_sz + 1 > max_len) {
+	if (HTTP_HEAD_SZ + content_len + 1 > max_len) {
 		*resp_len = 0;
 		return 1;
 	}
-	memcpy(dest, success_head, head_sz);
-	dest += head_sz;
-	memcpy(dest, len_str, len_sz);
-	dest += len_sz;
-	*resp_len = len_sz + head_sz;
-	dest[0] = '\0';
+	memcpy(dest, success_head, HTTP_HEAD_SZ);
+	d = dest + HTTP_HEAD_LEN_END;
+	do {
+		*--d = '0' + content_len % 10;
+		content_len /= 10;
+	} while (content_len);
+	*resp_len = HTTP_HEAD_SZ;
+	dest[HTTP_HEAD_SZ] = '\0';
 
 	return 0;
 }
@@ -815,6 +859,7 @@ void cos_init(void *arg)
 #include <arpa/inet.h>
 #include <malloc.h>
 #include <unistd.h>
+#include <sys/time.h>
 
 
 #define BUFF_SZ 256//1024
@@ -971,6 +1016,7 @@ static int unittest_http_parse(int print_success)
 	int success = 1, i;
 	char *ut_successes[] = {
 		"GET / HTTP/1.1\r\nUser-Agent: httperf/0.9.0\r\nHost: localhost\r\n\r\n",
+		"GET / HTTP/1.1\r\nHost: localhost\r\n\r\nGET /a HTTP/1.1\r\n\r\n", /* pipelined */
 		NULL
 	};
 	char *ut_pend[] = {
@@ -1015,13 +1061,137 @@ static int unittest_http_parse(int print_success)
 	return 1;
 }
 
-int main(void)
+/*
+ * Pipelined requests are parsed one after the other, as in
+ * connection_parse_requests, and answered one after the other into a
+ * single reply, as in connection_get_reply.  The reply must then
+ * hold one response per request, in the order of the requests.  The
+ * body of each response is the path of its request.
+ */
+static int unittest_http_pipeline(int print_success)
+{
+	char *paths[] = {"/", "/a", "/index.html", "/cgi/hw", "/b", NULL};
+	char req[512], reply[1024], *s, *end;
+	int i, len = 0, used = 0, consumed;
+	get_ret_t ret;
+
+	for (i = 0 ; paths[i] ; i++) {
+		len += sprintf(req + len, "GET %s HTTP/1.1\r\nHost: localhost\r\n\r\n", paths[i]);
+	}
+	end = req + len;
+
+	for (i = 0, s = req ; s < end ; i++, s = ret.end) {
+		int path_len;
+
+		if (!paths[i] || http_get_parse(s, (int)(end - s), &ret)) {
+			printf("Pipeline unit test: request %d at offset %d not parsed.\n", i, (int)(s - req));
+			return 1;
+		}
+		path_len = strlen(paths[i]);
+		if (ret.path_len != path_len || memcmp(ret.path, paths[i], path_len)) {
+			printf("Pipeline unit test: request %d parsed out of order.\n", i);
+			return 1;
+		}
+		if (http_get_header(reply + used, sizeof(reply) - used, ret.path_len, &consumed)) {
+			printf("Pipeline unit test: request %d not answered.\n", i);
+			return 1;
+		}
+		memcpy(reply + used + consumed, ret.path, ret.path_len);
+		used += consumed + ret.path_len;
+	}
+	if (paths[i]) {
+		printf("Pipeline unit test: only %d requests parsed.\n", i);
+		return 1;
+	}
+
+	for (i = 0, s = reply ; paths[i] ; i++) {
+		int body_len = 0, path_len = strlen(paths[i]);
+		char *l;
+
+		if (s + HTTP_HEAD_SZ > reply + used ||
+		    memcmp(s, success_head, HTTP_HEAD_LEN_END - 10)) {
+			printf("Pipeline unit test: response %d missing.\n", i);
+			return 1;
+		}
+		for (l = s + HTTP_HEAD_LEN_END - 10 ; l < s + HTTP_HEAD_LEN_END ; l++) {
+			if (*l != ' ') body_len = body_len * 10 + (*l - '0');
+		}
+		s += HTTP_HEAD_SZ;
+		if (body_len != path_len || memcmp(s, paths[i], path_len)) {
+			printf("Pipeline unit test: response %d out of order.\n", i);
+			return 1;
+		}
+		s += body_len;
+	}
+	if (s != reply + used) {
+		printf("Pipeline unit test: %d bytes after the last response.\n", (int)(reply + used - s));
+		return 1;
+	}
+	if (print_success) printf("Pipeline unit test successful (%d requests).\n", i);
+
+	return 0;
+}
+
+#define BENCH_PIPELINE 64
+#define BENCH_ITER     100000
+
+/*
+ * Parse throughput: a buffer of pipelined requests is parsed request
+ * after request, as in connection_parse_requests.
+ */
+static int bench_http_parse(int iter)
+{
+	static const char req[] =
+		"GET /index.html HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"User-Agent: httperf/0.9.0\r\n"
+		"Accept: */*\r\n"
+		"Connection: keep-alive\r\n\r\n";
+	int req_len = sizeof(req)-1, len = req_len * BENCH_PIPELINE;
+	int i, n = 0;
+	char *buff, *s;
+	struct timeval start, end;
+	double secs;
+	get_ret_t ret;
+
+	buff = malloc(len + 1);
+	if (!buff) return -1;
+	for (i = 0 ; i < BENCH_PIPELINE ; i++) memcpy(buff + i*req_len, req, req_len);
+	buff[len] = '\0';
+
+	gettimeofday(&start, NULL);
+	for (i = 0 ; i < iter ; i++) {
+		for (s = buff ; s < buff + len ; s = ret.end) {
+			if (http_get_parse(s, len - (int)(s - buff), &ret) ||
+			    ret.path_len != 11) {
+				printf("Benchmark parse failed at offset %d.\n", (int)(s - buff));
+				free(buff);
+				return -1;
+			}
+			n++;
+		}
+	}
+	gettimeofday(&end, NULL);
+
+	secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+	printf("%d requests (%d pipelined) in %f s: %.0f requests/s, %.1f MB/s\n",
+	       n, BENCH_PIPELINE, secs, n / secs, ((double)len * iter) / (secs * 1024 * 1024));
+	free(buff);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
 {
 	int sfd, epfd;
 	struct connection main_c;
 	struct epoll_event new_evts[MAX_CONNECTIONS];
 
-	if (unittest_http_parse(0)) return -1;
+	if (unittest_http_parse(0) || unittest_http_pipeline(0)) return -1;
+	/* -b [iterations]: benchmark the parser instead of serving */
+	if (argc > 1 && !strcmp(argv[1], "-b")) {
+		return bench_http_parse(argc > 2 ? atoi(argv[2]) : BENCH_ITER);
+	}
 
 	prep_signals();
 
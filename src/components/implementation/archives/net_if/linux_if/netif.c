@@ -521,9 +521,12 @@ int netif_event_wait(spdid_t spdid, struct cos_array *d)
 	if (d->sz < MTU) return -EINVAL;
 
 	interrupt_wait();
-	NET_LOCK_TAKE();
+	/* 
+	 * The ring has its own lock, and the thread map only changes
+	 * when receive threads are created, so receiving doesn't
+	 * serialize with transmission on the net lock.
+	 */
 	if (interrupt_process(d->mem, d->sz, &ret_sz)) BUG();
-	NET_LOCK_RELEASE();
 	d->sz = ret_sz;
 
 	return 0;
@@ -27,12 +27,29 @@
  *  net_connection_t.  There are mapping functions to convert between
  *  the two.  The packet queues in the intern_connections are
  *  implemented in an ugly, but easy and efficient way: the queue is
- *  implemented as a singly linked list, with a per-packet length, and
- *  pointer to the data. This struct packet_queue is actually not
- *  allocated separately, and exists in the ip_hdr region (after all
- *  packet processing is done).  Next there need to be exported
+ *  implemented as a ring of pointers to the packets, each with a
+ *  per-packet length, and pointer to the data. This struct
+ *  packet_queue is actually not allocated separately, and exists in
+ *  the ip_hdr region (after all packet processing is done).  Next
+ *  there need to be exported
  *  functions for other components to use these mechanisms.  Herein
  *  lies the net_* interface.
+ *
+ *  The packet memory is in cbufs, so that received data can be
+ *  handed to the application without copying it (net_recv_cbuf).
+ *  Likewise, net_send_cbuf transmits straight from the application's
+ *  cbuf: lwip references it from its segments (without
+ *  TCP_WRITE_FLAG_COPY), and we hold a reference to the cbuf until
+ *  its data is acknowledged (cos_net_lwip_tcp_sent).
+ *
+ *  lwip itself is not thread-safe, so all calls into it are made
+ *  with the net lock taken.  The ring of received packets of each
+ *  connection has a single producer (the network thread, in lwip's
+ *  callbacks) and a single consumer (the thread that owns the
+ *  connection), so it needs no lock at all, and receives only take
+ *  the net lock to (periodically) open the receive window.  The
+ *  owner's event is only triggered for the first packet queued after
+ *  it found the ring empty, so a burst of packets costs one wakeup.
  */
 #define COS_FMT_PRINT 
 
@@ -43,6 +60,7 @@
 #include <cos_map.h>
 #include <cos_synchronization.h>
 #include <cos_net.h>
+#include <cbuf.h>
 
 #include <lwip/init.h>
 #include <lwip/netif.h>
@@ -58,6 +76,12 @@
 #define UDP_RCV_MAX (1<<15)
 #define MTU 1500
 #define MAX_SEND MTU
+/* Zero-copy sends awaiting acknowledgment, per connection (a power of 2) */
+#define NET_TX_MAX 32
+/* Received bytes to consume before opening the receive window */
+#define NET_RECVED_BATCH (TCP_WND / 4)
+/* Received packets queued per connection (a power of 2) */
+#define NET_RX_MAX 128
 
 #include <sched.h>
 #include <evt.h>
@@ -76,6 +100,10 @@ cos_lock_t net_lock;
 		if (lock_release(&net_lock)) prints("error releasing net lock."); \
 	} while (0)
 
+/* Accesses to the other side's half of a receive ring */
+#define NET_READ_ONCE(x) (*(volatile typeof(x) *)&(x))
+#define NET_CC_BARRIER() __asm__ __volatile__("" : : : "memory")
+
 
 /*********************** Component Interface ************************/
 
@@ -88,7 +116,6 @@ typedef enum {
 
 typedef enum {
 	ACTIVE,
-	RECVING,
 	CONNECTING,
 	ACCEPTING,
 	SENDING
@@ -167,15 +194,25 @@ static void timing_output(void)
 
 /* This structure will alias with the ip header */
 struct packet_queue {
-	struct packet_queue *next;
 	void *data, *headers;
 	u32_t len;
+	cbuf_t cb;		/* the packet's memory, starting with this structure */
 #ifdef TEST_TIMING
 	/* Time stamps */
 	unsigned long long ts_start; 
 #endif
 };
 
+/*
+ * The cbuf of a zero-copy send, and the sequence number that follows
+ * its last byte: the copying sends (net_send) are interleaved in the
+ * same stream, so the acknowledged lengths can't be attributed.
+ */
+struct net_tx {
+	cbuf_t cb;
+	u32_t end;
+};
+
 struct intern_connection {
 	u16_t tid;
 	spdid_t spdid;
@@ -191,10 +228,23 @@ struct intern_connection {
 	/* FIXME: should include information for each packet
 	 * concerning the source ip and port as it can vary for
 	 * UDP. */
-	struct packet_queue *incoming, *incoming_last;
-	/* The size of the queue, and the offset into the current
-	 * packet where the read pointer is. */
-	int incoming_size, incoming_offset;
+	struct packet_queue *incoming[NET_RX_MAX];
+	/* The producer only writes the tail and the bytes queued, and
+	 * the consumer the rest: the head, the bytes consumed, and
+	 * the offset into the first packet where the read pointer
+	 * is. */
+	unsigned int rx_head, rx_tail;
+	unsigned int rx_queued, rx_consumed;
+	int incoming_offset;
+	/* Bytes consumed, but not yet given back to the tcp window */
+	int recved;
+	/* The owner has found the ring empty, and awaits its event */
+	unsigned long rx_armed;
+
+	/* Zero-copy sends, in order (protected by the net lock, as
+	 * they are released by lwip) */
+	struct net_tx outgoing[NET_TX_MAX];
+	unsigned int tx_head, tx_tail;
 
 	/* Accept will create a connection.  A list of connections is
 	 * stored here using the next pointer. */
@@ -257,15 +307,20 @@ static inline struct intern_connection *net_conn_alloc(conn_t conn_type, u16_t t
 	ic->thd_status = ACTIVE;
 	ic->conn_type = conn_type;
 	ic->data = data;
+	ic->rx_armed = 1;
 
 	return ic;
 }
 
+static void net_conn_rx_drain(struct intern_connection *ic);
+
+/* Called by the owner, once lwip no longer references the connection */
 static inline void net_conn_free(struct intern_connection *ic)
 {
 	assert(ic);
-	assert(0 == ic->incoming_size);
+	assert(ic->tx_head == ic->tx_tail);
 
+	net_conn_rx_drain(ic);
 	cos_map_del(&connections, net_conn_get_opaque(ic));
 	free(ic);
 
@@ -289,23 +344,109 @@ static inline struct packet_queue *net_packet_pq(void *data)
 	return &(((struct packet_queue*)data)[-1]);
 }
 
-static void net_conn_free_packet_data(struct intern_connection *ic)
+static inline void net_packet_free(struct packet_queue *pq)
+{
+	cbuf_free(pq->cb);
+}
+
+/*** The ring of received packets ***/
+
+/* The producer: is there room for n more packets? */
+static inline int net_rx_room(struct intern_connection *ic, int n)
+{
+	return ic->rx_tail - NET_READ_ONCE(ic->rx_head) + n <= NET_RX_MAX;
+}
+
+/* The producer: the packet is written before the tail is moved */
+static inline void net_rx_enqueue(struct intern_connection *ic, struct packet_queue *pq)
+{
+	ic->incoming[ic->rx_tail & (NET_RX_MAX-1)] = pq;
+	ic->rx_queued += pq->len;
+	/* x86 doesn't reorder stores, so the compiler mustn't either */
+	NET_CC_BARRIER();
+	ic->rx_tail++;
+}
+
+/* The consumer: the first packet, or NULL if the ring is empty */
+static inline struct packet_queue *net_rx_first(struct intern_connection *ic)
+{
+	if (ic->rx_head == NET_READ_ONCE(ic->rx_tail)) return NULL;
+	NET_CC_BARRIER();
+	return ic->incoming[ic->rx_head & (NET_RX_MAX-1)];
+}
+
+/* The consumer: done with the first packet, and len more bytes */
+static inline void net_rx_consume(struct intern_connection *ic, int len, int dequeue)
+{
+	ic->rx_consumed += len;
+	if (!dequeue) return;
+	ic->incoming_offset = 0;
+	NET_CC_BARRIER();
+	ic->rx_head++;
+}
+
+/* Received bytes not yet consumed (approximate for the producer) */
+static inline int net_rx_size(struct intern_connection *ic)
+{
+	return (int)(NET_READ_ONCE(ic->rx_queued) - NET_READ_ONCE(ic->rx_consumed));
+}
+
+/* 
+ * Trigger the owner's event if it awaits one.  Called by the producer
+ * after queueing packets, and by the consumer if packets were queued
+ * while it was arming itself (see net_conn_rx_arm).
+ */
+static void net_conn_notify(struct intern_connection *ic)
 {
-	struct packet_queue *pq, *pq_next;
-
-	assert(ic->conn_type == TCP_CLOSED);
-	pq = ic->incoming;
-	while (pq) {
-		pq_next = pq->next;
-		ic->incoming_size -= pq->len;
-		free(pq);
-		pq = pq_next;
+	/* our packets are visible before we look at rx_armed */
+	__sync_synchronize();
+	if (!ic->rx_armed || -1 == ic->data) return;
+	if (!cos_cas(&ic->rx_armed, 1, 0)) return;
+	if (evt_trigger(cos_spd_id(), ic->data)) BUG();
+}
+
+/* 
+ * The consumer: the ring is empty, so the next packet should trigger
+ * our event.  A packet queued before the producer saw rx_armed
+ * wouldn't, so we trigger it ourselves.
+ */
+static void net_conn_rx_arm(struct intern_connection *ic)
+{
+	if (ic->rx_armed) return;
+	ic->rx_armed = 1;
+	__sync_synchronize();
+	if (ic->rx_head != NET_READ_ONCE(ic->rx_tail)) net_conn_notify(ic);
+}
+
+/* The consumer: free the packets that will never be read */
+static void net_conn_rx_drain(struct intern_connection *ic)
+{
+	struct packet_queue *pq;
+
+	while (NULL != (pq = net_rx_first(ic))) {
+		net_rx_consume(ic, pq->len - ic->incoming_offset, 1);
+		net_packet_free(pq);
 	}
-	assert(ic->incoming_size == 0);
 	/* FIXME: go through the accept queue closing those tcp
 	 * connections too */
 }
 
+/* 
+ * Release the cbufs of the zero-copy sends whose data the peer has
+ * acknowledged (lastack has passed their end), or all of them if the
+ * connection is gone.  Called with the net lock taken.
+ */
+static void net_conn_release_tx(struct intern_connection *ic, int all)
+{
+	while (ic->tx_head != ic->tx_tail) {
+		struct net_tx *t = &ic->outgoing[ic->tx_head & (NET_TX_MAX-1)];
+
+		if (!all && TCP_SEQ_LT(ic->conn.tp->lastack, t->end)) break;
+		cbuf_free(t->cb);
+		ic->tx_head++;
+	}
+}
+
 /* 
  * The pbuf->payload might point to the actual data, but we might want
  * to free the data, which means we want to find the real start of the
@@ -332,7 +473,7 @@ static void cos_net_lwip_udp_recv(void *arg, struct udp_pcb *upcb, struct pbuf *
 				   struct ip_addr *ip, u16_t port)
 {
 	struct intern_connection *ic;
-	struct packet_queue *pq, *last;
+	struct packet_queue *pq;
 	void *headers;
 
 	/* We should not receive a list of packets unless it is from
@@ -347,9 +488,8 @@ static void cos_net_lwip_udp_recv(void *arg, struct udp_pcb *upcb, struct pbuf *
 	headers = cos_net_header_start(p, UDP);
 	assert (NULL != headers);
 	/* Over our allocation??? */
-	if (ic->incoming_size >= UDP_RCV_MAX) {
-		assert(ic->thd_status != RECVING);
-		assert(p->type == PBUF_ROM);
+	if (net_rx_size(ic) >= UDP_RCV_MAX || !net_rx_room(ic, 1)) {
+		assert(p->type == PBUF_REF);
 		//free(net_packet_pq(headers));
 		assert(p->ref > 0);
 		pbuf_free(p);
@@ -359,29 +499,12 @@ static void cos_net_lwip_udp_recv(void *arg, struct udp_pcb *upcb, struct pbuf *
 	pq = net_packet_pq(headers);
 	pq->data = p->payload;
 	pq->len = p->len;
-	pq->next = NULL;
-	
-	assert((NULL == ic->incoming) == (NULL == ic->incoming_last));
-	/* Is the queue empty? */
-	if (NULL == ic->incoming) {
-		assert(NULL == ic->incoming_last);
-		ic->incoming = ic->incoming_last = pq;
-	} else {
-		last = ic->incoming_last;
-		last->next = pq;
-		ic->incoming_last = pq;
-	}
-	ic->incoming_size += p->len;
+	net_rx_enqueue(ic, pq);
 	assert(1 == p->ref);
 	p->payload = p->alloc_track = NULL;
 	pbuf_free(p);
 
-	/* If the thread blocked waiting for a packet, wake it up */
-	if (RECVING == ic->thd_status) {
-		ic->thd_status = ACTIVE;
-		assert(ic->thd_status == ACTIVE); /* Detect races */
-		sched_wakeup(cos_spd_id(), ic->tid);
-	}
+	net_conn_notify(ic);
 
 	return;
 }
@@ -422,38 +545,32 @@ static int cos_net_udp_recv(struct intern_connection *ic, void *data, int sz)
 {
 	int xfer_amnt = 0;
 
+	struct packet_queue *pq;
+
 	/* If there is data available, get it */
-	if (ic->incoming_size > 0) {
-		struct packet_queue *pq;
+	if (NULL != (pq = net_rx_first(ic))) {
 		char *data_start;
 		int data_left;
 
-		pq = ic->incoming;
-		assert(pq);
 		data_start = ((char*)pq->data) + ic->incoming_offset;
 		data_left = pq->len - ic->incoming_offset;
 		assert(data_left > 0 && (u32_t)data_left <= pq->len);
 		/* Consume all of first packet? */
 		if (data_left <= sz) {
-			ic->incoming = pq->next;
-			if (ic->incoming_last == pq) {
-				assert(NULL == ic->incoming);
-				ic->incoming_last = NULL;
-			}
 			memcpy(data, data_start, data_left);
 			xfer_amnt = data_left;
-			ic->incoming_offset = 0;
-
-			free(pq);
+			net_rx_consume(ic, xfer_amnt, 1);
+			net_packet_free(pq);
 		} 
 		/* Consume part of first packet */
 		else {
 			memcpy(data, data_start, sz);
 			xfer_amnt = sz;
 			ic->incoming_offset += sz;
+			net_rx_consume(ic, xfer_amnt, 0);
 		}
-		ic->incoming_size -= xfer_amnt;
 	}
+	if (NULL == net_rx_first(ic)) net_conn_rx_arm(ic);
 
 	return xfer_amnt;
 }
@@ -474,9 +591,11 @@ static void cos_net_lwip_tcp_err(void *arg, err_t err)
 		assert(ic->conn_type == TCP);
 		assert(ic->conn_type != TCP_CLOSED);
 		if (-1 != ic->data && evt_trigger(cos_spd_id(), ic->data)) BUG();
+		/* the owner frees the received packets when it closes the connection */
 		ic->conn_type = TCP_CLOSED;
 		ic->conn.tp = NULL;
-		net_conn_free_packet_data(ic);
+		/* lwip has dropped the segments: nothing will be acknowledged */
+		net_conn_release_tx(ic, 1);
 		break;
 	default:
 		printc("TCP error #%d: don't really have docs to know what this means.", err);
@@ -521,9 +640,10 @@ static void __net_close(struct intern_connection *ic)
 static err_t cos_net_lwip_tcp_recv(void *arg, struct tcp_pcb *tp, struct pbuf *p, err_t err)
 {
 	struct intern_connection *ic;
-	struct packet_queue *pq, *last;
+	struct packet_queue *pq;
 	void *headers;
-	struct pbuf *first;
+	struct pbuf *first, *q;
+	int n;
 	
 	ic = (struct intern_connection*)arg;
 	assert(NULL != ic);
@@ -543,10 +663,12 @@ static err_t cos_net_lwip_tcp_recv(void *arg, struct tcp_pcb *tp, struct pbuf *p
 		assert(ic->conn_type == TCP_CLOSED && NULL == ic->conn.tp);
 		return ERR_CLSD;
 	}
+	/* No room in the ring: lwip keeps the data, and passes it again later */
+	for (n = 0, q = p ; q ; q = q->next) n++;
+	if (!net_rx_room(ic, n)) return ERR_MEM;
+
 	first = p;
 	while (p) {
-		struct pbuf *q;
-
 		if (p->ref != 1) printc("pbuf with len %d, totlen %d and refcnt %d", p->len, p->tot_len, p->ref);
 		assert(p->len > 0);
 		assert(p->type == PBUF_ROM || p->type == PBUF_REF);
@@ -555,22 +677,10 @@ static err_t cos_net_lwip_tcp_recv(void *arg, struct tcp_pcb *tp, struct pbuf *p
 		pq = net_packet_pq(headers);
 		pq->data = p->payload;
 		pq->len = p->len;
-		pq->next = NULL;
 #ifdef TEST_TIMING
 		pq->ts_start = timing_record(RECV, pq->ts_start);
 #endif
-	
-		assert((NULL == ic->incoming) == (NULL == ic->incoming_last));
-		/* Is the queue empty? */
-		if (NULL == ic->incoming) {
-			assert(NULL == ic->incoming_last);
-			ic->incoming = ic->incoming_last = pq;
-		} else {
-			last = ic->incoming_last;
-			last->next = pq;
-			ic->incoming_last = pq;
-		}
-		ic->incoming_size += p->len;
+		net_rx_enqueue(ic, pq);
 		//assert(1 == p->ref);
 		q = p->next;
 		p->payload = p->alloc_track = NULL;
@@ -583,13 +693,7 @@ static err_t cos_net_lwip_tcp_recv(void *arg, struct tcp_pcb *tp, struct pbuf *p
 	/* This should deallocate the entire chain */
 	pbuf_free(first);
 
-	if (-1 != ic->data && evt_trigger(cos_spd_id(), ic->data)) BUG();
-/* 	/\* If the thread blocked waiting for a packet, wake it up *\/ */
-/* 	if (RECVING == ic->thd_status) { */
-/* 		ic->thd_status = ACTIVE; */
-/* 		assert(ic->thd_status == ACTIVE); /\* Detect races *\/ */
-/* 		if (sched_wakeup(cos_spd_id(), ic->tid)) BUG(); */
-/* 	} */
+	net_conn_notify(ic);
 
 	return ERR_OK;
 }
@@ -599,6 +703,8 @@ static err_t cos_net_lwip_tcp_sent(void *arg, struct tcp_pcb *tp, u16_t len)
 	struct intern_connection *ic = arg;
 	assert(ic);
 
+	/* The acknowledged data is no longer referenced by lwip */
+	net_conn_release_tx(ic, 0);
 	/* I don't know why this is happening, but even when sending
 	 * nothing, it says that we send 1 byte on accepts.  There is
 	 * no ic->data associated with the connection yet, so we have
@@ -703,37 +809,54 @@ static err_t cos_net_lwip_tcp_accept(void *arg, struct tcp_pcb *new_tp, err_t er
 	return ERR_OK;
 }
 
-static int cos_net_tcp_recv(struct intern_connection *ic, void *data, int sz)
+/* 
+ * Give the bytes consumed from the connection back to the tcp
+ * window, once there are enough of them to be worth taking the net
+ * lock.  Called by the owner.
+ */
+static void cos_net_tcp_recved(struct intern_connection *ic, int force)
+{
+	int recved;
+
+	recved = ic->recved;
+	if (recved < NET_RECVED_BATCH && !(force && recved)) return;
+	ic->recved = 0;
+
+	NET_LOCK_TAKE();
+	/* the connection might have been closed in the mean time */
+	if (ic->conn_type == TCP && ic->conn.tp) tcp_recved(ic->conn.tp, recved);
+	NET_LOCK_RELEASE();
+}
+
+/* 
+ * Called by the owner, with the connection's type (TCP, or TCP_CLOSED
+ * if it has been reset since) read before looking at the ring: the
+ * packets received before a reset are still returned, and -EPIPE
+ * once they are consumed.
+ */
+static int cos_net_tcp_recv(struct intern_connection *ic, conn_t ct, void *data, int sz)
 {
 	int xfer_amnt = 0;
+	struct packet_queue *pq;
 
-	assert(ic->conn_type == TCP);
+	assert(ct == TCP || ct == TCP_CLOSED);
 	/* If there is data available, get it */
-	if (ic->incoming_size > 0) {
-		struct packet_queue *pq;
-		struct tcp_pcb *tp;
+	if (NULL != (pq = net_rx_first(ic))) {
 		char *data_start;
 		int data_left;
 
-		pq = ic->incoming;
-		assert(pq);
 		data_start = ((char*)pq->data) + ic->incoming_offset;
 		data_left = pq->len - ic->incoming_offset;
 		assert(data_left > 0 && (u32_t)data_left <= pq->len);
 		/* Consume all of first packet? */
 		if (data_left <= sz) {
-			ic->incoming = pq->next;
-			if (ic->incoming_last == pq) {
-				assert(NULL == ic->incoming);
-				ic->incoming_last = NULL;
-			}
 			memcpy(data, data_start, data_left);
 			xfer_amnt = data_left;
-			ic->incoming_offset = 0;
+			net_rx_consume(ic, xfer_amnt, 1);
 #ifdef TEST_TIMING
 			ic->ts_start = timing_record(APP_RECV, pq->ts_start);
 #endif			
-			free(pq);
+			net_packet_free(pq);
 		} 
 		/* Consume part of first packet */
 		else {
@@ -741,15 +864,54 @@ static int cos_net_tcp_recv(struct intern_connection *ic, void *data, int sz)
 			xfer_amnt = sz;
 			ic->incoming_offset += sz;
 			assert(ic->incoming_offset >= 0 && (u32_t)ic->incoming_offset < pq->len);
+			net_rx_consume(ic, xfer_amnt, 0);
 		}
-		ic->incoming_size -= xfer_amnt;
-		tp = ic->conn.tp;
-		tcp_recved(tp, xfer_amnt);
+		ic->recved += xfer_amnt;
+	} else if (ct == TCP_CLOSED) {
+		return -EPIPE;
 	}
+	if (NULL == net_rx_first(ic)) net_conn_rx_arm(ic);
 
 	return xfer_amnt;
 }
 
+/* 
+ * Zero-copy version of the above: pass the rest of the first packet
+ * to the client in the packet's own cbuf, returning it (0 if there is
+ * none, or -EPIPE), and its offset and size.  Called by the owner.
+ */
+static int cos_net_tcp_recv_cbuf(struct intern_connection *ic, conn_t ct, int *off, int *sz)
+{
+	struct packet_queue *pq;
+	char *data_start;
+	cbuf_t cb;
+
+	assert(ct == TCP || ct == TCP_CLOSED);
+	*off = *sz = 0;
+	if (NULL == (pq = net_rx_first(ic))) {
+		if (ct == TCP_CLOSED) return -EPIPE;
+		net_conn_rx_arm(ic);
+		return 0;
+	}
+
+	data_start = ((char*)pq->data) + ic->incoming_offset;
+	*off = data_start - (char*)pq;
+	*sz = pq->len - ic->incoming_offset;
+	assert(*sz > 0 && (u32_t)*sz <= pq->len);
+	net_rx_consume(ic, *sz, 1);
+	ic->recved += *sz;
+	if (NULL == net_rx_first(ic)) net_conn_rx_arm(ic);
+#ifdef TEST_TIMING
+	ic->ts_start = timing_record(APP_RECV, pq->ts_start);
+#endif			
+	/* our reference goes to the client */
+	cb = pq->cb;
+	cbuf_send_free(cb);
+	assert((int)cb > 0);
+
+	return (int)cb;
+}
+
 /**** COS generic networking functions ****/
 
 static struct intern_connection *net_verify_tcp_connection(net_connection_t nc, int *ret)
@@ -840,8 +1002,7 @@ int net_accept_data(spdid_t spdid, net_connection_t nc, long data)
 	ic->data = data;
 	/* If data has already arrived, but couldn't trigger the event
 	 * because ->data was not set, trigger the event now. */
-	if (0 < ic->incoming_size && 
-	    evt_trigger(cos_spd_id(), data)) goto err;
+	if (NULL != net_rx_first(ic)) net_conn_notify(ic);
 	NET_LOCK_RELEASE();
 
 	return 0;	
@@ -1040,47 +1201,92 @@ perm_err:
 	return -EPERM;
 }
 
-int net_recv(spdid_t spdid, net_connection_t nc, void *data, int sz)
+/* 
+ * The connection of the calling thread, looked up without the net
+ * lock: only the thread that owns a connection closes it.
+ */
+static struct intern_connection *net_conn_owned(net_connection_t nc, int *ret)
 {
-//	struct udp_pcb *up;
 	struct intern_connection *ic;
-	u16_t tid = cos_get_thd_id();
-	int xfer_amnt = 0;
-
-//	if (!cos_argreg_buff_intern(data, sz)) return -EFAULT;
-	if (!net_conn_valid(nc)) return -EINVAL;
 
-	NET_LOCK_TAKE();
+	*ret = 0;
+	if (!net_conn_valid(nc)) {
+		*ret = -EINVAL;
+		return NULL;
+	}
 	ic = net_conn_get_internal(nc);
 	if (NULL == ic) {
-		NET_LOCK_RELEASE();
-		return -EINVAL;
+		*ret = -EINVAL;
+		return NULL;
 	}
-	if (tid != ic->tid) {
-		NET_LOCK_RELEASE();
-		return -EPERM;
+	if (cos_get_thd_id() != ic->tid) {
+		*ret = -EPERM;
+		return NULL;
 	}
 
-	switch (ic->conn_type) {
+	return ic;
+}
+
+int net_recv(spdid_t spdid, net_connection_t nc, void *data, int sz)
+{
+	struct intern_connection *ic;
+	int xfer_amnt = 0;
+	conn_t ct;
+
+//	if (!cos_argreg_buff_intern(data, sz)) return -EFAULT;
+	ic = net_conn_owned(nc, &xfer_amnt);
+	if (NULL == ic) return xfer_amnt;
+
+	/* a reset can close the connection under us: look once, before the ring */
+	ct = NET_READ_ONCE(ic->conn_type);
+	NET_CC_BARRIER();
+	switch (ct) {
 	case UDP:
 		xfer_amnt = cos_net_udp_recv(ic, data, sz);
 		break;
 	case TCP:
-		xfer_amnt = cos_net_tcp_recv(ic, data, sz);
-		break;
 	case TCP_CLOSED:
-//		__net_close(ic);
-		xfer_amnt = -EPIPE;
+		xfer_amnt = cos_net_tcp_recv(ic, ct, data, sz);
 		break;
 	default:
-		printc("net_recv: invalid connection type: %d", ic->conn_type);
+		printc("net_recv: invalid connection type: %d", ct);
 		BUG();
 	}
 	assert(xfer_amnt <= sz);
-	NET_LOCK_RELEASE();
+	if (ct != UDP && xfer_amnt > 0) cos_net_tcp_recved(ic, 0);
+
 	return xfer_amnt;
 }
 
+/* 
+ * Receive without copying: returns the cbuf holding the next
+ * received data (0 if there is none), which the client accesses with
+ * cbuf2buf(cb, *off + *sz) and releases with cbuf_free.
+ */
+int net_recv_cbuf(spdid_t spdid, net_connection_t nc, int *off, int *sz)
+{
+	struct intern_connection *ic;
+	int ret;
+	conn_t ct;
+
+	ic = net_conn_owned(nc, &ret);
+	if (NULL == ic) return ret;
+
+	ct = NET_READ_ONCE(ic->conn_type);
+	NET_CC_BARRIER();
+	switch (ct) {
+	case TCP:
+	case TCP_CLOSED:
+		ret = cos_net_tcp_recv_cbuf(ic, ct, off, sz);
+		break;
+	default:
+		ret = -ENOTSUP;
+	}
+	if (ret > 0) cos_net_tcp_recved(ic, 0);
+
+	return ret;
+}
+
 int net_send(spdid_t spdid, net_connection_t nc, void *data, int sz)
 {
 	struct intern_connection *ic;
@@ -1129,33 +1335,21 @@ int net_send(spdid_t spdid, net_connection_t nc, void *data, int sz)
 	case TCP:
 	{
 		struct tcp_pcb *tp;
-#define TCP_SEND_COPY
-#ifdef TCP_SEND_COPY
-		void *d;
-		struct packet_queue *pq;
-#endif
+
 		tp = ic->conn.tp;
 		if (tcp_sndbuf(tp) < sz) { 
 			ret = 0;
 			break;
 		}
-#ifdef TCP_SEND_COPY
-		pq = malloc(sizeof(struct packet_queue) + sz);
-		if (unlikely(NULL == pq)) {
-			ret = -ENOMEM;
-			goto err;
-		}
 #ifdef TEST_TIMING
-		pq->ts_start = timing_record(APP_PROC, ic->ts_start);
+		timing_record(APP_PROC, ic->ts_start);
 #endif
-		pq->headers = NULL;
-		d = net_packet_data(pq);
-		memcpy(d, data, sz);
-		if (ERR_OK != (ret = tcp_write(tp, d, sz, 0))) {
-#else
+		/* 
+		 * The argument region is reused after we return, so
+		 * lwip copies it into its segments.  Use
+		 * net_send_cbuf to avoid the copy.
+		 */
 		if (ERR_OK != (ret = tcp_write(tp, data, sz, TCP_WRITE_FLAG_COPY))) {
-#endif
-			free(pq);
 			printc("tcp_write returned %d (sz %d, tcp_sndbuf %d, ERR_MEM: %d)", 
 			       ret, sz, tcp_sndbuf(tp), ERR_MEM);
 			BUG();
@@ -1181,6 +1375,83 @@ err:
 	return ret;
 }
 
+/* 
+ * Send the first sz bytes of the client's cbuf without copying them.
+ * lwip's segments reference the cbuf until they are acknowledged, so
+ * we keep a reference to it until then.  Returns sz, or 0 if the
+ * send buffer is full (try again later).
+ */
+int net_send_cbuf(spdid_t spdid, net_connection_t nc, cbuf_t cb, int sz)
+{
+	struct intern_connection *ic;
+	void *d;
+	int ret;
+
+	ic = net_conn_owned(nc, &ret);
+	if (NULL == ic) return ret;
+	if (sz <= 0 || sz > 0xFFFF) return -EMSGSIZE;
+	d = cbuf2buf(cb, sz);
+	if (NULL == d) return -EINVAL;
+	ret = sz;
+
+	NET_LOCK_TAKE();
+	switch (ic->conn_type) {
+	case UDP:
+	{
+		struct pbuf *p;
+
+		if (sz > MAX_SEND) {
+			ret = -EMSGSIZE;
+			break;
+		}
+		p = pbuf_alloc(PBUF_TRANSPORT, sz, PBUF_ROM);
+		if (NULL == p) {
+			ret = -ENOMEM;
+			break;
+		}
+		p->payload = d;
+		/* the datagram is sent by the time this returns */
+		if (ERR_OK != udp_send(ic->conn.up, p)) ret = -ENOTCONN;
+		pbuf_free(p);
+		break;
+	}
+	case TCP:
+	{
+		struct tcp_pcb *tp = ic->conn.tp;
+		struct net_tx *t;
+		err_t err;
+
+		if (tcp_sndbuf(tp) < sz || ic->tx_tail - ic->tx_head == NET_TX_MAX) {
+			ret = 0;
+			break;
+		}
+		if (ERR_OK != (err = tcp_write(tp, d, sz, 0))) {
+			ret = err == ERR_MEM ? 0 : -ENOMEM;
+			break;
+		}
+		t = &ic->outgoing[ic->tx_tail++ & (NET_TX_MAX-1)];
+		t->cb  = cb;
+		t->end = tp->snd_lbb;
+		if (ERR_OK != (err = tcp_output(tp))) {
+			printc("tcp_output returned %d, ERR_MEM: %d", err, ERR_MEM);
+			BUG();
+		}
+		NET_LOCK_RELEASE();
+
+		return sz;
+	}
+	case TCP_CLOSED:
+		ret = -EPIPE;
+		break;
+	default:
+		BUG();
+	}
+	NET_LOCK_RELEASE();
+	cbuf_free(cb);
+
+	return ret;
+}
+
 /************************ LWIP integration: **************************/
 
 struct ip_addr ip, mask, gw;
@@ -1193,6 +1464,7 @@ static void cos_net_interrupt(char *packet, int sz)
 	struct pbuf *p;
 	struct ip_hdr *ih;
 	struct packet_queue *pq;
+	cbuf_t cb;
 #ifdef TEST_TIMING
 	unsigned long long ts;
 #endif
@@ -1207,30 +1479,27 @@ static void cos_net_interrupt(char *packet, int sz)
 		goto done;
 	}
 
-	p = pbuf_alloc(PBUF_IP, len, PBUF_ROM);
+	/* PBUF_REF: PBUF_ROM payloads are the zero-copy sends */
+	p = pbuf_alloc(PBUF_IP, len, PBUF_REF);
 	if (unlikely(!p)) {
 		prints("OOM in interrupt: allocation of pbuf failed.\n");
 		goto done;
 	}
 
-	/* For now, we're going to do an additional copy.  Currently,
-	 * packets should be small, so this shouldn't hurt that badly.
-	 * This is done because 1) we are freeing the packet
-	 * elsewhere, 2) we want to malloc some (small) packets to
-	 * save space and free up the ring buffers, 3) it is difficult
-	 * to know in (1) which deallocation method (free or return to
-	 * ring buff) to use */
-	pq = malloc(len + sizeof(struct packet_queue));
+	/* This is the only copy of received data: the packet is
+	 * copied out of the argument region into a cbuf that is
+	 * later handed to the application (net_recv_cbuf).  The
+	 * packet_queue is at the start of the cbuf. */
+	pq = cbuf_alloc(len + sizeof(struct packet_queue), &cb);
 	if (unlikely(NULL == pq)) {
 		printc("OOM in interrupt: allocation of packet data (%d bytes) failed.\n", len);
 		pbuf_free(p);
 		goto done;
 	}
+	pq->cb = cb;
 	pq->headers = d = net_packet_data(pq);
 #ifdef TEST_TIMING
-#ifdef TCP_SEND_COPY
 	ts = pq->ts_start = timing_timestamp();
-#endif	
 #endif	
 	memcpy(d, packet, len);
 	p->payload = p->alloc_track = d;
@@ -1302,15 +1571,6 @@ static err_t cos_net_stack_send(struct netif *ni, struct pbuf *p, struct ip_addr
 		memcpy(buff + tot_len, p->payload, p->len);
 		tot_len += p->len;
 
-#ifdef TCP_SEND_COPY
-#ifdef TEST_TIMING
-		if ((p->type == PBUF_REF || p->type == PBUF_ROM)) {
-			struct packet_queue *pq;
-			pq = net_packet_pq(p->payload);
-			timing_record(SEND, pq->ts_start);
-		}
-#endif
-#endif
 		assert(p->type != PBUF_POOL);
 		assert(p->ref == 1);
 		p = p->next;
@@ -1328,7 +1588,9 @@ static err_t cos_net_stack_send(struct netif *ni, struct pbuf *p, struct ip_addr
 
 /* 
  * Called when pbuf_free is invoked on a pbuf that was allocated with
- * PBUF_{ROM|REF}.  Free the ->alloc_track if it is non-NULL.
+ * PBUF_{ROM|REF}.  Received packets are PBUF_REF: free their cbuf.
+ * Sent data is PBUF_ROM, and belongs to the client (its cbuf is
+ * released on acknowledgment).
  */
 static void lwip_free_payload(struct pbuf *p)
 {
@@ -1337,18 +1599,18 @@ static void lwip_free_payload(struct pbuf *p)
 
 	assert(p);
 	if (NULL == p->payload) return;
-	if (cos_argreg_buff_intern(p->payload, p->len)) {
+	if (p->type == PBUF_ROM || cos_argreg_buff_intern(p->payload, p->len)) {
 		p->payload = NULL;
 		return;
 	}
-	/* assuming this will only happen with TCP data */
+	/* assuming this will only happen with received data */
 	headers = cos_net_header_start(p, TCP);
 	assert (NULL != headers); /* we could just return NULL here */
 	pq = net_packet_pq(headers);
 	/* have we successfully extracted the packet_queue? */
-	assert(pq->headers == NULL || pq->headers == headers);
+	assert(pq->headers == headers);
 	p->payload = NULL;
-	free(pq);
+	net_packet_free(pq);
 }
 
 /*** Initialization routines: ***/
@@ -0,0 +1,244 @@
+/**
+ * Redistribution of this file is permitted under the GNU General
+ * Public License v2.
+ *
+ * The content of map/, served from a cache built at initialization.
+ * The files are indexed by the hash of their path (the id of the
+ * request), and each has its full HTTP response (the header followed
+ * by the body) precomputed in page-aligned memory.  A request is thus
+ * a hash probe on open, and retrieving the response is either a copy
+ * of the body, or (static_alias) mapping the response read-only into
+ * the client.
+ */
+
+#include <cos_component.h>
+#include <cos_alloc.h>
+#include <print.h>
+#include <cos_map.h>
+#include <errno.h>
+
+#include <static_content.h>
+#include <mem_mgr_large.h>
+
+#include <sched.h>
+#include <evt.h>
+
+#include "../map/map.h"
+
+#define SC_CACHE_SLOTS 1024 /* a power of 2, at least twice the files */
+#define SC_HEAD_SZ     128
+#define FNV32_INIT     0x811c9dc5
+#define FNV32_PRIME    0x01000193
+
+struct sc_entry {
+	const char *key;
+	u32_t hash;
+	char *resp; 		/* page-aligned, the header followed by the body */
+	int resp_len, head_len, npages;
+};
+
+static struct sc_entry sc_cache[SC_CACHE_SLOTS], sc_notfound;
+
+struct static_content {
+	content_req_t id;
+	long evt_id;
+	struct sc_entry *e;
+};
+
+COS_MAP_CREATE_STATIC(static_requests);
+
+static const char sc_head[] =
+	"HTTP/1.1 200 OK\r\n"
+	"Content-Type: text/xml\r\n"
+	"Content-Length: %d\r\n\r\n";
+static const char msg[] = "Confirmation numbers not found\n";
+
+static u32_t sc_hash(const char *k, int len)
+{
+	u32_t h = FNV32_INIT;
+	int i;
+
+	for (i = 0 ; i < len ; i++) {
+		h ^= (unsigned char)k[i];
+		h *= FNV32_PRIME;
+	}
+	return h;
+}
+
+static struct sc_entry *sc_lookup(const char *key, int len)
+{
+	u32_t h = sc_hash(key, len), i, n;
+
+	for (i = h & (SC_CACHE_SLOTS-1), n = 0 ; n < SC_CACHE_SLOTS ; i = (i+1) & (SC_CACHE_SLOTS-1), n++) {
+		struct sc_entry *e = &sc_cache[i];
+
+		if (!e->key) return NULL;
+		if (e->hash == h && !strncmp(e->key, key, len) && !e->key[len]) return e;
+	}
+	return NULL;
+}
+
+static int sc_entry_build(struct sc_entry *e, const char *key, const char *body)
+{
+	char head[SC_HEAD_SZ];
+	int body_len = strlen(body);
+
+	e->head_len = snprintf(head, SC_HEAD_SZ, sc_head, body_len);
+	if (e->head_len >= SC_HEAD_SZ) return -1;
+	e->resp_len = e->head_len + body_len;
+	e->npages   = round_up_to_page(e->resp_len) / PAGE_SIZE;
+	e->resp     = page_alloc(e->npages);
+	if (!e->resp) return -1;
+	memcpy(e->resp, head, e->head_len);
+	memcpy(e->resp + e->head_len, body, body_len);
+	e->hash = sc_hash(key, strlen(key));
+	e->key  = key;
+
+	return 0;
+}
+
+static int sc_cache_build(void)
+{
+	int i;
+
+	if (sc_entry_build(&sc_notfound, "", msg)) return -1;
+	for (i = 0 ; map[i].key ; i++) {
+		struct sc_entry e;
+		u32_t s, n;
+
+		if (sc_entry_build(&e, map[i].key, map[i].value)) return -1;
+		for (s = e.hash & (SC_CACHE_SLOTS-1), n = 0 ; n < SC_CACHE_SLOTS && sc_cache[s].key ; s = (s+1) & (SC_CACHE_SLOTS-1), n++) ;
+		/* more files than slots */
+		if (n == SC_CACHE_SLOTS) return -1;
+		sc_cache[s] = e;
+	}
+	return 0;
+}
+
+char *parse_getreq(char *str)
+{
+	char *args = strchr(str, '?');
+	
+	if (!args) return NULL;
+	if (!strncmp(args, "?id=", 4)) {
+		return &args[4];
+	}
+	return NULL;
+}
+
+content_req_t static_open(spdid_t spdid, long evt_id, struct cos_array *data)
+{
+	struct static_content *sc = malloc(sizeof(struct static_content));
+	content_req_t id;
+
+	if (NULL == sc) return -ENOMEM;
+	id = cos_map_add(&static_requests, sc);
+	if (id == -1) {
+		free(sc);
+		return -ENOMEM;
+	}
+
+	sc->e = NULL;
+	if (data && cos_argreg_arr_intern(data)) {
+		char *key = parse_getreq(data->mem);
+
+		if (key) sc->e = sc_lookup(key, strlen(key));
+	} else {
+		printc("no data on open\n");
+	}
+	if (!sc->e) sc->e = &sc_notfound;
+
+	sc->id = id;
+	sc->evt_id = evt_id;
+
+	return id;
+}
+
+int static_request(spdid_t spdid, content_req_t cr, struct cos_array *data)
+{
+	struct static_content *sc;
+	long evt_id;
+
+	sc = cos_map_lookup(&static_requests, cr);
+	if (NULL == sc) return -EINVAL;
+
+	evt_id = sc->evt_id;
+	/* Data available immediately */
+	evt_trigger(cos_spd_id(), evt_id);
+
+	return 0;
+}
+
+int static_retrieve(spdid_t spdid, content_req_t cr, struct cos_array *data, int *more)
+{
+	struct static_content *sc;
+	struct sc_entry *e;
+	int body_len;
+
+	if (!cos_argreg_arr_intern(data)) return -EINVAL;
+	if (!cos_argreg_buff_intern((char*)more, sizeof(int))) return -EINVAL;
+
+	sc = cos_map_lookup(&static_requests, cr);
+	if (NULL == sc) return -EINVAL;
+
+	e = sc->e;
+	body_len = e->resp_len - e->head_len;
+	if (body_len > data->sz) return -ENOMEM;
+	memcpy(data->mem, e->resp + e->head_len, body_len);
+	data->sz = body_len;
+	*more = 0;
+
+	return 0;
+}
+
+int static_alias(spdid_t spdid, content_req_t cr, vaddr_t dest, int npages)
+{
+	struct static_content *sc;
+	struct sc_entry *e;
+	int i;
+
+	sc = cos_map_lookup(&static_requests, cr);
+	if (NULL == sc) return -EINVAL;
+
+	e = sc->e;
+	if (npages < e->npages) return -ENOMEM;
+	for (i = 0 ; i < e->npages ; i++) {
+		vaddr_t d = dest + i * PAGE_SIZE;
+
+		if (d != mman_alias_page(cos_spd_id(), (vaddr_t)e->resp + i * PAGE_SIZE, spdid, d, MAPPING_READ)) {
+			goto err;
+		}
+	}
+
+	return e->resp_len;
+err:
+	/* don't leave the client with part of the response */
+	while (i-- > 0) mman_release_page(spdid, dest + i * PAGE_SIZE, 0);
+
+	return -EFAULT;
+}
+
+int static_close(spdid_t spdid, content_req_t cr)
+{
+	struct static_content *sc;
+
+	sc = cos_map_lookup(&static_requests, cr);
+	if (NULL == sc) return -EINVAL;
+	cos_map_del(&static_requests, cr);
+	free(sc);
+
+	return 0;
+}
+
+void cos_init(void *arg)
+{
+	cos_map_init_static(&static_requests);
+	if (sc_cache_build()) printc("static content cache: could not build the cache\n");
+
+	return;
+}
+
+void bin(void)
+{
+	sched_block(cos_spd_id(), 0);
+}
@@ -125,6 +125,11 @@ int static_close(spdid_t spdid, content_req_t cr)
 	return 0;
 }
 
+int static_alias(spdid_t spdid, content_req_t cr, vaddr_t dest, int npages)
+{
+	return -ENOSYS;
+}
+
 void cos_init(void *arg)
 {
 	cos_map_init_static(&static_requests);
@@ -14,7 +14,6 @@
 #include <print.h>
 #include <cos_time.h>
 #include <cos_list.h>
-#include <cos_vect.h>
 #include <cos_alloc.h>
 
 #include <timed_blk.h>
@@ -23,6 +22,7 @@
 #include <sched.h>
 
 #include <sys/param.h> 		/* MIN/MAX */
+#include <stddef.h>
 #include <res_spec.h> /* For creating timer thread */
 /* Lets save some typing... */
 #define TAKE(spdid) 	if (sched_component_take(spdid)) return -1;
@@ -38,10 +38,16 @@ unsigned long cyc_per_tick;
 #define TE_BLOCKED   0x2
 #define TE_PERIODIC  0x4
 
+/* The links of an event in its timing-wheel slot */
+struct te_link {
+	struct te_link *next, *prev;
+};
+
 struct thread_event {
+	struct te_link link;
 	event_time_t event_expiration;
 	unsigned short int thread_id, flags;
-	struct thread_event *next, *prev;
+	short int tw_level; /* -1 if not in the wheel */
 
 	/* if flags & TE_PERIODIC */
 	unsigned int period, missed;
@@ -51,177 +57,221 @@ struct thread_event {
 	long long completion;
 };
 
-static struct thread_event events, periodic;
+#define CSLAB_ALLOC(sz)   alloc_page()
+#define CSLAB_FREE(x, sz) free_page(x)
+#include <cslab.h>
+CSLAB_CREATE(te, sizeof(struct thread_event));
 
-COS_VECT_CREATE_STATIC(thd_evts);
-COS_VECT_CREATE_STATIC(thd_periodic);
+/* per-thread event records, allocated from the slab on first use */
+static struct thread_event *thd_evts[MAX_NUM_THREADS], *thd_periodic[MAX_NUM_THREADS];
 
-/* 
- * FIXME: to make this predictable (avoid memory allocation in the
- * must-be-predictable case, we should really cos_vect_add_id when we
- * first find out about the possibility of the thread making any
- * invocations.
- */
-static struct thread_event *__te_get(unsigned short int tid, cos_vect_t *v)
+static struct thread_event *__te_get(unsigned short int tid, struct thread_event **tbl)
 {
 	struct thread_event *te;
 
-	te = cos_vect_lookup(v, tid);
+	if (tid >= MAX_NUM_THREADS) return NULL;
+	te = tbl[tid];
 	if (NULL == te) {
-		te = malloc(sizeof(struct thread_event));
+		te = cslab_alloc_te();
 		if (NULL == te) return NULL;
 		memset(te, 0, sizeof(struct thread_event));
 		te->thread_id = tid;
-		INIT_LIST(te, next, prev);
-		if (tid != cos_vect_add_id(v, te, tid)) return NULL;
+		te->tw_level  = -1;
+		INIT_LIST(&te->link, next, prev);
+		tbl[tid] = te;
 	}
 	return te;
 }
 
 static struct thread_event *te_pget(unsigned short int tid)
 {
-	return __te_get(tid, &thd_periodic);
+	return __te_get(tid, thd_periodic);
 }
 
 static struct thread_event *te_get(unsigned short int tid)
 {
-	return __te_get(tid, &thd_evts);
+	return __te_get(tid, thd_evts);
+}
+
+static inline struct thread_event *te_of(struct te_link *l)
+{
+	return (struct thread_event *)((char *)l - offsetof(struct thread_event, link));
+}
+
+static inline int te_pending(struct thread_event *te)
+{
+	return te->tw_level >= 0;
 }
 
 //#define USEC_PER_SEC 1000000
 //static unsigned int usec_per_tick = 0;
 
-/* 
- * Return 1 if the inserted event is closer in the future than any
- * others, 0 otherwise.
+/*
+ * A hierarchical timing wheel of TW_LEVELS levels of TW_SLOTS slots.
+ * Level l holds the events that expire less than TW_SLOTS^(l+1)
+ * ticks after tw_now, each in the slot of its expiration's l-th
+ * digit (in base TW_SLOTS).  Insertion and removal are O(1).  Each
+ * tick expires the level 0 slot for that tick, and when a level's
+ * index wraps around, the next slot of the level above is cascaded
+ * down.  Events further away than the wheel covers wait in the last
+ * slot of the top level, and are redistributed when it cascades.
  */
-static int __insert_event(struct thread_event *te, struct thread_event *events)
+#define TW_BITS   6
+#define TW_SLOTS  (1 << TW_BITS)
+#define TW_MASK   (TW_SLOTS - 1)
+#define TW_LEVELS 4
+
+static struct te_link tw_slots[TW_LEVELS][TW_SLOTS];
+static unsigned int tw_nevents[TW_LEVELS];
+/* all events up to tw_now have been expired */
+static event_time_t tw_now;
+
+static inline unsigned int tw_slot(event_time_t t, int level)
 {
-	struct thread_event *tmp;
-
-	assert(NULL != te);
-	assert(te->event_expiration);
-	assert(EMPTY_LIST(te, next, prev));
-	assert(events->next && events->prev);
-	if (EMPTY_LIST(events, next, prev)) {
-		ADD_LIST(events, te, next, prev);
-	} else for (tmp = FIRST_LIST(events, next, prev) ;
-		    ; /* condition built into body (see break;) */
-		    tmp = FIRST_LIST(tmp, next, prev)) {
-		assert(tmp);
-		struct thread_event *prev_te = LAST_LIST(tmp, next, prev);
-		assert(prev_te);
-		assert(tmp->prev && tmp->next);
-		/* We found our place in the list OR end of list.
-		 * Either way, insert before this position */
-		if (tmp->event_expiration > te->event_expiration ||
-		    events == tmp) {
-			ADD_LIST(prev_te, te, next, prev);
-			assert(prev_te->next == te && te->prev == prev_te);
-			assert(te->next == tmp && tmp->prev == te);
-			break;
-		}
-		assert(tmp->next && tmp->prev);
+	return (unsigned int)(t >> (level * TW_BITS)) & TW_MASK;
+}
+
+static void tw_insert(struct thread_event *te)
+{
+	event_time_t exp = te->event_expiration, delta;
+	int level;
+	unsigned int slot;
+
+	assert(!te_pending(te));
+	assert(EMPTY_LIST(&te->link, next, prev));
+	/* late events expire on the next tick */
+	if (exp <= tw_now) exp = tw_now + 1;
+	delta = exp - tw_now;
+
+	for (level = 0 ; level < TW_LEVELS - 1 ; level++) {
+		if (delta < (1ULL << ((level + 1) * TW_BITS))) break;
+	}
+	if (delta < (1ULL << (TW_LEVELS * TW_BITS))) {
+		slot = tw_slot(exp, level);
+	} else {
+		/* beyond the wheel: the slot that cascades last */
+		slot = (tw_slot(tw_now, level) + TW_MASK) & TW_MASK;
 	}
-	
-	assert(!EMPTY_LIST(events, next, prev));
-	assert(!EMPTY_LIST(te, next, prev));
 
-	return 0;
+	ADD_END_LIST(&tw_slots[level][slot], &te->link, next, prev);
+	te->tw_level = level;
+	tw_nevents[level]++;
 }
 
-static int insert_event(struct thread_event *te)
+static void tw_remove(struct thread_event *te)
 {
-	return __insert_event(te, &events);
+	assert(te_pending(te));
+
+	REM_LIST(&te->link, next, prev);
+	tw_nevents[te->tw_level]--;
+	te->tw_level = -1;
 }
 
-static int insert_pevent(struct thread_event *te)
+static inline int tw_empty(void)
 {
-	return __insert_event(te, &periodic);
+	int level;
+
+	for (level = 0 ; level < TW_LEVELS ; level++) {
+		if (tw_nevents[level]) return 0;
+	}
+	return 1;
 }
 
-static struct thread_event *find_remove_event(unsigned short int thdid)
+/* An idle wheel doesn't advance, so catch up before inserting. */
+static inline void tw_sync(event_time_t now)
 {
-	struct thread_event *tmp;
-
-	for (tmp = FIRST_LIST(&events, next, prev);
-	     tmp != &events;
-	     tmp = FIRST_LIST(tmp, next, prev)) {
-		if (tmp->thread_id == thdid) {
-			REM_LIST(tmp, next, prev);
-			assert(events.next && events.prev);
-			return tmp;
-		}
+	if (tw_empty() && tw_now < now) tw_now = now;
+}
+
+static void te_expire(struct thread_event *te);
+
+/*
+ * Move the events of the current slot of level down to the lower
+ * levels, and expire those that are due at tw_now (they would
+ * otherwise go in the next tick's slot).
+ */
+static void tw_cascade(int level)
+{
+	struct te_link *head, *l;
+	struct thread_event *te;
+
+	if (level >= TW_LEVELS) return;
+	/* the level above wraps first, so it can refill this slot */
+	if (tw_slot(tw_now, level) == 0) tw_cascade(level + 1);
+	if (!tw_nevents[level]) return;
+
+	head = &tw_slots[level][tw_slot(tw_now, level)];
+	while (!EMPTY_LIST(head, next, prev)) {
+		l  = FIRST_LIST(head, next, prev);
+		te = te_of(l);
+		tw_remove(te);
+		if (te->event_expiration <= tw_now) te_expire(te);
+		else                                tw_insert(te);
 	}
-	return NULL;
 }
 
-static void __event_expiration(event_time_t time, struct thread_event *events)
+static struct thread_event *find_remove_event(unsigned short int thdid)
 {
-	spdid_t spdid = cos_spd_id();
+	struct thread_event *te;
 
-	struct thread_event *tmp, *next_te;
+	if (thdid >= MAX_NUM_THREADS) return NULL;
+	te = thd_evts[thdid];
+	if (NULL == te || !te_pending(te)) return NULL;
+	assert(!(te->flags & TE_PERIODIC));
+	tw_remove(te);
+	te->flags &= ~TE_BLOCKED;
 
-	assert(TIMER_NO_EVENTS != time);
+	return te;
+}
 
-	for (tmp = FIRST_LIST(events, next, prev) ;
-	     tmp != events && tmp->event_expiration <= time ; 
-	     tmp = next_te) {
-		u8_t b;
-		unsigned short int tid;
-
-		assert(tmp);
-		next_te = FIRST_LIST(tmp, next, prev);
-		assert(next_te && next_te->prev == tmp && tmp->next == next_te);
-		tmp->flags |= TE_TIMED_OUT;
-		REM_LIST(tmp, next, prev);
-		b = tmp->flags & TE_BLOCKED;
-		tmp->flags &= ~TE_BLOCKED;
-		tid = tmp->thread_id;
-
-		if (tmp->flags & TE_PERIODIC) {
-			/* thread hasn't blocked? deadline miss! */
-			if (!b) {
-				tmp->dl_missed++;
-				tmp->need_restart++;
-				if (!tmp->missed) { /* first miss? */
-					tmp->missed = 1;
-					if (tmp->completion) {
-						/* compute the lateness of 
-						   last task finished on time */
-						long long t;
-						rdtscll(t);
-						tmp->lateness_tot += -(t - tmp->completion);
-						tmp->samples++;
- 					}
-					/* save time of deadline, unless we
-					 * have saved the time of an earlier
-					 * deadline miss */
-					rdtscll(tmp->completion);
-					tmp->miss_samples++;
-					tmp->samples++;
+static void te_expire(struct thread_event *te)
+{
+	spdid_t spdid = cos_spd_id();
+	u8_t b;
+
+	te->flags |= TE_TIMED_OUT;
+	b = te->flags & TE_BLOCKED;
+	te->flags &= ~TE_BLOCKED;
+
+	if (te->flags & TE_PERIODIC) {
+		/* thread hasn't blocked? deadline miss! */
+		if (!b) {
+			te->dl_missed++;
+			te->need_restart++;
+			if (!te->missed) { /* first miss? */
+				te->missed = 1;
+				if (te->completion) {
+					/* compute the lateness of 
+					   last task finished on time */
+					long long t;
+					rdtscll(t);
+					te->lateness_tot += -(t - te->completion);
+					te->samples++;
 				}
-			} else {
-				assert(!tmp->missed); /* on time, compute lateness */
-				long long t;
-				assert (tmp->completion) ;
-				rdtscll(t);
-				tmp->lateness_tot += -(t - tmp->completion);
-				tmp->samples++;
-				tmp->completion = 0;
+				/* save time of deadline, unless we
+				 * have saved the time of an earlier
+				 * deadline miss */
+				rdtscll(te->completion);
+				te->miss_samples++;
+				te->samples++;
 			}
-
-			tmp->dl++;
-			/* Next periodic deadline! */
-			tmp->event_expiration += tmp->period;
-			insert_pevent(tmp);
+		} else {
+			assert(!te->missed); /* on time, compute lateness */
+			long long t;
+			assert (te->completion) ;
+			rdtscll(t);
+			te->lateness_tot += -(t - te->completion);
+			te->samples++;
+			te->completion = 0;
 		}
 
-		if (b) sched_wakeup(spdid, tmp->thread_id);
-		/* We don't have to deallocate the thread_events as
-		 * they are stack allocated on the sleeping
-		 * threads. */
+		te->dl++;
+		/* Next periodic deadline! */
+		te->event_expiration += te->period;
+		tw_insert(te);
 	}
+
+	if (b) sched_wakeup(spdid, te->thread_id);
 }
 
 /* 
@@ -231,24 +281,55 @@ static void __event_expiration(event_time_t time, struct thread_event *events)
  */
 static void event_expiration(event_time_t time)
 {
-	__event_expiration(time, &periodic);
-	__event_expiration(time, &events);
+	assert(TIMER_NO_EVENTS != time);
 
-	return;
+	if (tw_empty()) {
+		tw_now = MAX(tw_now, time);
+		return;
+	}
+	while (tw_now < time) {
+		struct te_link *head;
+
+		/* nothing in the lowest level: skip to its next wrap-around */
+		if (!tw_nevents[0]) tw_now = MIN(time, (tw_now | TW_MASK) + 1);
+		else                tw_now++;
+		if (tw_slot(tw_now, 0) == 0) tw_cascade(1);
+
+		/* expire the whole slot as a batch */
+		head = &tw_slots[0][tw_slot(tw_now, 0)];
+		while (!EMPTY_LIST(head, next, prev)) {
+			struct thread_event *te = te_of(FIRST_LIST(head, next, prev));
+
+			tw_remove(te);
+			te_expire(te);
+		}
+	}
 }
 
+/* 
+ * The next time the event thread must run: an expiration in level 0,
+ * or the cascade of the next non-empty slot of a higher level.
+ */
 static inline event_time_t next_event_time(void)
 {
-	event_time_t e = TIMER_NO_EVENTS, p = TIMER_NO_EVENTS;
-
-	e = EMPTY_LIST(&events, next, prev) ? 
-		TIMER_NO_EVENTS :
-		FIRST_LIST(&events, next, prev)->event_expiration;
-	p = EMPTY_LIST(&periodic, next, prev) ? 
-		TIMER_NO_EVENTS : 
-		FIRST_LIST(&periodic, next, prev)->event_expiration;
+	event_time_t next = TIMER_NO_EVENTS;
+	int level;
+
+	for (level = 0 ; level < TW_LEVELS ; level++) {
+		unsigned int k, cur = tw_slot(tw_now, level);
+
+		if (!tw_nevents[level]) continue;
+		for (k = 1 ; k <= TW_SLOTS ; k++) {
+			event_time_t t;
+
+			if (EMPTY_LIST(&tw_slots[level][(cur + k) & TW_MASK], next, prev)) continue;
+			t = ((tw_now >> (level * TW_BITS)) + k) << (level * TW_BITS);
+			next = MIN(next, t);
+			break;
+		}
+	}
 	/* assume here that TIMER_NO_EVENTS > all other values */
-	return MIN(e, p);
+	return next;
 }
 
 /**
@@ -281,7 +362,7 @@ int timed_event_block(spdid_t spdinv, unsigned int amnt)
 	TAKE(spdid);
 	te = te_get(cos_get_thd_id());
 	if (NULL == te) BUG();
-	assert(EMPTY_LIST(te, next, prev));
+	assert(!te_pending(te));
 
 	te->thread_id = cos_get_thd_id();
 	te->flags &= ~TE_TIMED_OUT;
@@ -291,9 +372,10 @@ int timed_event_block(spdid_t spdinv, unsigned int amnt)
 	te->event_expiration = ticks + amnt;
 	block_time = ticks;
    	assert(te->event_expiration > ticks);
+	tw_sync(ticks);
 	t = next_event_time();
-	insert_event(te);
-	assert(te->next && te->prev && !EMPTY_LIST(te, next, prev));
+	tw_insert(te);
+	assert(te_pending(te));
 	RELEASE(spdid);
 
 	if (t != next_event_time()) sched_timeout(spdid, amnt);
@@ -301,8 +383,8 @@ int timed_event_block(spdid_t spdinv, unsigned int amnt)
 		prints("fprr: sched block failed in timed_event_block.");
 	}
 
-	/* we better have been taking off the list! */
-	assert(EMPTY_LIST(te, next, prev));
+	/* we better have been taken out of the wheel! */
+	assert(!te_pending(te));
 	if (te->flags & TE_TIMED_OUT) return TIMER_EXPIRED;
 
 	/* 
@@ -496,19 +578,19 @@ int periodic_wake_create(spdid_t spdinv, unsigned int period)
 	te = te_pget(tid);
 	if (NULL == te) BUG();
 	if (te->flags & TE_PERIODIC) {
-		assert(!EMPTY_LIST(te, next, prev));
-		REM_LIST(te, next, prev);
+		tw_remove(te);
 	}
-	assert(EMPTY_LIST(te, next, prev));
+	assert(!te_pending(te));
 	te->flags |= TE_PERIODIC;
 	te->period = period;
 	ticks = sched_timestamp();
 	te->event_expiration = n = ticks + period;
 	assert(n > ticks);
 
+	tw_sync(ticks);
 	t = next_event_time();
 	assert(t > ticks);
-	insert_pevent(te);
+	tw_insert(te);
 	if (t > n) sched_timeout(spdid, n-ticks);
 	te->need_restart = 0;
 
@@ -527,8 +609,7 @@ int periodic_wake_remove(spdid_t spdinv, unsigned short int tid)
 	if (NULL == te) BUG();
 	if (!(te->flags & TE_PERIODIC)) goto err;
 		
-	assert(!EMPTY_LIST(te, next, prev));
-	REM_LIST(te, next, prev);
+	tw_remove(te);
 	te->flags = 0;
 	
 	RELEASE(spdid);
@@ -551,7 +632,7 @@ int periodic_wake_wait(spdid_t spdinv)
 	if (NULL == te) BUG();
 	if (!(te->flags & TE_PERIODIC)) goto err;
 		
-	assert(!EMPTY_LIST(te, next, prev));
+	assert(te_pending(te));
 
 	rdtscll(t);
 
@@ -608,7 +689,8 @@ static void start_timer_thread(void)
 	//	printc("cyc_per_tick = %lld\n", cyc_per_tick);
 
 	/* When the system boots, we have no pending waits */
-	assert(EMPTY_LIST(&events, next, prev));
+	assert(tw_empty());
+	tw_now = ticks;
 	sched_block(spdid, 0);
 	/* Wait for events, then act on expired events.  Loop. */
 	while (1) {
@@ -652,14 +734,12 @@ void cos_init()
 	static int first = 1;
 
 	if (first) {
-		first = 0;
-		INIT_LIST(&events, next, prev);
-		events.thread_id = 0;
-		INIT_LIST(&periodic, next, prev);
-		periodic.thread_id = 0;
+		int i, j;
 
-		cos_vect_init_static(&thd_evts);
-		cos_vect_init_static(&thd_periodic);
+		first = 0;
+		for (i = 0 ; i < TW_LEVELS ; i++) {
+			for (j = 0 ; j < TW_SLOTS ; j++) INIT_LIST(&tw_slots[i][j], next, prev);
+		}
 
 		sp.c.type = SCHEDP_PRIO;
 		sp.c.value = 3;
@@ -3,6 +3,12 @@
  *
  * Redistribution of this file is permitted under the GNU General
  * Public License v2.
+ *
+ * Files are stored as page-sized extents, each its own cbuf, indexed
+ * by a two-level radix tree.  Growing a file only adds extents (data
+ * is never moved), and treadp hands the extent itself to the reader
+ * to map, instead of copying it.  The global lock protects only the
+ * torrents and the namespace; the data of each file has its own lock.
  */
 
 #include <cos_component.h>
@@ -15,6 +21,9 @@
 #include <evt.h>
 #include <cos_alloc.h>
 #include <cos_map.h>
+
+static void rfs_file_free(void *d);
+#define FS_DATA_FREE rfs_file_free
 #include <fs.h>
 
 static cos_lock_t fs_lock;
@@ -22,7 +31,143 @@ struct fsobj root;
 #define LOCK() if (lock_take(&fs_lock)) BUG();
 #define UNLOCK() if (lock_release(&fs_lock)) BUG();
 
-#define MIN_DATA_SZ 256
+#define RFS_EXT_SZ PAGE_SIZE
+#define RFS_LEAF_NENT (PAGE_SIZE / sizeof(struct rfs_ext))
+#define RFS_ROOT_NENT (PAGE_SIZE / sizeof(struct rfs_ext *))
+#define RFS_MAX_SZ ((u32_t)(RFS_ROOT_NENT * RFS_LEAF_NENT) * RFS_EXT_SZ)
+
+struct rfs_ext {
+	cbuf_t cb;
+	char * mem;
+};
+
+/* fsobj->data of a file */
+struct rfs_file {
+	cos_lock_t       lock;
+	struct rfs_ext **root; /* allocated on the first write */
+};
+
+static struct rfs_file *
+rfs_file_alloc(void)
+{
+	struct rfs_file *f = malloc(sizeof(struct rfs_file));
+
+	if (!f) return NULL;
+	lock_static_init(&f->lock);
+	f->root = NULL;
+
+	return f;
+}
+
+static void
+rfs_file_free(void *d)
+{
+	struct rfs_file *f = d;
+	unsigned int     i, j;
+
+	if (f->root) {
+		for (i = 0; i < RFS_ROOT_NENT; i++) {
+			struct rfs_ext *leaf = f->root[i];
+
+			if (!leaf) continue;
+			for (j = 0; j < RFS_LEAF_NENT; j++) {
+				if (leaf[j].mem) cbuf_free(leaf[j].cb);
+			}
+			free(leaf);
+		}
+		free(f->root);
+	}
+	lock_static_free(&f->lock);
+	free(f);
+}
+
+static void *
+rfs_node_alloc(void)
+{
+	void *n = malloc(PAGE_SIZE);
+
+	if (n) memset(n, 0, PAGE_SIZE);
+
+	return n;
+}
+
+/*
+ * The extent holding the file's offset off, allocating it (and its
+ * path in the tree) if alloc.  Called with the file's lock.
+ */
+static struct rfs_ext *
+rfs_ext_lookup(struct rfs_file *f, u32_t off, int alloc)
+{
+	u32_t           e = off / RFS_EXT_SZ;
+	u32_t           r = e / RFS_LEAF_NENT;
+	struct rfs_ext *leaf, *ext;
+
+	if (r >= RFS_ROOT_NENT) return NULL;
+	if (!f->root) {
+		if (!alloc) return NULL;
+		f->root = rfs_node_alloc();
+		if (!f->root) return NULL;
+	}
+	leaf = f->root[r];
+	if (!leaf) {
+		if (!alloc) return NULL;
+		leaf = f->root[r] = rfs_node_alloc();
+		if (!leaf) return NULL;
+	}
+	ext = &leaf[e % RFS_LEAF_NENT];
+	if (!ext->mem) {
+		if (!alloc) return NULL;
+		ext->mem = cbuf_alloc(RFS_EXT_SZ, &ext->cb);
+		if (!ext->mem) return NULL;
+	}
+
+	return ext;
+}
+
+/*
+ * Find the file of td that has the flags, and take a reference to it
+ * so that the data can be accessed outside of the global lock.
+ */
+static struct fsobj *
+rfs_get(td_t td, int flags, u32_t *off, int *err)
+{
+	struct torrent *t;
+	struct fsobj *fso = NULL;
+
+	*err = -EINVAL;
+	if (tor_isnull(td)) return NULL;
+
+	LOCK();
+	t = tor_lookup(td);
+	if (!t) goto done;
+	assert(!tor_is_usrdef(td) || t->data);
+	*err = -EACCES;
+	if (!(t->flags & flags)) goto done;
+	fso = t->data;
+	if (!fso || !fso->data) {
+		*err = -EINVAL;
+		fso  = NULL;
+		goto done;
+	}
+	fsobj_take(fso);
+	*off = t->offset;
+done:
+	UNLOCK();
+	return fso;
+}
+
+static void
+rfs_put(td_t td, struct fsobj *fso, u32_t off)
+{
+	struct torrent *t;
+
+	LOCK();
+	/* the torrent might have been released in the mean time */
+	t = tor_lookup(td);
+	if (t && t->data == fso) t->offset = off;
+	fsobj_release(fso);
+	UNLOCK();
+}
 
 td_t 
 tsplit(spdid_t spdid, td_t td, char *param, 
@@ -45,6 +190,14 @@ tsplit(spdid_t spdid, td_t td, char *param,
 		fsc = fsobj_alloc(subpath, parent);
 		if (!fsc) ERR_THROW(-EINVAL, done);
 		fsc->flags = tflags;
+		if (fsc->type == FSOBJ_FILE) {
+			fsc->data = (char *)rfs_file_alloc();
+			if (!fsc->data) {
+				fsobj_rem(fsc, parent);
+				fsobj_release(fsc);
+				ERR_THROW(-ENOMEM, done);
+			}
+		}
 	} else {
 		/* File has less permissions than asked for? */
 		if ((~fsc->flags) & tflags) ERR_THROW(-EACCES, done);
@@ -102,87 +255,112 @@ done:
 int 
 tread(spdid_t spdid, td_t td, int cbid, int sz)
 {
-	int ret = -1, left;
-	struct torrent *t;
+	int ret = 0, err;
 	struct fsobj *fso;
+	struct rfs_file *f;
+	u32_t off;
 	char *buf;
 
-	if (tor_isnull(td)) return -EINVAL;
-
-	LOCK();
-	t = tor_lookup(td);
-	if (!t) ERR_THROW(-EINVAL, done);
-	assert(!tor_is_usrdef(td) || t->data);
-	if (!(t->flags & TOR_READ)) ERR_THROW(-EACCES, done);
-
-	fso = t->data;
-	assert(fso->size <= fso->allocated);
-	assert(t->offset <= fso->size);
-	if (!fso->size) ERR_THROW(0, done);
-
 	buf = cbuf2buf(cbid, sz);
-	if (!buf) ERR_THROW(-EINVAL, done);
+	if (!buf || sz < 0) return -EINVAL;
+	fso = rfs_get(td, TOR_READ, &off, &err);
+	if (!fso) return err;
+	f = (struct rfs_file *)fso->data;
+
+	if (lock_take(&f->lock)) BUG();
+	assert(off <= fso->size);
+	if (sz > (int)(fso->size - off)) sz = fso->size - off;
+	while (ret < sz) {
+		struct rfs_ext *ext = rfs_ext_lookup(f, off, 0);
+		u32_t eoff = off % RFS_EXT_SZ;
+		int n = RFS_EXT_SZ - eoff;
+
+		assert(ext);
+		if (n > sz - ret) n = sz - ret;
+		memcpy(buf + ret, ext->mem + eoff, n);
+		ret += n;
+		off += n;
+	}
+	if (lock_release(&f->lock)) BUG();
 
-	left = fso->size - t->offset;
-	ret  = left > sz ? sz : left;
+	rfs_put(td, fso, off);
+	return ret;
+}
 
-	assert(fso->data);
-	memcpy(buf, fso->data + t->offset, ret);
-	t->offset += ret;
-done:	
-	UNLOCK();
+/*
+ * Zero-copy read: return the extent holding the current offset for
+ * the reader to cbuf2buf (and then cbuf_free), with the offset and
+ * length of the data read within it.  Later writes to that part of
+ * the file are visible through the reader's mapping.
+ */
+int
+treadp(spdid_t spdid, td_t td, int *off, int *sz)
+{
+	int ret = 0, err;
+	struct fsobj *fso;
+	struct rfs_file *f;
+	struct rfs_ext *ext;
+	u32_t foff;
+
+	fso = rfs_get(td, TOR_READ, &foff, &err);
+	if (!fso) return err;
+	f = (struct rfs_file *)fso->data;
+
+	if (lock_take(&f->lock)) BUG();
+	assert(foff <= fso->size);
+	*off = foff % RFS_EXT_SZ;
+	*sz  = 0;
+	if (foff == fso->size) goto done;
+
+	ext = rfs_ext_lookup(f, foff, 0);
+	assert(ext);
+	*sz = RFS_EXT_SZ - *off;
+	if (*sz > (int)(fso->size - foff)) *sz = fso->size - foff;
+	cbuf_send(ext->cb);
+	ret   = ext->cb;
+	foff += *sz;
+done:
+	if (lock_release(&f->lock)) BUG();
+
+	rfs_put(td, fso, foff);
 	return ret;
 }
 
 int 
 twrite(spdid_t spdid, td_t td, int cbid, int sz)
 {
-	int ret = -1, left;
-	struct torrent *t;
+	int ret = 0, err;
 	struct fsobj *fso;
+	struct rfs_file *f;
+	u32_t off;
 	char *buf;
 
-	if (tor_isnull(td)) return -EINVAL;
-
-	LOCK();
-	t = tor_lookup(td);
-	if (!t) ERR_THROW(-EINVAL, done);
-	assert(t->data);
-	if (!(t->flags & TOR_WRITE)) ERR_THROW(-EACCES, done);
-
-	fso = t->data;
-	assert(fso->size <= fso->allocated);
-	assert(t->offset <= fso->size);
-
 	buf = cbuf2buf(cbid, sz);
-	if (!buf) ERR_THROW(-EINVAL, done);
-
-	left = fso->allocated - t->offset;
-	if (left >= sz) {
-		ret = sz;
-		if (fso->size < (t->offset + sz)) fso->size = t->offset + sz;
-	} else {
-		char *new;
-		int new_sz;
-
-		new_sz = fso->allocated == 0 ? MIN_DATA_SZ : fso->allocated * 2;
-		new    = malloc(new_sz);
-		if (!new) ERR_THROW(-ENOMEM, done);
-		if (fso->data) {
-			memcpy(new, fso->data, fso->size);
-			free(fso->data);
-		}
-
-		fso->data      = new;
-		fso->allocated = new_sz;
-		left           = new_sz - t->offset;
-		ret            = left > sz ? sz : left;
-		fso->size      = t->offset + ret;
+	if (!buf || sz < 0) return -EINVAL;
+	fso = rfs_get(td, TOR_WRITE, &off, &err);
+	if (!fso) return err;
+	f = (struct rfs_file *)fso->data;
+
+	if (lock_take(&f->lock)) BUG();
+	assert(off <= fso->size);
+	if ((u32_t)sz > RFS_MAX_SZ - off) sz = RFS_MAX_SZ - off;
+	while (ret < sz) {
+		struct rfs_ext *ext = rfs_ext_lookup(f, off, 1);
+		u32_t eoff = off % RFS_EXT_SZ;
+		int n = RFS_EXT_SZ - eoff;
+
+		if (!ext) break;
+		if (n > sz - ret) n = sz - ret;
+		memcpy(ext->mem + eoff, buf + ret, n);
+		ret += n;
+		off += n;
 	}
-	memcpy(fso->data + t->offset, buf, ret);
-	t->offset += ret;
-done:	
-	UNLOCK();
+	if (fso->size < off) fso->size = off;
+	fso->allocated = round_up_to_page(fso->size);
+	if (lock_release(&f->lock)) BUG();
+	if (!ret && sz) ret = -ENOMEM;
+
+	rfs_put(td, fso, off);
 	return ret;
 }
 
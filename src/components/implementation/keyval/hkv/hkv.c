@@ -0,0 +1,361 @@
+/**
+ * Redistribution of this file is permitted under the GNU General
+ * Public License v2.
+ *
+ * The keyval interface on open-addressing (linear probing) hash
+ * tables.  Each table has a fixed number of slots, each 0 or the
+ * reference of an entry in the table's arena.  An entry is written
+ * before it is published in a slot, a slot only ever changes to a
+ * newer entry for the same key, and a replaced entry's space is only
+ * reused by later puts, so lookups take no locks: only the writers of
+ * a table are serialized (with a spinlock).  The arenas are cbufs that
+ * are appended to, so that a reference to a value can be returned to
+ * (and mapped by) the client.  Each arena counts the bytes of its
+ * entries that are still in slots; once a full arena has none, it is
+ * reused.
+ */
+
+#include <cos_component.h>
+#include <cos_kernel_api.h>
+#include <cos_debug.h>
+#include <llprint.h>
+#include <ps.h>
+#include <cbuf.h>
+#include <keyval.h>
+
+#define HKV_MAX_TABLES 16
+#define HKV_SLOTS 2048 /* a power of 2 */
+#define HKV_MAX_ENTS (HKV_SLOTS / 4 * 3)
+#define HKV_NAME_SZ 32
+#define HKV_ARENA_SZ (PAGE_SIZE << CBUF_MAX_ORDER)
+#define FNV32_INIT 0x811c9dc5
+#define FNV32_PRIME 0x01000193
+/* waiting for a table's writer (can be defined to yield to it) */
+#ifndef HKV_RELAX
+#define HKV_RELAX() __asm__ __volatile__("pause" : : : "memory")
+#endif
+
+struct hkv_table {
+	unsigned long lock; /* taken by writers */
+	char          name[HKV_NAME_SZ];
+	u16_t         nlen;
+	unsigned long nents;
+	/* the arena we append to, and those with no live entries */
+	cbuf_t        arena, free_arenas;
+	unsigned long arena_used;
+	u32_t         hashes[HKV_SLOTS]; /* written before the slot is published */
+	u32_t         slots[HKV_SLOTS];
+};
+
+static struct hkv_table hkv_tables[HKV_MAX_TABLES];
+static unsigned long    hkv_ntables, hkv_tables_lock;
+
+struct hkv_arena {
+	char *        base; /* our mapping */
+	unsigned long live; /* the bytes of the entries in slots */
+	cbuf_t        next; /* on the table's free_arenas */
+};
+static struct hkv_arena hkv_arenas[CBUF_MAX + 1];
+
+static inline void
+hkv_lock_take(unsigned long *l)
+{
+	while (!ps_cas(l, 0, 1)) {
+		while (ps_load(l)) HKV_RELAX();
+	}
+}
+
+static inline void
+hkv_lock_release(unsigned long *l)
+{
+	ps_mem_fence();
+	*l = 0;
+}
+
+static inline u32_t
+hkv_hash(const char *k, u16_t len)
+{
+	u32_t h = FNV32_INIT;
+	u16_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char)k[i];
+		h *= FNV32_PRIME;
+	}
+
+	return h;
+}
+
+static inline struct keyval_rec *
+hkv_entry(u32_t ref)
+{
+	return (struct keyval_rec *)(hkv_arenas[KEYVAL_REF_CB(ref)].base + KEYVAL_REF_OFF(ref));
+}
+
+/*
+ * The record at off of the client's cbuf, if it is entirely in the
+ * cbuf.  The client can write its cbuf concurrently, so the header is
+ * copied into hdr, and only its lengths (that were checked) are used.
+ */
+static struct keyval_rec *
+hkv_rec(cbuf_t cb, int off, int with_val, struct keyval_rec *hdr)
+{
+	struct keyval_rec *r;
+	char *             buf;
+	unsigned long      sz;
+
+	if (!cbuf_valid(cb) || off < 0) return NULL;
+	sz  = cbuf_size(cb);
+	buf = cbuf2buf(cb, sz);
+	if (!buf || off + sizeof(struct keyval_rec) > sz) return NULL;
+	r    = (struct keyval_rec *)(buf + off);
+	*hdr = *(volatile struct keyval_rec *)r;
+	if (!with_val) hdr->vlen = 0;
+	if (off + KEYVAL_REC_SZ(hdr->klen, hdr->vlen) > sz) return NULL;
+
+	return r;
+}
+
+static inline struct hkv_table *
+hkv_table(int table)
+{
+	if (table < 0 || table >= (int)ps_load(&hkv_ntables)) return NULL;
+
+	return &hkv_tables[table];
+}
+
+/*
+ * Find the slot of the key, or the empty slot it would go in.  Lock
+ * free: a slot we see is either empty, or holds a complete entry.
+ */
+static int
+hkv_slot(struct hkv_table *t, const char *k, u16_t klen, u32_t h)
+{
+	unsigned int i, n;
+
+	for (i = h & (HKV_SLOTS - 1), n = 0; n < HKV_SLOTS; i = (i + 1) & (HKV_SLOTS - 1), n++) {
+		u32_t              ref = ps_load(&t->slots[i]);
+		struct keyval_rec *e;
+
+		if (!ref) return i;
+		if (t->hashes[i] != h) continue;
+		/* a replaced entry's arena can be reused under us: stay in it */
+		if (KEYVAL_REF_OFF(ref) + KEYVAL_REC_SZ(klen, 0) > HKV_ARENA_SZ) continue;
+		e = hkv_entry(ref);
+		if (e->klen == klen && !memcmp(e->data, k, klen)) return i;
+	}
+
+	return -1;
+}
+
+static u32_t
+hkv_lookup(struct hkv_table *t, struct keyval_rec *r, u16_t klen)
+{
+	int slot = hkv_slot(t, r->data, klen, hkv_hash(r->data, klen));
+
+	if (slot < 0) return 0;
+
+	return ps_load(&t->slots[slot]);
+}
+
+/* Called with the table's lock taken. */
+static void
+hkv_arena_release(struct hkv_table *t, cbuf_t cb)
+{
+	hkv_arenas[cb].next = t->free_arenas;
+	t->free_arenas      = cb;
+}
+
+/* Called with the table's lock taken. */
+static u32_t
+hkv_arena_alloc(struct hkv_table *t, unsigned long sz)
+{
+	unsigned long off;
+	void *        base;
+	cbuf_t        cb;
+
+	if (sz > HKV_ARENA_SZ) return 0;
+	if (!t->arena || t->arena_used + sz > HKV_ARENA_SZ) {
+		if (t->free_arenas) {
+			cb             = t->free_arenas;
+			t->free_arenas = hkv_arenas[cb].next;
+		} else {
+			cb = cbuf_alloc(HKV_ARENA_SZ, &base);
+			if (!cb) return 0;
+			hkv_arenas[cb].base = base;
+		}
+		/* the previous arena is reused once its last entry is replaced */
+		if (t->arena && !hkv_arenas[t->arena].live) hkv_arena_release(t, t->arena);
+		t->arena      = cb;
+		t->arena_used = 0;
+	}
+	off = t->arena_used;
+	t->arena_used += sz;
+	hkv_arenas[t->arena].live += sz;
+
+	return KEYVAL_REF(t->arena, off);
+}
+
+/* Called with the table's lock taken, once ref is no longer in a slot. */
+static void
+hkv_arena_free(struct hkv_table *t, u32_t ref, unsigned long sz)
+{
+	cbuf_t cb = KEYVAL_REF_CB(ref);
+
+	hkv_arenas[cb].live -= sz;
+	if (cb == t->arena) {
+		/* take the space back if nothing was appended since, or nothing is live */
+		if (KEYVAL_REF_OFF(ref) + sz == t->arena_used) t->arena_used -= sz;
+		if (!hkv_arenas[cb].live) t->arena_used = 0;
+		return;
+	}
+	if (!hkv_arenas[cb].live) hkv_arena_release(t, cb);
+}
+
+static int
+hkv_put(struct hkv_table *t, struct keyval_rec *r, struct keyval_rec *hdr)
+{
+	unsigned long      sz = KEYVAL_REC_SZ(hdr->klen, hdr->vlen);
+	u32_t              h, ref, old;
+	struct keyval_rec *e;
+	int                slot, ret = -ENOSPC;
+
+	hkv_lock_take(&t->lock);
+	/* copy the record first: the key we hash and compare can't change */
+	ref = hkv_arena_alloc(t, sz);
+	if (!ref) goto done;
+	e = hkv_entry(ref);
+	memcpy(e->data, r->data, hdr->klen + hdr->vlen);
+	e->klen = hdr->klen;
+	e->vlen = hdr->vlen;
+	e->ref  = h = hkv_hash(e->data, e->klen);
+
+	slot = hkv_slot(t, e->data, e->klen, h);
+	old  = slot < 0 ? 0 : t->slots[slot];
+	if (slot < 0 || (!old && t->nents == HKV_MAX_ENTS)) {
+		hkv_arena_free(t, ref, sz);
+		goto done;
+	}
+
+	if (!old) {
+		t->hashes[slot] = h;
+		t->nents++;
+	}
+	/* publish the entry (and its hash) to the lookups */
+	ps_mem_fence();
+	t->slots[slot] = ref;
+	if (old) {
+		e = hkv_entry(old);
+		hkv_arena_free(t, old, KEYVAL_REC_SZ(e->klen, e->vlen));
+	}
+	ret = 0;
+done:
+	hkv_lock_release(&t->lock);
+
+	return ret;
+}
+
+int
+keyval_tablespace(spdid_t spdid, cbuf_t cb, int off)
+{
+	struct keyval_rec  hdr;
+	struct keyval_rec *r = hkv_rec(cb, off, 0, &hdr);
+	struct hkv_table * t;
+	char               name[HKV_NAME_SZ];
+	int                i, ret = -ENOSPC;
+
+	if (!r || !hdr.klen || hdr.klen > HKV_NAME_SZ) return -EINVAL;
+	memcpy(name, r->data, hdr.klen);
+
+	hkv_lock_take(&hkv_tables_lock);
+	for (i = 0; i < (int)hkv_ntables; i++) {
+		t = &hkv_tables[i];
+		if (t->nlen == hdr.klen && !memcmp(t->name, name, hdr.klen)) {
+			ret = i;
+			goto done;
+		}
+	}
+	/* a miss creates the table space, as in luakv */
+	if (hkv_ntables < HKV_MAX_TABLES) {
+		t = &hkv_tables[hkv_ntables];
+		memcpy(t->name, name, hdr.klen);
+		t->nlen = hdr.klen;
+		ps_mem_fence();
+		ret = hkv_ntables++;
+	}
+done:
+	hkv_lock_release(&hkv_tables_lock);
+
+	return ret;
+}
+
+int
+keyval_put(spdid_t spdid, int table, cbuf_t cb, int off)
+{
+	struct hkv_table * t = hkv_table(table);
+	struct keyval_rec  hdr;
+	struct keyval_rec *r = hkv_rec(cb, off, 1, &hdr);
+
+	if (!t || !r) return -EINVAL;
+
+	return hkv_put(t, r, &hdr);
+}
+
+long
+keyval_get(spdid_t spdid, int table, cbuf_t cb, int off)
+{
+	struct hkv_table * t = hkv_table(table);
+	struct keyval_rec  hdr;
+	struct keyval_rec *r = hkv_rec(cb, off, 0, &hdr);
+
+	if (!t || !r) return 0;
+
+	return hkv_lookup(t, r, hdr.klen);
+}
+
+int
+keyval_put_batch(spdid_t spdid, int table, cbuf_t cb, int n)
+{
+	struct hkv_table * t = hkv_table(table);
+	struct keyval_rec *r, hdr;
+	int                i, off = 0;
+
+	if (!t) return -EINVAL;
+	for (i = 0; i < n; i++) {
+		r = hkv_rec(cb, off, 1, &hdr);
+		if (!r || hkv_put(t, r, &hdr)) break;
+		off += KEYVAL_REC_SZ(hdr.klen, hdr.vlen);
+	}
+
+	return i;
+}
+
+int
+keyval_get_batch(spdid_t spdid, int table, cbuf_t cb, int n)
+{
+	struct hkv_table * t = hkv_table(table);
+	struct keyval_rec *r, hdr;
+	int                i, off = 0, found = 0;
+	u32_t              ref;
+
+	/* we write the references into the client's records */
+	if (!t || !cbuf_writable(cb)) return -EINVAL;
+	for (i = 0; i < n; i++) {
+		r = hkv_rec(cb, off, 0, &hdr);
+		if (!r) break;
+		r->ref = ref = hkv_lookup(t, r, hdr.klen);
+		if (ref) found++;
+		off += KEYVAL_REC_SZ(hdr.klen, 0);
+	}
+
+	return found;
+}
+
+void
+cos_init(void)
+{
+	printc("Key-value store (hash tables)\n");
+	if (cbuf_client_init(BOOT_CAPTBL_SINV_CAP)) BUG();
+
+	cos_sinv(BOOT_CAPTBL_SINV_CAP, 1, 2, 3, 4);
+}
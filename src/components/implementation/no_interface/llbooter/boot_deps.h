@@ -1,8 +1,11 @@
 #include <cobj_format.h>
+#include <cbuf_mgr.h>
+#include <cos_stacks.h>
 #include <cos_alloc.h>
 #include <cos_debug.h>
 #include <cos_types.h>
 #include <llprint.h>
+#include <ps.h>
 
 #define UNDEF_SYMBS 64
 
@@ -19,6 +22,8 @@ struct comp_cap_info {
 	vaddr_t              addr_start;
 	vaddr_t              vaddr_mapped_in_booter;
 	vaddr_t              upcall_entry;
+	u32_t                sect_shared; /* bitmap of sections aliased from another instance */
+	vaddr_t              stack_window; /* where its invocation stacks are mapped */
 } new_comp_cap_info[MAX_NUM_SPDS + 1];
 
 struct cos_compinfo boot_info;
@@ -27,13 +32,102 @@ struct cos_compinfo new_compinfo[MAX_NUM_SPDS + 1];
 int                      schedule[MAX_NUM_SPDS + 1];
 volatile size_t          sched_cur;
 
+/*
+ * The capability and page-table frontiers in boot_info are not
+ * thread-safe, so their manipulation is serialized: once components
+ * run, their threads invoke the booter (cbufs, stacks) concurrently.
+ */
+static unsigned long boot_lock;
+
+static inline void
+boot_lock_take(void)
+{
+	while (!ps_cas(&boot_lock, 0, 1))
+		;
+}
+
+static inline void
+boot_lock_release(void)
+{
+	ps_mem_fence();
+	boot_lock = 0;
+}
+
+/*
+ * The booter has all components' page-tables, so it is also their
+ * cbuf manager.
+ */
+struct cbuf_mgr boot_cbuf_mgr;
+
+static void
+boot_cbuf_lock(void)
+{
+	boot_lock_take();
+}
+
+static void
+boot_cbuf_unlock(void)
+{
+	boot_lock_release();
+}
+
+/* ...and the stack manager of those on freelist stacks (see cos_stacks.h). */
+static long
+boot_stack_grant(spdid_t spdid, vaddr_t addr)
+{
+	struct comp_cap_info *ci = &new_comp_cap_info[spdid];
+	vaddr_t               w  = round_to_pgd_page(addr);
+	vaddr_t               page;
+	long                  ret = 0;
+
+	if (!spdid || spdid > MAX_NUM_SPDS || !ci->compinfo || addr != round_to_page(addr)) return 0;
+
+	boot_lock_take();
+	if (ci->stack_window != w) {
+		/* a component has a single window, at the top of its heap */
+		if (ci->stack_window) goto done;
+		if (!cos_pgtbl_intern_alloc(&boot_info, ci->compinfo->pgtbl_cap, w, COS_STACKS_VAS_WINDOW)) goto done;
+		ci->stack_window = w;
+	}
+	page = (vaddr_t)cos_page_bump_alloc(&boot_info);
+	if (!page) goto done;
+	if (cos_mem_alias_at(ci->compinfo, addr, &boot_info, page)) goto done;
+	ret = addr;
+done:
+	boot_lock_release();
+
+	return ret;
+}
+
+/* ro: the component's mapping is read-only; the booter's is not */
 static vaddr_t
-boot_deps_map_sect(spdid_t spdid, vaddr_t dest_daddr)
+boot_deps_map_sect(spdid_t spdid, vaddr_t dest_daddr, int ro)
 {
 	vaddr_t addr = (vaddr_t)cos_page_bump_alloc(&boot_info);
 	assert(addr);
 
-	if (cos_mem_alias_at(new_comp_cap_info[spdid].compinfo, dest_daddr, &boot_info, addr)) BUG();
+	if (ro) {
+		if (cos_mem_alias_ro_at(new_comp_cap_info[spdid].compinfo, dest_daddr, &boot_info, addr)) BUG();
+	} else {
+		if (cos_mem_alias_at(new_comp_cap_info[spdid].compinfo, dest_daddr, &boot_info, addr)) BUG();
+	}
+
+	return addr;
+}
+
+/*
+ * Map a page of a (read-only) section directly from the component's
+ * object, instead of copying it.  It is also aliased into the booter
+ * so that the component's image stays contiguous in the booter.  The
+ * component's mapping is read-only, as the page is shared.
+ */
+static vaddr_t
+boot_deps_alias_sect(spdid_t spdid, vaddr_t dest_daddr, vaddr_t src)
+{
+	vaddr_t addr = cos_mem_alias(&boot_info, &boot_info, src);
+	assert(addr);
+
+	if (cos_mem_alias_ro_at(new_comp_cap_info[spdid].compinfo, dest_daddr, &boot_info, src)) BUG();
 
 	return addr;
 }
@@ -69,6 +163,7 @@ boot_compinfo_init(spdid_t spdid, captblcap_t *ct, pgtblcap_t *pt, u32_t vaddr)
 
 	new_comp_cap_info[spdid].compinfo = &new_compinfo[spdid];
 	cos_compinfo_init(new_comp_cap_info[spdid].compinfo, *pt, *ct, 0, (vaddr_t)vaddr, 4, &boot_info);
+	cbuf_mgr_client_add(&boot_cbuf_mgr, spdid, new_comp_cap_info[spdid].compinfo);
 }
 
 static void
@@ -143,6 +238,7 @@ boot_bootcomp_init(void)
 
 	cos_compinfo_init(&boot_info, BOOT_CAPTBL_SELF_PT, BOOT_CAPTBL_SELF_CT, BOOT_CAPTBL_SELF_COMP,
 	                  (vaddr_t)cos_get_heap_ptr(), BOOT_CAPTBL_FREE, &boot_info);
+	cbuf_mgr_init(&boot_cbuf_mgr, &boot_info, boot_cbuf_lock, boot_cbuf_unlock);
 }
 
 static void
@@ -164,3 +260,28 @@ boot_thd_done(void)
 		printc("Done Initializing\n");
 	}
 }
+
+/* All invocations of the booter from components, via BOOT_CAPTBL_SINV_CAP */
+enum
+{
+	BOOT_OP_INIT_DONE = 1, /* the calling component's initialization is done */
+};
+
+long
+boot_sinv(unsigned long token, int op, unsigned long arg1, unsigned long arg2, unsigned long arg3)
+{
+	switch (op) {
+	case CBUF_OP_REGISTER:
+	case CBUF_OP_ALLOC:
+	case CBUF_OP_MAP:
+	case CBUF_OP_FREE:
+		return cbuf_mgr_invoke(&boot_cbuf_mgr, (spdid_t)token, op, arg1);
+	case COS_STACK_OP_GRANT:
+		return boot_stack_grant((spdid_t)token, arg1);
+	case BOOT_OP_INIT_DONE:
+		boot_thd_done();
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
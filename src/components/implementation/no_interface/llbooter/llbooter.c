@@ -38,6 +38,7 @@ boot_find_cobjs(struct cobj_header *h, int n)
 	for (i = 1; i < n; i++) {
 		int j = 0, size = 0, tot = 0;
 
+		assert(cobj_version(h) == COBJ_VERSION);
 		size = h->size;
 		for (j = 0; j < (int)h->nsect; j++) {
 			tot += cobj_sect_size(h, j);
@@ -51,11 +52,52 @@ boot_find_cobjs(struct cobj_header *h, int n)
 	}
 
 	hs[n] = NULL;
+	assert(cobj_version(hs[n - 1]) == COBJ_VERSION);
 	printc("cobj %s:%d found at %p -> %x\n", hs[n - 1]->name, hs[n - 1]->id, hs[n - 1],
 	       cobj_sect_get(hs[n - 1], 0)->vaddr);
 
 }
 
+/*
+ * Read-only sections that have been populated, and that later
+ * instances with identical sections (the same contents, e.g. replicas
+ * or position-independent code, wherever they are linked) alias
+ * instead of copying.  Data and BSS are never shared.
+ */
+#define BOOT_SHARED_MAX (MAX_NUM_SPDS * 2)
+struct boot_shared_sect {
+	struct cobj_header *h;
+	unsigned int        sect;
+	vaddr_t             addr; /* the section's first page in the booter */
+} boot_shared[BOOT_SHARED_MAX];
+static int boot_nshared;
+/* pages aliased from other instances, and mapped from the cobjs */
+static unsigned long boot_npages_shared, boot_npages_mapped;
+
+static vaddr_t
+boot_shared_lkup(struct cobj_header *h, unsigned int sect)
+{
+	int i;
+
+	if (sect >= 32 || !cobj_sect_shareable(h, sect)) return 0;
+	for (i = 0; i < boot_nshared; i++) {
+		if (cobj_sect_identical(boot_shared[i].h, boot_shared[i].sect, h, sect)) return boot_shared[i].addr;
+	}
+
+	return 0;
+}
+
+/* Called with the boot lock held. */
+static void
+boot_shared_add(struct cobj_header *h, unsigned int sect, vaddr_t addr)
+{
+	if (boot_nshared == BOOT_SHARED_MAX || !cobj_sect_shareable(h, sect)) return;
+	if (boot_shared_lkup(h, sect)) return;
+
+	boot_shared[boot_nshared] = (struct boot_shared_sect){ .h = h, .sect = sect, .addr = addr };
+	boot_nshared++;
+}
+
 static int
 boot_comp_map_memory(struct cobj_header *h, spdid_t spdid, pgtblcap_t pt)
 {
@@ -70,9 +112,15 @@ boot_comp_map_memory(struct cobj_header *h, spdid_t spdid, pgtblcap_t pt)
 	/* We'll map the component into booter's heap. */
 
 	for (i = 0; i < (int)h->nsect; i++) {
-		int left;
+		int     left;
+		int     mappable = cobj_sect_mappable(h, i);
+		vaddr_t body     = (vaddr_t)cobj_sect_contents(h, i);
+		int     ro       = cobj_sect_shareable(h, i);
+		vaddr_t shared   = boot_shared_lkup(h, i);
+		vaddr_t addr;
 
 		sect = cobj_sect_get(h, i);
+		if (shared) new_comp_cap_info[spdid].sect_shared |= 1 << i;
 
 		dest_daddr = sect->vaddr;
 		left       = cobj_sect_size(h, i);
@@ -84,11 +132,18 @@ boot_comp_map_memory(struct cobj_header *h, spdid_t spdid, pgtblcap_t pt)
 		}
 
 		while (left > 0) {
+			if (shared) {
+				addr = boot_deps_alias_sect(spdid, dest_daddr, shared + (dest_daddr - sect->vaddr));
+				ps_faa(&boot_npages_shared, 1);
+			} else if (mappable) {
+				addr = boot_deps_alias_sect(spdid, dest_daddr, body + (dest_daddr - sect->vaddr));
+				ps_faa(&boot_npages_mapped, 1);
+			} else {
+				addr = boot_deps_map_sect(spdid, dest_daddr, ro);
+			}
 			if (first) {
-				new_comp_cap_info[spdid].vaddr_mapped_in_booter = boot_deps_map_sect(spdid, dest_daddr);
+				new_comp_cap_info[spdid].vaddr_mapped_in_booter = addr;
 				first = 0;
-			} else {
-				boot_deps_map_sect(spdid, dest_daddr);
 			}
 			prev_map = dest_daddr;
 			dest_daddr += PAGE_SIZE;
@@ -201,10 +256,15 @@ boot_comp_map_populate(struct cobj_header *h, spdid_t spdid, vaddr_t comp_info)
 		left = cobj_sect_size(h, i);
 		total += left;
 
-		/* Initialize memory. */
-		if (!(sect->flags & COBJ_SECT_KMEM)) {
+		/* shared sections were populated by the first instance */
+		if (new_comp_cap_info[spdid].sect_shared & (1 << i)) continue;
+
+		/* Initialize memory (mappable sections are already mapped from the cobj). */
+		if (!(sect->flags & COBJ_SECT_KMEM) && !cobj_sect_mappable(h, i)) {
 			if (sect->flags & COBJ_SECT_ZEROS) {
 				memset(start_addr + (dest_daddr - init_daddr), 0, left);
+			} else if (sect->flags & COBJ_SECT_COMPRESSED) {
+				if (cobj_sect_decompress(h, i, start_addr + (dest_daddr - init_daddr))) BUG();
 			} else {
 				memcpy(start_addr + (dest_daddr - init_daddr), lsrc, left);
 			}
@@ -218,6 +278,10 @@ boot_comp_map_populate(struct cobj_header *h, spdid_t spdid, vaddr_t comp_info)
 			new_comp_cap_info[h->id].upcall_entry = ci->cos_upcall_entry;
 		}
 
+		/* only now can other instances use its contents */
+		boot_lock_take();
+		boot_shared_add(h, i, (vaddr_t)start_addr + (dest_daddr - init_daddr));
+		boot_lock_release();
 	}
 
 	return 0;
@@ -226,7 +290,9 @@ boot_comp_map_populate(struct cobj_header *h, spdid_t spdid, vaddr_t comp_info)
 int
 boot_comp_map(struct cobj_header *h, spdid_t spdid, vaddr_t comp_info, pgtblcap_t pt)
 {
+	boot_lock_take();
 	boot_comp_map_memory(h, spdid, pt);
+	boot_lock_release();
 	boot_comp_map_populate(h, spdid, comp_info);
 	return 0;
 }
@@ -268,34 +334,39 @@ boot_spd_inv_cap_alloc(struct cobj_header *h, spdid_t spdid)
 	return 0;
 }
 
+static void
+boot_comp_create(struct cobj_header *h)
+{
+	struct cobj_sect *sect;
+	captblcap_t       ct;
+	pgtblcap_t        pt;
+	spdid_t           spdid;
+	vaddr_t           ci = 0;
+
+	spdid = h->id;
+
+	sect                                = cobj_sect_get(h, 0);
+	new_comp_cap_info[spdid].addr_start = sect->vaddr;
+	boot_lock_take();
+	boot_compinfo_init(spdid, &ct, &pt, sect->vaddr);
+	boot_lock_release();
+
+	if (boot_spd_symbs(h, spdid, &ci, &new_comp_cap_info[spdid].vaddr_user_caps)) BUG();
+	if (boot_spd_inv_cap_alloc(h, spdid)) BUG();
+	if (boot_comp_map(h, spdid, ci, pt)) BUG();
+
+	boot_lock_take();
+	boot_newcomp_create(spdid, new_comp_cap_info[spdid].compinfo);
+	boot_lock_release();
+	printc("\nComp %d (%s) created @ %x!\n\n", h->id, h->name, sect->vaddr);
+}
+
 static void
 boot_create_cap_system(void)
 {
 	unsigned int i;
 
-	for (i = 0; hs[i] != NULL; i++) {
-		struct cobj_header *h;
-		struct cobj_sect *  sect;
-		captblcap_t         ct;
-		pgtblcap_t          pt;
-		spdid_t             spdid;
-		vaddr_t             ci = 0;
-
-		h     = hs[i];
-		spdid = h->id;
-
-		sect                                = cobj_sect_get(h, 0);
-		new_comp_cap_info[spdid].addr_start = sect->vaddr;
-		boot_compinfo_init(spdid, &ct, &pt, sect->vaddr);
-
-		if (boot_spd_symbs(h, spdid, &ci, &new_comp_cap_info[spdid].vaddr_user_caps)) BUG();
-		if (boot_spd_inv_cap_alloc(h, spdid)) BUG();
-		if (boot_comp_map(h, spdid, ci, pt)) BUG();
-
-		boot_newcomp_create(spdid, new_comp_cap_info[spdid].compinfo);
-		printc("\nComp %d (%s) created @ %x!\n\n", h->id, h->name, sect->vaddr);
-	}
-
+	for (i = 0; hs[i] != NULL; i++) boot_comp_create(hs[i]);
 
 	return;
 }
@@ -306,12 +377,12 @@ boot_init_ndeps(int num_cobj)
 	int i = 0;
 
 	printc("MAX DEPS: %d\n", MAX_DEPS);
-	for (i = 0; i < deps_list[i].server; i++) {
+	for (i = 0; i < (int)MAX_DEPS && deps_list[i].client; i++) {
 //		if (deps_list[i].client != 0) printc("client: %d, server: %d \n", deps_list[i].client, deps_list[i].server);
 	}
 
-	printc("ndeps: %d\n", ndeps);
 	ndeps = i;
+	printc("ndeps: %d\n", ndeps);
 }
 
 void
@@ -339,6 +410,8 @@ cos_init(void)
 	boot_find_cobjs(h, num_cobj);
 	boot_bootcomp_init();
 	boot_create_cap_system();
+	printc("Booter: %lu pages mapped from cobjs, %lu aliased from other instances\n", boot_npages_mapped,
+	       boot_npages_shared);
 
 	boot_done();
 }
@@ -132,20 +132,36 @@ vk_vm_io_init(struct vms_info *vminfo, struct vms_info *dom0info, struct vkernel
 	assert(ret == 0);
 }
 
+/*
+ * The booter's text and read-only data (everything below .ctors) are
+ * the same in every VM, so the VMs alias the vkernel's own pages for
+ * them, read-only so that a VM can't modify the others' text.  Only the
+ * writable remainder of the range is copied per VM.
+ */
 void
 vk_vm_virtmem_alloc(struct vms_info *vminfo, struct vkernel_info *vkinfo, unsigned long start_ptr, unsigned long range)
 {
+	extern long __CTOR_LIST__;
 	vaddr_t src_pg;
 	struct cos_compinfo *vmcinfo = cos_compinfo_get(&(vminfo->dci));
 	struct cos_compinfo *vk_cinfo = cos_compinfo_get(cos_defcompinfo_curr_get());
+	unsigned long ro_range = round_to_page((vaddr_t)&__CTOR_LIST__) - start_ptr;
 	vaddr_t addr;
 
 	assert(vminfo && vkinfo);
+	if (ro_range > range) ro_range = 0;
 
-	src_pg = (vaddr_t)cos_page_bump_allocn(vk_cinfo, range);
+	for (addr = 0; addr < ro_range; addr += PAGE_SIZE) {
+		vaddr_t dst_pg;
+
+		dst_pg = cos_mem_alias_ro(vmcinfo, vk_cinfo, start_ptr + addr);
+		assert(dst_pg);
+	}
+
+	src_pg = (vaddr_t)cos_page_bump_allocn(vk_cinfo, range - ro_range);
 	assert(src_pg);
 
-	for (addr = 0; addr < range; addr += PAGE_SIZE, src_pg += PAGE_SIZE) {
+	for (; addr < range; addr += PAGE_SIZE, src_pg += PAGE_SIZE) {
 		vaddr_t dst_pg;
 
 		memcpy((void *)src_pg, (void *)(start_ptr + addr), PAGE_SIZE);
@@ -99,6 +99,48 @@ test_mem(void)
 	PRINTC("SUCCESS: Atomically allocated and zeroed %d pages.\n", TEST_NPAGES);
 }
 
+#define TEST_COW_NPAGES 2
+
+static void
+test_mem_cow(void)
+{
+	char *p, *c, *o;
+
+	/* a pool of exactly two frames */
+	assert(!cos_mem_cow_reserve(&booter_info, TEST_COW_NPAGES));
+	p = cos_page_bump_alloc(&booter_info);
+	assert(p);
+	strcpy(p, "parent");
+
+	c = (char *)cos_mem_cow(&booter_info, &booter_info, (vaddr_t)p);
+	assert(c && !strcmp(c, "parent"));
+	/* the first write to each of the sharers takes a private copy */
+	c[0] = 'c';
+	assert(c[0] == 'c' && p[0] == 'p');
+	p[0] = 'P';
+	assert(p[0] == 'P' && c[0] == 'c' && !strcmp(p + 1, c + 1));
+	PRINTC("SUCCESS: Copy-on-write of a page\n");
+
+	/*
+	 * The pool is empty but for the original frame, which both
+	 * sharers have copied.  Freed frames are reused only after TLB
+	 * quiescence, so flush (there is no periodic flush).
+	 */
+	printc("FLUSH!%c", (int)cos_cpuid());
+	o = (char *)cos_mem_cow(&booter_info, &booter_info, (vaddr_t)p);
+	assert(o && !strcmp(o, "Parent"));
+	o[0] = 'O';
+	assert(o[0] == 'O' && p[0] == 'P');
+	/* and removing the child's copy returns its frame */
+	assert(!cos_mem_remove(booter_info.pgtbl_cap, (vaddr_t)c));
+	printc("FLUSH!%c", (int)cos_cpuid());
+	c = (char *)cos_mem_cow(&booter_info, &booter_info, (vaddr_t)p);
+	assert(c && !strcmp(c, "Parent"));
+	c[0] = 'C';
+	assert(c[0] == 'C' && p[0] == 'P' && o[0] == 'O');
+	PRINTC("SUCCESS: Copy-on-write frames reclaimed\n");
+}
+
 volatile arcvcap_t rcc_global, rcp_global;
 volatile asndcap_t scp_global;
 int                async_test_flag = 0;
@@ -371,7 +413,7 @@ struct exec_cluster {
 struct budget_test_data {
 	/* p=parent, c=child, g=grand-child */
 	struct exec_cluster p, c, g;
-} bt, mbt;
+} bt, mbt, rbt;
 
 static void
 exec_cluster_alloc(struct exec_cluster *e, cos_thd_fn_t fn, void *d, arcvcap_t parentc)
@@ -480,6 +522,46 @@ test_budgets_multi(void)
 	PRINTC("Done.\n");
 }
 
+static void
+test_budgets_refill(void)
+{
+	struct cos_tcap_refill r[3];
+	tcap_res_t             res = 800000;
+	cycles_t               s, e;
+	int                    i;
+
+	PRINTC("Starting budget refill test.\n");
+
+	exec_cluster_alloc(&rbt.p, spinner, &rbt.p, BOOT_CAPTBL_SELF_INITRCV_BASE);
+	exec_cluster_alloc(&rbt.c, spinner, &rbt.c, BOOT_CAPTBL_SELF_INITRCV_BASE);
+	exec_cluster_alloc(&rbt.g, spinner, &rbt.g, BOOT_CAPTBL_SELF_INITRCV_BASE);
+
+	/* the first budget sets the priority, refills keep it */
+	if (cos_tcap_transfer(rbt.p.rc, BOOT_CAPTBL_SELF_INITTCAP_BASE, res / 4, TCAP_PRIO_MAX + 2)) assert(0);
+	if (cos_tcap_transfer(rbt.c.rc, BOOT_CAPTBL_SELF_INITTCAP_BASE, res, TCAP_PRIO_MAX + 2)) assert(0);
+	if (cos_tcap_transfer(rbt.g.rc, BOOT_CAPTBL_SELF_INITTCAP_BASE, res / 2, TCAP_PRIO_MAX + 2)) assert(0);
+
+	r[0] = (struct cos_tcap_refill){ .rcv = rbt.p.rc, .res = res };
+	r[1] = (struct cos_tcap_refill){ .rcv = rbt.c.rc, .res = res };
+	r[2] = (struct cos_tcap_refill){ .rcv = rbt.g.rc, .res = res };
+	for (i = 0; i < 2; i++) {
+		rdtscll(s);
+		if (cos_tcap_refill(BOOT_CAPTBL_SELF_INITTCAP_BASE, r, 3) != 3) assert(0);
+		rdtscll(e);
+
+		/* topped up to res, and never over it */
+		assert(cos_introspect(&booter_info, rbt.p.tcc, TCAP_GET_BUDGET) == (long)res);
+		assert(cos_introspect(&booter_info, rbt.c.tcc, TCAP_GET_BUDGET) == (long)res);
+		assert(cos_introspect(&booter_info, rbt.g.tcc, TCAP_GET_BUDGET) == (long)res);
+		PRINTC("Refill of 3 tcaps: %llu cycles\n", e - s);
+	}
+
+	/* refills stop at the first invalid end-point, and report it */
+	r[1].rcv = rbt.c.tc;
+	if (cos_tcap_refill(BOOT_CAPTBL_SELF_INITTCAP_BASE, r, 3) != 1) assert(0);
+	PRINTC("Done.\n");
+}
+
 static void
 test_budgets(void)
 {
@@ -488,6 +570,9 @@ test_budgets(void)
 
 	/* multi-level budgets test */
 	test_budgets_multi();
+
+	/* batched top-ups of budgets */
+	test_budgets_refill();
 }
 
 #define TEST_PRIO_HIGH (TCAP_PRIO_MAX)
@@ -863,6 +948,7 @@ test_run_mb(void)
 	test_thds_perf();
 
 	test_mem();
+	test_mem_cow();
 
 	test_async_endpoints();
 	test_async_endpoints_perf();
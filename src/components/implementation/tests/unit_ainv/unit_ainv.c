@@ -0,0 +1,154 @@
+/*
+ * Copyright 2017, The George Washington University
+ *
+ * This uses a two clause BSD License.
+ */
+
+#include <cos_defkernel_api.h>
+#include <llprint.h>
+#include <res_spec.h>
+#include <sl.h>
+#include <cos_ainv.h>
+
+/* Ensure this is the same as what is in sl_mod_fprr.c */
+#define SL_FPRR_NPRIOS 32
+
+#define LOWEST_PRIORITY (SL_FPRR_NPRIOS - 1)
+#define LOW_PRIORITY (LOWEST_PRIORITY - 1)
+#define HIGH_PRIORITY (LOWEST_PRIORITY - 10)
+
+#define TEST_NENTS 64
+#define TEST_NENTS_SMALL 8
+#define TEST_NCALLS 4096
+#define TEST_OP_DOUBLE 1
+
+static struct cos_ainv_srv    srv;
+static struct cos_ainv_client client;
+static volatile int           client_done = 0;
+static struct cos_chan *      rogue_sq, *rogue_cq;
+static asndcap_t              srv_snd;
+
+static long
+srv_fn(u16_t c, u32_t op, long a0, long a1, long a2)
+{
+	assert(c <= 1 && op == TEST_OP_DOUBLE);
+
+	return a0 * 2;
+}
+
+static void
+srv_thd_fn(arcvcap_t rcv, void *data)
+{
+	cos_ainv_srv_loop(&srv);
+}
+
+static void
+client_thd_fn(arcvcap_t rcv, void *data)
+{
+	struct cos_ainv_cmpl cmpls[COS_AINV_BATCH];
+	long                 called = 0, completed = 0;
+	unsigned int         i, n;
+
+	client.rcv = rcv;
+	while (completed < TEST_NCALLS) {
+		/* post as many calls as our completion ring can hold... */
+		while (called < TEST_NCALLS && cos_ainv_call(&client, TEST_OP_DOUBLE, called, 0, 0)) called++;
+		/* ...and collect their results in batches */
+		n = cos_ainv_wait(&client, cmpls, COS_AINV_BATCH);
+		for (i = 0; i < n; i++) assert(cmpls[i].ret == (completed + (long)i) * 2);
+		completed += n;
+	}
+	assert(!cos_ainv_poll(&client, cmpls, COS_AINV_BATCH));
+	client_done = 1;
+	sl_thd_exit();
+}
+
+static void
+test_ainv(void)
+{
+	struct cos_compinfo *ci = cos_compinfo_get(cos_defcompinfo_curr_get());
+	struct sl_thd *      s, *c;
+	struct cos_chan *    sq, *cq;
+	asndcap_t            client_snd;
+
+	sq       = cos_chan_alloc(ci, sizeof(struct cos_ainv_req), TEST_NENTS);
+	cq       = cos_chan_alloc(ci, sizeof(struct cos_ainv_cmpl), TEST_NENTS);
+	rogue_sq = cos_chan_alloc(ci, sizeof(struct cos_ainv_req), TEST_NENTS);
+	rogue_cq = cos_chan_alloc(ci, sizeof(struct cos_ainv_cmpl), TEST_NENTS_SMALL);
+	assert(sq && cq && rogue_sq && rogue_cq);
+
+	s = sl_thd_aep_alloc(srv_thd_fn, NULL, 0);
+	c = sl_thd_aep_alloc(client_thd_fn, NULL, 0);
+	assert(s && c);
+	srv_snd    = cos_asnd_alloc(ci, sl_thd_rcvcap(s), ci->captbl_cap);
+	client_snd = cos_asnd_alloc(ci, sl_thd_rcvcap(c), ci->captbl_cap);
+	assert(srv_snd && client_snd);
+
+	cos_ainv_srv_init(&srv, sl_thd_rcvcap(s), srv_fn);
+	assert(!cos_ainv_srv_client_add(&srv, 0, sq, cq, client_snd));
+	assert(cos_ainv_srv_client_add(&srv, 0, sq, cq, client_snd));
+	/* the test thread polls this client's completions */
+	assert(!cos_ainv_srv_client_add(&srv, 1, rogue_sq, rogue_cq, 0));
+	cos_ainv_client_init(&client, sq, cq, srv_snd, sl_thd_rcvcap(c));
+
+	sl_thd_param_set(s, sched_param_pack(SCHEDP_PRIO, HIGH_PRIORITY));
+	sl_thd_param_set(c, sched_param_pack(SCHEDP_PRIO, LOW_PRIORITY));
+	while (!client_done) sl_thd_yield(0);
+}
+
+/*
+ * A client that posts more requests than its completion ring holds
+ * loses the excess, and the server keeps serving.
+ */
+static void
+test_overflow(void)
+{
+	struct cos_ainv_req  r = { .op = TEST_OP_DOUBLE };
+	struct cos_ainv_cmpl cmpls[TEST_NENTS];
+	unsigned int         i, n;
+
+	for (i = 0; i < TEST_NENTS; i++) {
+		r.id      = i;
+		r.args[0] = i;
+		assert(cos_chan_enqueue_spsc(rogue_sq, &r, 1, srv_snd) == 1);
+	}
+	while (cos_chan_size(rogue_sq)) sl_thd_yield(0);
+
+	n = cos_chan_dequeue(rogue_cq, cmpls, TEST_NENTS);
+	assert(n == TEST_NENTS_SMALL);
+	for (i = 0; i < n; i++) assert(cmpls[i].id == i && cmpls[i].ret == (long)i * 2);
+}
+
+static void
+run_tests()
+{
+	test_ainv();
+	printc("Test successful! Asynchronous calls completed in order!\n");
+	test_overflow();
+	printc("Test successful! Excess calls dropped!\n");
+
+	printc("Done testing, spinning...\n");
+	SPIN();
+}
+
+void
+cos_init(void)
+{
+	struct sl_thd *testing_thread;
+	struct cos_defcompinfo *defci = cos_defcompinfo_curr_get();
+	struct cos_compinfo *   ci    = cos_compinfo_get(defci);
+
+	printc("Unit-test for asynchronous invocations (cos_ainv)\n");
+	cos_meminfo_init(&(ci->mi), BOOT_MEM_KM_BASE, COS_MEM_KERN_PA_SZ, BOOT_CAPTBL_SELF_UNTYPED_PT);
+	cos_defcompinfo_init();
+	sl_init(SL_MIN_PERIOD_US);
+
+	testing_thread = sl_thd_alloc(run_tests, NULL);
+	sl_thd_param_set(testing_thread, sched_param_pack(SCHEDP_PRIO, LOWEST_PRIORITY));
+
+	sl_sched_loop();
+
+	assert(0);
+
+	return;
+}
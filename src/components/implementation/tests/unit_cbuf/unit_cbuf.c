@@ -0,0 +1,103 @@
+#include <cos_component.h>
+#include <string.h>
+#include <cos_kernel_api.h>
+#include <cos_debug.h>
+#include <llprint.h>
+#include <cbuf.h>
+
+#define TEST_ITERS 16
+
+static void
+test_orders(void)
+{
+	unsigned int order;
+
+	for (order = CBUF_MIN_ORDER; order <= CBUF_MAX_ORDER; order++) {
+		unsigned long sz = PAGE_SIZE << order;
+		cbuf_t        cb;
+		char *        buf;
+
+		cb = cbuf_alloc(sz, (void **)&buf);
+		assert(cb && buf);
+		assert(cbuf_order(cb) == order);
+		assert(cbuf2buf(cb, sz) == buf);
+		/* touch every page */
+		memset(buf, order + 1, sz);
+		assert(buf[sz - 1] == (char)(order + 1));
+		cbuf_free(cb);
+	}
+	printc("\tAllocated cbufs of each order.\n");
+}
+
+static void
+test_reuse(void)
+{
+	cbuf_t cb, cb2;
+	char * buf, *buf2;
+	int    i;
+
+	cb = cbuf_alloc(PAGE_SIZE, (void **)&buf);
+	assert(cb);
+	buf[0] = 'c';
+	cbuf_free(cb);
+
+	/* we freed it on this core, so it is the next one allocated */
+	for (i = 0; i < TEST_ITERS; i++) {
+		cb2 = cbuf_alloc(PAGE_SIZE, (void **)&buf2);
+		assert(cb2 == cb && buf2 == buf);
+		/* we are still its owner: not cleared, and still mapped */
+		assert(buf2[0] == 'c');
+		cbuf_free(cb2);
+	}
+	printc("\tReused the per-core freelist.\n");
+}
+
+static void
+test_refcnt(void)
+{
+	cbuf_t cb, cb2;
+	char * buf;
+
+	cb = cbuf_alloc(PAGE_SIZE, (void **)&buf);
+	assert(cb);
+	/* a reference for a "receiver": the first free doesn't release it */
+	cbuf_send(cb);
+	cbuf_free(cb);
+	cb2 = cbuf_alloc(PAGE_SIZE, (void **)&buf);
+	assert(cb2 && cb2 != cb);
+	cbuf_free(cb2);
+	cbuf_free(cb);
+
+	assert(!cbuf_alloc(PAGE_SIZE << (CBUF_MAX_ORDER + 1), (void **)&buf));
+	assert(!cbuf2buf(cb, PAGE_SIZE + 1));
+	printc("\tReference counts are respected.\n");
+}
+
+static void
+test_shared(void)
+{
+	cbuf_t cb;
+	char * buf;
+
+	cb = cbuf_alloc_shared(2 * PAGE_SIZE, (void **)&buf);
+	assert(cb && cbuf_order(cb) == 1);
+	memset(buf, 's', 2 * PAGE_SIZE);
+	assert(cbuf2buf(cb, 2 * PAGE_SIZE) == buf && buf[PAGE_SIZE] == 's');
+	cbuf_free(cb);
+	printc("\tAllocated a shared cbuf.\n");
+}
+
+void
+cos_init(void)
+{
+	printc("Unit-test for the cbuf library\n");
+	if (cbuf_client_init(BOOT_CAPTBL_SINV_CAP)) BUG();
+
+	test_orders();
+	test_reuse();
+	test_refcnt();
+	test_shared();
+	printc("Done.\n");
+
+	cos_sinv(BOOT_CAPTBL_SINV_CAP, 1, 2, 3, 4);
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright 2017, The George Washington University
+ *
+ * This uses a two clause BSD License.
+ */
+
+#include <cos_defkernel_api.h>
+#include <llprint.h>
+#include <res_spec.h>
+#include <sl.h>
+#include <cos_chan.h>
+
+/* Ensure this is the same as what is in sl_mod_fprr.c */
+#define SL_FPRR_NPRIOS 32
+
+#define LOWEST_PRIORITY (SL_FPRR_NPRIOS - 1)
+#define HIGH_PRIORITY (LOWEST_PRIORITY - 10)
+
+#define TEST_NENTS 64
+#define TEST_NSENT 4096
+
+static struct cos_chan *chan;
+static volatile u32_t   consumed = 0;
+
+static void
+test_batch(void)
+{
+	u32_t        in[TEST_NENTS * 2], out[TEST_NENTS * 2];
+	unsigned int i, round;
+
+	for (i = 0; i < TEST_NENTS * 2; i++) in[i] = i;
+
+	/* only a ring-full is enqueued */
+	assert(cos_chan_enqueue_spsc(chan, in, TEST_NENTS * 2, 0) == TEST_NENTS);
+	assert(cos_chan_enqueue_mpsc(chan, in, 1, 0) == 0);
+	assert(cos_chan_dequeue(chan, out, TEST_NENTS * 2) == TEST_NENTS);
+	for (i = 0; i < TEST_NENTS; i++) assert(out[i] == i);
+	assert(cos_chan_dequeue(chan, out, 1) == 0);
+
+	/* batches that wrap around the end of the ring */
+	for (round = 0; round < 8; round++) {
+		assert(cos_chan_enqueue_mpsc(chan, in, 40, 0) == 40);
+		assert(cos_chan_dequeue(chan, out, 40) == 40);
+		for (i = 0; i < 40; i++) assert(out[i] == i);
+	}
+}
+
+/* A producer is preempted after reserving entries, but before publishing them. */
+static void
+test_stalled(void)
+{
+	u32_t         in[4] = { 1, 2, 3, 4 }, out[8];
+	unsigned long r;
+
+	r          = chan->tail;
+	chan->tail = r + 2;
+	/* another producer doesn't wait for it, but its entries are behind it */
+	assert(cos_chan_enqueue_mpsc(chan, in, 2, 0) == 2);
+	assert(cos_chan_dequeue(chan, out, 8) == 0);
+	assert(!cos_chan_poll(chan, 0));
+
+	__cos_chan_copy(chan, r, in + 2, 2, 1);
+	__cos_chan_publish(chan, r, 2, 0);
+	assert(cos_chan_dequeue(chan, out, 8) == 4);
+	assert(out[0] == 3 && out[1] == 4 && out[2] == 1 && out[3] == 2);
+}
+
+static void
+consumer_fn(arcvcap_t rcv, void *data)
+{
+	u32_t        out[TEST_NENTS];
+	unsigned int i, n;
+
+	while (consumed < TEST_NSENT) {
+		n = cos_chan_dequeue_wait(chan, out, TEST_NENTS, rcv);
+		for (i = 0; i < n; i++) assert(out[i] == consumed + i);
+		consumed += n;
+	}
+	sl_thd_exit();
+}
+
+static void
+test_notify(void)
+{
+	struct cos_compinfo *ci = cos_compinfo_get(cos_defcompinfo_curr_get());
+	struct sl_thd *      consumer;
+	asndcap_t            snd;
+	u32_t                in[TEST_NENTS / 4];
+	u32_t                sent = 0;
+	unsigned int         i, n;
+
+	consumer = sl_thd_aep_alloc(consumer_fn, NULL, 0);
+	assert(consumer);
+	sl_thd_param_set(consumer, sched_param_pack(SCHEDP_PRIO, HIGH_PRIORITY));
+	snd = cos_asnd_alloc(ci, sl_thd_rcvcap(consumer), ci->captbl_cap);
+	assert(snd);
+
+	while (sent < TEST_NSENT) {
+		for (i = 0; i < TEST_NENTS / 4; i++) in[i] = sent + i;
+		n = cos_chan_enqueue_spsc(chan, in, TEST_NENTS / 4, snd);
+		sent += n;
+		/* the higher-priority consumer empties the ring each time it's notified */
+		if (!n) sl_thd_yield(0);
+	}
+	while (consumed < TEST_NSENT) sl_thd_yield(0);
+}
+
+static void
+run_tests()
+{
+	struct cos_compinfo *ci = cos_compinfo_get(cos_defcompinfo_curr_get());
+
+	chan = cos_chan_alloc(ci, sizeof(u32_t), TEST_NENTS);
+	assert(chan);
+	assert(!cos_chan_alloc(ci, sizeof(u32_t), TEST_NENTS - 1));
+
+	test_batch();
+	printc("Test successful! Batches enqueued and dequeued!\n");
+	test_stalled();
+	printc("Test successful! A preempted producer didn't block the others!\n");
+	test_notify();
+	printc("Test successful! Notified consumer got every entry in order!\n");
+
+	printc("Done testing, spinning...\n");
+	SPIN();
+}
+
+void
+cos_init(void)
+{
+	struct sl_thd *testing_thread;
+	struct cos_defcompinfo *defci = cos_defcompinfo_curr_get();
+	struct cos_compinfo *   ci    = cos_compinfo_get(defci);
+
+	printc("Unit-test for shared-memory channels (cos_chan)\n");
+	cos_meminfo_init(&(ci->mi), BOOT_MEM_KM_BASE, COS_MEM_KERN_PA_SZ, BOOT_CAPTBL_SELF_UNTYPED_PT);
+	cos_defcompinfo_init();
+	sl_init(SL_MIN_PERIOD_US);
+
+	testing_thread = sl_thd_alloc(run_tests, NULL);
+	sl_thd_param_set(testing_thread, sched_param_pack(SCHEDP_PRIO, LOWEST_PRIORITY));
+
+	sl_sched_loop();
+
+	assert(0);
+
+	return;
+}
@@ -0,0 +1,138 @@
+#include <cos_component.h>
+#include <string.h>
+#include <cos_kernel_api.h>
+#include <cos_debug.h>
+#include <llprint.h>
+#include <cbuf.h>
+#include <keyval.h>
+
+#define TEST_NBATCH 64
+#define TEST_NUPDATES 8192
+#define TEST_VAL_SZ 3072
+
+static cbuf_t req;
+static char * reqbuf;
+
+static int
+test_table(const char *name)
+{
+	int t;
+
+	keyval_rec_write(reqbuf, name, strlen(name), NULL, 0);
+	t = keyval_tablespace(cos_spd_id(), req, 0);
+	assert(t >= 0);
+
+	return t;
+}
+
+static int
+test_put(int t, const char *key, const void *val, u16_t vlen)
+{
+	keyval_rec_write(reqbuf, key, strlen(key), val, vlen);
+
+	return keyval_put(cos_spd_id(), t, req, 0);
+}
+
+static void *
+test_get(int t, const char *key, u16_t *vlen)
+{
+	keyval_rec_write(reqbuf, key, strlen(key), NULL, 0);
+
+	return keyval_value(keyval_get(cos_spd_id(), t, req, 0), vlen);
+}
+
+static void
+test_tablespaces(void)
+{
+	int   def = test_table("DEFAULT"), t2 = test_table("TABLE2"), two = 2;
+	char *s;
+	u16_t len;
+
+	assert(def != t2 && test_table("DEFAULT") == def);
+	assert(!test_get(def, "EMPTY", NULL));
+
+	assert(!test_put(def, "key1", "value1", 7));
+	s = test_get(def, "key1", &len);
+	assert(s && len == 7 && !strcmp(s, "value1"));
+
+	assert(!test_put(def, "key2", &two, sizeof(int)));
+	assert(*(int *)test_get(def, "key2", NULL) == 2);
+
+	/* tables don't share keys */
+	assert(!test_put(t2, "key3", "value3", 7));
+	assert(!test_get(def, "key3", NULL) && !test_get(t2, "key1", NULL));
+
+	/* an update doesn't change the value a previous get returned (until its space is reused) */
+	assert(!test_put(def, "key1", "new", 4));
+	assert(!strcmp(s, "value1") && !strcmp(test_get(def, "key1", NULL), "new"));
+	printc("\tPut and got strings and numbers in table spaces.\n");
+}
+
+static void
+test_batch(void)
+{
+	int                t = test_table("BATCH"), i, off = 0;
+	struct keyval_rec *r;
+	char               key[16], *robuf;
+	cbuf_t             ro;
+
+	for (i = 0; i < TEST_NBATCH; i++) {
+		snprintf(key, sizeof(key), "bkey%d", i);
+		off += keyval_rec_write(reqbuf + off, key, strlen(key), &i, sizeof(int));
+	}
+	assert(keyval_put_batch(cos_spd_id(), t, req, TEST_NBATCH) == TEST_NBATCH);
+
+	off = 0;
+	for (i = 0; i < TEST_NBATCH + 1; i++) {
+		snprintf(key, sizeof(key), "bkey%d", i);
+		off += keyval_rec_write(reqbuf + off, key, strlen(key), NULL, 0);
+	}
+	assert(keyval_get_batch(cos_spd_id(), t, req, TEST_NBATCH + 1) == TEST_NBATCH);
+	for (i = 0, r = (struct keyval_rec *)reqbuf; i < TEST_NBATCH; i++, r = keyval_rec_next(r, 0)) {
+		assert(*(int *)keyval_value(r->ref, NULL) == i);
+	}
+	assert(!r->ref);
+
+	/* the server can't write the references into a cbuf that isn't shared */
+	ro = cbuf_alloc(PAGE_SIZE, (void **)&robuf);
+	assert(ro);
+	keyval_rec_write(robuf, "bkey0", 5, NULL, 0);
+	assert(keyval_get_batch(cos_spd_id(), t, ro, 1) == -EINVAL);
+	cbuf_free(ro);
+	printc("\tBatches of puts and gets.\n");
+}
+
+/* Many times the space of all arenas is put, but replaced values free theirs. */
+static void
+test_reuse(void)
+{
+	int   t = test_table("REUSE"), i;
+	char *v;
+	u16_t len;
+
+	for (i = 0; i < TEST_NUPDATES; i++) {
+		keyval_rec_write(reqbuf, "big", 3, NULL, TEST_VAL_SZ);
+		memset(((struct keyval_rec *)reqbuf)->data + 3, i & 0xff, TEST_VAL_SZ);
+		assert(!keyval_put(cos_spd_id(), t, req, 0));
+	}
+	v = test_get(t, "big", &len);
+	assert(v && len == TEST_VAL_SZ && v[0] == ((TEST_NUPDATES - 1) & 0xff) && v[TEST_VAL_SZ - 1] == v[0]);
+	printc("\tReplaced values' space is reused.\n");
+}
+
+void
+cos_init(void)
+{
+	printc("Unit-test for the key-value store\n");
+	if (cbuf_client_init(BOOT_CAPTBL_SINV_CAP)) BUG();
+	/* the server writes the batched gets' references into it */
+	req = cbuf_alloc_shared(PAGE_SIZE, (void **)&reqbuf);
+	assert(req);
+
+	test_tablespaces();
+	test_batch();
+	test_reuse();
+	printc("Unit-test for the key-value store done.\n");
+
+	cos_sinv(BOOT_CAPTBL_SINV_CAP, 1, 2, 3, 4);
+}
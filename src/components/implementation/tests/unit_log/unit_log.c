@@ -0,0 +1,102 @@
+/*
+ * Copyright 2017, The George Washington University
+ *
+ * This uses a two clause BSD License.
+ */
+
+#include <cos_defkernel_api.h>
+#include <llprint.h>
+#include <res_spec.h>
+#include <sl.h>
+#include <cos_log.h>
+
+/* Ensure this is the same as what is in sl_mod_fprr.c */
+#define SL_FPRR_NPRIOS 32
+
+#define LOWEST_PRIORITY (SL_FPRR_NPRIOS - 1)
+#define LOW_PRIORITY (LOWEST_PRIORITY - 1)
+
+#define LOGDRAIN_BATCH 32
+#define LOGDRAIN_PERIOD_US 1000
+
+/*
+ * The drain runs at the lowest priority, so that logging never spends
+ * the time of the threads that log on the console.
+ */
+static void
+logdrain_fn(void *d)
+{
+	while (1) {
+		int cpu, n = 0;
+
+		for (cpu = 0; cpu < NUM_CPU; cpu++) n += cos_log_drain(cpu, COS_LOG_INFO, LOGDRAIN_BATCH);
+		/* the rings are empty: check back in a period */
+		if (!n) sl_thd_block_timeout(0, sl_now() + sl_usec2cyc(LOGDRAIN_PERIOD_US));
+	}
+}
+
+static void
+test_log(void)
+{
+	struct cos_log_ring *r = cos_log_ring(cos_cpuid());
+	unsigned long        t = r->tail;
+	int                  i;
+
+	/* the drain doesn't run until we block */
+	for (i = 0; i < COS_LOG_NRECS / 2; i++) {
+		assert(cos_logf(COS_LOG_INFO, "unit_log record %d\n", i) > 0);
+	}
+	assert(r->tail == t + COS_LOG_NRECS / 2);
+	assert(r->recs[t & (COS_LOG_NRECS - 1)].seq == t + 1);
+	assert(r->recs[t & (COS_LOG_NRECS - 1)].thdid == cos_thdid());
+	printc("\tLogged %d records.\n", i);
+
+	/* the ring fills, and the rest are dropped (and not printed, at this level) */
+	for (i = 0; i < COS_LOG_NRECS; i++) cos_logf(COS_LOG_DBG, "unit_log overflow %d\n", i);
+	assert(r->tail - r->head == COS_LOG_NRECS);
+	assert(r->dropped > 0);
+	printc("\tA full ring drops records.\n");
+
+	/* the drain reports the dropped records after the ring's last ones */
+	while (ps_load(&r->head) != r->tail || ps_load(&r->dropped)) {
+		sl_thd_block_timeout(0, sl_now() + sl_usec2cyc(LOGDRAIN_PERIOD_US));
+	}
+	printc("\tThe drain thread emptied the ring.\n");
+}
+
+static void
+run_tests()
+{
+	test_log();
+	printc("Unit-test for the log rings done.\n");
+
+	printc("Done testing, spinning...\n");
+	SPIN();
+}
+
+void
+cos_init(void)
+{
+	struct sl_thd *testing_thread, *drain_thread;
+	struct cos_defcompinfo *defci = cos_defcompinfo_curr_get();
+	struct cos_compinfo *   ci    = cos_compinfo_get(defci);
+
+	printc("Unit-test for the log rings\n");
+	cos_meminfo_init(&(ci->mi), BOOT_MEM_KM_BASE, COS_MEM_KERN_PA_SZ, BOOT_CAPTBL_SELF_UNTYPED_PT);
+	cos_defcompinfo_init();
+	sl_init(SL_MIN_PERIOD_US);
+
+	cos_log_init();
+	drain_thread = sl_thd_alloc(logdrain_fn, NULL);
+	assert(drain_thread);
+	sl_thd_param_set(drain_thread, sched_param_pack(SCHEDP_PRIO, LOWEST_PRIORITY));
+	testing_thread = sl_thd_alloc(run_tests, NULL);
+	assert(testing_thread);
+	sl_thd_param_set(testing_thread, sched_param_pack(SCHEDP_PRIO, LOW_PRIORITY));
+
+	sl_sched_loop();
+
+	assert(0);
+
+	return;
+}
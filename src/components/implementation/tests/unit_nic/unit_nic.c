@@ -0,0 +1,192 @@
+/*
+ * Copyright 2017, The George Washington University
+ *
+ * This uses a two clause BSD License.
+ */
+
+#include <cos_defkernel_api.h>
+#include <llprint.h>
+#include <res_spec.h>
+#include <sl.h>
+#include <cos_nic.h>
+
+/* Ensure this is the same as what is in sl_mod_fprr.c */
+#define SL_FPRR_NPRIOS 32
+
+#define LOWEST_PRIORITY (SL_FPRR_NPRIOS - 1)
+#define HIGH_PRIORITY (LOWEST_PRIORITY - 10)
+
+#define TEST_NBUFS 128
+#define TEST_NPKTS 8192
+#define TEST_PKT_SZ(seq) (64 + (seq) % 1024)
+
+static struct cos_nic  port_a, port_b;
+static volatile u32_t  received = 0;
+
+/* Transmit a burst of up to n packets, numbered from seq, on n. */
+static unsigned int
+send_burst(struct cos_nic *n, u32_t seq, unsigned int cnt)
+{
+	struct cos_nic_desc d[COS_NIC_BURST];
+	unsigned int        i, sent;
+	int                 b;
+
+	for (i = 0; i < cnt; i++) {
+		if ((b = cos_nic_buf_alloc(n)) < 0) break;
+		*(u32_t *)cos_nic_buf(n, b) = seq + i;
+		d[i].buf = b;
+		d[i].len = TEST_PKT_SZ(seq + i);
+	}
+	sent = cos_nic_tx_burst(n, d, i);
+	assert(sent == i);
+
+	return sent;
+}
+
+static void
+test_loopback(void)
+{
+	struct cos_nic_desc d[COS_NIC_BURST * 2];
+	unsigned int        i;
+	int                 b;
+
+	assert(send_burst(&port_a, 0, COS_NIC_BURST) == COS_NIC_BURST);
+	assert(cos_nic_rx_burst(&port_a, d, COS_NIC_BURST) == 0);
+	assert(cos_nic_pair_xfer(&port_a, &port_a, COS_NIC_BURST * 2) == COS_NIC_BURST);
+	assert(cos_nic_rx_burst(&port_a, d, COS_NIC_BURST * 2) == COS_NIC_BURST);
+	for (i = 0; i < COS_NIC_BURST; i++) {
+		assert(d[i].len == TEST_PKT_SZ(i));
+		assert(*(u32_t *)cos_nic_buf(&port_a, d[i].buf) == i);
+		cos_nic_buf_free(&port_a, d[i].buf);
+	}
+	assert(cos_nic_refill(&port_a, COS_NIC_BURST) == COS_NIC_BURST);
+	assert(cos_nic_reclaim(&port_a) == COS_NIC_BURST);
+	assert(port_a.rx_drops == 0);
+
+	/* malformed descriptors are returned, but not received */
+	d[0].buf = TEST_NBUFS;
+	d[0].len = 64;
+	assert(cos_nic_tx_burst(&port_a, d, 1) == 1);
+	assert(cos_nic_pair_xfer(&port_a, &port_a, 1) == 1);
+	assert(cos_nic_rx_burst(&port_a, d, 1) == 0);
+	/* as are empty packets, whose buffers are reclaimed */
+	assert((b = cos_nic_buf_alloc(&port_a)) >= 0);
+	d[0].buf = b;
+	d[0].len = 0;
+	assert(cos_nic_tx_burst(&port_a, d, 1) == 1);
+	assert(cos_nic_pair_xfer(&port_a, &port_a, 1) == 1);
+	assert(cos_nic_rx_burst(&port_a, d, 1) == 0);
+	assert(cos_nic_reclaim(&port_a) == 2);
+	assert(port_a.rx_drops == 0);
+}
+
+static void
+device_fn(arcvcap_t rcv, void *data)
+{
+	cos_nic_pair_loop(&port_a, &port_b, rcv);
+}
+
+static void
+receiver_fn(arcvcap_t rcv, void *data)
+{
+	struct cos_nic_desc d[COS_NIC_BURST];
+	unsigned int        i, n;
+	u32_t               seq;
+
+	while (received + port_b.rx_drops < TEST_NPKTS) {
+		n = cos_nic_rx_wait(&port_b, d, COS_NIC_BURST, rcv);
+		if (!n) {
+			/* polling, and there's nothing yet */
+			sl_thd_yield(0);
+			continue;
+		}
+		for (i = 0; i < n; i++) {
+			seq = *(u32_t *)cos_nic_buf(&port_b, d[i].buf);
+			/* in order, though the device can drop packets */
+			assert(seq >= received && d[i].len == TEST_PKT_SZ(seq));
+			received++;
+			cos_nic_buf_free(&port_b, d[i].buf);
+		}
+		cos_nic_refill(&port_b, n);
+	}
+	sl_thd_exit();
+}
+
+static void
+test_pair(void)
+{
+	struct cos_compinfo *ci = cos_compinfo_get(cos_defcompinfo_curr_get());
+	struct sl_thd *      device, *receiver;
+	asndcap_t            dev_snd;
+	u32_t                sent = 0;
+	unsigned int         n;
+	cycles_t             start, end;
+
+	device = sl_thd_aep_alloc(device_fn, NULL, 0);
+	assert(device);
+	sl_thd_param_set(device, sched_param_pack(SCHEDP_PRIO, HIGH_PRIORITY));
+	receiver = sl_thd_aep_alloc(receiver_fn, NULL, 0);
+	assert(receiver);
+	sl_thd_param_set(receiver, sched_param_pack(SCHEDP_PRIO, HIGH_PRIORITY + 1));
+
+	dev_snd = cos_asnd_alloc(ci, sl_thd_rcvcap(device), ci->captbl_cap);
+	assert(dev_snd);
+	port_a.tx_snd = port_b.tx_snd = dev_snd;
+	port_b.rx_snd = cos_asnd_alloc(ci, sl_thd_rcvcap(receiver), ci->captbl_cap);
+	assert(port_b.rx_snd);
+
+	rdtscll(start);
+	while (sent < TEST_NPKTS) {
+		n = TEST_NPKTS - sent;
+		if (n > COS_NIC_BURST) n = COS_NIC_BURST;
+		n = send_burst(&port_a, sent, n);
+		sent += n;
+		/* out of buffers until the device is done with them */
+		if (!n) sl_thd_yield(0);
+	}
+	while (received + port_b.rx_drops < TEST_NPKTS) sl_thd_yield(0);
+	rdtscll(end);
+
+	printc("Pair device: %d packets received, %lu dropped, %llu cycles/packet\n", received, port_b.rx_drops,
+	       (end - start) / TEST_NPKTS);
+}
+
+static void
+run_tests()
+{
+	struct cos_compinfo *ci = cos_compinfo_get(cos_defcompinfo_curr_get());
+
+	assert(cos_nic_init(&port_a, ci, TEST_NBUFS - 1) == -EINVAL);
+	assert(!cos_nic_init(&port_a, ci, TEST_NBUFS));
+	assert(!cos_nic_init(&port_b, ci, TEST_NBUFS));
+
+	test_loopback();
+	printc("Test successful! Loopback bursts received in order!\n");
+	test_pair();
+	printc("Test successful! Packets crossed the pair device in order!\n");
+
+	printc("Done testing, spinning...\n");
+	SPIN();
+}
+
+void
+cos_init(void)
+{
+	struct sl_thd *testing_thread;
+	struct cos_defcompinfo *defci = cos_defcompinfo_curr_get();
+	struct cos_compinfo *   ci    = cos_compinfo_get(defci);
+
+	printc("Unit-test for polled-mode network ports (cos_nic)\n");
+	cos_meminfo_init(&(ci->mi), BOOT_MEM_KM_BASE, COS_MEM_KERN_PA_SZ, BOOT_CAPTBL_SELF_UNTYPED_PT);
+	cos_defcompinfo_init();
+	sl_init(SL_MIN_PERIOD_US);
+
+	testing_thread = sl_thd_alloc(run_tests, NULL);
+	sl_thd_param_set(testing_thread, sched_param_pack(SCHEDP_PRIO, LOWEST_PRIORITY));
+
+	sl_sched_loop();
+
+	assert(0);
+
+	return;
+}
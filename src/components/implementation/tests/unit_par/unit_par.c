@@ -0,0 +1,341 @@
+/*
+ * Copyright 2017, The George Washington University
+ *
+ * This uses a two clause BSD License.
+ */
+
+#include <cos_defkernel_api.h>
+#include <llprint.h>
+#include <res_spec.h>
+#include <sl.h>
+#include <cos_par.h>
+
+/* Ensure this is the same as what is in sl_mod_fprr.c */
+#define SL_FPRR_NPRIOS 32
+
+#define LOWEST_PRIORITY (SL_FPRR_NPRIOS - 1)
+
+#define TEST_NWORKERS 4
+#define TEST_FOR_SZ   4096
+#define TEST_FIB      20
+#define TEST_FIB_SEQ  8 /* below this, fib doesn't spawn */
+#define BENCH_ITERS   1024
+
+static struct cos_par par;
+
+/* parallel_for touches every index exactly once */
+
+static int for_seen[TEST_FOR_SZ];
+
+static void
+for_fn(void *arg, long lo, long hi)
+{
+	long i;
+
+	assert(lo < hi);
+	for (i = lo; i < hi; i++) for_seen[i]++;
+}
+
+static void
+test_for(void)
+{
+	int i;
+
+	cos_par_for(0, TEST_FOR_SZ, 0, for_fn, NULL);
+	for (i = 0; i < TEST_FOR_SZ; i++) assert(for_seen[i] == 1);
+
+	cos_par_for(0, TEST_FOR_SZ, 1, for_fn, NULL);
+	for (i = 0; i < TEST_FOR_SZ; i++) assert(for_seen[i] == 2);
+}
+
+/* nested tasks: each fib spawns one child, and runs the other itself */
+
+static long
+fib_seq(long n)
+{
+	return n < 2 ? n : fib_seq(n - 1) + fib_seq(n - 2);
+}
+
+static void
+fib_fn(void *arg, long n, long unused)
+{
+	long *              ret = arg;
+	long                a, b;
+	struct cos_par_join j = { .pending = 0 };
+
+	if (n < TEST_FIB_SEQ) {
+		*ret = fib_seq(n);
+		return;
+	}
+	cos_par_spawn(&j, fib_fn, &a, n - 1, 0);
+	fib_fn(&b, n - 2, 0);
+	cos_par_join_wait(&j);
+	*ret = a + b;
+}
+
+static void
+test_nested(void)
+{
+	long r = 0;
+
+	fib_fn(&r, TEST_FIB, 0);
+	assert(r == fib_seq(TEST_FIB));
+}
+
+/* the overheads of fork/join and parallel_for (once micro_par's OpenMP measurements) */
+
+static void
+nop_fn(void *arg, long lo, long hi)
+{ }
+
+static void
+bench_overheads(void)
+{
+	struct cos_par_join j = { .pending = 0 };
+	cycles_t            start, spawn, loop;
+	int                 i;
+
+	start = sl_now();
+	for (i = 0; i < BENCH_ITERS; i++) {
+		cos_par_spawn(&j, nop_fn, NULL, 0, 0);
+		cos_par_join_wait(&j);
+	}
+	spawn = (sl_now() - start) / BENCH_ITERS;
+
+	start = sl_now();
+	for (i = 0; i < BENCH_ITERS; i++) cos_par_for(0, TEST_NWORKERS, 1, nop_fn, NULL);
+	loop = (sl_now() - start) / BENCH_ITERS;
+
+	printc("\tfork/join: %llu cycles, parallel_for over %d workers: %llu cycles\n", spawn, TEST_NWORKERS, loop);
+}
+
+/*
+ * The 2D FFT of the archived omp_fft, with its OpenMP loops (the
+ * transposes, the row FFTs, and the twiddle scaling) run with
+ * cos_par_for.  Rows are transformed independently, so the parallel
+ * and sequential results must be identical.  The FPU isn't saved
+ * across thread switches (FPU_ENABLED is off by default), so the FFT
+ * is in fixed point, scaled by 1/2 at each stage so it can't overflow.
+ */
+
+#define FFT_LOGN 5
+#define FFT_N    (1 << FFT_LOGN)
+#define FFT_NN   (FFT_N * FFT_N)
+#define FFT_ITERS 8
+#define FFT_Q    30 /* fraction bits of the twiddles */
+/* e^(-2 pi i / FFT_NN), the twiddle every other is a power of */
+#define FFT_W1_RE 1073721611
+#define FFT_W1_IM (-6588356)
+
+typedef struct {
+	long re, im;
+} fft_complex_t;
+
+static fft_complex_t fft_a[FFT_NN], fft_b[FFT_NN], fft_v[FFT_NN], fft_w[FFT_N / 2], fft_seq[FFT_NN];
+static fft_complex_t fft_twiddles[FFT_NN];
+static int           fft_brt[FFT_N];
+
+/* a * w, with w a twiddle */
+static inline fft_complex_t
+fft_mul(fft_complex_t a, fft_complex_t w)
+{
+	fft_complex_t c;
+
+	c.re = (long)(((s64_t)a.re * w.re - (s64_t)a.im * w.im) >> FFT_Q);
+	c.im = (long)(((s64_t)a.re * w.im + (s64_t)a.im * w.re) >> FFT_Q);
+
+	return c;
+}
+
+static void
+fft_tables(void)
+{
+	fft_complex_t w1 = { .re = FFT_W1_RE, .im = FFT_W1_IM };
+	int           i, j, k;
+
+	/* bit reversal: brt[i] = bit-reverse(i) + 1 */
+	for (i = 1, j = 1, fft_brt[0] = 1; i < FFT_N; i++) {
+		for (k = FFT_N / 2; k < j; k /= 2) j -= k;
+		j += k;
+		fft_brt[i] = j;
+	}
+	/* twiddles[k] = e^(-2 pi i k / FFT_NN) */
+	fft_twiddles[0] = (fft_complex_t){ .re = 1L << FFT_Q, .im = 0 };
+	for (i = 1; i < FFT_NN; i++) fft_twiddles[i] = fft_mul(fft_twiddles[i - 1], w1);
+
+	for (i = 0; i < FFT_N / 2; i++) fft_w[i] = fft_twiddles[i * FFT_N];
+	for (i = 0; i < FFT_N; i++) {
+		for (j = 0; j < FFT_N; j++) fft_v[i * FFT_N + j] = fft_twiddles[(i * j) % FFT_NN];
+	}
+}
+
+static void
+fft_gen(fft_complex_t *a)
+{
+	int i;
+
+	for (i = 0; i < FFT_NN; i++) {
+		a[i].re = (i << 8) / 3;
+		a[i].im = (i << 8) / 2;
+	}
+	a[FFT_NN / 2].re = FFT_NN << 8;
+}
+
+/* in-place decimation-in-time Cooley-Tukey of one row */
+static void
+fft_row(fft_complex_t *a)
+{
+	int           i, j, stage, first, pw, spw = FFT_N / 2, diff = 1, stride = 2;
+	fft_complex_t t, x;
+
+	for (i = 0; i < FFT_N; i++) {
+		j = fft_brt[i] - 1;
+		if (i >= j) continue;
+		t    = a[j];
+		a[j] = a[i];
+		a[i] = t;
+	}
+
+	for (stage = 0; stage < FFT_LOGN; stage++) {
+		for (pw = 0, first = 0; pw < FFT_N / 2; pw += spw, first++) {
+			for (i = first; i < FFT_N; i += stride) {
+				j       = i + diff;
+				x       = a[i];
+				t       = fft_mul(a[j], fft_w[pw]);
+				a[j].re = (x.re - t.re) / 2;
+				a[j].im = (x.im - t.im) / 2;
+				a[i].re = (x.re + t.re) / 2;
+				a[i].im = (x.im + t.im) / 2;
+			}
+		}
+		diff = stride;
+		stride <<= 1;
+		spw /= 2;
+	}
+}
+
+struct fft_args {
+	fft_complex_t *a, *b;
+};
+
+static void
+fft_tpose(void *arg, long lo, long hi)
+{
+	struct fft_args *f = arg;
+	long             i, j;
+
+	for (i = lo; i < hi; i++) {
+		for (j = 0; j < FFT_N; j++) f->b[i * FFT_N + j] = f->a[j * FFT_N + i];
+	}
+}
+
+static void
+fft_rows(void *arg, long lo, long hi)
+{
+	struct fft_args *f = arg;
+	long             i;
+
+	for (i = lo; i < hi; i++) fft_row(&f->a[i * FFT_N]);
+}
+
+static void
+fft_scale(void *arg, long lo, long hi)
+{
+	struct fft_args *f = arg;
+	long             i;
+
+	for (i = lo * FFT_N; i < hi * FFT_N; i++) f->a[i] = fft_mul(f->a[i], fft_v[i]);
+}
+
+/* loop(lo, hi, grain, fn, arg): cos_par_for, or its sequential equivalent */
+typedef void (*fft_loop_fn_t)(long lo, long hi, long grain, cos_par_fn_t fn, void *arg);
+
+static void
+fft_loop_seq(long lo, long hi, long grain, cos_par_fn_t fn, void *arg)
+{
+	fn(arg, lo, hi);
+}
+
+static cycles_t
+fft_2d(fft_complex_t *out, fft_loop_fn_t loop)
+{
+	struct fft_args ab = { .a = fft_a, .b = fft_b }, ba = { .a = fft_b, .b = fft_a };
+	cycles_t        start;
+	int             i;
+
+	fft_gen(fft_a);
+	start = sl_now();
+	for (i = 0; i < FFT_ITERS; i++) {
+		/* the six-step FFT of an NN vector */
+		loop(0, FFT_N, 0, fft_tpose, &ab);
+		loop(0, FFT_N, 0, fft_rows, &ba);
+		loop(0, FFT_N, 0, fft_scale, &ba);
+		loop(0, FFT_N, 0, fft_tpose, &ba);
+		loop(0, FFT_N, 0, fft_rows, &ab);
+		loop(0, FFT_N, 0, fft_tpose, &ab);
+		/* and back into a for the next iteration */
+		loop(0, FFT_N, 0, fft_tpose, &ba);
+	}
+	start = sl_now() - start;
+	for (i = 0; i < FFT_NN; i++) out[i] = fft_a[i];
+
+	return start / FFT_ITERS;
+}
+
+static void
+bench_fft(void)
+{
+	cycles_t seq, par;
+	int      i;
+
+	fft_tables();
+	seq = fft_2d(fft_seq, fft_loop_seq);
+	par = fft_2d(fft_b, cos_par_for);
+	for (i = 0; i < FFT_NN; i++) {
+		assert(fft_b[i].re == fft_seq[i].re && fft_b[i].im == fft_seq[i].im);
+	}
+
+	printc("\t%dx%d FFT: %llu cycles sequential, %llu cycles with %d workers\n", FFT_N, FFT_N, seq, par,
+	       TEST_NWORKERS);
+}
+
+static void
+run_tests()
+{
+	int i;
+
+	/* the workers are below us, so our joins must block to let them run */
+	assert(!cos_par_init(&par, TEST_NWORKERS, LOWEST_PRIORITY));
+
+	test_for();
+	printc("Test successful! parallel_for ran each index once!\n");
+	test_nested();
+	printc("Test successful! Nested tasks joined!\n");
+	bench_overheads();
+	bench_fft();
+	printc("Test successful! The parallel FFT matches the sequential one!\n");
+	for (i = 0; i < TEST_NWORKERS; i++) printc("\tworker %d: %lu steals\n", i, par.workers[i].steals);
+
+	printc("Done testing, spinning...\n");
+	SPIN();
+}
+
+void
+cos_init(void)
+{
+	struct sl_thd *testing_thread;
+	struct cos_defcompinfo *defci = cos_defcompinfo_curr_get();
+	struct cos_compinfo *   ci    = cos_compinfo_get(defci);
+
+	printc("Unit-test for the work-stealing fork/join runtime (cos_par)\n");
+	cos_meminfo_init(&(ci->mi), BOOT_MEM_KM_BASE, COS_MEM_KERN_PA_SZ, BOOT_CAPTBL_SELF_UNTYPED_PT);
+	cos_defcompinfo_init();
+	sl_init(SL_MIN_PERIOD_US);
+
+	testing_thread = sl_thd_alloc(run_tests, NULL);
+	sl_thd_param_set(testing_thread, sched_param_pack(SCHEDP_PRIO, LOWEST_PRIORITY - 1));
+
+	sl_sched_loop();
+
+	assert(0);
+}
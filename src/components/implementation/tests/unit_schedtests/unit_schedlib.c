@@ -13,6 +13,7 @@
 #include <cos_defkernel_api.h>
 #include <llprint.h>
 #include <sl.h>
+#include <sl_lock.h>
 
 /* sl also defines a SPIN macro */
 #undef SPIN
@@ -140,6 +141,95 @@ test_timeout_wakeup(void)
 	sl_thd_param_set(high, spw.v);
 }
 
+#define DEP_ITERS 100
+
+struct sl_lock dep_lock;
+struct sl_thd *dep_low, *dep_med;
+/* the high priority thread waits for the lock */
+volatile int   dep_waiting;
+int            dep_inherited;
+
+void
+test_dep_low(void *data)
+{
+	while (1) {
+		int workiters = WORKITERS * 10;
+
+		sl_lock_take(&dep_lock);
+		SPIN(workiters);
+		printc("l");
+		sl_lock_release(&dep_lock);
+	}
+}
+
+void
+test_dep_med(void *data)
+{
+	while (1) {
+		int i;
+
+		/* let the low priority thread take the lock */
+		sl_thd_block_timeout(0, sl_now() + sl_usec2cyc(500));
+		for (i = 0; i < 100; i++) {
+			int workiters = WORKITERS;
+
+			/* the holder runs at the waiter's priority: we can't preempt it */
+			assert(!dep_waiting);
+			SPIN(workiters);
+		}
+		printc("m");
+	}
+}
+
+/*
+ * With the lock holder running at our priority, we only wait for the
+ * holder's critical section, not for the medium priority thread.
+ */
+void
+test_dep_high(void *data)
+{
+	int iters;
+
+	for (iters = 0; iters < DEP_ITERS; iters++) {
+		cycles_t start;
+
+		sl_thd_block_timeout(0, sl_now() + sl_usec2cyc(1000));
+		start = sl_now();
+		if (sl_lock_holder(&dep_lock)) dep_inherited++;
+		dep_waiting = 1;
+		sl_lock_take(&dep_lock);
+		dep_waiting = 0;
+		printc(".h:%lluus.", sl_cyc2usec(sl_now() - start));
+		sl_lock_release(&dep_lock);
+	}
+	/* the holder was preempted in its critical section, and ran on our priority */
+	assert(dep_inherited > 0);
+	printc("\nDependency test done! (lock held %d of %d times)\n", dep_inherited, DEP_ITERS);
+
+	sl_thd_free(dep_low);
+	sl_thd_free(dep_med);
+	test_timeout_wakeup();
+	sl_thd_free(sl_thd_curr());
+}
+
+void
+test_dependency_inheritance(void)
+{
+	struct sl_thd *         high;
+	union sched_param_union sph = {.c = {.type = SCHEDP_PRIO, .value = 5}};
+	union sched_param_union spm = {.c = {.type = SCHEDP_PRIO, .value = 7}};
+	union sched_param_union spl = {.c = {.type = SCHEDP_PRIO, .value = 10}};
+
+	sl_lock_init(&dep_lock);
+	dep_low = sl_thd_alloc(test_dep_low, NULL);
+	dep_med = sl_thd_alloc(test_dep_med, NULL);
+	high    = sl_thd_alloc(test_dep_high, NULL);
+	assert(dep_low && dep_med && high);
+	sl_thd_param_set(dep_low, spl.v);
+	sl_thd_param_set(dep_med, spm.v);
+	sl_thd_param_set(high, sph.v);
+}
+
 void
 cos_init(void)
 {
@@ -153,7 +243,8 @@ cos_init(void)
 
 	//	test_yields();
 	//	test_blocking_directed_yield();
-	test_timeout_wakeup();
+	/* followed by test_timeout_wakeup */
+	test_dependency_inheritance();
 
 	sl_sched_loop_nonblock();
 
@@ -0,0 +1,182 @@
+/*
+ * Copyright 2017, The George Washington University
+ *
+ * This uses a two clause BSD License.
+ */
+
+#include <cos_defkernel_api.h>
+#include <llprint.h>
+#include <res_spec.h>
+#include <sl.h>
+#include <sl_evt.h>
+
+/* Ensure this is the same as what is in sl_mod_fprr.c */
+#define SL_FPRR_NPRIOS 32
+
+#define LOWEST_PRIORITY (SL_FPRR_NPRIOS - 1)
+#define HIGH_PRIORITY (LOWEST_PRIORITY - 10)
+
+#define TEST_NEVTS 64
+
+static struct sl_evt     evts;
+static struct sl_evt_shm evts_shm;
+static sl_evt_id_t       ids[TEST_NEVTS];
+static struct sl_evt_res res[TEST_NEVTS * 2];
+static volatile int      waiter_got = 0;
+
+static void
+test_batch(void)
+{
+	sl_evt_id_t removed;
+	int         i, n;
+
+	for (i = 0; i < TEST_NEVTS; i++) {
+		ids[i] = sl_evt_add(&evts, (void *)i);
+		assert(ids[i]);
+	}
+	removed = sl_evt_add(&evts, NULL);
+	assert(removed);
+
+	/* edges before the wait are coalesced */
+	for (i = 0; i < TEST_NEVTS; i++) {
+		sl_evt_trigger(&evts, ids[i]);
+		sl_evt_trigger(&evts, ids[i]);
+	}
+	sl_evt_trigger(&evts, removed);
+	assert(!sl_evt_rem(&evts, removed));
+
+	n = sl_evt_wait(&evts, res, TEST_NEVTS * 2, 0);
+	assert(n == TEST_NEVTS);
+	for (i = 0; i < n; i++) {
+		assert(res[i].id == ids[i]);
+		assert(res[i].data == (void *)i);
+	}
+}
+
+static void
+test_timeout(void)
+{
+	assert(sl_evt_wait(&evts, res, TEST_NEVTS, sl_now() + sl_usec2cyc(1000)) == 0);
+}
+
+/* A producer is preempted between reserving its slot, and filling it. */
+static void
+test_stalled(void)
+{
+	struct sl_evt_shm *shm = &evts_shm;
+	unsigned long      slot;
+	int                n;
+
+	shm->pending[ids[2]] = SL_EVT_QUEUED;
+	slot                 = ps_faa(&shm->tail, 1);
+
+	/* the events behind it are still delivered... */
+	sl_evt_trigger(&evts, ids[1]);
+	n = sl_evt_wait(&evts, res, TEST_NEVTS, 0);
+	assert(n == 1 && res[0].id == ids[1]);
+	/* ...and a new edge isn't lost while the slot is stuck */
+	sl_evt_trigger(&evts, ids[1]);
+	sl_evt_trigger(&evts, ids[1]);
+
+	/* the producer fills its slot */
+	shm->ring[slot & SL_EVT_RING_MASK] = ids[2];
+	n = sl_evt_wait(&evts, res, TEST_NEVTS, 0);
+	assert(n == 2 && res[0].id == ids[2] && res[1].id == ids[1]);
+	assert(shm->head == shm->tail);
+}
+
+static void
+waiter_fn()
+{
+	struct sl_evt_res r;
+
+	assert(sl_evt_wait(&evts, &r, 1, 0) == 1);
+	assert(r.id == ids[0]);
+	waiter_got = 1;
+	sl_thd_exit();
+}
+
+static void
+test_wakeup(void)
+{
+	struct sl_thd *waiter;
+
+	waiter = sl_thd_alloc(waiter_fn, NULL);
+	sl_thd_param_set(waiter, sched_param_pack(SCHEDP_PRIO, HIGH_PRIORITY));
+	/* let the waiter run, and block in sl_evt_wait */
+	sl_thd_yield(0);
+	assert(!waiter_got && evts.waiter == waiter->thdid);
+	/* it preempts us as soon as the event triggers */
+	sl_evt_trigger(&evts, ids[0]);
+	assert(waiter_got);
+}
+
+static void
+trigger_fn()
+{
+	sl_thd_block_timeout(0, sl_now() + sl_usec2cyc(1000));
+	sl_evt_trigger(&evts, ids[3]);
+	sl_thd_exit();
+}
+
+/*
+ * While we wait, nothing is runnable, so the scheduler thread idles
+ * in its rcv: the timer's events must still get to it.
+ */
+static void
+test_idle_rcv(void)
+{
+	struct sl_thd *   trigger;
+	struct sl_evt_res r;
+
+	sl_idle_rcv(1);
+	assert(sl_evt_wait(&evts, &r, 1, sl_now() + sl_usec2cyc(1000)) == 0);
+
+	trigger = sl_thd_alloc(trigger_fn, NULL);
+	sl_thd_param_set(trigger, sched_param_pack(SCHEDP_PRIO, HIGH_PRIORITY));
+	assert(sl_evt_wait(&evts, &r, 1, 0) == 1);
+	assert(r.id == ids[3]);
+	sl_idle_rcv(0);
+}
+
+static void
+run_tests()
+{
+	sl_evt_init(&evts, &evts_shm);
+
+	test_batch();
+	printc("Test successful! A batch of edge-triggered events!\n");
+	test_timeout();
+	printc("Test successful! Waiting timed out!\n");
+	test_stalled();
+	printc("Test successful! A preempted producer didn't hold up the others!\n");
+	test_wakeup();
+	printc("Test successful! A trigger woke the waiter!\n");
+	test_idle_rcv();
+	printc("Test successful! Idling in the scheduler's rcv, timeouts still fired!\n");
+
+	printc("Done testing, spinning...\n");
+	SPIN();
+}
+
+void
+cos_init(void)
+{
+	struct sl_thd *testing_thread;
+	struct cos_defcompinfo *defci = cos_defcompinfo_curr_get();
+	struct cos_compinfo *   ci    = cos_compinfo_get(defci);
+
+	printc("Unit-test for the sl event sets (sl_evt)\n");
+	cos_meminfo_init(&(ci->mi), BOOT_MEM_KM_BASE, COS_MEM_KERN_PA_SZ, BOOT_CAPTBL_SELF_UNTYPED_PT);
+	cos_defcompinfo_init();
+	sl_init(SL_MIN_PERIOD_US);
+
+	testing_thread = sl_thd_alloc(run_tests, NULL);
+	sl_thd_param_set(testing_thread, sched_param_pack(SCHEDP_PRIO, LOWEST_PRIORITY));
+
+	sl_sched_loop();
+
+	assert(0);
+
+	return;
+}
@@ -0,0 +1,33 @@
+#include <cos_component.h>
+#include <cos_kernel_api.h>
+#include <cos_debug.h>
+#include <llprint.h>
+#include <stacktest.h>
+
+#define TEST_NCALLS 16
+
+static void
+test_stacks(void)
+{
+	vaddr_t s = stacktest_stack();
+	int     i;
+
+	/*
+	 * The server's freelist was empty, and its pool exhausted: the
+	 * stub requested a stack (COS_ASM_REQUEST_STACK) that the manager
+	 * mapped, and returned it to the freelist, to be reused.
+	 */
+	assert(s);
+	for (i = 0; i < TEST_NCALLS; i++) assert(stacktest_stack() == s);
+	printc("\tInvocations ran on a stack granted on demand, and reused it.\n");
+}
+
+void
+cos_init(void)
+{
+	printc("Unit-test for the invocation stacks\n");
+	test_stacks();
+	printc("Unit-test for the invocation stacks done.\n");
+
+	cos_sinv(BOOT_CAPTBL_SINV_CAP, 1, 2, 3, 4);
+}
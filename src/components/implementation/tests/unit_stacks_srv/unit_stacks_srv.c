@@ -0,0 +1,42 @@
+#include <cos_component.h>
+#include <cos_kernel_api.h>
+#include <cos_debug.h>
+#include <llprint.h>
+#include <cos_stacks.h>
+#include <stacktest.h>
+
+/* The stack manager maps its stacks above our initial heap. */
+static vaddr_t heap_base;
+
+vaddr_t
+stacktest_stack(void)
+{
+	vaddr_t s = (vaddr_t)&s;
+
+	/* the pool is exhausted, so the stub got this stack from the manager */
+	assert(s >= heap_base);
+
+	return round_to_page(s);
+}
+
+void
+cos_init(void)
+{
+	void *s;
+	int   i;
+
+	printc("Unit-test for the invocation stacks (server)\n");
+	heap_base = (vaddr_t)cos_get_heap_ptr();
+
+	/* our initialization's upcall took the first stack of the pool */
+	for (i = 1; i < COS_STACKS_POOL; i++) {
+		s = cos_stack_grant(cos_cpuid());
+		assert(s && (vaddr_t)s < heap_base);
+	}
+	s = cos_stack_grant(cos_cpuid());
+	assert(s && (vaddr_t)s >= heap_base);
+	memset(s, 0, COS_STACK_SZ);
+	printc("\tExhausted the pool of %d stacks, then mapped one from the manager.\n", COS_STACKS_POOL);
+
+	cos_sinv(BOOT_CAPTBL_SINV_CAP, 1, 2, 3, 4);
+}
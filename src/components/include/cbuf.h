@@ -0,0 +1,134 @@
+/**
+ * Redistribution of this file is permitted under the GNU General
+ * Public License v2.
+ *
+ * Zero-copy shared buffers (cbufs).
+ *
+ * A cbuf is a power-of-two number of pages, owned by a cbuf manager
+ * (a component with the page-tables of its clients, e.g. the
+ * llbooter), and mapped lazily into each client that calls cbuf2buf
+ * on it.  A cbuf is passed between components by its id (a cbuf_t)
+ * in invocation registers, and its contents are never copied.
+ *
+ * Each buffer is mapped at the same offset of a per-client window of
+ * virtual memory, so the manager only tracks the window's base for
+ * each client.  The reference counts of all cbufs are kept in an array
+ * that is shared between the manager and all clients, so sending
+ * (cbuf_send) and releasing (cbuf_free) a cbuf only invokes the
+ * manager when the last reference is dropped.  The rest of the meta
+ * data (the owner, and where each cbuf is mapped) is only written by
+ * the manager, and is mapped read-only into the clients.
+ *
+ * The owner (the component that allocated the cbuf) maps it
+ * read-write, and other components read-only, unless it was allocated
+ * with cbuf_alloc_shared.
+ */
+
+#ifndef CBUF_H
+#define CBUF_H
+
+#include <cos_kernel_api.h>
+
+typedef u32_t cbuf_t;
+
+/* cbuf sizes are PAGE_SIZE << order */
+#define CBUF_MIN_ORDER 0
+#define CBUF_MAX_ORDER 4
+#define CBUF_NORDERS (CBUF_MAX_ORDER - CBUF_MIN_ORDER + 1)
+#define CBUF_PER_ORDER 128
+#define CBUF_MAX (CBUF_NORDERS * CBUF_PER_ORDER)
+
+#define CBUF_MAPPED_WORDS ((MAX_NUM_SPDS + 31) / 32)
+
+/* The meta-data of each cbuf, read-only in the clients */
+struct cbuf_meta {
+	u32_t mapped[CBUF_MAPPED_WORDS]; /* the components it is mapped into, bit spdid - 1 */
+	u16_t owner;                     /* spdid of the last component to allocate it */
+	u16_t flags;
+};
+
+/* cbuf_meta flags */
+#define CBUF_FLAG_SHARED 1 /* other components may write it too */
+
+/* cbuf ids start at 1 so that 0 is never a valid cbuf */
+#define CBUF_META_SZ round_up_to_page(sizeof(struct cbuf_meta) * (CBUF_MAX + 1))
+#define CBUF_REFCNT_SZ round_up_to_page(sizeof(unsigned long) * (CBUF_MAX + 1))
+#define CBUF_HDR_SZ (CBUF_META_SZ + CBUF_REFCNT_SZ)
+/* the meta array, the reference counts, and the buffers of each order */
+#define CBUF_VAS_SZ (CBUF_HDR_SZ + CBUF_PER_ORDER * PAGE_SIZE * ((1 << CBUF_NORDERS) - 1))
+#define CBUF_VAS_WINDOW round_up_to_pgd_page(CBUF_VAS_SZ)
+
+/*
+ * The manager's operations, passed as the first argument of its
+ * invocations.  They are distinct from the llbooter's own (1: the
+ * calling component's initialization is done).
+ */
+typedef enum {
+	CBUF_OP_REGISTER = 16, /* arg: the client's window, returns the meta array */
+	CBUF_OP_ALLOC,         /* arg: order | CBUF_ALLOC_SHARED, returns the cbuf */
+	CBUF_OP_MAP,           /* arg: cbuf, returns its address in the client */
+	CBUF_OP_FREE,          /* arg: cbuf, the last reference has been dropped */
+} cbuf_op_t;
+
+#define CBUF_ALLOC_SHARED (1 << 8)
+
+static inline int
+cbuf_valid(cbuf_t cb)
+{
+	return cb > 0 && cb <= CBUF_MAX;
+}
+
+static inline unsigned int
+cbuf_order(cbuf_t cb)
+{
+	return CBUF_MIN_ORDER + (cb - 1) / CBUF_PER_ORDER;
+}
+
+static inline int
+cbuf_meta_mapped(struct cbuf_meta *m, spdid_t spdid)
+{
+	return (((volatile u32_t *)m->mapped)[(spdid - 1) / 32] >> ((spdid - 1) % 32)) & 1;
+}
+
+static inline unsigned long
+cbuf_size(cbuf_t cb)
+{
+	return PAGE_SIZE << cbuf_order(cb);
+}
+
+/* The offset of the cbuf in each client's window */
+static inline unsigned long
+cbuf_offset(cbuf_t cb)
+{
+	unsigned int o   = cbuf_order(cb) - CBUF_MIN_ORDER;
+	unsigned int idx = (cb - 1) % CBUF_PER_ORDER;
+
+	return CBUF_HDR_SZ + CBUF_PER_ORDER * PAGE_SIZE * ((1 << o) - 1) + idx * (PAGE_SIZE << o);
+}
+
+static inline cbuf_t
+cbuf_id(unsigned int order, unsigned int idx)
+{
+	return (order - CBUF_MIN_ORDER) * CBUF_PER_ORDER + idx + 1;
+}
+
+/*
+ * The client library.  cbuf_client_init reserves the window at the
+ * top of the heap, and registers it with the manager reached through
+ * the mgr invocation capability.
+ */
+int   cbuf_client_init(sinvcap_t mgr);
+/* Allocate a cbuf of at least sz bytes, and return its address in *buf. */
+cbuf_t cbuf_alloc(unsigned long sz, void **buf);
+/* As cbuf_alloc, but the components it is sent to may write it too. */
+cbuf_t cbuf_alloc_shared(unsigned long sz, void **buf);
+/* The address of the cbuf (of at least len bytes), mapping it on first use. */
+void *cbuf2buf(cbuf_t cb, unsigned long len);
+/* Is the cbuf mapped writable into us (we own it, or it is shared)? */
+int   cbuf_writable(cbuf_t cb);
+/* Take a reference for a component we're passing the cbuf to. */
+void  cbuf_send(cbuf_t cb);
+/* Drop a reference (the allocation's, or one from a cbuf_send). */
+void  cbuf_free(cbuf_t cb);
+
+#endif /* CBUF_H */
@@ -0,0 +1,52 @@
+/**
+ * Redistribution of this file is permitted under the GNU General
+ * Public License v2.
+ *
+ * The cbuf manager: owns the memory of all cbufs, and maps them into
+ * the clients whose page-tables it has (see cbuf.h).  It is a library
+ * for whichever component holds the clients' cos_compinfos (e.g. the
+ * llbooter), and that component forwards its clients' invocations to
+ * cbuf_mgr_invoke.
+ */
+
+#ifndef CBUF_MGR_H
+#define CBUF_MGR_H
+
+#include <cos_kernel_api.h>
+#include <cbuf.h>
+
+/* Each core allocates from, and frees to, its own freelists. */
+struct cbuf_mgr_freelist {
+	unsigned long lock;
+	int           n[CBUF_NORDERS];
+	u16_t         cbs[CBUF_NORDERS][CBUF_PER_ORDER];
+} CACHE_ALIGNED;
+
+struct cbuf_mgr_client {
+	struct cos_compinfo *ci;   /* the client's page-table */
+	vaddr_t              base; /* its window, 0 until it registers */
+};
+
+struct cbuf_mgr {
+	/* the manager's own memory, guarded by lock/unlock */
+	struct cos_compinfo *ci;
+	void (*lock)(void);
+	void (*unlock)(void);
+
+	struct cbuf_meta *meta;   /* only the manager writes it */
+	unsigned long *   refcnt; /* written by the clients */
+	vaddr_t           bufs[CBUF_MAX + 1]; /* each cbuf in the manager */
+	unsigned long     inuse[CBUF_MAX + 1];
+	unsigned int      ncreated[CBUF_NORDERS];
+
+	struct cbuf_mgr_client   clients[MAX_NUM_SPDS + 1];
+	struct cbuf_mgr_freelist freelists[NUM_CPU];
+};
+
+void cbuf_mgr_init(struct cbuf_mgr *m, struct cos_compinfo *ci, void (*lock)(void), void (*unlock)(void));
+/* Add the component spdid, whose page-table is client->pgtbl_cap. */
+void cbuf_mgr_client_add(struct cbuf_mgr *m, spdid_t spdid, struct cos_compinfo *client);
+/* Serve a client's operation (see cbuf_op_t). */
+long cbuf_mgr_invoke(struct cbuf_mgr *m, spdid_t spdid, cbuf_op_t op, unsigned long arg);
+
+#endif /* CBUF_MGR_H */
@@ -31,6 +31,14 @@
  *
  * Pending additions: 1) exported function names, 2) undefined function
  * names, 3) thread state
+ *
+ * Page-aligned (COBJ_PAGE_ALIGNED) objects are produced by cobj_pack:
+ * the header is page-aligned, the size is a multiple of a page, and
+ * each uncompressed section body starts on a page boundary so that it
+ * can be mapped, rather than copied, into the component.  Sections
+ * with COBJ_SECT_COMPRESSED have bodies that are compressed with
+ * cobj_lz_compress; their payload is the compressed size, while bytes
+ * is always the size in memory.  Zero-filled sections have no body.
  */
 
 /* Currently assume that nsect == 4, data, text, bss, initonce*/
@@ -40,9 +48,20 @@
 /* cobj flags */
 enum
 {
-	COBJ_INIT_THD = 1,
+	COBJ_INIT_THD     = 1,
+	COBJ_PAGE_ALIGNED = 1 << 1,
 };
 
+/*
+ * The format version lives in the top byte of the header's flags, and
+ * is set by cobj_create.  Version 1 added the sections' payload (and
+ * so changed the size of struct cobj_sect); objects without a version
+ * predate it and can't be parsed.
+ */
+#define COBJ_VERSION 1
+#define COBJ_VERSION_SHIFT 24
+#define COBJ_VERSION_MASK (0xFFUL << COBJ_VERSION_SHIFT)
+
 struct cobj_header {
 	u32_t id, nsect, nsymb, ncap, size, flags;
 	char  name[COBJ_NAME_SZ];
@@ -50,19 +69,21 @@ struct cobj_header {
 
 enum
 {
-	COBJ_SECT_UNINIT   = 0,
-	COBJ_SECT_READ     = 0x1,
-	COBJ_SECT_WRITE    = 0x2,
-	COBJ_SECT_ZEROS    = 0x8,
-	COBJ_SECT_INITONCE = 0x10,
-	COBJ_SECT_KMEM     = 0x20,
-	COBJ_SECT_CINFO    = 0x40,
+	COBJ_SECT_UNINIT     = 0,
+	COBJ_SECT_READ       = 0x1,
+	COBJ_SECT_WRITE      = 0x2,
+	COBJ_SECT_ZEROS      = 0x8,
+	COBJ_SECT_INITONCE   = 0x10,
+	COBJ_SECT_KMEM       = 0x20,
+	COBJ_SECT_CINFO      = 0x40,
+	COBJ_SECT_COMPRESSED = 0x80,
 };
 
 struct cobj_sect {
 	u32_t flags;
 	u32_t offset;
 	u32_t vaddr, bytes;
+	u32_t payload; /* bytes of the body in the object */
 } __attribute__((packed));
 
 enum
@@ -112,6 +133,35 @@ char *cobj_sect_contents(struct cobj_header *h, unsigned int sect_id);
 u32_t cobj_sect_size(struct cobj_header *h, unsigned int sect_id);
 u32_t cobj_sect_addr(struct cobj_header *h, unsigned int sect_id);
 
+u32_t cobj_sect_payload(struct cobj_header *h, unsigned int sect_id);
+/* Is the section read-only, and does it occupy its pages alone? */
+int   cobj_sect_shareable(struct cobj_header *h, unsigned int sect_id);
+/* Do two sections have the same contents (at any address)? */
+int   cobj_sect_identical(struct cobj_header *h1, unsigned int s1, struct cobj_header *h2, unsigned int s2);
+/* Can the section's body be mapped directly into the component? */
+int   cobj_sect_mappable(struct cobj_header *h, unsigned int sect_id);
+/* Decompress the section's body into mem (of cobj_sect_size bytes). */
+int   cobj_sect_decompress(struct cobj_header *h, unsigned int sect_id, char *mem);
+
+/*
+ * Repack h into a page-aligned object in space (which must be
+ * page-aligned, and at least cobj_pack_size_req(h) bytes),
+ * compressing read-only sections if compress is set.
+ */
+u32_t               cobj_pack_size_req(struct cobj_header *h);
+struct cobj_header *cobj_pack(struct cobj_header *h, char *space, u32_t sz, int compress);
+
+/* LZ4-style compression: returns the output size, or 0 if it doesn't fit in dst_sz. */
+u32_t cobj_lz_compress(const char *src, u32_t src_sz, char *dst, u32_t dst_sz);
+/* returns the decompressed size, or 0 on a malformed input */
+u32_t cobj_lz_decompress(const char *src, u32_t src_sz, char *dst, u32_t dst_sz);
+
+static inline u32_t
+cobj_version(struct cobj_header *h)
+{
+	return (h->flags & COBJ_VERSION_MASK) >> COBJ_VERSION_SHIFT;
+}
+
 static inline int
 cobj_cap_undef(struct cobj_cap *c)
 {
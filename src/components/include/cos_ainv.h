@@ -0,0 +1,118 @@
+/**
+ * Redistribution of this file is permitted under the GNU General
+ * Public License v2.
+ *
+ * Asynchronous invocations on shared-memory channels (cos_chan.h).
+ *
+ * A client posts requests into its submission ring, and keeps
+ * running.  The server's thread drains the requests of all of its
+ * clients' rings in batches, and posts the results into each client's
+ * completion ring, which the client polls, or waits on through its
+ * arcv end-point.  Each side is only notified when a ring goes from
+ * empty to non-empty, so a batch of calls costs a couple of asnds,
+ * rather than a pair of switches per call.
+ *
+ * The server knows a client by the ring its requests come from, so a
+ * client can't make calls, or receive completions, as another.  A
+ * client may have no more requests outstanding than its completion
+ * ring holds; the server drops those that don't fit.
+ *
+ * A component with the page-tables of the server and its clients sets
+ * up the rings, aliases them into each (cos_chan_alias), and gives each
+ * end its rings and notification capabilities.
+ */
+
+#ifndef COS_AINV_H
+#define COS_AINV_H
+
+#include <cos_chan.h>
+
+#define COS_AINV_MAX_CLIENTS 16
+/* the most requests drained, or completions consumed, at once */
+#define COS_AINV_BATCH 32
+
+struct cos_ainv_req {
+	u32_t id; /* returned in the completion */
+	u32_t op;
+	long  args[3];
+};
+
+struct cos_ainv_cmpl {
+	u32_t id;
+	long  ret;
+};
+
+typedef long (*cos_ainv_fn_t)(u16_t client, u32_t op, long a0, long a1, long a2);
+
+struct cos_ainv_client {
+	struct cos_chan *sq;      /* our submission ring */
+	struct cos_chan *cq;      /* our completion ring */
+	asndcap_t        srv_snd; /* to the server's rcv */
+	arcvcap_t        rcv;     /* our thread's end-point for completions */
+	u32_t            next_id;
+	unsigned int     outstanding; /* at most the capacity of cq */
+};
+
+struct cos_ainv_srv {
+	arcvcap_t     rcv;
+	cos_ainv_fn_t fn;
+	struct cos_ainv_srv_client {
+		struct cos_chan *sq, *cq;
+		asndcap_t        snd;
+	} clients[COS_AINV_MAX_CLIENTS];
+};
+
+/*
+ * Post a request, and return its id (never 0), or 0 if as many
+ * requests are outstanding as our completion ring can hold.
+ */
+static inline u32_t
+cos_ainv_call(struct cos_ainv_client *c, u32_t op, long a0, long a1, long a2)
+{
+	struct cos_ainv_req r;
+
+	if (unlikely(c->outstanding == cos_chan_capacity(c->cq))) return 0;
+
+	if (unlikely(!++c->next_id)) c->next_id++;
+	r = (struct cos_ainv_req){ .id = c->next_id, .op = op, .args = { a0, a1, a2 } };
+	if (!cos_chan_enqueue_spsc(c->sq, &r, 1, c->srv_snd)) return 0;
+	c->outstanding++;
+
+	return r.id;
+}
+
+/* Take up to n completions without blocking. */
+static inline unsigned int
+cos_ainv_poll(struct cos_ainv_client *c, struct cos_ainv_cmpl *cmpls, unsigned int n)
+{
+	unsigned int ret = cos_chan_dequeue(c->cq, cmpls, n);
+
+	c->outstanding -= ret;
+
+	return ret;
+}
+
+/* Take at least one, and up to n, completions. */
+static inline unsigned int
+cos_ainv_wait(struct cos_ainv_client *c, struct cos_ainv_cmpl *cmpls, unsigned int n)
+{
+	unsigned int ret;
+
+	assert(c->outstanding);
+	ret = cos_chan_dequeue_wait(c->cq, cmpls, n, c->rcv);
+	c->outstanding -= ret;
+
+	return ret;
+}
+
+void cos_ainv_client_init(struct cos_ainv_client *c, struct cos_chan *sq, struct cos_chan *cq, asndcap_t srv_snd,
+                          arcvcap_t rcv);
+void cos_ainv_srv_init(struct cos_ainv_srv *s, arcvcap_t rcv, cos_ainv_fn_t fn);
+/* The client's requests come from sq, and complete into cq (notifying snd). */
+int  cos_ainv_srv_client_add(struct cos_ainv_srv *s, u16_t client, struct cos_chan *sq, struct cos_chan *cq,
+                             asndcap_t snd);
+/* Serve a batch of requests, waiting for one if there are none.  Returns the number served. */
+int  cos_ainv_srv_process(struct cos_ainv_srv *s);
+void cos_ainv_srv_loop(struct cos_ainv_srv *s) __attribute__((noreturn));
+
+#endif /* COS_AINV_H */
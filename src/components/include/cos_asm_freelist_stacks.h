@@ -0,0 +1,113 @@
+#ifndef COS_ASM_FREELIST_STACKS_H
+#define COS_ASM_FREELIST_STACKS_H
+
+/*
+ * Invocation stacks taken on demand from per-core freelists (see
+ * cos_stacks.h), instead of a static stack per thread.
+ *
+ * The head of a core's freelist is the address of its first free
+ * stack, tagged in its low (otherwise zero) bits with a generation
+ * that each update increments, so that a preempted pop or push fails
+ * its cmpxchg if other threads have since changed the list (ABA).
+ * Only a core's threads use its freelist, so the cmpxchg is atomic
+ * without a lock prefix.  A free stack's next pointer is at its base.
+ *
+ * The pop needs more registers than are free on entry, so it is done
+ * on a small per-thread stack (cos_stack_tmp), which is also where
+ * cos_stack_grant is called when the freelist is empty.
+ */
+
+#ifndef MAX_STACK_SZ_BYTE_ORDER
+#error "Missing MAX_STACK_SZ_BYTE_ORDER, try including consts.h"
+#endif
+
+#define COS_STACK_FL_SZ (1 << MAX_STACK_SZ_BYTE_ORDER)
+#define COS_STACK_FL_TAG (COS_STACK_FL_SZ - 1)
+#define COS_STACK_FL_ORDER 6   /* log2(sizeof(struct cos_stack_fl)) */
+#define COS_STACK_TMP_ORDER 7  /* log2(TMP_STACK_SZ * 4) */
+
+/* clang-format off */
+
+/*
+ * %eax = cpuid << 16 | thdid.  Preserves the arguments: %ebx, %ecx,
+ * %esi, %edi, and %ebp.
+ */
+#define COS_ASM_GET_STACK                                          \
+	movl %eax, %edx;                                           \
+	andl $0xffff, %edx;                                        \
+	shl $COS_STACK_TMP_ORDER, %edx;                            \
+	leal cos_stack_tmp+(1 << COS_STACK_TMP_ORDER)(%edx), %esp; \
+	pushl %eax;                                                \
+	pushl %ebx;                                                \
+	pushl %ecx;                                                \
+	pushl %esi;                                                \
+	movl %eax, %ebx;                                           \
+	shr $16, %ebx;                                             \
+	shl $COS_STACK_FL_ORDER, %ebx;                             \
+	addl $cos_stack_freelists, %ebx;                           \
+1:                                                                 \
+	movl (%ebx), %eax;                                         \
+	movl %eax, %edx;                                           \
+	andl $~COS_STACK_FL_TAG, %edx;                             \
+	je 2f;                                                     \
+	movl (%edx), %ecx;                                         \
+	andl $~COS_STACK_FL_TAG, %ecx;                             \
+	leal 1(%eax), %esi;                                        \
+	andl $COS_STACK_FL_TAG, %esi;                              \
+	orl %ecx, %esi;                                            \
+	cmpxchgl %esi, (%ebx);                                     \
+	jne 1b;                                                    \
+3:                                                                 \
+	/* %edx is our stack: move to it */                        \
+	popl %esi;                                                 \
+	popl %ecx;                                                 \
+	popl %ebx;                                                 \
+	popl %eax;                                                 \
+	leal COS_STACK_FL_SZ(%edx), %esp;                          \
+	movl %eax, %edx;                                           \
+	shr $16, %edx;                                             \
+	pushl %edx;     /* cpu id */                               \
+	andl $0xffff, %eax;                                        \
+	pushl %eax;     /* thd id */
+
+/*
+ * Push the stack back on the freelist of its core (saved at its top).
+ * Preserves %ecx (the return value), %esi, and %edi.  We don't use
+ * the stack after it is on the freelist.
+ */
+#define COS_ASM_RET_STACK                                          \
+	movl %esp, %edx;                                           \
+	andl $~COS_STACK_FL_TAG, %edx;                             \
+	movl COS_STACK_FL_SZ-4(%edx), %ebx;                        \
+	shl $COS_STACK_FL_ORDER, %ebx;                             \
+	addl $cos_stack_freelists, %ebx;                           \
+4:                                                                 \
+	movl (%ebx), %eax;                                         \
+	movl %eax, (%edx);                                         \
+	leal 1(%eax), %esp;                                        \
+	andl $COS_STACK_FL_TAG, %esp;                              \
+	orl %edx, %esp;                                            \
+	cmpxchgl %esp, (%ebx);                                     \
+	jne 4b;                                                    \
+	movl $RET_CAP, %eax;
+
+/*
+ * The freelist is empty (out of line, after the sysenter): get a new
+ * stack.  If there is no memory for one, we can only wait for another
+ * thread on the core to free one.
+ */
+#define COS_ASM_REQUEST_STACK                                      \
+2:                                                                 \
+	movl 12(%esp), %eax;                                       \
+	shr $16, %eax;                                             \
+	pushl %eax;                                                \
+	call cos_stack_grant;                                      \
+	addl $4, %esp;                                             \
+	movl %eax, %edx;                                           \
+	testl %edx, %edx;                                          \
+	jne 3b;                                                    \
+	jmp 1b;
+
+/* clang-format on */
+
+#endif
@@ -0,0 +1,62 @@
+/**
+ * Redistribution of this file is permitted under the GNU General
+ * Public License v2.
+ */
+
+#ifndef COS_ASM_SERVER_STUB_FREELIST_STACK_H
+#define COS_ASM_SERVER_STUB_FREELIST_STACK_H
+
+#include "../../kernel/include/asm_ipc_defs.h"
+#include <cos_asm_freelist_stacks.h>
+
+/*
+ * The server stubs of cos_asm_server_stub_simple_stack.h, on stacks
+ * taken from the per-core freelists.  Components with these stubs
+ * must link with freelist_stklib.o (MANDITORY_LIB), and the stubs
+ * must include consts.h (with __ASM__ defined) first.
+ */
+
+/* clang-format off */
+
+#define cos_asm_server_stub(name) \
+.globl name##_inv ;               \
+.type  name##_inv, @function ;	  \
+.align 16 ;			  \
+name##_inv:                       \
+        COS_ASM_GET_STACK         \
+	pushl %ebp;		  \
+	xor %ebp, %ebp;		  \
+        pushl %edi;	          \
+        pushl %esi;	          \
+        pushl %ebx;	          \
+        call name ;		  \
+        addl $16, %esp;           \
+                                  \
+        movl %eax, %ecx;          \
+        COS_ASM_RET_STACK         \
+                                  \
+        sysenter;                 \
+        COS_ASM_REQUEST_STACK
+
+#define cos_asm_server_stub_token(name) \
+.globl name##_inv ;                     \
+.type  name##_inv, @function ;	        \
+.align 16 ;			        \
+name##_inv:                             \
+        COS_ASM_GET_STACK               \
+	pushl %ebp;		        \
+	xor %ebp, %ebp;			\
+        pushl %edi;	                \
+        pushl %esi;	                \
+        pushl %ecx;	                \
+        call name ;		        \
+        addl $16, %esp;                 \
+                                        \
+        movl %eax, %ecx;                \
+        COS_ASM_RET_STACK		\
+                                        \
+        sysenter;                       \
+        COS_ASM_REQUEST_STACK
+/* clang-format on */
+
+#endif /* COS_ASM_SERVER_STUB_FREELIST_STACK_H */
@@ -0,0 +1,211 @@
+/**
+ * Redistribution of this file is permitted under the GNU General
+ * Public License v2.
+ *
+ * Shared-memory channels between components.
+ *
+ * A channel is a ring of fixed-size entries (after ck_ring, see
+ * archives/ck_ring_cos.h) in pages that are aliased into both the
+ * producer(s) and the consumer.  Entries are enqueued and dequeued in
+ * batches, without any invocation.  The producer only notifies the
+ * consumer (cos_asnd) when the ring goes from empty to non-empty, and
+ * never while the consumer is polling it.
+ *
+ * The single-producer enqueue must only be used if there is one
+ * producer; the multi-producer one can be used by any number.  There
+ * is always a single consumer.
+ *
+ * Producers reserve entries by advancing tail, and publish each one
+ * by setting its sequence number (after the ring) to its index + 1.
+ * The consumer takes the published entries in order, so a producer
+ * that is preempted after reserving never makes others wait for it:
+ * the consumer only waits for its entries, and is notified by it.
+ */
+
+#ifndef COS_CHAN_H
+#define COS_CHAN_H
+
+#include <cos_kernel_api.h>
+#include <ps.h>
+#include <string.h>
+
+struct cos_chan {
+	/* written by the consumer */
+	unsigned long head CACHE_ALIGNED;
+	unsigned long polling; /* the consumer doesn't need notifications */
+	/* written by the producers */
+	unsigned long tail CACHE_ALIGNED; /* entries up to tail are reserved */
+	/* read-only after initialization */
+	unsigned int esz CACHE_ALIGNED;
+	unsigned int mask;
+	char         ring[0] CACHE_ALIGNED; /* followed by the sequence numbers */
+};
+
+#define COS_CHAN_RING_SZ(esz, nents) round_up_to_pow2((esz) * (nents), sizeof(unsigned long))
+#define COS_CHAN_SZ(esz, nents)                                                                     \
+	round_up_to_page(sizeof(struct cos_chan) + COS_CHAN_RING_SZ(esz, nents) + sizeof(unsigned long) * (nents))
+
+static inline unsigned int
+cos_chan_capacity(struct cos_chan *c)
+{
+	return c->mask + 1;
+}
+
+/* The entries in the ring, including those still being written. */
+static inline unsigned int
+cos_chan_size(struct cos_chan *c)
+{
+	return ps_load(&c->tail) - ps_load(&c->head);
+}
+
+static inline unsigned long *
+__cos_chan_seq(struct cos_chan *c, unsigned long idx)
+{
+	return &((unsigned long *)&c->ring[COS_CHAN_RING_SZ(c->esz, c->mask + 1)])[idx & c->mask];
+}
+
+/* Has entry idx been published? */
+static inline int
+__cos_chan_ready(struct cos_chan *c, unsigned long idx)
+{
+	return ps_load(__cos_chan_seq(c, idx)) == idx + 1;
+}
+
+/* Can the consumer dequeue an entry? */
+static inline int
+cos_chan_ready(struct cos_chan *c)
+{
+	return __cos_chan_ready(c, c->head);
+}
+
+/* Copy n entries to/from the ring, starting at index idx. */
+static inline void
+__cos_chan_copy(struct cos_chan *c, unsigned long idx, void *ents, unsigned int n, int to_ring)
+{
+	unsigned int off   = (idx & c->mask) * c->esz;
+	unsigned int first = (c->mask + 1 - (idx & c->mask)) * c->esz;
+	unsigned int sz    = n * c->esz;
+
+	if (first > sz) first = sz;
+	if (to_ring) {
+		memcpy(&c->ring[off], ents, first);
+		memcpy(c->ring, (char *)ents + first, sz - first);
+	} else {
+		memcpy(ents, &c->ring[off], first);
+		memcpy((char *)ents + first, c->ring, sz - first);
+	}
+}
+
+/*
+ * Publish the n entries from r.  Notify the consumer if it may be
+ * waiting for one of them (i.e. it found the ring empty), and isn't
+ * polling: either we see its head, or it sees our entries.
+ */
+static inline void
+__cos_chan_publish(struct cos_chan *c, unsigned long r, unsigned int n, asndcap_t snd)
+{
+	unsigned int i;
+
+	ps_mem_fence();
+	for (i = 0; i < n; i++) *__cos_chan_seq(c, r + i) = r + i + 1;
+	ps_mem_fence();
+	if (snd && ps_load(&c->head) - r < n && !ps_load(&c->polling)) cos_asnd(snd, 0);
+}
+
+/* Enqueue up to n entries, returns the number enqueued. */
+static inline unsigned int
+cos_chan_enqueue_spsc(struct cos_chan *c, const void *ents, unsigned int n, asndcap_t snd)
+{
+	unsigned long t    = c->tail;
+	unsigned int  free = cos_chan_capacity(c) - (t - ps_load(&c->head));
+
+	if (n > free) n = free;
+	if (!n) return 0;
+
+	c->tail = t + n;
+	__cos_chan_copy(c, t, (void *)ents, n, 1);
+	__cos_chan_publish(c, t, n, snd);
+
+	return n;
+}
+
+static inline unsigned int
+cos_chan_enqueue_mpsc(struct cos_chan *c, const void *ents, unsigned int n, asndcap_t snd)
+{
+	unsigned long r;
+	unsigned int  free;
+
+	/* reserve our entries */
+	do {
+		r    = ps_load(&c->tail);
+		free = cos_chan_capacity(c) - (r - ps_load(&c->head));
+		if (n > free) n = free;
+		if (!n) return 0;
+	} while (!ps_cas(&c->tail, r, r + n));
+
+	__cos_chan_copy(c, r, (void *)ents, n, 1);
+	__cos_chan_publish(c, r, n, snd);
+
+	return n;
+}
+
+/* Dequeue up to n entries, returns the number dequeued. */
+static inline unsigned int
+cos_chan_dequeue(struct cos_chan *c, void *ents, unsigned int n)
+{
+	unsigned long h = c->head;
+	unsigned int  avail;
+
+	/* the entries published in order, up to the first that isn't */
+	for (avail = 0; avail < n && __cos_chan_ready(c, h + avail); avail++)
+		;
+	if (!avail) return 0;
+	n = avail;
+
+	ps_mem_fence();
+	__cos_chan_copy(c, h, ents, n, 0);
+	ps_mem_fence();
+	c->head = h + n;
+
+	return n;
+}
+
+/*
+ * Suppress notifications while we poll.  Stopping polling returns 1
+ * if an entry is ready, so that we don't wait for a notification
+ * that was suppressed.
+ */
+static inline int
+cos_chan_poll(struct cos_chan *c, int on)
+{
+	c->polling = on;
+	ps_mem_fence();
+
+	return !on && cos_chan_ready(c);
+}
+
+/*
+ * Dequeue at least one entry, waiting for notifications on rcv (the
+ * receive end-point of the consumer's thread) while the ring is empty.
+ */
+static inline unsigned int
+cos_chan_dequeue_wait(struct cos_chan *c, void *ents, unsigned int n, arcvcap_t rcv)
+{
+	unsigned int ret;
+
+	while (!(ret = cos_chan_dequeue(c, ents, n))) {
+		/* make our head visible before checking the ring again */
+		ps_mem_fence();
+		if (cos_chan_ready(c)) continue;
+		cos_rcv(rcv, 0, NULL);
+	}
+
+	return ret;
+}
+
+/* Allocate a channel of nents (a power of 2) entries of esz bytes in ci. */
+struct cos_chan *cos_chan_alloc(struct cos_compinfo *ci, unsigned int esz, unsigned int nents);
+/* Alias the channel c of srcci into dstci, and return its address there. */
+vaddr_t cos_chan_alias(struct cos_compinfo *dstci, struct cos_compinfo *srcci, struct cos_chan *c);
+
+#endif /* COS_CHAN_H */
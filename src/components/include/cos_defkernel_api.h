@@ -77,6 +77,16 @@ void cos_defcompinfo_init_ext(tcap_t sched_tc, thdcap_t sched_thd, arcvcap_t sch
 int cos_defcompinfo_child_alloc(struct cos_defcompinfo *child_defci, vaddr_t entry, vaddr_t heap_ptr,
                                 capid_t cap_frontier, int is_sched);
 
+/*
+ * cos_defcompinfo_fork: like cos_defcompinfo_child_alloc, but the child is a copy-on-write clone of parent_defci:
+ * its capabilities are copied, and its memory in [vas_base, heap) is shared copy-on-write. The child starts at entry
+ * with the parent's (already initialized) memory, except for the nshared ranges in shared, which stay shared
+ * with the parent (see cos_compinfo_fork). Frames to resolve write faults must be donated with
+ * cos_mem_cow_reserve.
+ */
+int cos_defcompinfo_fork(struct cos_defcompinfo *child_defci, struct cos_defcompinfo *parent_defci, vaddr_t entry,
+                         vaddr_t vas_base, struct cos_vas_range *shared, int nshared, int is_sched);
+
 /*
  * cos_aep_alloc: creates a new async activation end-point which includes thread, tcap and rcv capabilities.
  *                struct cos_aep_info passed in, must not be stack allocated.
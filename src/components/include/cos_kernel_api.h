@@ -76,6 +76,12 @@ struct cos_compinfo {
 	struct cos_meminfo   mi;     /* only populated for the component with real memory */
 };
 
+/* A range of virtual memory, [addr, addr + sz) */
+struct cos_vas_range {
+	vaddr_t       addr;
+	unsigned long sz;
+};
+
 void cos_compinfo_init(struct cos_compinfo *ci, pgtblcap_t pgtbl_cap, captblcap_t captbl_cap, compcap_t comp_cap,
                        vaddr_t heap_ptr, capid_t cap_frontier, struct cos_compinfo *ci_resources);
 /*
@@ -105,6 +111,17 @@ int cos_pgtbl_intern_expandwith(struct cos_compinfo *ci, pgtblcap_t intern, vadd
  */
 int         cos_compinfo_alloc(struct cos_compinfo *ci, vaddr_t heap_ptr, capid_t cap_frontier, vaddr_t entry,
                                struct cos_compinfo *ci_resources);
+/*
+ * Allocate a new component that is a copy-on-write clone of parent:
+ * parent's capabilities (from BOOT_CAPTBL_FREE) are copied to the same
+ * capids, and its pages in [vas_base, heap) are shared copy-on-write.
+ * The nshared ranges in shared are memory that parent shares with
+ * others (e.g. through cos_mem_alias), and are aliased instead, so
+ * that they stay shared.  Write faults are resolved by the kernel
+ * with frames donated through cos_mem_cow_reserve.
+ */
+int         cos_compinfo_fork(struct cos_compinfo *ci, struct cos_compinfo *parent, vaddr_t vas_base, vaddr_t entry,
+                              struct cos_vas_range *shared, int nshared, struct cos_compinfo *ci_resources);
 captblcap_t cos_captbl_alloc(struct cos_compinfo *ci);
 pgtblcap_t  cos_pgtbl_alloc(struct cos_compinfo *ci);
 compcap_t   cos_comp_alloc(struct cos_compinfo *ci, captblcap_t ctc, pgtblcap_t ptc, vaddr_t entry);
@@ -158,9 +175,17 @@ int cos_sinv(sinvcap_t sinv, word_t arg1, word_t arg2, word_t arg3, word_t arg4)
 
 vaddr_t cos_mem_alias(struct cos_compinfo *dstci, struct cos_compinfo *srcci, vaddr_t src);
 int     cos_mem_alias_at(struct cos_compinfo *dstci, vaddr_t dst, struct cos_compinfo *srcci, vaddr_t src);
+/* as cos_mem_alias(_at), but the alias is not writable */
+vaddr_t cos_mem_alias_ro(struct cos_compinfo *dstci, struct cos_compinfo *srcci, vaddr_t src);
+int     cos_mem_alias_ro_at(struct cos_compinfo *dstci, vaddr_t dst, struct cos_compinfo *srcci, vaddr_t src);
 vaddr_t cos_mem_move(struct cos_compinfo *dstci, struct cos_compinfo *srcci, vaddr_t src);
 int     cos_mem_move_at(struct cos_compinfo *dstci, vaddr_t dst, struct cos_compinfo *srcci, vaddr_t src);
 int     cos_mem_remove(pgtblcap_t pt, vaddr_t addr);
+/* share src copy-on-write: both src and dst become read-only until written */
+vaddr_t cos_mem_cow(struct cos_compinfo *dstci, struct cos_compinfo *srcci, vaddr_t src);
+int     cos_mem_cow_at(struct cos_compinfo *dstci, vaddr_t dst, struct cos_compinfo *srcci, vaddr_t src);
+/* donate npages frames to the kernel (on this core) to resolve copy-on-write faults */
+int     cos_mem_cow_reserve(struct cos_compinfo *ci, int npages);
 
 /* Tcap operations */
 tcap_t cos_tcap_alloc(struct cos_compinfo *ci);
@@ -178,6 +203,16 @@ int cos_tcap_transfer(tcap_t src, arcvcap_t dst, tcap_res_t res, tcap_prio_t pri
 int cos_tcap_delegate(asndcap_t dst, tcap_t src, tcap_res_t res, tcap_prio_t prio, tcap_deleg_flags_t flags);
 int cos_tcap_merge(tcap_t dst, tcap_t rm);
 
+/*
+ * Top up the budgets of the tcaps of n end-points from src, keeping
+ * the priorities src's transfers gave them, with a system call for
+ * each page of the array.  The refills are done in order, up to the
+ * first that fails (an invalid end-point, one src hasn't transferred
+ * to, or src running out of budget).  Returns the number of refills
+ * done (n on success), or -EINVAL if the array is invalid.
+ */
+int cos_tcap_refill(tcap_t src, struct cos_tcap_refill *r, int n);
+
 /* Hardware (interrupts) operations */
 hwcap_t cos_hw_alloc(struct cos_compinfo *ci, u32_t bitmap);
 int     cos_hw_attach(hwcap_t hwc, hwid_t hwid, arcvcap_t rcvcap);
@@ -0,0 +1,60 @@
+/**
+ * Redistribution of this file is permitted under the GNU General
+ * Public License v2.
+ *
+ * Structured logging into memory rings.
+ *
+ * Each component has its own ring of fixed-size log records per core,
+ * that its threads write into without locks or invocations, and that
+ * a low-priority drain thread of the same component flushes to the
+ * serial port (cos_print, see cos_log_drain).  Writers never wait for
+ * the console: when a ring is full, records are dropped and counted.
+ * As the rings aren't shared between components, one that floods its
+ * log, or a writer preempted mid-record, only delays its own records.
+ *
+ * A component without a drain thread never enables its rings
+ * (cos_log_init), and cos_logf prints directly.
+ */
+
+#ifndef COS_LOG_H
+#define COS_LOG_H
+
+#include <cos_kernel_api.h>
+
+typedef enum {
+	COS_LOG_ERR = 0,
+	COS_LOG_WARN,
+	COS_LOG_INFO,
+	COS_LOG_DBG,
+} cos_log_level_t;
+
+#define COS_LOG_REC_SZ 128
+#define COS_LOG_MSG_SZ (COS_LOG_REC_SZ - 20)
+#define COS_LOG_NRECS 128 /* per core, a power of 2 */
+
+struct cos_log_rec {
+	unsigned long seq; /* the record's index + 1, once it is written */
+	u32_t         pad;
+	u64_t         tsc;
+	u16_t         thdid;
+	u8_t          level;
+	u8_t          len;
+	char          msg[COS_LOG_MSG_SZ];
+};
+
+struct cos_log_ring {
+	unsigned long      tail CACHE_ALIGNED; /* writers reserve records here */
+	unsigned long      dropped;
+	unsigned long      head CACHE_ALIGNED; /* the next record to drain */
+	struct cos_log_rec recs[COS_LOG_NRECS] CACHE_ALIGNED;
+};
+
+/* Log into the rings from now on; the caller must run a drain thread. */
+void cos_log_init(void);
+int  cos_logf(cos_log_level_t level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+/* Print up to max records of cpu's ring at or below level, returns the number consumed. */
+int  cos_log_drain(int cpu, cos_log_level_t level, int max);
+/* This component's ring on cpu */
+struct cos_log_ring *cos_log_ring(int cpu);
+
+#endif /* COS_LOG_H */
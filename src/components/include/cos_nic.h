@@ -0,0 +1,122 @@
+/**
+ * Redistribution of this file is permitted under the GNU General
+ * Public License v2.
+ *
+ * Polled-mode network interfaces on shared descriptor rings.
+ *
+ * A port has a pool of fixed-size packet buffers, and four channels
+ * (cos_chan.h) of descriptors that pass them between the network
+ * stack and the device, as in AF_XDP:
+ *
+ *     fill: empty buffers for the device to receive into (stack -> device)
+ *     rx:   received packets                           (device -> stack)
+ *     tx:   packets to transmit                        (stack -> device)
+ *     done: transmitted buffers to reuse               (device -> stack)
+ *
+ * Each ring can hold all of the buffers, so enqueues never fail.
+ * Packets are received and transmitted in bursts, and both sides
+ * switch from notifications to polling under load (like Linux's NAPI):
+ * while bursts keep coming, notifications are suppressed, and after
+ * COS_NIC_POLL_IDLE empty polls they are enabled again, and the side
+ * blocks.
+ *
+ * The pair device connects two ports like a cable (a loopback if both
+ * are the same port), so that a stack can be tested and benchmarked
+ * without a NIC.
+ */
+
+#ifndef COS_NIC_H
+#define COS_NIC_H
+
+#include <cos_chan.h>
+
+#define COS_NIC_BUF_SZ 2048   /* MTU and headroom; a power of 2 */
+#define COS_NIC_MAX_BUFS 512  /* per port */
+#define COS_NIC_BURST 32
+#define COS_NIC_POLL_IDLE 64  /* empty polls before blocking */
+
+struct cos_nic_desc {
+	u32_t buf; /* index of the buffer in the port's pool */
+	u32_t len;
+};
+
+/* A port, as seen by one component (the rings are shared). */
+struct cos_nic {
+	struct cos_chan *fill, *rx, *tx, *done;
+	char *           bufs;
+	unsigned int     nbufs;
+	asndcap_t        tx_snd; /* the stack notifies the device of transmissions */
+	asndcap_t        rx_snd; /* the device notifies the stack of receptions */
+	unsigned long    rx_drops; /* packets the device had no fill buffer for */
+	/* the stack's state */
+	int          polling;
+	unsigned int idle;
+	unsigned int nfree; /* buffers that are in no ring */
+	u32_t        free[COS_NIC_MAX_BUFS];
+};
+
+static inline void *
+cos_nic_buf(struct cos_nic *n, u32_t buf)
+{
+	return n->bufs + buf * COS_NIC_BUF_SZ;
+}
+
+/* Reclaim the transmitted buffers, returns the number reclaimed. */
+unsigned int cos_nic_reclaim(struct cos_nic *n);
+
+/* A free buffer for transmission, or -1. */
+static inline int
+cos_nic_buf_alloc(struct cos_nic *n)
+{
+	if (!n->nfree && !cos_nic_reclaim(n)) return -1;
+
+	return n->free[--n->nfree];
+}
+
+/* Free a received buffer (or an allocated one that wasn't sent). */
+static inline void
+cos_nic_buf_free(struct cos_nic *n, u32_t buf)
+{
+	assert(n->nfree < n->nbufs);
+	n->free[n->nfree++] = buf;
+}
+
+/* Give up to cnt free buffers to the device to receive into. */
+unsigned int cos_nic_refill(struct cos_nic *n, unsigned int cnt);
+
+/* Transmit up to cnt packets, returns the number queued. */
+static inline unsigned int
+cos_nic_tx_burst(struct cos_nic *n, struct cos_nic_desc *d, unsigned int cnt)
+{
+	return cos_chan_enqueue_spsc(n->tx, d, cnt, n->tx_snd);
+}
+
+/* Receive up to max packets without blocking. */
+static inline unsigned int
+cos_nic_rx_burst(struct cos_nic *n, struct cos_nic_desc *d, unsigned int max)
+{
+	return cos_chan_dequeue(n->rx, d, max);
+}
+
+/*
+ * Receive up to max packets, in notification or polling mode.  A
+ * full burst switches to polling: then this returns 0 when there are
+ * no packets (poll again), until it has been idle for too long, and
+ * goes back to blocking on notifications to rcv.
+ */
+unsigned int cos_nic_rx_wait(struct cos_nic *n, struct cos_nic_desc *d, unsigned int max, arcvcap_t rcv);
+
+/* Set up a port with nbufs (a power of 2) buffers in ci. */
+int cos_nic_init(struct cos_nic *n, struct cos_compinfo *ci, unsigned int nbufs);
+/* The port src of srcci, aliased into dstci (e.g. the device's component). */
+int cos_nic_alias(struct cos_nic *dst, struct cos_compinfo *dstci, struct cos_compinfo *srcci, struct cos_nic *src);
+
+/*
+ * The pair device: move up to budget packets transmitted on from to
+ * the receive ring of to, returns the number moved (or dropped).
+ */
+unsigned int cos_nic_pair_xfer(struct cos_nic *from, struct cos_nic *to, unsigned int budget);
+/* The device's thread: transfer packets both ways, forever. */
+void cos_nic_pair_loop(struct cos_nic *a, struct cos_nic *b, arcvcap_t rcv);
+
+#endif /* COS_NIC_H */
@@ -0,0 +1,102 @@
+/**
+ * Redistribution of this file is permitted under the GNU General
+ * Public License v2.
+ *
+ * A work-stealing fork/join runtime on sl, for parallel loops and
+ * nested tasks (in the place of the archived par_mgr's OpenMP teams).
+ *
+ * Each worker is a thread with a Chase-Lev deque of tasks: the worker
+ * pushes and pops tasks at the bottom of its own deque, and workers
+ * that run out of tasks steal from the top of the others'.  Joins are
+ * not barriers: a thread waiting for its children runs tasks (its own
+ * first, then stolen ones), and only blocks once there are none left
+ * to run, to be woken by the child that completes the join.  Workers
+ * that find no work to steal block in the rcv of their aep end-point,
+ * and are woken by an asnd when tasks are spawned.
+ *
+ * sl schedules a single core, so all of the workers are threads on
+ * the core of the sl instance that creates them: they share that
+ * core, and the parallelism is in the structure (and the asnd
+ * wakeups), not yet in the speedup.
+ *
+ * Loops are split lazily: the range being run is halved, and the
+ * upper half made stealable, only when the worker's deque is empty
+ * (i.e. its previous half was stolen), so splitting adapts to how
+ * many workers are actually idle.
+ */
+
+#ifndef COS_PAR_H
+#define COS_PAR_H
+
+#include <cos_kernel_api.h>
+#include <ps.h>
+
+#define COS_PAR_MAX_WORKERS 16
+#define COS_PAR_DEQUE_SZ 256 /* a power of 2 */
+/* rounds over the other workers' deques before going to sleep */
+#define COS_PAR_STEAL_ROUNDS 4
+/* default loop grain: ranges are split into ~this many chunks per worker */
+#define COS_PAR_CHUNKS_PER_WORKER 8
+
+typedef void (*cos_par_fn_t)(void *arg, long lo, long hi);
+
+/*
+ * Spawned tasks are counted in a join, which the spawner waits on:
+ * the first spawn records it as the thread to wake.
+ */
+struct cos_par_join {
+	unsigned long pending;
+	thdid_t       waiter;
+};
+
+struct cos_par_task {
+	cos_par_fn_t         fn;
+	void *               arg;
+	long                 lo, hi;
+	long                 grain; /* non-zero for a loop range, which is split further */
+	struct cos_par_join *join;
+};
+
+struct cos_par_deque {
+	unsigned long       top CACHE_ALIGNED;    /* thieves take from here... */
+	unsigned long       bottom CACHE_ALIGNED; /* ...and the owner here */
+	struct cos_par_task tasks[COS_PAR_DEQUE_SZ] CACHE_ALIGNED;
+};
+
+struct cos_par;
+
+struct cos_par_worker {
+	struct cos_par_deque deque;
+	struct cos_par *     par;
+	int                  id;
+	arcvcap_t            rcv;
+	asndcap_t            snd;
+	unsigned long        sleeping;
+	int                  victim; /* the worker we last stole from */
+	unsigned long        steals;
+} CACHE_ALIGNED;
+
+struct cos_par {
+	int                   nworkers;
+	unsigned long         nsleeping;
+	struct cos_par_worker workers[COS_PAR_MAX_WORKERS];
+};
+
+/*
+ * The calling (sl) thread becomes worker 0, and nworkers - 1 worker
+ * threads are created at the sl priority prio.  Returns 0, or -errno.
+ */
+int  cos_par_init(struct cos_par *p, int nworkers, unsigned int prio);
+/* Spawn fn(arg, lo, hi), counted in j, from a worker or a task. */
+void cos_par_spawn(struct cos_par_join *j, cos_par_fn_t fn, void *arg, long lo, long hi);
+/* Run tasks until those counted in j are done. */
+void cos_par_join_wait(struct cos_par_join *j);
+/*
+ * Run fn over [lo, hi) in parallel, in calls for sub-ranges of at
+ * least grain (0 for the default), and return once all are done.
+ */
+void cos_par_for(long lo, long hi, long grain, cos_par_fn_t fn, void *arg);
+/* The current thread's worker, or NULL if it isn't one. */
+struct cos_par_worker *cos_par_self(void);
+
+#endif /* COS_PAR_H */
@@ -0,0 +1,47 @@
+/**
+ * Redistribution of this file is permitted under the GNU General
+ * Public License v2.
+ *
+ * Invocation stacks on demand.
+ *
+ * With the simple stacks, each component reserves a stack for every
+ * thread in the system (MAX_NUM_THREADS * COS_STACK_SZ), though only
+ * the threads concurrently executing in it need one.  Components that
+ * link with freelist_stklib.o instead take a stack from a per-core
+ * freelist in their server stubs and invocation upcall, and return it
+ * on the way out (cos_asm_freelist_stacks.h); each thread only keeps a
+ * small temporary stack (TMP_STACK_SZ) to do so.
+ *
+ * The freelists start out empty.  Stacks are first taken from a small
+ * static pool, then mapped by the stack manager (the llbooter, with
+ * all page-tables) into a window at the top of the heap, and are never
+ * freed back to it.
+ */
+
+#ifndef COS_STACKS_H
+#define COS_STACKS_H
+
+#include <cos_component.h>
+
+/* The head's low bits (below COS_STACK_SZ) are a generation count. */
+struct cos_stack_fl {
+	unsigned long head;
+	char          __padding[CACHE_LINE - sizeof(unsigned long)];
+} CACHE_ALIGNED;
+
+#define COS_STACKS_POOL (NUM_CPU * 4)
+#define COS_STACKS_VAS_WINDOW PGD_RANGE
+#define COS_STACKS_MAX (COS_STACKS_VAS_WINDOW / COS_STACK_SZ)
+
+/* The stack manager's operation; distinct from those of the cbuf and log managers. */
+#define COS_STACK_OP_GRANT 33 /* arg: the address of the stack to map, returns it */
+
+extern struct cos_stack_fl cos_stack_freelists[NUM_CPU];
+
+/*
+ * A new stack for cpu's freelist, or NULL if there is no more memory.
+ * Called from the stubs on the temporary stack: keep it shallow.
+ */
+void *cos_stack_grant(int cpu);
+
+#endif /* COS_STACKS_H */
@@ -0,0 +1,451 @@
+/***
+ * Copyright 2011 by Gabriel Parmer.  All rights reserved.
+ *
+ * Redistribution of this file is permitted under the GNU General
+ * Public License v2.
+ *
+ * Author: Gabriel Parmer, gparmer@gwu.edu, 2011
+ */
+
+#ifndef CSLAB_H
+#define CSLAB_H
+
+#ifdef LINUX_TEST
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <assert.h>
+#include <sched.h>
+#include <sys/mman.h>
+/* mmap fails with MAP_FAILED, but CSLAB_ALLOC must fail with NULL */
+static inline void *
+__cslab_mmap(size_t sz)
+{
+	void *m = mmap(0, sz, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, (size_t)0);
+
+	return m == MAP_FAILED ? NULL : m;
+}
+#define CSLAB_ALLOC(sz) __cslab_mmap(sz)
+#define CSLAB_FREE(x, sz) munmap(x, sz)
+#define CSLAB_NCORES 32
+#define CSLAB_CORE() (sched_getcpu() % CSLAB_NCORES)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+#define likely(x) __builtin_expect(!!(x), 1)
+#else
+
+#include <cos_component.h>
+#include <cos_debug.h>
+#define CSLAB_NCORES NUM_CPU
+#define CSLAB_CORE() cos_cpuid()
+#endif
+
+#include <string.h>
+#include <consts.h>
+
+/***
+ * Slab allocator with per-core magazines.  Note that "cslab" stands
+ * for "Composite Slab", not "CS Lab".
+ *
+ * To use, your program should include:
+ * CSLAB_CREATE(ms, sizeof(my_struct)); //ms is a name chosen by you
+ *
+ * allocations and deallocations are made:
+ * struct my_struct *ms = cslab_alloc_ms();
+ * cslab_free_ms(ms);
+ * and cslab_reap_ms() returns the memory cached in the depot to the
+ * slabs, and the pages of empty slabs to CSLAB_FREE.
+ *
+ * There are three layers (as in Bonwick's magazines):
+ *
+ * - Each core caches objects in two magazines (arrays of object
+ *   pointers), and allocates and frees without any atomic operations
+ *   other than taking its (uncontended) cache.
+ * - When both of its magazines are empty (or full), a core exchanges
+ *   one with the depot, which holds full and empty magazines in two
+ *   lock-free stacks.
+ * - Only when the depot has no full magazines (or no empty ones) are
+ *   magazines filled from (or flushed into) the slabs, with the slab
+ *   lock taken.  A slab whose objects have all been freed has its
+ *   page returned with CSLAB_FREE.
+ *
+ * Objects are sized in classes that never straddle cache-lines:
+ * objects up to a cache-line are a power of two, and larger objects
+ * are a multiple of the cache-line, and the first object of a slab
+ * is cache-aligned.
+ *
+ * A thread that is preempted (or migrated) while using its core's
+ * cache doesn't block others: if the cache is taken, the allocation
+ * or free goes straight to the slabs.  The slab lock is a spinlock:
+ * components with preemptive threads on a core should define
+ * CSLAB_RELAX() to yield to the lock's holder.
+ */
+
+#ifndef CSLAB_ALLOC
+#error "You must pound define a CSLAB_ALLOC and CSLAB_FREE"
+#endif
+#ifndef CSLAB_RELAX
+#define CSLAB_RELAX() __asm__ __volatile__("" : : : "memory")
+#endif
+
+#define CSLAB_MEM_ALLOC_SZ PAGE_SIZE
+#define CSLAB_FIRST_OFF CACHE_LINE /* first memory allocation is cache-aligned */
+#define CSLAB_MAG_SZ 30            /* objects per magazine */
+#define CSLAB_NMAGS (CSLAB_NCORES * 4)
+/* the depot packs a magazine's index (+1) into 8 bits: fails to compile otherwise */
+typedef char cslab_nmags_fit_depot[CSLAB_NMAGS < 255 ? 1 : -1];
+
+/* The class (object size) of a size */
+#define CSLAB_OBJ_SZ(sz)                                                                   \
+	((sz) <= sizeof(void *) ? sizeof(void *)                                           \
+	                        : (sz) <= 16 ? 16                                          \
+	                                     : (sz) <= 32 ? 32                             \
+	                                                  : (sz) <= CACHE_LINE ? CACHE_LINE \
+	                                                                       : round_up_to_cacheline(sz))
+#define CSLAB_MAX_OBJS(sz) ((CSLAB_MEM_ALLOC_SZ - CSLAB_FIRST_OFF) / CSLAB_OBJ_SZ(sz))
+
+/* The header for a slab. */
+struct cslab {
+	void *        freelist; /* of free objects, linked through their first word */
+	unsigned int  nfree;
+	struct cslab *next, *prev; /* in the partial list */
+};
+
+struct cslab_mag {
+	unsigned int nobjs;
+	unsigned int next; /* the depot stack's next magazine index (+1) */
+	void *       objs[CSLAB_MAG_SZ];
+};
+
+struct cslab_core {
+	unsigned long     busy;
+	struct cslab_mag *loaded, *prev;
+} CACHE_ALIGNED;
+
+struct cslab_class {
+	struct cslab_core cores[CSLAB_NCORES];
+	/*
+	 * The depot's stacks: the index (+1) of the top magazine in
+	 * the low 8 bits, and a generation in the rest, incremented
+	 * on each operation, to avoid ABA.
+	 */
+	unsigned long full CACHE_ALIGNED, empty;
+	unsigned long nmags; /* magazines handed out so far */
+	/* the slabs, with some free objects */
+	unsigned long lock CACHE_ALIGNED;
+	struct cslab *partial;
+	unsigned int  obj_sz, max_objs;
+	struct cslab_mag mags[CSLAB_NMAGS];
+};
+
+/*** The depot ***/
+
+static inline void
+__cslab_depot_push(struct cslab_class *c, unsigned long *stk, struct cslab_mag *m)
+{
+	unsigned long old, new;
+
+	do {
+		old     = *(volatile unsigned long *)stk;
+		m->next = old & 0xFF;
+		new     = (((old >> 8) + 1) << 8) | (unsigned long)(m - c->mags + 1);
+	} while (!__sync_bool_compare_and_swap(stk, old, new));
+}
+
+static inline struct cslab_mag *
+__cslab_depot_pop(struct cslab_class *c, unsigned long *stk)
+{
+	unsigned long     old, new;
+	struct cslab_mag *m;
+
+	do {
+		old = *(volatile unsigned long *)stk;
+		if (!(old & 0xFF)) return NULL;
+		/* the generation catches a next that changed after we read it */
+		m   = &c->mags[(old & 0xFF) - 1];
+		new = (((old >> 8) + 1) << 8) | m->next;
+	} while (!__sync_bool_compare_and_swap(stk, old, new));
+
+	return m;
+}
+
+static inline struct cslab_mag *
+__cslab_mag_empty(struct cslab_class *c)
+{
+	struct cslab_mag *m;
+	unsigned long     n;
+
+	m = __cslab_depot_pop(c, &c->empty);
+	if (likely(m)) return m;
+	/* a magazine that was never used */
+	if (*(volatile unsigned long *)&c->nmags >= CSLAB_NMAGS) return NULL;
+	n = __sync_fetch_and_add(&c->nmags, 1);
+	if (n >= CSLAB_NMAGS) return NULL;
+	m        = &c->mags[n];
+	m->nobjs = 0;
+
+	return m;
+}
+
+/*** The slabs ***/
+
+static inline void
+__cslab_lock(struct cslab_class *c)
+{
+	while (__sync_lock_test_and_set(&c->lock, 1)) {
+		while (*(volatile unsigned long *)&c->lock) CSLAB_RELAX();
+	}
+}
+
+static inline void
+__cslab_unlock(struct cslab_class *c)
+{
+	__sync_lock_release(&c->lock);
+}
+
+static inline struct cslab *
+__cslab_lookup(void *buf)
+{
+	return (struct cslab *)((unsigned long)buf & ~(unsigned long)(CSLAB_MEM_ALLOC_SZ - 1));
+}
+
+static void
+__cslab_partial_add(struct cslab_class *c, struct cslab *s)
+{
+	s->prev = NULL;
+	s->next = c->partial;
+	if (c->partial) c->partial->prev = s;
+	c->partial = s;
+}
+
+static void
+__cslab_partial_rem(struct cslab_class *c, struct cslab *s)
+{
+	if (s->prev) s->prev->next = s->next;
+	else         c->partial = s->next;
+	if (s->next) s->next->prev = s->prev;
+	s->next = s->prev = NULL;
+}
+
+/* Called with the slab lock taken. */
+static struct cslab *
+__cslab_slab_alloc(struct cslab_class *c)
+{
+	struct cslab *s;
+	char *        mem;
+	unsigned int  i;
+
+	s = CSLAB_ALLOC(CSLAB_MEM_ALLOC_SZ);
+	if (unlikely(!s)) return NULL;
+	assert(__cslab_lookup(s) == s);
+
+	s->freelist = NULL;
+	mem         = ((char *)s) + CSLAB_FIRST_OFF;
+	for (i = c->max_objs; i > 0; i--) {
+		void **o = (void **)(mem + (i - 1) * c->obj_sz);
+
+		*o          = s->freelist;
+		s->freelist = o;
+	}
+	s->nfree = c->max_objs;
+	__cslab_partial_add(c, s);
+
+	return s;
+}
+
+/* Called with the slab lock taken. */
+static inline void *
+__cslab_obj_alloc(struct cslab_class *c)
+{
+	struct cslab *s = c->partial;
+	void **       o;
+
+	if (unlikely(!s)) {
+		s = __cslab_slab_alloc(c);
+		if (unlikely(!s)) return NULL;
+	}
+	o           = s->freelist;
+	s->freelist = *o;
+	s->nfree--;
+	if (!s->nfree) __cslab_partial_rem(c, s);
+
+	return o;
+}
+
+/* Called with the slab lock taken: this is where pages are returned. */
+static inline void
+__cslab_obj_free(struct cslab_class *c, void *buf)
+{
+	struct cslab *s = __cslab_lookup(buf);
+
+	assert((unsigned long)((char *)buf - (char *)s - CSLAB_FIRST_OFF) % c->obj_sz == 0);
+	*(void **)buf = s->freelist;
+	s->freelist   = buf;
+	s->nfree++;
+	if (s->nfree == 1) __cslab_partial_add(c, s);
+	if (s->nfree == c->max_objs) {
+		__cslab_partial_rem(c, s);
+		CSLAB_FREE(s, CSLAB_MEM_ALLOC_SZ);
+	}
+}
+
+static void
+__cslab_mag_fill(struct cslab_class *c, struct cslab_mag *m)
+{
+	__cslab_lock(c);
+	while (m->nobjs < CSLAB_MAG_SZ) {
+		void *o = __cslab_obj_alloc(c);
+
+		if (unlikely(!o)) break;
+		m->objs[m->nobjs++] = o;
+	}
+	__cslab_unlock(c);
+}
+
+static void
+__cslab_mag_flush(struct cslab_class *c, struct cslab_mag *m)
+{
+	__cslab_lock(c);
+	while (m->nobjs > 0) __cslab_obj_free(c, m->objs[--m->nobjs]);
+	__cslab_unlock(c);
+}
+
+/*** The per-core caches ***/
+
+static inline void *
+__cslab_mem_alloc(struct cslab_class *c)
+{
+	struct cslab_core *cc = &c->cores[CSLAB_CORE()];
+	struct cslab_mag * m;
+	void *             o;
+
+	if (unlikely(!__sync_bool_compare_and_swap(&cc->busy, 0, 1))) goto slow;
+
+	m = cc->loaded;
+	if (likely(m && m->nobjs)) goto done;
+	if (cc->prev && cc->prev->nobjs) {
+		cc->loaded = cc->prev;
+		cc->prev   = m;
+		m          = cc->loaded;
+		goto done;
+	}
+	/* both are empty: exchange one for a full magazine */
+	m = __cslab_depot_pop(c, &c->full);
+	if (m) {
+		if (cc->prev) __cslab_depot_push(c, &c->empty, cc->prev);
+		cc->prev   = cc->loaded;
+		cc->loaded = m;
+		goto done;
+	}
+	/* ...or fill one from the slabs */
+	m = cc->loaded;
+	if (!m) m = cc->loaded = __cslab_mag_empty(c);
+	if (unlikely(!m)) {
+		__sync_lock_release(&cc->busy);
+		goto slow;
+	}
+	__cslab_mag_fill(c, m);
+	if (unlikely(!m->nobjs)) {
+		__sync_lock_release(&cc->busy);
+		return NULL;
+	}
+done:
+	o = m->objs[--m->nobjs];
+	__sync_lock_release(&cc->busy);
+
+	return o;
+slow:
+	__cslab_lock(c);
+	o = __cslab_obj_alloc(c);
+	__cslab_unlock(c);
+
+	return o;
+}
+
+static inline void
+__cslab_mem_free(struct cslab_class *c, void *buf)
+{
+	struct cslab_core *cc = &c->cores[CSLAB_CORE()];
+	struct cslab_mag * m;
+
+	assert(buf);
+	if (unlikely(!__sync_bool_compare_and_swap(&cc->busy, 0, 1))) goto slow;
+
+	m = cc->loaded;
+	if (likely(m && m->nobjs < CSLAB_MAG_SZ)) goto done;
+	if (cc->prev && !cc->prev->nobjs) {
+		cc->loaded = cc->prev;
+		cc->prev   = m;
+		m          = cc->loaded;
+		goto done;
+	}
+	/* both are full: exchange one for an empty magazine */
+	m = __cslab_mag_empty(c);
+	if (m) {
+		if (cc->prev) __cslab_depot_push(c, &c->full, cc->prev);
+		cc->prev   = cc->loaded;
+		cc->loaded = m;
+		goto done;
+	}
+	/* ...or flush one into the slabs */
+	m = cc->loaded;
+	if (unlikely(!m)) {
+		__sync_lock_release(&cc->busy);
+		goto slow;
+	}
+	__cslab_mag_flush(c, m);
+done:
+	m->objs[m->nobjs++] = buf;
+	__sync_lock_release(&cc->busy);
+
+	return;
+slow:
+	__cslab_lock(c);
+	__cslab_obj_free(c, buf);
+	__cslab_unlock(c);
+}
+
+/* Return the objects in the depot's full magazines to the slabs. */
+static void
+__cslab_reap(struct cslab_class *c)
+{
+	struct cslab_mag *m;
+
+	while ((m = __cslab_depot_pop(c, &c->full))) {
+		__cslab_mag_flush(c, m);
+		__cslab_depot_push(c, &c->empty, m);
+	}
+}
+
+/***
+ * This macro creates the allocation and deallocation functions for
+ * a class of objects of a given size.  The size information is
+ * constant in the class, so that slab initialization and checks are
+ * specialized by the compiler.
+ */
+/* objects must fit in a slab (after its cache-line offset): fails to compile otherwise */
+#define CSLAB_CREATE_DATA(name, size)                                                                \
+	typedef char          cslab_##name##_obj_fits_slab[CSLAB_MAX_OBJS(size) > 0 ? 1 : -1];          \
+	struct cslab_class    slab_##name##_class = {.obj_sz   = CSLAB_OBJ_SZ(size),                     \
+	                                          .max_objs = CSLAB_MAX_OBJS(size)}
+
+#define CSLAB_CREATE_FNS(name, size)                         \
+	static inline void *cslab_alloc_##name(void)         \
+	{                                                    \
+		return __cslab_mem_alloc(&slab_##name##_class); \
+	}                                                    \
+                                                             \
+	static inline void cslab_free_##name(void *buf)      \
+	{                                                    \
+		__cslab_mem_free(&slab_##name##_class, buf);    \
+	}                                                    \
+                                                             \
+	static inline void cslab_reap_##name(void)           \
+	{                                                    \
+		__cslab_reap(&slab_##name##_class);             \
+	}
+
+#define CSLAB_CREATE(name, size)       \
+	CSLAB_CREATE_DATA(name, size); \
+	CSLAB_CREATE_FNS(name, size)
+
+#endif /* CSLAB_H */
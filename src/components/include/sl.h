@@ -64,7 +64,12 @@ struct sl_global {
 	cycles_t    timer_next;
 	tcap_time_t timeout_next;
 
-	struct ps_list_head event_head; /* all pending events for sched end-point */
+	int idle_rcv;   /* idle in the scheduler thread's rcv, rather than in idle_thd */
+	int sched_idle; /* we switched to the scheduler thread to idle */
+
+	struct ps_list_head event_head;     /* all pending events for sched end-point */
+	struct ps_list_head replenish_head; /* threads with their own tcap and a budget */
+	cycles_t            replenish_next; /* the next replenishment, 0 if none */
 };
 
 extern struct sl_global sl_global_data;
@@ -214,6 +219,11 @@ retry:
  * dependency from this thread on the target tid (i.e. when the
  * scheduler chooses to run this thread, we will run the dependency
  * instead (note that "dependency" is transitive).
+ *
+ * A dependency lasts until the dependency releases its dependents
+ * (sl_thd_dependents_release), exits, or the chain can't be followed
+ * (a cycle, or a thread in it that is blocked), so callers must
+ * recheck the condition they were waiting for.
  */
 void sl_thd_block(thdid_t tid);
 /*
@@ -223,8 +233,24 @@ void sl_thd_block(thdid_t tid);
  * @returns: 0 if the thread is woken up by external events before timeout.
  *	     +ve - number of cycles elapsed from abs_timeout before the thread
  *		   was woken up by Timeout module.
+ *
+ * A dependency on tid expires at abs_timeout, but is only noticed
+ * at the next scheduling decision (at worst, the next timer tick).
  */
 cycles_t sl_thd_block_timeout(thdid_t tid, cycles_t abs_timeout);
+/*
+ * In the critical section, which this releases: make the dependency
+ * of the current thread on tid, until abs_timeout (if non-zero).
+ * Returns -EDEADLK if tid (transitively) depends on us, -EINVAL if it
+ * doesn't exist, and 0 once we run again.
+ */
+int      sl_thd_block_dep_cs_exit(thdid_t tid, cycles_t abs_timeout);
+/*
+ * In the critical section: end the dependencies on t (e.g. as it
+ * releases a lock) and wake the dependents blocked on them.  Returns
+ * the number of dependents, so that the caller can reschedule.
+ */
+int      sl_thd_dependents_release(struct sl_thd *t);
 /*
  * blocks for a timeout = next replenishment period of the task.
  * Note: care should be taken to not interleave this with sl_thd_block_timeout().
@@ -358,8 +384,41 @@ sl_timeout_wakeup_expired(cycles_t now)
 	} while (heap_size(sl_timeout_heap()));
 }
 
+/*
+ * The thread to run when the policy selects t: the end of its chain
+ * of dependencies, running at t's priority if that is higher.  If the
+ * chain can't be followed (it is longer than SL_MAX_DEP_DEPTH, so
+ * likely a cycle, or ends in a thread that isn't runnable), t itself
+ * runs, and returns from its block.  A thread whose dependency has
+ * expired runs itself.
+ */
+static inline struct sl_thd *
+sl_thd_dependency_resolve(struct sl_thd *t, cycles_t now, tcap_prio_t *prio)
+{
+	struct sl_thd *d = t;
+	int            i;
+
+	*prio = t->prio;
+	for (i = 0; d->dependency; i++) {
+		if (unlikely(i == SL_MAX_DEP_DEPTH)) return t;
+		if (d->dep_timeout && (s64_t)(d->dep_timeout - now) <= 0) break;
+		d = d->dependency;
+	}
+	if (unlikely(d->state != SL_THD_RUNNABLE)) return t;
+	if (d->prio < *prio) *prio = d->prio;
+
+	return d;
+}
+
+/* ...not part of the public API */
+/*
+ * Replenish the tcaps of the threads whose periods have elapsed, and
+ * set the next replenishment.
+ */
+void sl_replenish_expired(cycles_t now);
+
 static inline int
-sl_thd_activate(struct sl_thd *t, sched_tok_t tok)
+sl_thd_activate(struct sl_thd *t, tcap_prio_t prio, sched_tok_t tok)
 {
 	struct cos_defcompinfo *dci = cos_defcompinfo_curr_get();
 	struct cos_compinfo    *ci  = &dci->ci;
@@ -368,10 +427,10 @@ sl_thd_activate(struct sl_thd *t, sched_tok_t tok)
 	if (t->properties & SL_THD_PROPERTY_SEND) {
 		return cos_sched_asnd(t->sndcap, g->timeout_next, g->sched_rcv, tok);
 	} else if (t->properties & SL_THD_PROPERTY_OWN_TCAP) {
-		return cos_switch(sl_thd_thdcap(t), sl_thd_tcap(t), t->prio,
+		return cos_switch(sl_thd_thdcap(t), sl_thd_tcap(t), prio,
 				  g->timeout_next, g->sched_rcv, tok);
 	} else {
-		return cos_defswitch(sl_thd_thdcap(t), t->prio, t == g->sched_thd ? 
+		return cos_defswitch(sl_thd_thdcap(t), prio, t == g->sched_thd ? 
 				     TCAP_TIME_NIL : g->timeout_next, tok);
 	}
 }
@@ -403,11 +462,10 @@ sl_thd_activate(struct sl_thd *t, sched_tok_t tok)
 static inline int
 sl_cs_exit_schedule_nospin_arg(struct sl_thd *to)
 {
-	struct cos_defcompinfo *dci = cos_defcompinfo_curr_get();
-	struct cos_compinfo *ci = &dci->ci;
 	struct sl_thd_policy *pt;
 	struct sl_thd *       t;
 	struct sl_global *    globals = sl__globals();
+	tcap_prio_t           prio;
 	sched_tok_t           tok;
 	cycles_t              now;
 	s64_t                 offset;
@@ -421,6 +479,7 @@ sl_cs_exit_schedule_nospin_arg(struct sl_thd *to)
 	offset = (s64_t)(globals->timer_next - now);
 	if (globals->timer_next && offset <= 0) sl_timeout_expended(now, globals->timer_next);
 	sl_timeout_wakeup_expired(now);
+	if (unlikely(globals->replenish_next && (s64_t)(globals->replenish_next - now) <= 0)) sl_replenish_expired(now);
 
 	/*
 	 * Once we exit, we can't trust t's memory as it could be
@@ -430,42 +489,33 @@ sl_cs_exit_schedule_nospin_arg(struct sl_thd *to)
 	 * it in a function, here.
 	 */
 	if (unlikely(to)) {
-		t = to;
+		t    = to;
+		prio = t->prio;
 		if (t->state != SL_THD_RUNNABLE) to= NULL;
 	}
 	if (likely(!to)) {
 		pt = sl_mod_schedule();
-		if (unlikely(!pt))
-			t = sl__globals()->idle_thd;
-		else
-			t = sl_mod_thd_get(pt);
-	}
-
-	if (t->properties & SL_THD_PROPERTY_OWN_TCAP && t->budget) {
-		assert(t->period);
-		assert(sl_thd_tcap(t) != sl__globals()->sched_tcap);
-
-		if (t->last_replenish == 0 || t->last_replenish + t->period <= now) {
-			tcap_res_t currbudget = 0;
-			cycles_t replenish    = now - ((now - t->last_replenish) % t->period);  
-
-			ret = 0;
-			currbudget = (tcap_res_t)cos_introspect(ci, sl_thd_tcap(t), TCAP_GET_BUDGET);
-
-			if (!cycles_same(currbudget, t->budget, SL_CYCS_DIFF) && currbudget < t->budget) {
-				tcap_res_t transfer = t->budget - currbudget;
-
-				ret = cos_tcap_transfer(sl_thd_rcvcap(t), sl__globals()->sched_tcap, transfer, t->prio);
+		if (unlikely(!pt)) {
+			t = globals->idle_thd;
+			if (globals->idle_rcv) {
+				/* the scheduler thread idles in a blocking rcv (see sl_sched_loop_intern) */
+				t = globals->sched_thd;
+				globals->sched_idle = 1;
+				if (sl_thd_curr() == t) {
+					sl_cs_exit();
+					return 0;
+				}
 			}
-
-			if (likely(ret == 0)) t->last_replenish = replenish;
+			prio = t->prio;
+		} else {
+			t = sl_thd_dependency_resolve(sl_mod_thd_get(pt), now, &prio);
 		}
 	}
 
 	assert(t->state == SL_THD_RUNNABLE);
 	sl_cs_exit();
 
-	ret = sl_thd_activate(t, tok);
+	ret = sl_thd_activate(t, prio, tok);
 	/*
 	 * dispatch failed with -EPERM because tcap associated with thread t does not have budget.
 	 * Block the thread until it's next replenishment and return to the scheduler thread.
@@ -484,7 +534,7 @@ sl_cs_exit_schedule_nospin_arg(struct sl_thd *to)
 			sl_thd_block_no_cs(t, SL_THD_BLOCKED_TIMEOUT, abs_timeout);
 			sl_cs_exit();
 
-			if (unlikely(sl_thd_curr() != globals->sched_thd)) ret = sl_thd_activate(globals->sched_thd, tok);
+			if (unlikely(sl_thd_curr() != globals->sched_thd)) ret = sl_thd_activate(globals->sched_thd, globals->sched_thd->prio, tok);
 	}
 
 	return ret;
@@ -546,5 +596,15 @@ void sl_sched_loop(void) __attribute__((noreturn));
  * booter receive (INITRCV) end-point at the kernel level.
  */
 void sl_sched_loop_nonblock(void) __attribute__((noreturn));
+/*
+ * When nothing is runnable, switch to the scheduler thread, which
+ * idles in a blocking rcv on its end-point, instead of spinning in
+ * the idle thread.  For a child scheduler, this switches to the
+ * parent scheduler (which is sent the block event), so the child's
+ * budget isn't burnt idling; at the root, the kernel idles the core.
+ * Otherwise, the rcv mode is that of the loop, so the non-blocking
+ * loop still only retrieves events while there is work to do.
+ */
+void sl_idle_rcv(int on);
 
 #endif /* SL_H */
@@ -4,5 +4,7 @@
 #define SL_MIN_PERIOD_US 1000
 #define SL_MAX_NUM_THDS  MAX_NUM_THREADS
 #define SL_CYCS_DIFF     (1<<14)
+#define SL_MAX_DEP_DEPTH 16 /* longest dependency chain we follow */
+#define SL_REPLENISH_BATCH 16 /* tcaps refilled per cos_tcap_refill */
 
 #endif /* SL_CONSTS */
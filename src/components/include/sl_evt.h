@@ -0,0 +1,142 @@
+/**
+ * Redistribution of this file is permitted under the BSD two clause license.
+ *
+ * Copyright 2017, The George Washington University
+ */
+
+/*
+ * Edge-triggered event sets on sl (in the spirit of epoll).
+ *
+ * A thread adds the events it is interested in to a set (sl_evt_add),
+ * and then waits for a batch of them (sl_evt_wait).  Triggering an
+ * event appends it to a ready ring, unless it is already there (a
+ * trigger is an edge: triggers before the next wait are coalesced), so
+ * waiting costs O(ready events), not O(interest set).
+ *
+ * The ready ring and the pending flags live in a struct sl_evt_shm
+ * that may be shared with other components (e.g. in a cbuf).  Those
+ * trigger events with sl_evt_shm_trigger, and only need to send an
+ * asynchronous notification to the set's receive thread
+ * (sl_evt_rcv_alloc) when it returns 1, i.e. when the owner is
+ * blocked.  A receive thread can also be bound to an event, to trigger
+ * it on each notification (e.g. interrupts).
+ */
+
+#ifndef SL_EVT_H
+#define SL_EVT_H
+
+#include <sl.h>
+
+typedef u32_t sl_evt_id_t;
+
+/* ids are 1..SL_EVT_MAX, 0 is never a valid event */
+#define SL_EVT_MAX 4095
+#define SL_EVT_RING_SZ (SL_EVT_MAX + 1)
+#define SL_EVT_RING_MASK (SL_EVT_RING_SZ - 1)
+/* receive threads per set */
+#define SL_EVT_NRCV 8
+
+/*
+ * The ring can never overflow: an event is in it at most once (see
+ * pending), and it has a slot for every event.
+ *
+ * A producer that is preempted between reserving and filling its slot
+ * doesn't hold up the events behind it: the owner takes those, and
+ * marks their slots SL_EVT_TAKEN until head passes them.  Until then,
+ * such an event stays SL_EVT_DELIVERED, and a trigger only marks it
+ * SL_EVT_RETRIGGERED, for the owner to queue it again.
+ */
+enum
+{
+	SL_EVT_IDLE = 0,
+	SL_EVT_QUEUED,
+	SL_EVT_DELIVERED,
+	SL_EVT_RETRIGGERED,
+};
+#define SL_EVT_TAKEN (1UL << 31)
+
+struct sl_evt_shm {
+	unsigned long tail CACHE_ALIGNED; /* producers: the next slot to fill */
+	unsigned long waiting;            /* the owner is (about to be) blocked */
+	unsigned long head CACHE_ALIGNED; /* owner: the next slot to read */
+	unsigned long pending[SL_EVT_RING_SZ];
+	sl_evt_id_t   ring[SL_EVT_RING_SZ]; /* 0: the producer hasn't filled it yet */
+};
+
+struct sl_evt;
+
+struct sl_evt_rcv {
+	struct sl_evt *e;
+	sl_evt_id_t    id; /* triggered by each notification, if not 0 */
+};
+
+/* A set has a single waiter at a time. */
+struct sl_evt {
+	struct sl_evt_shm *shm;
+	thdid_t            waiter; /* 0 if nobody is blocked in sl_evt_wait */
+	void *             data[SL_EVT_RING_SZ];
+	u8_t               active[SL_EVT_RING_SZ];
+	sl_evt_id_t        freelist[SL_EVT_MAX];
+	int                nfree;
+	struct sl_evt_rcv  rcvs[SL_EVT_NRCV];
+	int                nrcv;
+};
+
+/* An event of a batch returned by sl_evt_wait. */
+struct sl_evt_res {
+	sl_evt_id_t id;
+	void *      data;
+};
+
+/* Put a QUEUED event in the ring. */
+static inline void
+__sl_evt_shm_enqueue(struct sl_evt_shm *shm, sl_evt_id_t id)
+{
+	unsigned long t = ps_faa(&shm->tail, 1);
+
+	shm->ring[t & SL_EVT_RING_MASK] = id;
+	ps_mem_fence();
+}
+
+/*
+ * Trigger id in the shared part of a set.  Returns 1 if the caller
+ * must notify the owner's receive thread (cos_asnd).
+ */
+static inline int
+sl_evt_shm_trigger(struct sl_evt_shm *shm, sl_evt_id_t id)
+{
+	if (unlikely(!id || id > SL_EVT_MAX)) return 0;
+	while (1) {
+		unsigned long p = ps_load(&shm->pending[id]);
+
+		/* already in the ring: coalesce the edges */
+		if (p == SL_EVT_QUEUED || p == SL_EVT_RETRIGGERED) return 0;
+		if (p == SL_EVT_DELIVERED && ps_cas(&shm->pending[id], p, SL_EVT_RETRIGGERED)) return 0;
+		if (p == SL_EVT_IDLE && ps_cas(&shm->pending[id], p, SL_EVT_QUEUED)) break;
+	}
+	__sl_evt_shm_enqueue(shm, id);
+
+	return ps_load(&shm->waiting) && ps_cas(&shm->waiting, 1, 0);
+}
+
+/* shm is the ready ring, either in this component, or a shared cbuf */
+void        sl_evt_init(struct sl_evt *e, struct sl_evt_shm *shm);
+/* Add an event, with data to return from sl_evt_wait.  Returns 0 on failure. */
+sl_evt_id_t sl_evt_add(struct sl_evt *e, void *data);
+int         sl_evt_rem(struct sl_evt *e, sl_evt_id_t id);
+/* Trigger an event from a thread of this component. */
+int         sl_evt_trigger(struct sl_evt *e, sl_evt_id_t id);
+/*
+ * Wait for at most max triggered events.  Blocks until there is at
+ * least one, or until abs_timeout (if it isn't 0).  Returns the number
+ * of events in res.
+ */
+int         sl_evt_wait(struct sl_evt *e, struct sl_evt_res *res, int max, cycles_t abs_timeout);
+/*
+ * A receive thread for asynchronous notifications to the set.  If id
+ * is not 0, each notification triggers it, otherwise it only wakes up
+ * the waiter for events in the ring.
+ */
+struct sl_thd *sl_evt_rcv_alloc(struct sl_evt *e, sl_evt_id_t id);
+
+#endif /* SL_EVT_H */
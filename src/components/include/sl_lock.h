@@ -21,7 +21,8 @@ sl_lock_take(struct sl_lock *lock)
 {
 	sl_cs_enter();
 	while (lock->holder != 0) {
-		sl_thd_yield_cs_exit(lock->holder);
+		/* run the holder at our priority until it releases the lock */
+		if (sl_thd_block_dep_cs_exit(lock->holder, 0)) sl_thd_yield(0);
 		sl_cs_enter();
 	}
 	lock->holder = sl_thdid();
@@ -38,7 +39,9 @@ sl_lock_release(struct sl_lock *lock)
 	sl_cs_enter();
 	assert(lock->holder == sl_thdid());
 	lock->holder = 0;
-	sl_cs_exit();
+	/* the waiters we ran on behalf of can now take the lock */
+	if (sl_thd_dependents_release(sl_thd_curr())) sl_cs_exit_schedule();
+	else                                          sl_cs_exit();
 }
 
 
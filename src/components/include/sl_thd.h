@@ -12,6 +12,8 @@
 #include <cos_debug.h>
 
 #define SL_THD_EVENT_LIST event_list
+#define SL_THD_DEP_LIST dep_list
+#define SL_THD_REPLENISH_LIST replenish_list
 
 typedef enum {
 	SL_THD_FREE = 0,
@@ -40,7 +42,8 @@ struct sl_thd {
 	struct cos_aep_info *aepinfo;
 	asndcap_t            sndcap;
 	tcap_prio_t          prio;
-	struct sl_thd       *dependency;
+	struct sl_thd       *dependency; /* run this thread instead of us (see sl_thd_block) */
+	cycles_t             dep_timeout; /* when the dependency expires, 0 if never */
 
 	tcap_res_t budget;        /* budget if this thread has it's own tcap */
 	cycles_t   last_replenish;
@@ -50,8 +53,11 @@ struct sl_thd {
 	cycles_t   wakeup_cycs;   /* actual last wakeup - used in timeout API for jitter information, etc */
 	int        timeout_idx;   /* timeout heap index, used in timeout API */
 
-	struct event_info event_info;
-	struct ps_list    SL_THD_EVENT_LIST; /* list of events for the scheduler end-point */
+	struct event_info   event_info;
+	struct ps_list      SL_THD_EVENT_LIST; /* list of events for the scheduler end-point */
+	struct ps_list      SL_THD_DEP_LIST;   /* in the dependents of our dependency */
+	struct ps_list_head dependents;        /* threads with a dependency on us */
+	struct ps_list      SL_THD_REPLENISH_LIST; /* threads with a budget (see sl_replenish_expired) */
 };
 
 static inline struct cos_aep_info *
@@ -1,6 +1,16 @@
 #ifndef   	FD_H
 #define   	FD_H
 
+#include <cbuf.h>
+#include <sys/uio.h>
+
+/*
+ * Descriptors are numbered as in POSIX: the fd component never
+ * returns those of the standard streams, so libposix can send writes
+ * to other descriptors here.
+ */
+#define FD_POSIX_STD 3
+
 int cos_app_open(int type, struct cos_array *data);
 int cos_socket(int domain, int type, int protocol);
 int cos_listen(int fd, int queue);
@@ -10,7 +20,34 @@ int cos_close(int fd);
 int cos_split(int fd);
 int cos_write(int fd, char *buf, int sz);
 int cos_read(int fd, char *buf, int sz);
+/* 
+ * Network descriptors' events are edge-triggered (see net_recv): read
+ * them until cos_read returns 0 before waiting on them again.
+ */
 int cos_wait(int fd);
 int cos_wait_all(void);
 
+/*
+ * Scatter-gather versions of cos_read/cos_write: the client stubs
+ * gather the iovecs into one cbuf (or scatter the cbuf of received
+ * data into them), so each is a single invocation of the fd
+ * component, which passes the cbuf on to the network without copying
+ * it.  Return the bytes written/read, or -errno.
+ */
+int cos_fd_writev(int fd, const struct iovec *iov, int iovcnt);
+int cos_fd_readv(int fd, const struct iovec *iov, int iovcnt);
+/*
+ * Wait for at least one descriptor to be ready, and return the number
+ * (up to max) of ready descriptors written to fds.
+ */
+int cos_wait_many(int *fds, int max);
+
+/* The fd component's side of the above (called by its server stubs) */
+int cos_fd_writev_cbuf(int fd, cbuf_t cb, int sz);
+int cos_fd_readv_cbuf(int fd, int sz, cbuf_t *cb, int *off, int *len);
+
+/* the most data moved by one vectored call (a shorter count is returned) */
+#define FD_IOV_MAX_SZ 0xFFFF
+#define FD_WAIT_MANY_MAX 32
+
 #endif 	    /* !FD_H */
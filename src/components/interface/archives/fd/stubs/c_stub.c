@@ -0,0 +1,98 @@
+#include <fd.h>
+#include <cstub.h>
+#include <string.h>
+#include <errno.h>
+
+static int
+__fd_iov_sz(const struct iovec *iov, int iovcnt)
+{
+	int i, sz = 0;
+
+	for (i = 0; i < iovcnt; i++) {
+		if (sz + iov[i].iov_len > FD_IOV_MAX_SZ) return FD_IOV_MAX_SZ;
+		sz += iov[i].iov_len;
+	}
+
+	return sz;
+}
+
+CSTUB_FN(int, cos_fd_writev)(struct usr_inv_cap *uc,
+			     int fd, const struct iovec *iov, int iovcnt)
+{
+	int ret, i, off, sz;
+	long fault = 0;
+	char *d;
+	cbuf_t cb;
+
+	if (iovcnt < 0) return -EINVAL;
+	sz = __fd_iov_sz(iov, iovcnt);
+	if (sz == 0) return 0;
+
+	d = cbuf_alloc(sz, &cb);
+	if (!d) return -ENOMEM;
+	for (i = 0, off = 0; off < sz; i++) {
+		int len = iov[i].iov_len;
+
+		if (off + len > sz) len = sz - off;
+		memcpy(d + off, iov[i].iov_base, len);
+		off += len;
+	}
+	cbuf_send(cb);
+
+	CSTUB_INVOKE(ret, fault, uc, 3, fd, cb, sz);
+
+	cbuf_free(cb);
+	return ret;
+}
+
+/* The received data is returned in a cbuf, at offset off */
+CSTUB_FN(int, cos_fd_readv)(struct usr_inv_cap *uc,
+			    int fd, const struct iovec *iov, int iovcnt)
+{
+	int ret, i, off, len, sz;
+	long fault = 0;
+	char *d;
+
+	if (iovcnt < 0) return -EINVAL;
+	sz = __fd_iov_sz(iov, iovcnt);
+	if (sz == 0) return 0;
+
+	CSTUB_INVOKE_3RETS(ret, fault, off, len, uc, 2, fd, sz);
+	if (ret <= 0) return ret;
+
+	d = cbuf2buf(ret, off + len);
+	assert(d && len <= sz);
+	d += off;
+	for (i = 0, off = 0; off < len; i++) {
+		int l = iov[i].iov_len;
+
+		if (off + l > len) l = len - off;
+		memcpy(iov[i].iov_base, d + off, l);
+		off += l;
+	}
+	cbuf_free(ret);
+
+	return len;
+}
+
+CSTUB_FN(int, cos_wait_many)(struct usr_inv_cap *uc,
+			     int *fds, int max)
+{
+	int ret;
+	long fault = 0;
+	int *d;
+	cbuf_t cb;
+
+	if (max <= 0) return -EINVAL;
+	if (max > FD_WAIT_MANY_MAX) max = FD_WAIT_MANY_MAX;
+
+	d = cbuf_alloc(max * sizeof(int), &cb);
+	if (!d) return -ENOMEM;
+	cbuf_send(cb);
+
+	CSTUB_INVOKE(ret, fault, uc, 2, cb, max);
+
+	if (ret > 0) memcpy(fds, d, ret * sizeof(int));
+	cbuf_free(cb);
+	return ret;
+}
@@ -0,0 +1,40 @@
+#include <fd.h>
+#include <errno.h>
+
+int
+__sg_cos_fd_writev(int fd, cbuf_t cb, int sz)
+{
+	if (unlikely(sz <= 0 || sz > FD_IOV_MAX_SZ)) return -EINVAL;
+
+	/* maps (and releases) the cbuf itself */
+	return cos_fd_writev_cbuf(fd, cb, sz);
+}
+
+/* Returns the cbuf with the data (0 without data), or -errno */
+int
+__sg_cos_fd_readv(int fd, int sz, int __pad0, int __pad1, int *off_len)
+{
+	cbuf_t cb;
+	int    ret;
+
+	if (unlikely(sz <= 0 || sz > FD_IOV_MAX_SZ)) return -EINVAL;
+	ret = cos_fd_readv_cbuf(fd, sz, &cb, &off_len[0], &off_len[1]);
+	if (ret) return ret;
+	assert((int)cb >= 0);
+
+	return (int)cb;
+}
+
+int
+__sg_cos_wait_many(cbuf_t cb, int max)
+{
+	int *fds, ret;
+
+	if (unlikely(max <= 0 || max > FD_WAIT_MANY_MAX)) return -EINVAL;
+	fds = cbuf2buf(cb, max * sizeof(int));
+	if (unlikely(!fds)) return -EFAULT;
+	ret = cos_wait_many(fds, max);
+	cbuf_free(cb);
+
+	return ret;
+}
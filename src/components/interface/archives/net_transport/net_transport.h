@@ -2,6 +2,7 @@
 #define   	NET_TRANSPORT_H
 
 #include <cos_net.h>
+#include <cbuf.h>
 
 net_connection_t net_create_tcp_connection(spdid_t spdid, u16_t tid, long evt_id);
 net_connection_t net_create_udp_connection(spdid_t spdid, long evt_id);
@@ -12,6 +13,18 @@ int net_bind(spdid_t spdid, net_connection_t nc, u32_t ip, u16_t port);
 int net_connect(spdid_t spdid, net_connection_t nc, u32_t ip, u16_t port);
 int net_close(spdid_t spdid, net_connection_t nc);
 int net_send(spdid_t spdid, net_connection_t nc, void *data, int sz);
+/* 
+ * The connection's event is edge-triggered: it is triggered once
+ * for the data arriving after a receive found none (returned 0).  A
+ * client must receive until it gets 0 (or an error) before waiting
+ * on the event again, or it can wait while data is queued.  Data
+ * received before a reset is returned before -EPIPE.
+ */
 int net_recv(spdid_t spdid, net_connection_t nc, void *data, int sz);
+/* Zero-copy versions: the connection references the sent cbuf until
+ * its data is acknowledged, and received data is returned in a cbuf
+ * (with the data at *off) that the client must cbuf_free. */
+int net_send_cbuf(spdid_t spdid, net_connection_t nc, cbuf_t cb, int sz);
+int net_recv_cbuf(spdid_t spdid, net_connection_t nc, int *off, int *sz);
 
 #endif 	    /* !NET_TRANSPORT_H */
@@ -0,0 +1,12 @@
+#include <net_transport.h>
+#include <cstub.h>
+
+/* The offset and size of the received data are returned in registers */
+CSTUB_FN(int, net_recv_cbuf)(struct usr_inv_cap *uc,
+			     spdid_t spdid, net_connection_t nc, int *off, int *sz)
+{
+	int ret;
+	long fault = 0;
+	CSTUB_INVOKE_3RETS(ret, fault, *off, *sz, uc, 2, spdid, nc);
+	return ret;
+}
@@ -0,0 +1,7 @@
+#include <net_transport.h>
+
+int
+__sg_net_recv_cbuf(spdid_t spdid, net_connection_t nc, int __pad0, int __pad1, int *off_sz)
+{
+	return net_recv_cbuf(spdid, nc, &off_sz[0], &off_sz[1]);
+}
@@ -7,5 +7,10 @@ content_req_t static_open(spdid_t spdid, long evt_id, struct cos_array *data);
 int static_request(spdid_t spdid, content_req_t cr, struct cos_array *data);
 int static_retrieve(spdid_t spdid, content_req_t cr, struct cos_array *data, int *more);
 int static_close(spdid_t spdid, content_req_t cr);
+/*
+ * Map the full response (HTTP header and body) read-only into the
+ * client's npages at dest, and return its length.
+ */
+int static_alias(spdid_t spdid, content_req_t cr, vaddr_t dest, int npages);
 
 #endif 	    /* !STATIC_CONTENT_H */
@@ -0,0 +1,88 @@
+/**
+ * Redistribution of this file is permitted under the GNU General
+ * Public License v2.
+ *
+ * A key-value store with the table-space API of the archived luakv,
+ * on a native hash table.
+ *
+ * Keys and values are passed in records in a cbuf of the client, and
+ * a value is returned by reference into its table's arena (a cbuf of
+ * the server), so neither is copied through the invocation.  The
+ * batch operations take n consecutive records from the start of the
+ * cbuf.  The batched get writes the references into the records, so
+ * its cbuf must be allocated with cbuf_alloc_shared.
+ *
+ * The space of a replaced value is reused, so a reference is only
+ * valid until its key is put again.
+ */
+
+#ifndef KEYVAL_H
+#define KEYVAL_H
+
+#include <cos_component.h>
+#include <cbuf.h>
+#include <string.h>
+
+struct keyval_rec {
+	u16_t klen;
+	u16_t vlen;
+	u32_t ref;     /* get: the value's reference, 0 if the key isn't found */
+	char  data[0]; /* the key, followed by the value for put */
+};
+
+#define KEYVAL_REC_SZ(klen, vlen) round_up_to_pow2(sizeof(struct keyval_rec) + (klen) + (vlen), 4)
+
+/* A reference to a value: a cbuf, and the offset of its entry in it. */
+#define KEYVAL_REF_OFF_BITS 20
+#define KEYVAL_REF(cb, off) (((cb) << KEYVAL_REF_OFF_BITS) | (off))
+#define KEYVAL_REF_CB(ref) ((ref) >> KEYVAL_REF_OFF_BITS)
+#define KEYVAL_REF_OFF(ref) ((ref) & ((1 << KEYVAL_REF_OFF_BITS) - 1))
+
+/* Returns the table named by the record's key, creating it if needed, or -errno. */
+int  keyval_tablespace(spdid_t spdid, cbuf_t cb, int off);
+int  keyval_put(spdid_t spdid, int table, cbuf_t cb, int off);
+/* Returns the reference to the value (see keyval_value), or 0 if the key isn't found. */
+long keyval_get(spdid_t spdid, int table, cbuf_t cb, int off);
+/* Returns the number of records put. */
+int  keyval_put_batch(spdid_t spdid, int table, cbuf_t cb, int n);
+/* Sets each record's ref, and returns the number of keys found (-EINVAL if cb isn't shared). */
+int  keyval_get_batch(spdid_t spdid, int table, cbuf_t cb, int n);
+
+/* Write a record at buf, and return the space it takes. */
+static inline int
+keyval_rec_write(void *buf, const char *key, u16_t klen, const void *val, u16_t vlen)
+{
+	struct keyval_rec *r = buf;
+
+	r->klen = klen;
+	r->vlen = vlen;
+	r->ref  = 0;
+	memcpy(r->data, key, klen);
+	if (val) memcpy(r->data + klen, val, vlen);
+
+	return KEYVAL_REC_SZ(klen, vlen);
+}
+
+static inline struct keyval_rec *
+keyval_rec_next(struct keyval_rec *r, int with_val)
+{
+	return (struct keyval_rec *)((char *)r + KEYVAL_REC_SZ(r->klen, with_val ? r->vlen : 0));
+}
+
+/* The value, mapped from its arena, of a reference returned by get. */
+static inline void *
+keyval_value(u32_t ref, u16_t *vlen)
+{
+	cbuf_t             cb = KEYVAL_REF_CB(ref);
+	struct keyval_rec *e;
+
+	if (!ref || !cbuf_valid(cb)) return NULL;
+	e = cbuf2buf(cb, cbuf_size(cb));
+	if (!e) return NULL;
+	e = (struct keyval_rec *)((char *)e + KEYVAL_REF_OFF(ref));
+	if (vlen) *vlen = e->vlen;
+
+	return e->data + e->klen;
+}
+
+#endif /* KEYVAL_H */
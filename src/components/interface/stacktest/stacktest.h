@@ -0,0 +1,7 @@
+#ifndef STACKTEST_H
+#define STACKTEST_H
+
+/* The address of the invocation stack the server ran on. */
+vaddr_t stacktest_stack(void);
+
+#endif /* STACKTEST_H */
@@ -0,0 +1,107 @@
+/**
+ * Redistribution of this file is permitted under the GNU General
+ * Public License v2.
+ *
+ * The client side of the cbuf library: reference counting in the
+ * shared array, and lazy mapping of cbufs into our window.
+ */
+
+#include <cos_component.h>
+#include <cos_debug.h>
+#include <ps.h>
+#include <cbuf.h>
+
+static sinvcap_t         cbuf_mgr;
+static vaddr_t           cbuf_base;
+static struct cbuf_meta *cbuf_meta;   /* read-only */
+static unsigned long *   cbuf_refcnt;
+
+int
+cbuf_client_init(sinvcap_t mgr)
+{
+	vaddr_t base = round_up_to_pgd_page((vaddr_t)cos_get_heap_ptr());
+
+	cos_set_heap_ptr((void *)(base + CBUF_VAS_WINDOW));
+	if ((vaddr_t)cos_sinv(mgr, CBUF_OP_REGISTER, base, 0, 0) != base) return -EINVAL;
+
+	cbuf_mgr  = mgr;
+	cbuf_base = base;
+	cbuf_meta   = (struct cbuf_meta *)base;
+	cbuf_refcnt = (unsigned long *)(base + CBUF_META_SZ);
+
+	return 0;
+}
+
+void *
+cbuf2buf(cbuf_t cb, unsigned long len)
+{
+	if (unlikely(!cbuf_valid(cb) || len > cbuf_size(cb))) return NULL;
+
+	/* Common case: the manager has mapped the cbuf into us. */
+	if (unlikely(!cbuf_meta_mapped(&cbuf_meta[cb], cos_spd_id()))) {
+		if ((vaddr_t)cos_sinv(cbuf_mgr, CBUF_OP_MAP, cb, 0, 0) != cbuf_base + cbuf_offset(cb)) return NULL;
+	}
+
+	return (void *)(cbuf_base + cbuf_offset(cb));
+}
+
+int
+cbuf_writable(cbuf_t cb)
+{
+	volatile struct cbuf_meta *m;
+
+	if (unlikely(!cbuf_valid(cb))) return 0;
+	m = &cbuf_meta[cb];
+
+	return m->owner == cos_spd_id() || (m->flags & CBUF_FLAG_SHARED);
+}
+
+static cbuf_t
+__cbuf_alloc(unsigned long sz, void **buf, unsigned long flags)
+{
+	unsigned int order = CBUF_MIN_ORDER;
+	cbuf_t       cb;
+
+	while (order <= CBUF_MAX_ORDER && (unsigned long)(PAGE_SIZE << order) < sz) order++;
+	if (order > CBUF_MAX_ORDER) return 0;
+
+	cb = cos_sinv(cbuf_mgr, CBUF_OP_ALLOC, order | flags, 0, 0);
+	if (!cbuf_valid(cb)) return 0;
+
+	*buf = cbuf2buf(cb, sz);
+	if (!*buf) {
+		cbuf_free(cb);
+		return 0;
+	}
+
+	return cb;
+}
+
+cbuf_t
+cbuf_alloc(unsigned long sz, void **buf)
+{
+	return __cbuf_alloc(sz, buf, 0);
+}
+
+cbuf_t
+cbuf_alloc_shared(unsigned long sz, void **buf)
+{
+	return __cbuf_alloc(sz, buf, CBUF_ALLOC_SHARED);
+}
+
+void
+cbuf_send(cbuf_t cb)
+{
+	assert(cbuf_valid(cb));
+
+	ps_faa(&cbuf_refcnt[cb], 1);
+}
+
+void
+cbuf_free(cbuf_t cb)
+{
+	assert(cbuf_valid(cb));
+
+	/* the last reference returns it to the manager */
+	if (ps_faa(&cbuf_refcnt[cb], -1) == 1) cos_sinv(cbuf_mgr, CBUF_OP_FREE, cb, 0, 0);
+}
@@ -0,0 +1,276 @@
+/**
+ * Redistribution of this file is permitted under the GNU General
+ * Public License v2.
+ *
+ * The cbuf manager.  Allocation and freeing are served from per-core
+ * freelists of each order, and only creating new cbufs (or stealing
+ * them from another core) takes the manager's lock.  A cbuf is only
+ * mapped into a client when it first asks for it (cbuf2buf): writable
+ * for its owner (or for anyone, if it was allocated shared), and
+ * read-only for others.  When the last reference is dropped, it is
+ * unmapped from all but its owner, and it is unmapped from (and
+ * cleared for) the owner when another component allocates it.
+ */
+
+#include <cos_component.h>
+#include <cos_debug.h>
+#include <string.h>
+#include <ps.h>
+#include <cbuf_mgr.h>
+
+static inline void
+__cbuf_mapped_set(struct cbuf_meta *meta, spdid_t spdid)
+{
+	meta->mapped[(spdid - 1) / 32] |= 1 << ((spdid - 1) % 32);
+}
+
+static inline void
+__cbuf_mapped_clear(struct cbuf_meta *meta, spdid_t spdid)
+{
+	meta->mapped[(spdid - 1) / 32] &= ~(1 << ((spdid - 1) % 32));
+}
+
+static inline int
+__cbuf_mgr_spdid_valid(spdid_t spdid)
+{
+	return spdid > 0 && spdid <= MAX_NUM_SPDS;
+}
+
+static inline void
+__freelist_take(struct cbuf_mgr_freelist *fl)
+{
+	while (!ps_cas(&fl->lock, 0, 1))
+		;
+}
+
+static inline void
+__freelist_release(struct cbuf_mgr_freelist *fl)
+{
+	ps_mem_fence();
+	fl->lock = 0;
+}
+
+static cbuf_t
+__freelist_pop(struct cbuf_mgr_freelist *fl, unsigned int o)
+{
+	cbuf_t cb = 0;
+
+	__freelist_take(fl);
+	if (fl->n[o] > 0) cb = fl->cbs[o][--fl->n[o]];
+	__freelist_release(fl);
+
+	return cb;
+}
+
+static void
+__freelist_push(struct cbuf_mgr_freelist *fl, cbuf_t cb)
+{
+	unsigned int o = cbuf_order(cb) - CBUF_MIN_ORDER;
+
+	__freelist_take(fl);
+	assert(fl->n[o] < CBUF_PER_ORDER);
+	fl->cbs[o][fl->n[o]++] = cb;
+	__freelist_release(fl);
+}
+
+/* Called with the lock taken. */
+static void
+__cbuf_unmap(struct cbuf_mgr *m, cbuf_t cb, spdid_t spdid)
+{
+	struct cbuf_mgr_client *c = &m->clients[spdid];
+	unsigned long           off;
+
+	if (!cbuf_meta_mapped(&m->meta[cb], spdid)) return;
+	/* the client must map it again before it can use it */
+	__cbuf_mapped_clear(&m->meta[cb], spdid);
+	ps_mem_fence();
+	for (off = 0; off < cbuf_size(cb); off += PAGE_SIZE) {
+		cos_mem_remove(c->ci->pgtbl_cap, c->base + cbuf_offset(cb) + off);
+	}
+}
+
+/* Slow path: create a new cbuf of the order, or steal one from another core. */
+static cbuf_t
+__cbuf_create(struct cbuf_mgr *m, unsigned int o)
+{
+	cbuf_t  cb = 0;
+	vaddr_t mem;
+	int     i;
+
+	m->lock();
+	if (m->ncreated[o] < CBUF_PER_ORDER) {
+		mem = (vaddr_t)cos_page_bump_allocn(m->ci, PAGE_SIZE << (o + CBUF_MIN_ORDER));
+		if (mem) {
+			cb          = cbuf_id(o + CBUF_MIN_ORDER, m->ncreated[o]++);
+			m->bufs[cb] = mem;
+		}
+	}
+	m->unlock();
+	if (cb) return cb;
+
+	for (i = 0; i < NUM_CPU && !cb; i++) cb = __freelist_pop(&m->freelists[i], o);
+
+	return cb;
+}
+
+static long
+__cbuf_alloc(struct cbuf_mgr *m, spdid_t spdid, unsigned long arg)
+{
+	struct cbuf_meta *meta;
+	spdid_t           prev;
+	cbuf_t            cb;
+	unsigned int      order = arg & ~CBUF_ALLOC_SHARED, o;
+
+	if (order - CBUF_MIN_ORDER >= CBUF_NORDERS) return 0;
+	o = order - CBUF_MIN_ORDER;
+
+	/* Common case: a cbuf this core freed */
+	cb = __freelist_pop(&m->freelists[cos_cpuid()], o);
+	if (!cb) cb = __cbuf_create(m, o);
+	if (!cb) return 0;
+	if (!ps_cas(&m->inuse[cb], 0, 1)) BUG();
+
+	meta = &m->meta[cb];
+	prev = meta->owner;
+	m->lock();
+	if (prev && prev != spdid) {
+		/* the previous owner mustn't see, or leave, the new owner's data */
+		__cbuf_unmap(m, cb, prev);
+		memset((void *)m->bufs[cb], 0, cbuf_size(cb));
+	}
+	meta->owner = spdid;
+	meta->flags = arg & CBUF_ALLOC_SHARED ? CBUF_FLAG_SHARED : 0;
+	m->unlock();
+	ps_mem_fence();
+	m->refcnt[cb] = 1;
+
+	return cb;
+}
+
+static long
+__cbuf_map(struct cbuf_mgr *m, spdid_t spdid, cbuf_t cb)
+{
+	struct cbuf_mgr_client *c    = &m->clients[spdid];
+	struct cbuf_meta *      meta = &m->meta[cb];
+	vaddr_t                 dst  = c->base + cbuf_offset(cb);
+	unsigned long           off;
+	int                     ro, ret = 0;
+
+	if (!cbuf_valid(cb) || !ps_load(&m->inuse[cb]) || !c->base) return 0;
+
+	m->lock();
+	/* only the owner may write a cbuf that isn't shared */
+	ro = meta->owner != spdid && !(meta->flags & CBUF_FLAG_SHARED);
+	if (!cbuf_meta_mapped(meta, spdid)) {
+		for (off = 0; off < cbuf_size(cb); off += PAGE_SIZE) {
+			if (ro) ret = cos_mem_alias_ro_at(c->ci, dst + off, m->ci, m->bufs[cb] + off);
+			else    ret = cos_mem_alias_at(c->ci, dst + off, m->ci, m->bufs[cb] + off);
+			if (ret) break;
+		}
+		if (ret) {
+			/* don't leave it partially mapped */
+			while (off > 0) {
+				off -= PAGE_SIZE;
+				cos_mem_remove(c->ci->pgtbl_cap, dst + off);
+			}
+		} else {
+			__cbuf_mapped_set(meta, spdid);
+		}
+	}
+	m->unlock();
+	if (ret) return 0;
+
+	return dst;
+}
+
+static long
+__cbuf_free(struct cbuf_mgr *m, spdid_t spdid, cbuf_t cb)
+{
+	spdid_t owner;
+	int     i;
+
+	if (!cbuf_valid(cb) || ps_load(&m->refcnt[cb])) return -EINVAL;
+	/* only one free can succeed */
+	if (!ps_cas(&m->inuse[cb], 1, 0)) return -EINVAL;
+
+	/* Nobody holds a reference, so only the owner keeps its mapping. */
+	owner = m->meta[cb].owner;
+	m->lock();
+	for (i = 1; i <= MAX_NUM_SPDS; i++) {
+		if (i != owner) __cbuf_unmap(m, cb, i);
+	}
+	m->unlock();
+	__freelist_push(&m->freelists[cos_cpuid()], cb);
+
+	return 0;
+}
+
+static long
+__cbuf_register(struct cbuf_mgr *m, spdid_t spdid, vaddr_t base)
+{
+	struct cbuf_mgr_client *c = &m->clients[spdid];
+	unsigned long           off;
+
+	if (!c->ci || c->base || !base || base != round_up_to_pgd_page(base)) return 0;
+
+	m->lock();
+	if (!cos_pgtbl_intern_alloc(m->ci, c->ci->pgtbl_cap, base, CBUF_VAS_WINDOW)) {
+		m->unlock();
+		return 0;
+	}
+	for (off = 0; off < CBUF_META_SZ; off += PAGE_SIZE) {
+		cos_mem_alias_ro_at(c->ci, base + off, m->ci, (vaddr_t)m->meta + off);
+	}
+	for (off = 0; off < CBUF_REFCNT_SZ; off += PAGE_SIZE) {
+		cos_mem_alias_at(c->ci, base + CBUF_META_SZ + off, m->ci, (vaddr_t)m->refcnt + off);
+	}
+	c->base = base;
+	m->unlock();
+
+	return base;
+}
+
+long
+cbuf_mgr_invoke(struct cbuf_mgr *m, spdid_t spdid, cbuf_op_t op, unsigned long arg)
+{
+	if (!__cbuf_mgr_spdid_valid(spdid)) return -EINVAL;
+
+	switch (op) {
+	case CBUF_OP_REGISTER:
+		return __cbuf_register(m, spdid, arg);
+	case CBUF_OP_ALLOC:
+		return __cbuf_alloc(m, spdid, arg);
+	case CBUF_OP_MAP:
+		return __cbuf_map(m, spdid, arg);
+	case CBUF_OP_FREE:
+		return __cbuf_free(m, spdid, arg);
+	default:
+		return -EINVAL;
+	}
+}
+
+void
+cbuf_mgr_client_add(struct cbuf_mgr *m, spdid_t spdid, struct cos_compinfo *client)
+{
+	assert(__cbuf_mgr_spdid_valid(spdid) && client);
+
+	m->clients[spdid] = (struct cbuf_mgr_client){ .ci = client, .base = 0 };
+}
+
+void
+cbuf_mgr_init(struct cbuf_mgr *m, struct cos_compinfo *ci, void (*lock)(void), void (*unlock)(void))
+{
+	assert(m && ci && lock && unlock);
+
+	memset(m, 0, sizeof(struct cbuf_mgr));
+	m->ci     = ci;
+	m->lock   = lock;
+	m->unlock = unlock;
+
+	m->meta = cos_page_bump_allocn(ci, CBUF_META_SZ);
+	assert(m->meta);
+	memset(m->meta, 0, CBUF_META_SZ);
+	m->refcnt = cos_page_bump_allocn(ci, CBUF_REFCNT_SZ);
+	assert(m->refcnt);
+	memset(m->refcnt, 0, CBUF_REFCNT_SZ);
+}
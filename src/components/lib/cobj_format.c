@@ -62,7 +62,7 @@ cobj_vaddr_get(struct cobj_header *h, u32_t vaddr)
 
 		s = cobj_sect_get(h, i);
 		if (vaddr < s->vaddr || vaddr >= s->vaddr + s->bytes) continue;
-		if (s->flags & COBJ_SECT_ZEROS) return NULL;
+		if (s->flags & (COBJ_SECT_ZEROS | COBJ_SECT_COMPRESSED)) return NULL;
 		return cobj_sect_contents(h, i) + (vaddr - s->vaddr);
 	}
 	return NULL;
@@ -120,6 +120,83 @@ cobj_sect_addr(struct cobj_header *h, unsigned int sect_id)
 	return s->vaddr;
 }
 
+u32_t
+cobj_sect_payload(struct cobj_header *h, unsigned int sect_id)
+{
+	struct cobj_sect *s;
+
+	s = cobj_sect_get(h, sect_id);
+	if (!s || s->flags & COBJ_SECT_UNINIT) return 0;
+
+	return s->payload;
+}
+
+int
+cobj_sect_shareable(struct cobj_header *h, unsigned int sect_id)
+{
+	struct cobj_sect *s, *next;
+
+	s = cobj_sect_get(h, sect_id);
+	if (!s || !s->bytes) return 0;
+	/*
+	 * INITONCE doesn't matter here: read-only sections are all
+	 * INITONCE, and the writable INITONCE section is excluded as
+	 * writable.
+	 */
+	if (s->flags & (COBJ_SECT_WRITE | COBJ_SECT_ZEROS | COBJ_SECT_KMEM | COBJ_SECT_CINFO)) return 0;
+	if (s->vaddr % PAGE_SIZE) return 0;
+	/* cannot share the last page with the next section */
+	next = cobj_sect_get(h, sect_id + 1);
+	if (next && next->vaddr < round_up_to_page(s->vaddr + s->bytes)) return 0;
+
+	return 1;
+}
+
+int
+cobj_sect_identical(struct cobj_header *h1, unsigned int s1, struct cobj_header *h2, unsigned int s2)
+{
+	struct cobj_sect *a, *b;
+
+	a = cobj_sect_get(h1, s1);
+	b = cobj_sect_get(h2, s2);
+	if (!a || !b) return 0;
+	/*
+	 * The link address doesn't matter: pages with the same contents
+	 * can be mapped anywhere (both sections are page-aligned).
+	 */
+	if (a->bytes != b->bytes || a->payload != b->payload) return 0;
+	if ((a->flags ^ b->flags) & (COBJ_SECT_ZEROS | COBJ_SECT_COMPRESSED)) return 0;
+
+	/* the same payload with the same encoding */
+	return !memcmp(((char *)h1) + a->offset, ((char *)h2) + b->offset, a->payload);
+}
+
+int
+cobj_sect_mappable(struct cobj_header *h, unsigned int sect_id)
+{
+	struct cobj_sect *s;
+
+	if (!(h->flags & COBJ_PAGE_ALIGNED)) return 0;
+	/* Only read-only, uncompressed bodies can be shared with the object. */
+	if (!cobj_sect_shareable(h, sect_id)) return 0;
+	s = cobj_sect_get(h, sect_id);
+	if (s->flags & COBJ_SECT_COMPRESSED || s->offset % PAGE_SIZE) return 0;
+
+	return 1;
+}
+
+int
+cobj_sect_decompress(struct cobj_header *h, unsigned int sect_id, char *mem)
+{
+	struct cobj_sect *s;
+
+	s = cobj_sect_get(h, sect_id);
+	if (!s || !(s->flags & COBJ_SECT_COMPRESSED)) return -1;
+	if (cobj_lz_decompress(((char *)h) + s->offset, s->payload, mem, s->bytes) != s->bytes) return -1;
+
+	return 0;
+}
+
 struct cobj_header *
 cobj_create(u32_t id, char *name, u32_t nsect, u32_t sect_sz, u32_t nsymb, u32_t ncap, char *space, unsigned int sz,
             u32_t flags)
@@ -143,7 +220,7 @@ cobj_create(u32_t id, char *name, u32_t nsect, u32_t sect_sz, u32_t nsymb, u32_t
 	h->nsymb = nsymb;
 	h->ncap  = ncap;
 	h->size  = tot_sz;
-	h->flags = flags;
+	h->flags = (flags & ~COBJ_VERSION_MASK) | (COBJ_VERSION << COBJ_VERSION_SHIFT);
 
 	memset(&h[1], 0, sect_symb_cap_sz);
 
@@ -170,7 +247,7 @@ cobj_sect_init(struct cobj_header *h, unsigned int sect_idx, u32_t flags, u32_t
 	} else {
 		s = cobj_sect_get(h, sect_idx - 1);
 		if (s->flags & COBJ_SECT_UNINIT) return -1;
-		offset = (s->flags & COBJ_SECT_ZEROS) ? s->offset : s->offset + s->bytes;
+		offset = s->offset + s->payload;
 	}
 	if (!(flags & COBJ_SECT_ZEROS) && offset + size > h->size) return -1;
 
@@ -179,6 +256,7 @@ cobj_sect_init(struct cobj_header *h, unsigned int sect_idx, u32_t flags, u32_t
 	s->bytes  = size;
 	s->vaddr  = vaddr;
 	s->flags  = flags;
+	s->payload = (flags & COBJ_SECT_ZEROS) ? 0 : size;
 
 	return 0;
 }
@@ -216,8 +294,317 @@ cobj_cap_init(struct cobj_header *h, unsigned int cap_idx, u32_t cap_off, u32_t
 	return 0;
 }
 
+u32_t
+cobj_pack_size_req(struct cobj_header *h)
+{
+	u32_t i, sz;
+
+	sz = round_up_to_page(cobj_sect_content_offset(h));
+	for (i = 0; i < h->nsect; i++) {
+		struct cobj_sect *s = cobj_sect_get(h, i);
+
+		if (s->flags & COBJ_SECT_ZEROS) continue;
+		sz += round_up_to_page(s->bytes);
+	}
+
+	return sz;
+}
+
+struct cobj_header *
+cobj_pack(struct cobj_header *h, char *space, u32_t sz, int compress)
+{
+	struct cobj_header *n = (struct cobj_header *)space;
+	u32_t               i, off;
+
+	if (!space || (unsigned long)space % PAGE_SIZE || sz < cobj_pack_size_req(h)) return NULL;
+	if (h->flags & COBJ_PAGE_ALIGNED) return NULL;
+
+	memset(space, 0, sz);
+	memcpy(n, h, cobj_sect_content_offset(h));
+	off = round_up_to_page(cobj_sect_content_offset(h));
+
+	for (i = 0; i < n->nsect; i++) {
+		struct cobj_sect *s    = cobj_sect_get(n, i);
+		char *            body = cobj_sect_contents(h, i);
+		u32_t             csz  = 0;
+
+		if (s->flags & COBJ_SECT_ZEROS) {
+			s->offset  = off;
+			s->payload = 0;
+			continue;
+		}
+
+		/* Compress read-only sections, if it saves at least 1/8th. */
+		if (compress && s->bytes && !(s->flags & (COBJ_SECT_WRITE | COBJ_SECT_KMEM | COBJ_SECT_CINFO))) {
+			u32_t max = s->bytes - s->bytes / 8;
+
+			off = round_up_to_pow2(off, sizeof(u32_t));
+			csz = cobj_lz_compress(body, s->bytes, space + off, max);
+			if (!csz) memset(space + off, 0, max);
+		}
+		if (csz) {
+			s->flags |= COBJ_SECT_COMPRESSED;
+			s->offset  = off;
+			s->payload = csz;
+			off += csz;
+			continue;
+		}
+
+		off = round_up_to_page(off);
+		memcpy(space + off, body, s->bytes);
+		s->offset  = off;
+		s->payload = s->bytes;
+		off += s->bytes;
+	}
+	n->size = round_up_to_page(off);
+	n->flags |= COBJ_PAGE_ALIGNED;
+
+	return n;
+}
+
+/*
+ * A simple LZ4-like format.  Each sequence is a token (high nibble:
+ * literal count, low nibble: match length - COBJ_LZ_MINMATCH, 15 in
+ * either means more length bytes follow, each adding up to 255),
+ * the literals, a 16 bit little-endian offset back into the output,
+ * and the match length bytes.  The last sequence has only literals.
+ */
+#define COBJ_LZ_HASH_ORD 12
+#define COBJ_LZ_MINMATCH 4
+#define COBJ_LZ_MAXOFF 0xFFFF
+
+static inline u32_t
+cobj_lz_hash(const unsigned char *p)
+{
+	u32_t v = p[0] | (p[1] << 8) | (p[2] << 16) | ((u32_t)p[3] << 24);
+
+	return (v * 2654435761U) >> (32 - COBJ_LZ_HASH_ORD);
+}
+
+static unsigned char *
+cobj_lz_len_put(unsigned char *op, unsigned char *oend, u32_t len)
+{
+	for (; len >= 255; len -= 255) {
+		if (op >= oend) return NULL;
+		*op++ = 255;
+	}
+	if (op >= oend) return NULL;
+	*op++ = len;
+
+	return op;
+}
+
+static unsigned char *
+cobj_lz_seq_put(unsigned char *op, unsigned char *oend, const unsigned char *lit, u32_t nlit, u32_t off, u32_t mlen)
+{
+	u32_t mcode = mlen ? mlen - COBJ_LZ_MINMATCH : 0;
+
+	if (op >= oend) return NULL;
+	*op++ = ((nlit < 15 ? nlit : 15) << 4) | (mcode < 15 ? mcode : 15);
+	if (nlit >= 15 && !(op = cobj_lz_len_put(op, oend, nlit - 15))) return NULL;
+	if ((u32_t)(oend - op) < nlit) return NULL;
+	memcpy(op, lit, nlit);
+	op += nlit;
+	if (!mlen) return op;
+
+	if (oend - op < 2) return NULL;
+	*op++ = off & 0xFF;
+	*op++ = off >> 8;
+	if (mcode >= 15 && !(op = cobj_lz_len_put(op, oend, mcode - 15))) return NULL;
+
+	return op;
+}
+
+u32_t
+cobj_lz_compress(const char *src, u32_t src_sz, char *dst, u32_t dst_sz)
+{
+	u32_t                table[1 << COBJ_LZ_HASH_ORD];
+	const unsigned char *base = (const unsigned char *)src;
+	const unsigned char *ip = base, *anchor = base, *iend = base + src_sz;
+	unsigned char *      op = (unsigned char *)dst, *oend = op + dst_sz;
+
+	memset(table, 0, sizeof(table));
+	while (iend - ip >= COBJ_LZ_MINMATCH) {
+		u32_t                h   = cobj_lz_hash(ip);
+		const unsigned char *ref = base + table[h];
+		u32_t                mlen;
+
+		table[h] = ip - base;
+		if (ref >= ip || ip - ref > COBJ_LZ_MAXOFF || memcmp(ref, ip, COBJ_LZ_MINMATCH)) {
+			ip++;
+			continue;
+		}
+		for (mlen = COBJ_LZ_MINMATCH; ip + mlen < iend && ref[mlen] == ip[mlen]; mlen++)
+			;
+
+		op = cobj_lz_seq_put(op, oend, anchor, ip - anchor, ip - ref, mlen);
+		if (!op) return 0;
+		ip += mlen;
+		anchor = ip;
+	}
+	op = cobj_lz_seq_put(op, oend, anchor, iend - anchor, 0, 0);
+	if (!op) return 0;
+
+	return op - (unsigned char *)dst;
+}
+
+static inline int
+cobj_lz_len_get(const unsigned char **ip, const unsigned char *iend, u32_t *len)
+{
+	unsigned char b;
+
+	do {
+		if (*ip >= iend) return -1;
+		b = *(*ip)++;
+		*len += b;
+	} while (b == 255);
+
+	return 0;
+}
+
+u32_t
+cobj_lz_decompress(const char *src, u32_t src_sz, char *dst, u32_t dst_sz)
+{
+	const unsigned char *ip = (const unsigned char *)src, *iend = ip + src_sz;
+	unsigned char *      op = (unsigned char *)dst, *oend = op + dst_sz;
+
+	while (ip < iend) {
+		unsigned char token = *ip++;
+		u32_t         nlit  = token >> 4, mlen = token & 0xF, off;
+
+		if (nlit == 15 && cobj_lz_len_get(&ip, iend, &nlit)) return 0;
+		if ((u32_t)(iend - ip) < nlit || (u32_t)(oend - op) < nlit) return 0;
+		memcpy(op, ip, nlit);
+		ip += nlit;
+		op += nlit;
+		/* the last sequence has no match */
+		if (ip == iend) break;
+
+		if (iend - ip < 2) return 0;
+		off = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (mlen == 15 && cobj_lz_len_get(&ip, iend, &mlen)) return 0;
+		mlen += COBJ_LZ_MINMATCH;
+		if (!off || off > (u32_t)(op - (unsigned char *)dst) || (u32_t)(oend - op) < mlen) return 0;
+		/* matches can overlap their output, so copy bytewise */
+		for (; mlen > 0; mlen--, op++) *op = *(op - off);
+	}
+
+	return op - (unsigned char *)dst;
+}
+
 #ifdef TESTING
 #include <malloc.h>
+#include <stdlib.h>
+
+static int
+test_lz_roundtrip(const char *name, const char *src, u32_t sz)
+{
+	char *c = malloc(sz + sz / 2 + 16), *d = malloc(sz);
+	u32_t csz, dsz;
+
+	csz = cobj_lz_compress(src, sz, c, sz + sz / 2 + 16);
+	dsz = csz ? cobj_lz_decompress(c, csz, d, sz) : 0;
+	printf("lz %s: %d -> %d -> %d bytes\n", name, sz, csz, dsz);
+	if (!csz || dsz != sz || memcmp(src, d, sz)) {
+		printf("lz %s: FAIL\n", name);
+		return -1;
+	}
+	free(c);
+	free(d);
+
+	return 0;
+}
+
+static int
+test_lz(void)
+{
+	u32_t sz = 3 * PAGE_SIZE + 17, i;
+	char *src = malloc(sz), *c = malloc(sz), *d = malloc(sz);
+	u32_t csz;
+
+	memset(src, 0, sz);
+	if (test_lz_roundtrip("zeros", src, sz)) return -1;
+	for (i = 0; i < sz; i++) src[i] = "int main(void) { return 0; }\n"[i % 29] + (i / 1000);
+	if (test_lz_roundtrip("text", src, sz)) return -1;
+	/* incompressible input doesn't fit in a smaller buffer... */
+	srand(42);
+	for (i = 0; i < sz; i++) src[i] = rand();
+	csz = cobj_lz_compress(src, sz, c, sz - sz / 8);
+	printf("lz random: %d -> %d bytes (0 expected)\n", sz, csz);
+	if (csz) return -1;
+	/* ...but still round-trips given the space */
+	if (test_lz_roundtrip("random", src, sz)) return -1;
+	/* a match reaching before the start of the output is malformed */
+	c[0] = 0x10; c[1] = 'a'; c[2] = 2; c[3] = 0;
+	if (cobj_lz_decompress(c, 4, d, sz)) return -1;
+	/* as is a truncated input */
+	for (i = 0; i < sz; i++) src[i] = "int main(void) { return 0; }\n"[i % 29];
+	csz = cobj_lz_compress(src, sz, c, sz);
+	if (!csz || cobj_lz_decompress(c, csz / 2, d, sz) == sz) return -1;
+
+	free(src);
+	free(c);
+	free(d);
+
+	return 0;
+}
+
+/*
+ * Pack an object with page-aligned text (read-only and init-once, as
+ * the linker makes it), data and bss, and check which sections the
+ * booter will map directly.
+ */
+static int
+test_pack(int compress)
+{
+	u32_t               sz = cobj_size_req(3, 3 * PAGE_SIZE, 0, 0), psz, i;
+	char *              mem = malloc(sz), *pmem, *body;
+	struct cobj_header *h, *p;
+
+	h = cobj_create(0, "packtest", 3, 3 * PAGE_SIZE, 0, 0, mem, sz, COBJ_INIT_THD);
+	if (!h || cobj_version(h) != COBJ_VERSION || !(h->flags & COBJ_INIT_THD)) return -1;
+	if (cobj_sect_init(h, 0, COBJ_SECT_READ | COBJ_SECT_INITONCE, 0x40000000, 2 * PAGE_SIZE)
+	    || cobj_sect_init(h, 1, COBJ_SECT_READ | COBJ_SECT_WRITE, 0x40002000, 100)
+	    || cobj_sect_init(h, 2, COBJ_SECT_READ | COBJ_SECT_WRITE | COBJ_SECT_ZEROS, 0x40002064, 5000)) {
+		return -1;
+	}
+	body = cobj_sect_contents(h, 0);
+	for (i = 0; i < 2 * PAGE_SIZE; i++) body[i] = i % 251;
+	memset(cobj_sect_contents(h, 1), 'd', 100);
+	if (!cobj_sect_shareable(h, 0) || cobj_sect_shareable(h, 1) || cobj_sect_shareable(h, 2)) return -1;
+	/* not page-aligned yet */
+	if (cobj_sect_mappable(h, 0)) return -1;
+
+	psz  = cobj_pack_size_req(h);
+	pmem = memalign(PAGE_SIZE, psz);
+	p    = cobj_pack(h, pmem, psz, compress);
+	if (!p || p->size % PAGE_SIZE || !(p->flags & COBJ_PAGE_ALIGNED)) return -1;
+	printf("pack%s: %d -> %d bytes, text %s\n", compress ? " (compressed)" : "", h->size, p->size,
+	       cobj_sect_mappable(p, 0) ? "mapped" : "copied");
+	if (cobj_sect_mappable(p, 1) || cobj_sect_mappable(p, 2)) return -1;
+	if (compress) {
+		char *out = malloc(2 * PAGE_SIZE);
+
+		if (cobj_sect_mappable(p, 0) || cobj_sect_decompress(p, 0, out)) return -1;
+		if (memcmp(out, body, 2 * PAGE_SIZE)) return -1;
+		free(out);
+	} else {
+		if (!cobj_sect_mappable(p, 0)) return -1;
+		if (memcmp(cobj_sect_contents(p, 0), body, 2 * PAGE_SIZE)) return -1;
+	}
+	if (memcmp(cobj_sect_contents(p, 1), cobj_sect_contents(h, 1), 100)) return -1;
+	/* the encoding is part of a section's identity */
+	if (cobj_sect_identical(h, 0, p, 0) != !compress) return -1;
+	/* but its address is not */
+	cobj_sect_get(p, 0)->vaddr += 16 * PAGE_SIZE;
+	if (cobj_sect_identical(h, 0, p, 0) != !compress) return -1;
+
+	free(mem);
+	free(pmem);
+
+	return 0;
+}
 
 int
 main(void)
@@ -257,6 +644,12 @@ main(void)
 	printf("data_offset %x, sect 0 data %x, sect 1 data %x\n", (u32_t)h + cobj_sect_content_offset(h),
 	       cobj_sect_contents(h, 0), cobj_sect_contents(h, 1));
 
+	if (test_lz() || test_pack(0) || test_pack(1)) {
+		printf("fail\n");
+		return -1;
+	}
+	printf("success\n");
+
 	return 0;
 }
 #endif
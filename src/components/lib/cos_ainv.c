@@ -0,0 +1,100 @@
+/**
+ * Redistribution of this file is permitted under the GNU General
+ * Public License v2.
+ *
+ * The set-up of asynchronous invocations, and the server's side (see
+ * cos_ainv.h).
+ */
+
+#include <cos_component.h>
+#include <cos_debug.h>
+#include <cos_ainv.h>
+
+void
+cos_ainv_client_init(struct cos_ainv_client *c, struct cos_chan *sq, struct cos_chan *cq, asndcap_t srv_snd,
+                     arcvcap_t rcv)
+{
+	assert(c && sq && cq);
+
+	*c = (struct cos_ainv_client){ .sq = sq, .cq = cq, .srv_snd = srv_snd, .rcv = rcv };
+}
+
+void
+cos_ainv_srv_init(struct cos_ainv_srv *s, arcvcap_t rcv, cos_ainv_fn_t fn)
+{
+	assert(s && fn);
+
+	memset(s, 0, sizeof(struct cos_ainv_srv));
+	s->rcv = rcv;
+	s->fn  = fn;
+}
+
+int
+cos_ainv_srv_client_add(struct cos_ainv_srv *s, u16_t client, struct cos_chan *sq, struct cos_chan *cq,
+                        asndcap_t snd)
+{
+	if (client >= COS_AINV_MAX_CLIENTS || !sq || !cq || s->clients[client].sq) return -EINVAL;
+
+	s->clients[client] = (struct cos_ainv_srv_client){ .sq = sq, .cq = cq, .snd = snd };
+
+	return 0;
+}
+
+/*
+ * Execute a batch of a client's requests.  A well-behaved client has
+ * no more requests outstanding than its completion ring holds, so
+ * there is room for all of them.  Those of a client that exceeds that
+ * would have nowhere to complete, so we drop them, rather than block
+ * the other clients behind it.
+ */
+static unsigned int
+__ainv_client_process(struct cos_ainv_srv *s, u16_t client)
+{
+	struct cos_ainv_srv_client *c = &s->clients[client];
+	struct cos_ainv_req         reqs[COS_AINV_BATCH];
+	struct cos_ainv_cmpl        cmpls[COS_AINV_BATCH];
+	unsigned int                n, i, room;
+
+	n = cos_chan_dequeue(c->sq, reqs, COS_AINV_BATCH);
+	if (!n) return 0;
+
+	room = cos_chan_capacity(c->cq) - cos_chan_size(c->cq);
+	if (unlikely(n > room)) n = room;
+	for (i = 0; i < n; i++) {
+		struct cos_ainv_req *r = &reqs[i];
+
+		cmpls[i] = (struct cos_ainv_cmpl){ .id = r->id, .ret = s->fn(client, r->op, r->args[0], r->args[1], r->args[2]) };
+	}
+	if (n) cos_chan_enqueue_spsc(c->cq, cmpls, n, c->snd);
+
+	return n;
+}
+
+int
+cos_ainv_srv_process(struct cos_ainv_srv *s)
+{
+	unsigned int i, n;
+
+	while (1) {
+		int ready = 0;
+
+		for (i = 0, n = 0; i < COS_AINV_MAX_CLIENTS; i++) {
+			if (!s->clients[i].sq) continue;
+			n += __ainv_client_process(s, i);
+		}
+		if (n) return n;
+
+		/* make our heads visible before checking the rings again */
+		ps_mem_fence();
+		for (i = 0; i < COS_AINV_MAX_CLIENTS; i++) {
+			if (s->clients[i].sq && cos_chan_ready(s->clients[i].sq)) ready = 1;
+		}
+		if (!ready) cos_rcv(s->rcv, 0, NULL);
+	}
+}
+
+void
+cos_ainv_srv_loop(struct cos_ainv_srv *s)
+{
+	while (1) cos_ainv_srv_process(s);
+}
@@ -0,0 +1,47 @@
+/**
+ * Redistribution of this file is permitted under the GNU General
+ * Public License v2.
+ *
+ * Setting up shared-memory channels (see cos_chan.h).  This is done
+ * by a component with the page-tables of both ends, e.g. their
+ * parent.
+ */
+
+#include <cos_component.h>
+#include <cos_debug.h>
+#include <cos_chan.h>
+
+struct cos_chan *
+cos_chan_alloc(struct cos_compinfo *ci, unsigned int esz, unsigned int nents)
+{
+	struct cos_chan *c;
+
+	if (!esz || !nents || (nents & (nents - 1))) return NULL;
+
+	c = cos_page_bump_allocn(ci, COS_CHAN_SZ(esz, nents));
+	if (!c) return NULL;
+	memset(c, 0, sizeof(struct cos_chan));
+	c->esz  = esz;
+	c->mask = nents - 1;
+	/* no entry is published */
+	memset(__cos_chan_seq(c, 0), 0, sizeof(unsigned long) * nents);
+
+	return c;
+}
+
+vaddr_t
+cos_chan_alias(struct cos_compinfo *dstci, struct cos_compinfo *srcci, struct cos_chan *c)
+{
+	unsigned long sz = COS_CHAN_SZ(c->esz, cos_chan_capacity(c)), off;
+	vaddr_t       dst, addr;
+
+	dst = cos_mem_alias(dstci, srcci, (vaddr_t)c);
+	if (!dst) return 0;
+	for (off = PAGE_SIZE; off < sz; off += PAGE_SIZE) {
+		addr = cos_mem_alias(dstci, srcci, (vaddr_t)c + off);
+		/* the ring must be virtually contiguous in dstci */
+		if (addr != dst + off) BUG();
+	}
+
+	return dst;
+}
@@ -61,21 +61,15 @@ cos_defcompinfo_init_ext(tcap_t sched_tc, thdcap_t sched_thd, arcvcap_t sched_rc
 	curr_defci_init_status = INITIALIZED;
 }
 
-int
-cos_defcompinfo_child_alloc(struct cos_defcompinfo *child_defci, vaddr_t entry, vaddr_t heap_ptr, capid_t cap_frontier,
-                            int is_sched)
+static void
+__defcompinfo_child_aep_alloc(struct cos_defcompinfo *child_defci, int is_sched)
 {
-	int                     ret;
 	struct cos_defcompinfo *defci     = cos_defcompinfo_curr_get();
 	struct cos_aep_info *   sched_aep = cos_sched_aep_get(defci);
 	struct cos_compinfo *   ci        = cos_compinfo_get(defci);
 	struct cos_aep_info *   child_aep = cos_sched_aep_get(child_defci);
 	struct cos_compinfo *   child_ci  = cos_compinfo_get(child_defci);
 
-	assert(curr_defci_init_status == INITIALIZED);
-	ret = cos_compinfo_alloc(child_ci, heap_ptr, cap_frontier, entry, ci);
-	if (ret) return ret;
-
 	child_aep->thd = cos_initthd_alloc(ci, child_ci->comp_cap);
 	assert(child_aep->thd);
 
@@ -92,6 +86,40 @@ cos_defcompinfo_child_alloc(struct cos_defcompinfo *child_defci, vaddr_t entry,
 
 	child_aep->fn   = NULL;
 	child_aep->data = NULL;
+}
+
+int
+cos_defcompinfo_child_alloc(struct cos_defcompinfo *child_defci, vaddr_t entry, vaddr_t heap_ptr, capid_t cap_frontier,
+                            int is_sched)
+{
+	int                     ret;
+	struct cos_defcompinfo *defci    = cos_defcompinfo_curr_get();
+	struct cos_compinfo *   ci       = cos_compinfo_get(defci);
+	struct cos_compinfo *   child_ci = cos_compinfo_get(child_defci);
+
+	assert(curr_defci_init_status == INITIALIZED);
+	ret = cos_compinfo_alloc(child_ci, heap_ptr, cap_frontier, entry, ci);
+	if (ret) return ret;
+	__defcompinfo_child_aep_alloc(child_defci, is_sched);
+
+	return ret;
+}
+
+int
+cos_defcompinfo_fork(struct cos_defcompinfo *child_defci, struct cos_defcompinfo *parent_defci, vaddr_t entry,
+                     vaddr_t vas_base, struct cos_vas_range *shared, int nshared, int is_sched)
+{
+	int                     ret;
+	struct cos_defcompinfo *defci     = cos_defcompinfo_curr_get();
+	struct cos_compinfo *   ci        = cos_compinfo_get(defci);
+	struct cos_compinfo *   child_ci  = cos_compinfo_get(child_defci);
+	struct cos_compinfo *   parent_ci = cos_compinfo_get(parent_defci);
+
+	assert(curr_defci_init_status == INITIALIZED);
+	assert(parent_defci != defci);
+	ret = cos_compinfo_fork(child_ci, parent_ci, vas_base, entry, shared, nshared, ci);
+	if (ret) return ret;
+	__defcompinfo_child_aep_alloc(child_defci, is_sched);
 
 	return ret;
 }
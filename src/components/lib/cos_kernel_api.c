@@ -618,6 +618,72 @@ cos_compinfo_alloc(struct cos_compinfo *ci, vaddr_t heap_ptr, capid_t cap_fronti
 	return 0;
 }
 
+static int
+__vas_range_contains(struct cos_vas_range *r, int n, vaddr_t addr)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (addr >= r[i].addr && addr - r[i].addr < r[i].sz) return 1;
+	}
+
+	return 0;
+}
+
+int
+cos_compinfo_fork(struct cos_compinfo *ci, struct cos_compinfo *parent, vaddr_t vas_base, vaddr_t entry,
+                  struct cos_vas_range *shared, int nshared, struct cos_compinfo *ci_resources)
+{
+	capid_t cap;
+	vaddr_t addr;
+	int     ret;
+
+	printd("cos_compinfo_fork\n");
+
+	assert(ci && parent && ci_resources);
+	assert(parent->vas_frontier > vas_base);
+	assert(nshared == 0 || shared);
+
+	if (cos_compinfo_alloc(ci, parent->vas_frontier, BOOT_CAPTBL_FREE, entry, ci_resources)) return -1;
+
+	/* Grow the child's captbl to cover the parent's, and mirror its layout. */
+	while (ci->cap_frontier < parent->cap_frontier) {
+		ci->cap_frontier += CAPMAX_ENTRY_SZ;
+		if (__capid_captbl_check_expand(ci)) return -1;
+	}
+	ci->cap_frontier   = parent->cap_frontier;
+	ci->cap16_frontier = parent->cap16_frontier;
+	ci->cap32_frontier = parent->cap32_frontier;
+	ci->cap64_frontier = parent->cap64_frontier;
+
+	/*
+	 * We don't know the type of each capability, so try each
+	 * slot: empty slots fail with -ENOENT, and the slots in the
+	 * middle of larger capabilities with -EEXIST (the child's
+	 * slot was taken by the copy of the capability's first slot).
+	 */
+	for (cap = BOOT_CAPTBL_FREE; cap < parent->cap_frontier; cap += CAP16B_IDSZ) {
+		ret = call_cap_op(parent->captbl_cap, CAPTBL_OP_CPY, cap, ci->captbl_cap, cap, 0);
+		if (ret && ret != -ENOENT && ret != -EEXIST) return ret;
+	}
+
+	/* The child's page-table nodes, then the pages themselves (unmapped pages fail and are skipped). */
+	if (!cos_pgtbl_intern_alloc(ci, ci->pgtbl_cap, round_to_pgd_page(vas_base),
+	                            ci->vasrange_frontier - round_to_pgd_page(vas_base))) {
+		return -1;
+	}
+	for (addr = vas_base; addr < parent->vas_frontier; addr += PAGE_SIZE) {
+		if (__vas_range_contains(shared, nshared, addr)) {
+			ret = call_cap_op(parent->pgtbl_cap, CAPTBL_OP_CPY, addr, ci->pgtbl_cap, addr, 0);
+		} else {
+			ret = cos_mem_cow_at(ci, addr, parent, addr);
+		}
+		if (ret && ret != -ENOENT) return ret;
+	}
+
+	return 0;
+}
+
 sinvcap_t
 cos_sinv_alloc(struct cos_compinfo *srcci, compcap_t dstcomp, vaddr_t entry, unsigned long token)
 {
@@ -839,11 +905,33 @@ cos_mem_alias_at(struct cos_compinfo *dstci, vaddr_t dst, struct cos_compinfo *s
 	return 0;
 }
 
+vaddr_t
+cos_mem_alias_ro(struct cos_compinfo *dstci, struct cos_compinfo *srcci, vaddr_t src)
+{
+	vaddr_t dst;
+
+	assert(srcci && dstci);
+
+	dst = __page_bump_valloc(dstci, PAGE_SIZE);
+	if (unlikely(!dst)) return 0;
+
+	if (cos_mem_alias_ro_at(dstci, dst, srcci, src)) return 0;
+
+	return dst;
+}
+
+int
+cos_mem_alias_ro_at(struct cos_compinfo *dstci, vaddr_t dst, struct cos_compinfo *srcci, vaddr_t src)
+{
+	assert(srcci && dstci);
+
+	return call_cap_op(srcci->pgtbl_cap, CAPTBL_OP_CPY, src, dstci->pgtbl_cap, dst, 1);
+}
+
 int
 cos_mem_remove(pgtblcap_t pt, vaddr_t addr)
 {
-	assert(0);
-	return 0;
+	return call_cap_op(pt, CAPTBL_OP_MEMDEACTIVATE, addr, 0, 0, 0);
 }
 
 vaddr_t
@@ -872,6 +960,45 @@ cos_mem_move_at(struct cos_compinfo *dstci, vaddr_t dst, struct cos_compinfo *sr
 	return 0;
 }
 
+vaddr_t
+cos_mem_cow(struct cos_compinfo *dstci, struct cos_compinfo *srcci, vaddr_t src)
+{
+	vaddr_t dst;
+
+	assert(srcci && dstci);
+
+	dst = __page_bump_valloc(dstci, PAGE_SIZE);
+	if (unlikely(!dst)) return 0;
+
+	if (cos_mem_cow_at(dstci, dst, srcci, src)) return 0;
+
+	return dst;
+}
+
+int
+cos_mem_cow_at(struct cos_compinfo *dstci, vaddr_t dst, struct cos_compinfo *srcci, vaddr_t src)
+{
+	assert(srcci && dstci);
+
+	return call_cap_op(srcci->pgtbl_cap, CAPTBL_OP_MEMCOW, src, dstci->pgtbl_cap, dst, 0);
+}
+
+int
+cos_mem_cow_reserve(struct cos_compinfo *ci, int npages)
+{
+	struct cos_compinfo *meta = __compinfo_metacap(ci);
+	int                  i;
+
+	for (i = 0; i < npages; i++) {
+		vaddr_t umem = __umem_bump_alloc(ci);
+
+		if (!umem) return -ENOMEM;
+		if (call_cap_op(meta->mi.pgtbl_cap, CAPTBL_OP_MEMCOW_DONATE, umem, 0, 0, 0)) return -EINVAL;
+	}
+
+	return 0;
+}
+
 /* TODO: generalize to modify all state */
 int
 cos_thd_mod(struct cos_compinfo *ci, thdcap_t tc, void *tlsaddr)
@@ -926,6 +1053,26 @@ cos_tcap_delegate(asndcap_t dst, tcap_t src, tcap_res_t res, tcap_prio_t prio, t
 	return call_cap_op(src, CAPTBL_OP_TCAP_DELEGATE, dst, res, prio_higher, prio_lower);
 }
 
+int
+cos_tcap_refill(tcap_t src, struct cos_tcap_refill *r, int n)
+{
+	int done = 0, ret;
+
+	while (done < n) {
+		/* the kernel reads the refills from a single page */
+		vaddr_t addr = (vaddr_t)&r[done];
+		int     m    = (round_up_to_page(addr + 1) - addr) / sizeof(struct cos_tcap_refill);
+
+		if (m > n - done) m = n - done;
+		ret = call_cap_op(src, CAPTBL_OP_TCAP_REFILL, addr, m, 0, 0);
+		if (ret < 0) return ret;
+		done += ret;
+		if (ret < m) break;
+	}
+
+	return done;
+}
+
 int
 cos_tcap_merge(tcap_t dst, tcap_t rm)
 {
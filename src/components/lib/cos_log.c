@@ -0,0 +1,132 @@
+/**
+ * Redistribution of this file is permitted under the GNU General
+ * Public License v2.
+ *
+ * Writing to, and draining, the log rings (see cos_log.h).
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <cos_component.h>
+#include <cos_debug.h>
+#include <ps.h>
+#include <cos_log.h>
+
+static struct cos_log_ring cos_log_rings[NUM_CPU];
+static int                 cos_log_on;
+
+static const char *cos_log_lvls[] = { "ERR", "WRN", "INF", "DBG" };
+
+void
+cos_log_init(void)
+{
+	cos_log_on = 1;
+}
+
+struct cos_log_ring *
+cos_log_ring(int cpu)
+{
+	return &cos_log_rings[cpu];
+}
+
+/*
+ * The length vsnprintf wrote, bounded to the buffer: it returns the
+ * length it would have written, or a negative value on an error.
+ */
+static inline int
+__cos_log_len(int len, int sz)
+{
+	if (len < 0) return 0;
+	if (len >= sz) return sz - 1;
+	return len;
+}
+
+/* Reserve a record, or return NULL if the ring is full. */
+static struct cos_log_rec *
+__cos_log_reserve(struct cos_log_ring *r, unsigned long *idx)
+{
+	unsigned long t;
+
+	do {
+		t = ps_load(&r->tail);
+		if (t - ps_load(&r->head) >= COS_LOG_NRECS) {
+			ps_faa(&r->dropped, 1);
+			return NULL;
+		}
+	} while (!ps_cas(&r->tail, t, t + 1));
+	*idx = t;
+
+	return &r->recs[t & (COS_LOG_NRECS - 1)];
+}
+
+int
+cos_logf(cos_log_level_t level, const char *fmt, ...)
+{
+	struct cos_log_rec *rec;
+	unsigned long       idx;
+	va_list             args;
+	int                 len;
+
+	if (unlikely(!cos_log_on)) {
+		char s[COS_LOG_MSG_SZ];
+
+		va_start(args, fmt);
+		len = vsnprintf(s, COS_LOG_MSG_SZ, fmt, args);
+		va_end(args);
+		len = __cos_log_len(len, COS_LOG_MSG_SZ);
+		cos_print(s, len);
+
+		return len;
+	}
+
+	rec = __cos_log_reserve(&cos_log_rings[cos_cpuid()], &idx);
+	if (!rec) return 0;
+
+	rdtscll(rec->tsc);
+	rec->thdid = cos_thdid();
+	rec->level = level;
+	va_start(args, fmt);
+	len = vsnprintf(rec->msg, COS_LOG_MSG_SZ, fmt, args);
+	va_end(args);
+	len      = __cos_log_len(len, COS_LOG_MSG_SZ);
+	rec->len = len;
+	/* publish the record to the drain */
+	ps_mem_fence();
+	rec->seq = idx + 1;
+
+	return len;
+}
+
+int
+cos_log_drain(int cpu, cos_log_level_t level, int max)
+{
+	struct cos_log_ring *r = &cos_log_rings[cpu];
+	unsigned long        h = r->head, dropped;
+	int                  n = 0, len;
+	char                 s[COS_LOG_REC_SZ + 48];
+
+	for (; n < max; h++, n++) {
+		struct cos_log_rec *rec = &r->recs[h & (COS_LOG_NRECS - 1)];
+
+		/* a writer has reserved, but not yet written, the record */
+		if (ps_load(&rec->seq) != h + 1) break;
+		if (rec->level <= level) {
+			len = snprintf(s, sizeof(s), "[%llu c%d s%d t%d %s] %.*s", rec->tsc, cpu, (int)cos_spd_id(),
+			               rec->thdid, cos_log_lvls[rec->level & 3], rec->len, rec->msg);
+			len = __cos_log_len(len, sizeof(s));
+			cos_print(s, len);
+		}
+		ps_mem_fence();
+		r->head = h + 1;
+	}
+
+	dropped = ps_load(&r->dropped);
+	if (dropped && ps_cas(&r->dropped, dropped, 0)) {
+		len = snprintf(s, sizeof(s), "[c%d] %lu log records dropped\n", cpu, dropped);
+		len = __cos_log_len(len, sizeof(s));
+		cos_print(s, len);
+	}
+
+	return n;
+}
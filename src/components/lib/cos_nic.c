@@ -0,0 +1,181 @@
+/**
+ * Redistribution of this file is permitted under the GNU General
+ * Public License v2.
+ *
+ * Polled-mode network ports, and the pair device (see cos_nic.h).
+ */
+
+#include <cos_component.h>
+#include <cos_debug.h>
+#include <cos_nic.h>
+
+unsigned int
+cos_nic_reclaim(struct cos_nic *n)
+{
+	struct cos_nic_desc d[COS_NIC_BURST];
+	unsigned int        i, cnt;
+
+	cnt = cos_chan_dequeue(n->done, d, COS_NIC_BURST);
+	for (i = 0; i < cnt; i++) {
+		/* the device returns the malformed descriptors as well */
+		if (d[i].buf < n->nbufs) cos_nic_buf_free(n, d[i].buf);
+	}
+
+	return cnt;
+}
+
+unsigned int
+cos_nic_refill(struct cos_nic *n, unsigned int cnt)
+{
+	struct cos_nic_desc d[COS_NIC_BURST];
+	unsigned int        i, tot = 0, b;
+
+	while (tot < cnt && n->nfree) {
+		for (b = 0; b < COS_NIC_BURST && tot + b < cnt && n->nfree; b++) {
+			d[b].buf = n->free[--n->nfree];
+			d[b].len = COS_NIC_BUF_SZ;
+		}
+		i = cos_chan_enqueue_spsc(n->fill, d, b, 0);
+		assert(i == b);
+		tot += b;
+	}
+
+	return tot;
+}
+
+unsigned int
+cos_nic_rx_wait(struct cos_nic *n, struct cos_nic_desc *d, unsigned int max, arcvcap_t rcv)
+{
+	unsigned int ret = cos_nic_rx_burst(n, d, max);
+
+	if (ret) {
+		/* under load: poll, rather than take a notification per burst */
+		if (ret == max && !n->polling) {
+			n->polling = 1;
+			cos_chan_poll(n->rx, 1);
+		}
+		n->idle = 0;
+
+		return ret;
+	}
+	if (n->polling && ++n->idle < COS_NIC_POLL_IDLE) return 0;
+
+	/* back to notifications */
+	n->polling = 0;
+	n->idle    = 0;
+	if (cos_chan_poll(n->rx, 0)) return cos_nic_rx_burst(n, d, max);
+
+	return cos_chan_dequeue_wait(n->rx, d, max, rcv);
+}
+
+int
+cos_nic_init(struct cos_nic *n, struct cos_compinfo *ci, unsigned int nbufs)
+{
+	unsigned int i;
+
+	if (!nbufs || nbufs > COS_NIC_MAX_BUFS || (nbufs & (nbufs - 1))) return -EINVAL;
+
+	memset(n, 0, sizeof(struct cos_nic));
+	n->fill = cos_chan_alloc(ci, sizeof(struct cos_nic_desc), nbufs);
+	n->rx   = cos_chan_alloc(ci, sizeof(struct cos_nic_desc), nbufs);
+	n->tx   = cos_chan_alloc(ci, sizeof(struct cos_nic_desc), nbufs);
+	n->done = cos_chan_alloc(ci, sizeof(struct cos_nic_desc), nbufs);
+	n->bufs = cos_page_bump_allocn(ci, round_up_to_page(nbufs * COS_NIC_BUF_SZ));
+	if (!n->fill || !n->rx || !n->tx || !n->done || !n->bufs) return -ENOMEM;
+	n->nbufs = nbufs;
+
+	for (i = 0; i < nbufs; i++) cos_nic_buf_free(n, nbufs - 1 - i);
+	/* half of the buffers to receive into, the other half to transmit */
+	cos_nic_refill(n, nbufs / 2);
+
+	return 0;
+}
+
+int
+cos_nic_alias(struct cos_nic *dst, struct cos_compinfo *dstci, struct cos_compinfo *srcci, struct cos_nic *src)
+{
+	unsigned long sz = round_up_to_page(src->nbufs * COS_NIC_BUF_SZ), off;
+	vaddr_t       addr;
+
+	memset(dst, 0, sizeof(struct cos_nic));
+	dst->fill = (struct cos_chan *)cos_chan_alias(dstci, srcci, src->fill);
+	dst->rx   = (struct cos_chan *)cos_chan_alias(dstci, srcci, src->rx);
+	dst->tx   = (struct cos_chan *)cos_chan_alias(dstci, srcci, src->tx);
+	dst->done = (struct cos_chan *)cos_chan_alias(dstci, srcci, src->done);
+	if (!dst->fill || !dst->rx || !dst->tx || !dst->done) return -ENOMEM;
+
+	dst->bufs = (char *)cos_mem_alias(dstci, srcci, (vaddr_t)src->bufs);
+	if (!dst->bufs) return -ENOMEM;
+	for (off = PAGE_SIZE; off < sz; off += PAGE_SIZE) {
+		addr = cos_mem_alias(dstci, srcci, (vaddr_t)src->bufs + off);
+		/* the pool must be virtually contiguous in dstci */
+		if (addr != (vaddr_t)dst->bufs + off) BUG();
+	}
+	dst->nbufs = src->nbufs;
+
+	return 0;
+}
+
+unsigned int
+cos_nic_pair_xfer(struct cos_nic *from, struct cos_nic *to, unsigned int budget)
+{
+	struct cos_nic_desc tx[COS_NIC_BURST], rx[COS_NIC_BURST];
+	unsigned int        ntx, nrx, nvalid = 0, i, f, r;
+
+	if (budget > COS_NIC_BURST) budget = COS_NIC_BURST;
+	ntx = cos_chan_dequeue(from->tx, tx, budget);
+	if (!ntx) return 0;
+
+	/* the descriptors come from the stack: ignore the malformed */
+	for (i = 0; i < ntx; i++) {
+		if (tx[i].buf < from->nbufs && tx[i].len > 0 && tx[i].len <= COS_NIC_BUF_SZ) nvalid++;
+		else tx[i].len = 0;
+	}
+	nrx = cos_chan_dequeue(to->fill, rx, nvalid);
+	for (i = 0, f = 0, r = 0; i < ntx && f < nrx; i++) {
+		if (!tx[i].len) continue;
+		/* as are malformed fill descriptors */
+		while (f < nrx && rx[f].buf >= to->nbufs) f++;
+		if (f == nrx) break;
+		memcpy(cos_nic_buf(to, rx[f].buf), cos_nic_buf(from, tx[i].buf), tx[i].len);
+		rx[r].buf = rx[f].buf;
+		rx[r].len = tx[i].len;
+		r++;
+		f++;
+	}
+	/* a NIC with no (valid) fill buffers drops the packets */
+	to->rx_drops += nvalid - r;
+
+	if (r) cos_chan_enqueue_spsc(to->rx, rx, r, to->rx_snd);
+	cos_chan_enqueue_spsc(from->done, tx, ntx, 0);
+
+	return ntx;
+}
+
+void
+cos_nic_pair_loop(struct cos_nic *a, struct cos_nic *b, arcvcap_t rcv)
+{
+	unsigned int moved, idle = 0;
+	int          polling = 0, pending;
+
+	while (1) {
+		moved = cos_nic_pair_xfer(a, b, COS_NIC_BURST);
+		if (a != b) moved += cos_nic_pair_xfer(b, a, COS_NIC_BURST);
+		if (moved) {
+			if (!polling) {
+				polling = 1;
+				cos_chan_poll(a->tx, 1);
+				cos_chan_poll(b->tx, 1);
+			}
+			idle = 0;
+			continue;
+		}
+		if (polling && ++idle < COS_NIC_POLL_IDLE) continue;
+
+		polling = 0;
+		idle    = 0;
+		pending = cos_chan_poll(a->tx, 0);
+		pending |= cos_chan_poll(b->tx, 0);
+		if (!pending) cos_rcv(rcv, 0, NULL);
+	}
+}
@@ -0,0 +1,318 @@
+/**
+ * Redistribution of this file is permitted under the GNU General
+ * Public License v2.
+ *
+ * The work-stealing deques, workers, and lazily split loops of the
+ * fork/join runtime (see cos_par.h).
+ */
+
+#include <cos_component.h>
+#include <cos_debug.h>
+#include <cos_defkernel_api.h>
+#include <sl.h>
+#include <cos_par.h>
+
+static struct cos_par_worker *cos_par_workers[MAX_NUM_THREADS];
+
+struct cos_par_worker *
+cos_par_self(void)
+{
+	return cos_par_workers[cos_thdid()];
+}
+
+/* Only the owner pushes. */
+static int
+cos_par_push(struct cos_par_deque *d, struct cos_par_task *t)
+{
+	unsigned long b = d->bottom;
+
+	if (b - ps_load(&d->top) >= COS_PAR_DEQUE_SZ) return -ENOSPC;
+	d->tasks[b & (COS_PAR_DEQUE_SZ - 1)] = *t;
+	/* the task is written before thieves can see it */
+	ps_mem_fence();
+	d->bottom = b + 1;
+
+	return 0;
+}
+
+/* Only the owner pops: it races with thieves only for the last task. */
+static int
+cos_par_pop(struct cos_par_deque *d, struct cos_par_task *t)
+{
+	unsigned long b = d->bottom - 1, top;
+
+	d->bottom = b;
+	ps_mem_fence();
+	top = ps_load(&d->top);
+	if ((long)(b - top) < 0) {
+		d->bottom = b + 1;
+		return -ENOENT;
+	}
+	*t = d->tasks[b & (COS_PAR_DEQUE_SZ - 1)];
+	if (b != top) return 0;
+
+	/* the last task: whoever moves top first gets it */
+	d->bottom = b + 1;
+	if (!ps_cas(&d->top, top, top + 1)) return -ENOENT;
+
+	return 0;
+}
+
+/*
+ * A task that is read before top is moved past it can't be
+ * overwritten, as the owner only reuses the slot once top is past it.
+ */
+static int
+cos_par_steal(struct cos_par_deque *d, struct cos_par_task *t)
+{
+	unsigned long top = ps_load(&d->top), b;
+
+	ps_mem_fence();
+	b = ps_load(&d->bottom);
+	if ((long)(b - top) <= 0) return -ENOENT;
+	*t = d->tasks[top & (COS_PAR_DEQUE_SZ - 1)];
+	if (!ps_cas(&d->top, top, top + 1)) return -EAGAIN;
+
+	return 0;
+}
+
+static inline int
+cos_par_deque_empty(struct cos_par_deque *d)
+{
+	return (long)(ps_load(&d->bottom) - ps_load(&d->top)) <= 0;
+}
+
+/* Wake a sleeping worker, if there is one, to steal a new task. */
+static void
+cos_par_wake(struct cos_par *p)
+{
+	int i;
+
+	if (likely(!ps_load(&p->nsleeping))) return;
+
+	for (i = 0; i < p->nworkers; i++) {
+		struct cos_par_worker *w = &p->workers[i];
+
+		if (!ps_load(&w->sleeping) || !ps_cas(&w->sleeping, 1, 0)) continue;
+		ps_faa(&p->nsleeping, -1);
+		cos_asnd(w->snd, 0);
+
+		return;
+	}
+}
+
+static int
+cos_par_spawn_task(struct cos_par_worker *w, struct cos_par_task *t)
+{
+	if (!t->join->waiter) t->join->waiter = cos_thdid();
+	ps_faa(&t->join->pending, 1);
+	if (unlikely(cos_par_push(&w->deque, t))) {
+		ps_faa(&t->join->pending, -1);
+		return -ENOSPC;
+	}
+	cos_par_wake(w->par);
+
+	return 0;
+}
+
+/*
+ * Run [lo, hi) in chunks of grain, making the upper half of what is
+ * left stealable whenever our deque is empty.
+ */
+static void
+cos_par_range(struct cos_par_worker *w, struct cos_par_task *t)
+{
+	struct cos_par_task split = *t;
+	long                lo = t->lo, hi = t->hi;
+
+	while (hi - lo > t->grain) {
+		if (cos_par_deque_empty(&w->deque)) {
+			split.lo = lo + (hi - lo) / 2;
+			split.hi = hi;
+			if (!cos_par_spawn_task(w, &split)) {
+				hi = split.lo;
+				continue;
+			}
+		}
+		t->fn(t->arg, lo, lo + t->grain);
+		lo += t->grain;
+	}
+	t->fn(t->arg, lo, hi);
+}
+
+static void
+cos_par_run(struct cos_par_worker *w, struct cos_par_task *t)
+{
+	thdid_t waiter;
+
+	if (t->grain) cos_par_range(w, t);
+	else          t->fn(t->arg, t->lo, t->hi);
+
+	/* the join can be gone once it is complete, so read its waiter first */
+	waiter = t->join->waiter;
+	if (ps_faa(&t->join->pending, -1) == 1 && waiter != cos_thdid()) sl_thd_wakeup(waiter);
+}
+
+/* Our own tasks first (the most recently spawned), then stolen ones. */
+static int
+cos_par_find(struct cos_par_worker *w, struct cos_par_task *t)
+{
+	struct cos_par *p = w->par;
+	int             r, i, v;
+
+	if (!cos_par_pop(&w->deque, t)) return 1;
+
+	for (r = 0; r < COS_PAR_STEAL_ROUNDS; r++) {
+		for (i = 0; i < p->nworkers; i++) {
+			int ret;
+
+			/* start with the last worker we stole from */
+			v = (w->victim + i) % p->nworkers;
+			if (v == w->id) continue;
+			do {
+				ret = cos_par_steal(&p->workers[v].deque, t);
+			} while (ret == -EAGAIN);
+			if (ret) continue;
+
+			w->victim = v;
+			w->steals++;
+
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int
+cos_par_work_left(struct cos_par *p)
+{
+	int i;
+
+	for (i = 0; i < p->nworkers; i++) {
+		if (!cos_par_deque_empty(&p->workers[i].deque)) return 1;
+	}
+
+	return 0;
+}
+
+static void
+cos_par_worker_fn(arcvcap_t rcv, void *data)
+{
+	struct cos_par_worker *w = data;
+	struct cos_par *       p = w->par;
+	struct cos_par_task    t;
+
+	cos_par_workers[cos_thdid()] = w;
+	while (1) {
+		if (cos_par_find(w, &t)) {
+			cos_par_run(w, &t);
+			continue;
+		}
+
+		/* advertise that we sleep, then look again, so that a spawn can't be missed */
+		w->sleeping = 1;
+		ps_faa(&p->nsleeping, 1);
+		ps_mem_fence();
+		if (cos_par_work_left(p) && ps_cas(&w->sleeping, 1, 0)) {
+			ps_faa(&p->nsleeping, -1);
+			continue;
+		}
+		/* either nothing is left, or a spawner has already sent us the wakeup */
+		cos_rcv(rcv, 0, NULL);
+	}
+}
+
+void
+cos_par_spawn(struct cos_par_join *j, cos_par_fn_t fn, void *arg, long lo, long hi)
+{
+	struct cos_par_worker *w = cos_par_self();
+	struct cos_par_task    t = { .fn = fn, .arg = arg, .lo = lo, .hi = hi, .grain = 0, .join = j };
+
+	assert(w);
+	/* with a full deque, there is plenty of parallelism: run it now */
+	if (unlikely(cos_par_spawn_task(w, &t))) fn(arg, lo, hi);
+}
+
+void
+cos_par_join_wait(struct cos_par_join *j)
+{
+	struct cos_par_worker *w = cos_par_self();
+	struct cos_par_task    t;
+
+	assert(w);
+	while (ps_load(&j->pending)) {
+		if (cos_par_find(w, &t)) {
+			cos_par_run(w, &t);
+			continue;
+		}
+
+		/*
+		 * Our children are running in other workers, which can
+		 * be of a lower priority: block rather than spin.  The
+		 * check is in the critical section, so the wakeup of the
+		 * last child (which takes it) can't come between the
+		 * check and the block.  Wakeups are not counted: one that
+		 * comes after we saw the join complete only makes a later
+		 * wait here check its join again.
+		 */
+		sl_cs_enter();
+		if (!ps_load(&j->pending)) {
+			sl_cs_exit();
+			break;
+		}
+		sl_thd_block_no_cs(sl_thd_curr(), SL_THD_BLOCKED, 0);
+		sl_cs_exit_schedule();
+	}
+}
+
+void
+cos_par_for(long lo, long hi, long grain, cos_par_fn_t fn, void *arg)
+{
+	struct cos_par_worker *w = cos_par_self();
+	struct cos_par_join    j = { .pending = 1, .waiter = cos_thdid() };
+	struct cos_par_task    t;
+
+	assert(w);
+	if (hi <= lo) return;
+	if (!grain) grain = (hi - lo) / (w->par->nworkers * COS_PAR_CHUNKS_PER_WORKER);
+	if (grain < 1) grain = 1;
+
+	t = (struct cos_par_task){ .fn = fn, .arg = arg, .lo = lo, .hi = hi, .grain = grain, .join = &j };
+	cos_par_run(w, &t);
+	cos_par_join_wait(&j);
+}
+
+int
+cos_par_init(struct cos_par *p, int nworkers, unsigned int prio)
+{
+	struct cos_compinfo *ci = cos_compinfo_get(cos_defcompinfo_curr_get());
+	int                  i;
+
+	if (nworkers < 1 || nworkers > COS_PAR_MAX_WORKERS) return -EINVAL;
+
+	memset(p, 0, sizeof(struct cos_par));
+	p->nworkers = nworkers;
+	for (i = 0; i < nworkers; i++) {
+		struct cos_par_worker *w = &p->workers[i];
+
+		w->par    = p;
+		w->id     = i;
+		w->victim = (i + 1) % nworkers;
+	}
+	cos_par_workers[cos_thdid()] = &p->workers[0];
+
+	for (i = 1; i < nworkers; i++) {
+		struct cos_par_worker *w = &p->workers[i];
+		struct sl_thd *        t;
+
+		t = sl_thd_aep_alloc(cos_par_worker_fn, w, 0);
+		if (!t) return -ENOMEM;
+		w->rcv = sl_thd_rcvcap(t);
+		w->snd = cos_asnd_alloc(ci, w->rcv, ci->captbl_cap);
+		if (!w->snd) return -ENOMEM;
+		sl_thd_param_set(t, sched_param_pack(SCHEDP_PRIO, prio));
+	}
+
+	return 0;
+}
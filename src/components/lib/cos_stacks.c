@@ -0,0 +1,49 @@
+/**
+ * Redistribution of this file is permitted under the GNU General
+ * Public License v2.
+ *
+ * The per-core invocation stack freelists, and the stacks that are
+ * added to them (see cos_stacks.h).  Linked in freelist_stklib.o.
+ */
+
+#include <cos_component.h>
+#include <cos_kernel_api.h>
+#include <ps.h>
+#include <cos_stacks.h>
+
+struct cos_stack_fl cos_stack_freelists[NUM_CPU];
+
+static char          cos_stack_pool[COS_STACKS_POOL][COS_STACK_SZ] __attribute__((aligned(COS_STACK_SZ)));
+static unsigned long cos_stack_npool, cos_stack_nmapped;
+static vaddr_t       cos_stack_window;
+
+/* The window the manager maps stacks into, reserved on first use. */
+static vaddr_t
+cos_stack_window_get(void)
+{
+	vaddr_t w = ps_load(&cos_stack_window);
+
+	if (likely(w)) return w;
+	w = round_up_to_pgd_page((vaddr_t)cos_get_heap_ptr());
+	if (!ps_cas(&cos_stack_window, 0, w)) return ps_load(&cos_stack_window);
+	cos_set_heap_ptr((void *)(w + COS_STACKS_VAS_WINDOW));
+
+	return w;
+}
+
+void *
+cos_stack_grant(int cpu)
+{
+	unsigned long i;
+	vaddr_t       addr;
+
+	i = ps_faa(&cos_stack_npool, 1);
+	if (i < COS_STACKS_POOL) return cos_stack_pool[i];
+
+	i = ps_faa(&cos_stack_nmapped, 1);
+	if (i >= COS_STACKS_MAX) return NULL;
+	addr = cos_stack_window_get() + i * COS_STACK_SZ;
+	if ((vaddr_t)cos_sinv(BOOT_CAPTBL_SINV_CAP, COS_STACK_OP_GRANT, addr, 0, 0) != addr) return NULL;
+
+	return (void *)addr;
+}
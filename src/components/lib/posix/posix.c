@@ -33,6 +33,13 @@ libc_syscall_override(cos_syscall_t fn, int syscall_num)
 
 struct sl_lock stdout_lock = SL_LOCK_STATIC_INIT();
 
+/*
+ * Other descriptors are those of the fd component (numbered as in
+ * POSIX, see fd.h), if this component depends on it (its client stub
+ * is linked in).
+ */
+CWEAKSYMB int cos_fd_writev(int fd, const struct iovec *iov, int iovcnt);
+
 ssize_t
 write_bytes_to_stdout(const char *buf, size_t count)
 {
@@ -50,6 +57,10 @@ cos_write(int fd, const void *buf, size_t count)
 		write_bytes_to_stdout((const char *) buf, count);
 		sl_lock_release(&stdout_lock);
 		return count;
+	} else if (cos_fd_writev) {
+		struct iovec iov = { .iov_base = (void *)buf, .iov_len = count };
+
+		return cos_fd_writev(fd, &iov, 1);
 	} else {
 		printc("fd: %d not supported!\n", fd);
 		assert(0);
@@ -68,6 +79,9 @@ cos_writev(int fd, const struct iovec *iov, int iovcnt)
 		}
 		sl_lock_release(&stdout_lock);
 		return ret;
+	} else if (cos_fd_writev) {
+		/* all of the iovecs in one invocation */
+		return cos_fd_writev(fd, iov, iovcnt);
 	} else {
 		printc("fd: %d not supported!\n", fd);
 		assert(0);
@@ -154,13 +154,119 @@ update:
 	return 0;
 }
 
+static inline void
+sl_thd_dependency_rm(struct sl_thd *t)
+{
+	if (!t->dependency) return;
+
+	ps_list_rem(t, SL_THD_DEP_LIST);
+	t->dependency  = NULL;
+	t->dep_timeout = 0;
+}
+
+/* Is the end of t's dependency chain blocked? */
+static int
+sl_thd_dependency_blocked(struct sl_thd *t)
+{
+	struct sl_thd *d = t;
+	int            i;
+
+	for (i = 0; d->dependency && i < SL_MAX_DEP_DEPTH; i++) d = d->dependency;
+
+	return d != t && (d->state == SL_THD_BLOCKED || d->state == SL_THD_BLOCKED_TIMEOUT);
+}
+
+/*
+ * t was woken: the dependents (transitively) of t that blocked as t
+ * was blocked can run t again.
+ */
+static void
+sl_thd_dependents_wakeup(struct sl_thd *t, int depth)
+{
+	struct sl_thd *d;
+
+	if (unlikely(depth == SL_MAX_DEP_DEPTH)) return;
+
+	ps_list_foreach(&t->dependents, d, SL_THD_DEP_LIST) {
+		if (d->state == SL_THD_BLOCKED_TIMEOUT) sl_timeout_remove(d);
+		if (d->state == SL_THD_BLOCKED || d->state == SL_THD_BLOCKED_TIMEOUT) {
+			d->state = SL_THD_RUNNABLE;
+			sl_mod_wakeup(sl_mod_thd_policy_get(d));
+		}
+		sl_thd_dependents_wakeup(d, depth + 1);
+	}
+}
+
+int
+sl_thd_block_dep_cs_exit(thdid_t tid, cycles_t abs_timeout)
+{
+	struct sl_thd *t = sl_thd_curr(), *dep = sl_thd_lkup(tid), *d;
+	int            i;
+
+	assert(sl_cs_owner());
+	if (unlikely(!dep || dep->state == SL_THD_FREE || dep->state == SL_THD_DYING)) {
+		sl_cs_exit();
+		return -EINVAL;
+	}
+	for (d = dep, i = 0; d && i < SL_MAX_DEP_DEPTH; d = d->dependency, i++) {
+		if (unlikely(d == t)) {
+			sl_cs_exit();
+			return -EDEADLK;
+		}
+	}
+
+	/*
+	 * We stay runnable, so that the policy selects us at our
+	 * priority, and runs the dependency in our place.
+	 */
+	t->dependency  = dep;
+	t->dep_timeout = abs_timeout;
+	ps_list_head_append(&dep->dependents, t, SL_THD_DEP_LIST);
+
+	while (1) {
+		sl_cs_exit_schedule();
+		sl_cs_enter();
+
+		/* the dependency was released, or expired... */
+		if (!t->dependency) break;
+		if (abs_timeout && (s64_t)(abs_timeout - sl_now()) <= 0) break;
+		/* ...or it can't run: wait for it to be woken, instead of spinning */
+		if (!sl_thd_dependency_blocked(t)) break;
+		sl_thd_block_no_cs(t, abs_timeout ? SL_THD_BLOCKED_TIMEOUT : SL_THD_BLOCKED, abs_timeout);
+	}
+	sl_thd_dependency_rm(t);
+	sl_cs_exit();
+
+	return 0;
+}
+
+int
+sl_thd_dependents_release(struct sl_thd *t)
+{
+	struct sl_thd *d, *n;
+	int            cnt = 0;
+
+	assert(sl_cs_owner());
+
+	ps_list_foreach_del(&t->dependents, d, n, SL_THD_DEP_LIST) {
+		sl_thd_dependency_rm(d);
+		if (d->state == SL_THD_BLOCKED || d->state == SL_THD_BLOCKED_TIMEOUT) sl_thd_wakeup_no_cs(d);
+		cnt++;
+	}
+
+	return cnt;
+}
+
 void
 sl_thd_block(thdid_t tid)
 {
 	struct sl_thd *t;
 
-	/* TODO: dependencies not yet supported */
-	assert(!tid);
+	if (tid) {
+		sl_cs_enter();
+		sl_thd_block_dep_cs_exit(tid, 0);
+		return;
+	}
 
 	sl_cs_enter();
 	t = sl_thd_curr();
@@ -201,13 +307,19 @@ sl_thd_block_timeout(thdid_t tid, cycles_t abs_timeout)
 	cycles_t jitter  = 0, wcycs, tcycs;
 	struct sl_thd *t = sl_thd_curr();
 
-	/* TODO: dependencies not yet supported */
-	assert(!tid);
-
 	if (unlikely(!abs_timeout)) {
 		sl_thd_block(tid);
 		goto done;
 	}
+	if (tid) {
+		cycles_t now;
+
+		sl_cs_enter();
+		sl_thd_block_dep_cs_exit(tid, abs_timeout);
+		now = sl_now();
+		if (now > abs_timeout) jitter = now - abs_timeout;
+		goto done;
+	}
 
 	if (sl_thd_block_timeout_intern(tid, abs_timeout)) goto done;
 	wcycs = t->wakeup_cycs;
@@ -252,6 +364,7 @@ sl_thd_wakeup_no_cs_rm(struct sl_thd *t)
 	assert(t->state == SL_THD_BLOCKED || t->state == SL_THD_BLOCKED_TIMEOUT);
 	t->state = SL_THD_RUNNABLE;
 	sl_mod_wakeup(sl_mod_thd_policy_get(t));
+	if (unlikely(!ps_list_head_empty(&t->dependents))) sl_thd_dependents_wakeup(t, 0);
 
 	return 0;
 }
@@ -362,6 +475,11 @@ sl_thd_alloc_init(thdid_t tid, struct cos_aep_info *aep, asndcap_t sndcap, sl_th
 	t->prio           = TCAP_PRIO_MIN;
 	ps_list_init(t, SL_THD_EVENT_LIST);
 	sl_thd_event_info_reset(t);
+	t->dependency     = NULL;
+	t->dep_timeout    = 0;
+	ps_list_init(t, SL_THD_DEP_LIST);
+	ps_list_head_init(&t->dependents);
+	ps_list_init(t, SL_THD_REPLENISH_LIST);
 
 done:
 	return t;
@@ -457,7 +575,13 @@ sl_thd_aep_alloc(cos_aepthd_fn_t fn, void *data, int own_tcap)
 	return t;
 }
 
-/* sl object for inithd in the child comp */
+/*
+ * sl object for inithd in the child comp.  A child scheduler
+ * (is_sched) is dispatched with an asnd to its end-point, and runs on
+ * its own tcap: with SCHEDP_BUDGET and SCHEDP_WINDOW, it is
+ * replenished each period, like any thread with its own tcap, and
+ * when it idles in its rcv, we're sent its block event.
+ */
 struct sl_thd *
 sl_thd_comp_init(struct cos_defcompinfo *comp, int is_sched)
 {
@@ -502,6 +626,9 @@ sl_thd_free(struct sl_thd *t)
 
 	assert(t->state != SL_THD_FREE);
 	if (t->state == SL_THD_BLOCKED_TIMEOUT) sl_timeout_remove(t);
+	sl_thd_dependency_rm(t);
+	sl_thd_dependents_release(t);
+	ps_list_rem(t, SL_THD_REPLENISH_LIST);
 	sl_thd_index_rem_backend(sl_mod_thd_policy_get(t));
 	sl_mod_thd_delete(sl_mod_thd_policy_get(t));
 	t->state = SL_THD_FREE;
@@ -522,6 +649,101 @@ sl_thd_exit()
 	sl_thd_free(sl_thd_curr());
 }
 
+/*
+ * The first replenishment of a thread (after each change of its
+ * parameters) also sets the priority of its tcap, so it is a transfer
+ * at that priority (the kernel's refills keep the priority of the last
+ * transfer).  A full tcap still gets a cycle, to carry the priority.
+ */
+static int
+sl_thd_replenish_transfer(struct sl_thd *t)
+{
+	struct cos_compinfo *ci         = &cos_defcompinfo_curr_get()->ci;
+	tcap_res_t           currbudget = (tcap_res_t)cos_introspect(ci, sl_thd_tcap(t), TCAP_GET_BUDGET);
+	tcap_res_t           res        = 1;
+
+	if (!cycles_same(currbudget, t->budget, SL_CYCS_DIFF) && currbudget < t->budget) res = t->budget - currbudget;
+
+	return cos_tcap_transfer(sl_thd_rcvcap(t), sl__globals()->sched_tcap, res, t->prio);
+}
+
+static inline cycles_t
+__sl_replenish_min(cycles_t next, cycles_t at)
+{ return (!next || at < next) ? at : next; }
+
+/* Refill a batch and advance its replenishments, returns the earliest next one. */
+static cycles_t
+sl_replenish_flush(struct cos_tcap_refill *refills, struct sl_thd **batch, int n, cycles_t now, cycles_t next)
+{
+	struct sl_global *g = sl__globals();
+	int               i, done;
+
+	done = cos_tcap_refill(g->sched_tcap, refills, n);
+	for (i = 0; i < done; i++) {
+		struct sl_thd *t = batch[i];
+
+		t->last_replenish = now - ((now - t->last_replenish) % t->period);
+		next              = __sl_replenish_min(next, t->last_replenish + t->period);
+	}
+	/* refills only top up, so the rest (from the one that failed) are retried at the next tick */
+	if (done < n) next = __sl_replenish_min(next, now + g->period);
+
+	return next;
+}
+
+void
+sl_replenish_expired(cycles_t now)
+{
+	struct sl_global      *g = sl__globals();
+	struct cos_tcap_refill refills[SL_REPLENISH_BATCH];
+	struct sl_thd         *batch[SL_REPLENISH_BATCH], *t;
+	cycles_t               next = 0;
+	int                    n    = 0;
+
+	assert(sl_cs_owner());
+
+	ps_list_foreach(&g->replenish_head, t, SL_THD_REPLENISH_LIST) {
+		if (likely(t->last_replenish) && (s64_t)(t->last_replenish + t->period - now) > 0) {
+			next = __sl_replenish_min(next, t->last_replenish + t->period);
+		} else if (unlikely(!t->last_replenish)) {
+			if (sl_thd_replenish_transfer(t)) {
+				next = __sl_replenish_min(next, now + g->period);
+				continue;
+			}
+			t->last_replenish = now - (now % t->period);
+			next              = __sl_replenish_min(next, t->last_replenish + t->period);
+		} else {
+			refills[n].rcv = sl_thd_rcvcap(t);
+			refills[n].res = t->budget;
+			batch[n++]     = t;
+			if (n < SL_REPLENISH_BATCH) continue;
+
+			next = sl_replenish_flush(refills, batch, n, now, next);
+			n    = 0;
+		}
+	}
+	if (n) next = sl_replenish_flush(refills, batch, n, now, next);
+
+	g->replenish_next = next;
+}
+
+/* Threads with their own tcap, a budget and a period are replenished each period. */
+static void
+sl_thd_replenish_update(struct sl_thd *t)
+{
+	struct sl_global *g = sl__globals();
+
+	if (!(t->properties & SL_THD_PROPERTY_OWN_TCAP) || !t->budget || !t->period) return;
+	assert(sl_thd_tcap(t) != g->sched_tcap);
+
+	sl_cs_enter();
+	if (ps_list_singleton(t, SL_THD_REPLENISH_LIST)) ps_list_head_append(&g->replenish_head, t, SL_THD_REPLENISH_LIST);
+	/* replenish it at the next scheduling decision */
+	t->last_replenish = 0;
+	g->replenish_next = sl_now();
+	sl_cs_exit();
+}
+
 void
 sl_thd_param_set(struct sl_thd *t, sched_param_t sp)
 {
@@ -548,6 +770,8 @@ sl_thd_param_set(struct sl_thd *t, sched_param_t sp)
 	}
 
 	sl_mod_thd_param_set(sl_mod_thd_policy_get(t), type, value);
+	/* a new priority reaches the tcap with the next (first) replenishment */
+	if (type == SCHEDP_WINDOW || type == SCHEDP_BUDGET || type == SCHEDP_PRIO) sl_thd_replenish_update(t);
 }
 
 void
@@ -564,6 +788,14 @@ void
 sl_idle(void *d)
 { while (1) ; }
 
+void
+sl_idle_rcv(int on)
+{
+	sl_cs_enter();
+	sl__globals()->idle_rcv = on;
+	sl_cs_exit();
+}
+
 void
 sl_init(microsec_t period)
 {
@@ -589,6 +821,7 @@ sl_init(microsec_t period)
 	g->sched_rcv       = BOOT_CAPTBL_SELF_INITRCV_BASE;
 	g->sched_thd->prio = 0;
 	ps_list_head_init(&g->event_head);
+	ps_list_head_init(&g->replenish_head);
 
 	g->idle_thd        = sl_thd_alloc(sl_idle, NULL);
 	assert(g->idle_thd);
@@ -617,8 +850,10 @@ sl_sched_loop_intern(int non_block)
 			 * states of it's child threads) and normal notifications (mainly activations from
 			 * it's parent scheduler).
 			 */
-			pending = cos_sched_rcv(g->sched_rcv, rfl, timeout,
+			/* switched to, to idle: block here, even in the non-blocking loop */
+			pending = cos_sched_rcv(g->sched_rcv, g->sched_idle ? rfl & ~RCV_NON_BLOCKING : rfl, timeout,
 						&rcvd, &tid, &blocked, &cycles, &thd_timeout);
+			g->sched_idle = 0;
 			if (!tid) goto pending_events;
 
 			t = sl_thd_lkup(tid);
@@ -0,0 +1,215 @@
+/**
+ * Redistribution of this file is permitted under the BSD two clause license.
+ *
+ * Copyright 2017, The George Washington University
+ */
+
+#include <string.h>
+#include <sl.h>
+#include <sl_evt.h>
+
+void
+sl_evt_init(struct sl_evt *e, struct sl_evt_shm *shm)
+{
+	int i;
+
+	assert(e && shm);
+	memset(e, 0, sizeof(struct sl_evt));
+	memset(shm, 0, sizeof(struct sl_evt_shm));
+	e->shm = shm;
+	/* hand out the lowest ids first */
+	for (i = 0; i < SL_EVT_MAX; i++) e->freelist[i] = SL_EVT_MAX - i;
+	e->nfree = SL_EVT_MAX;
+}
+
+sl_evt_id_t
+sl_evt_add(struct sl_evt *e, void *data)
+{
+	sl_evt_id_t id = 0;
+
+	sl_cs_enter();
+	if (e->nfree > 0) {
+		id            = e->freelist[--e->nfree];
+		e->data[id]   = data;
+		e->active[id] = 1;
+	}
+	sl_cs_exit();
+
+	return id;
+}
+
+int
+sl_evt_rem(struct sl_evt *e, sl_evt_id_t id)
+{
+	if (unlikely(!id || id > SL_EVT_MAX)) return -EINVAL;
+
+	sl_cs_enter();
+	if (!e->active[id]) {
+		sl_cs_exit();
+		return -EINVAL;
+	}
+	/* a pending trigger is dropped by sl_evt_wait */
+	e->active[id]           = 0;
+	e->freelist[e->nfree++] = id;
+	sl_cs_exit();
+
+	return 0;
+}
+
+/* Called in the critical section. */
+static void
+__sl_evt_wake(struct sl_evt *e)
+{
+	struct sl_thd *t;
+
+	if (!e->waiter) return;
+	t = sl_thd_lkup(e->waiter);
+	if (t) sl_thd_wakeup_no_cs(t);
+}
+
+int
+sl_evt_trigger(struct sl_evt *e, sl_evt_id_t id)
+{
+	if (unlikely(!id || id > SL_EVT_MAX)) return -EINVAL;
+
+	sl_evt_shm_trigger(e->shm, id);
+	/* our own threads only wake the waiter in the critical section */
+	sl_cs_enter();
+	__sl_evt_wake(e);
+	sl_cs_exit_schedule();
+
+	return 0;
+}
+
+/* head has passed the slot of id: the next trigger is a new edge */
+static void
+__sl_evt_release(struct sl_evt_shm *shm, sl_evt_id_t id)
+{
+	ps_mem_fence();
+	if (ps_cas(&shm->pending[id], SL_EVT_QUEUED, SL_EVT_IDLE)) return;
+	if (ps_cas(&shm->pending[id], SL_EVT_DELIVERED, SL_EVT_IDLE)) return;
+	/* triggered after we took it out of order */
+	assert(shm->pending[id] == SL_EVT_RETRIGGERED);
+	shm->pending[id] = SL_EVT_QUEUED;
+	__sl_evt_shm_enqueue(shm, id);
+}
+
+/*
+ * Take up to max events off the ring, without an invocation per
+ * event.  Slots that producers have reserved but not yet filled are
+ * skipped (see SL_EVT_TAKEN), and head only moves over taken slots.
+ */
+static int
+__sl_evt_drain(struct sl_evt *e, struct sl_evt_res *res, int max)
+{
+	struct sl_evt_shm *shm = e->shm;
+	unsigned long      i;
+	int                n = 0, gap = 0;
+
+	for (i = shm->head; i != ps_load(&shm->tail); i++) {
+		sl_evt_id_t *slot = &shm->ring[i & SL_EVT_RING_MASK];
+		sl_evt_id_t  id   = ps_load(slot);
+
+		/* a producer has reserved the slot, but not yet filled it */
+		if (!id) {
+			gap = 1;
+			continue;
+		}
+		if (!(id & SL_EVT_TAKEN)) {
+			if (n == max) break;
+			if (e->active[id]) {
+				res[n].id   = id;
+				res[n].data = e->data[id];
+				n++;
+			}
+			if (gap) {
+				*slot = id | SL_EVT_TAKEN;
+				shm->pending[id] = SL_EVT_DELIVERED;
+				continue;
+			}
+		}
+		if (gap) continue;
+		*slot     = 0;
+		shm->head = i + 1;
+		__sl_evt_release(shm, id & ~SL_EVT_TAKEN);
+	}
+
+	return n;
+}
+
+int
+sl_evt_wait(struct sl_evt *e, struct sl_evt_res *res, int max, cycles_t abs_timeout)
+{
+	struct sl_evt_shm *shm = e->shm;
+	struct sl_thd *    t;
+	int                n;
+
+	assert(max > 0);
+	while (1) {
+		sl_cs_enter();
+		e->waiter    = 0;
+		shm->waiting = 0;
+		n = __sl_evt_drain(e, res, max);
+		if (n) break;
+		if (abs_timeout && sl_now() >= abs_timeout) break;
+
+		/*
+		 * Tell the producers to notify us, then look again: a
+		 * producer either sees waiting, or we see its event.  One
+		 * that is preempted before filling its slot notifies us
+		 * once it does, so we block rather than wait for it.
+		 */
+		shm->waiting = 1;
+		ps_mem_fence();
+		n = __sl_evt_drain(e, res, max);
+		if (n) {
+			shm->waiting = 0;
+			break;
+		}
+
+		t         = sl_thd_curr();
+		e->waiter = t->thdid;
+		if (abs_timeout) sl_thd_block_no_cs(t, SL_THD_BLOCKED_TIMEOUT, abs_timeout);
+		else             sl_thd_block_no_cs(t, SL_THD_BLOCKED, 0);
+		sl_cs_exit_schedule();
+	}
+	sl_cs_exit();
+
+	return n;
+}
+
+static void
+__sl_evt_rcv_fn(arcvcap_t rcv, void *data)
+{
+	struct sl_evt_rcv *r = data;
+	struct sl_evt *    e = r->e;
+
+	while (1) {
+		cos_rcv(rcv, 0, NULL);
+		if (r->id) sl_evt_shm_trigger(e->shm, r->id);
+
+		sl_cs_enter();
+		__sl_evt_wake(e);
+		sl_cs_exit_schedule();
+	}
+}
+
+struct sl_thd *
+sl_evt_rcv_alloc(struct sl_evt *e, sl_evt_id_t id)
+{
+	struct sl_evt_rcv *r;
+
+	if (unlikely(id > SL_EVT_MAX)) return NULL;
+
+	sl_cs_enter();
+	if (e->nrcv == SL_EVT_NRCV) {
+		sl_cs_exit();
+		return NULL;
+	}
+	r = &e->rcvs[e->nrcv++];
+	sl_cs_exit();
+	r->e  = e;
+	r->id = id;
+
+	return sl_thd_aep_alloc(__sl_evt_rcv_fn, r, 0);
+}
@@ -21,7 +21,7 @@ sl_lock_timed_take(struct sl_lock *lock, microsec_t max_wait_time)
 
     sl_cs_enter();
     while (lock->holder != 0 && sl_now() < deadline) {
-        sl_thd_yield_cs_exit(lock->holder);
+        if (sl_thd_block_dep_cs_exit(lock->holder, deadline)) sl_thd_yield(0);
         sl_cs_enter();
     }
 
@@ -297,10 +297,12 @@ err:
 /*
  * Copy a capability from a location in one captbl/pgtbl to a location
  * in the other.  Fundamental operation used to delegate capabilities.
+ * For page-table entries, ro removes write access (and copy-on-write)
+ * from the copy.
  * TODO: should limit the types of capabilities this works on.
  */
 static inline int
-cap_cpy(struct captbl *t, capid_t cap_to, capid_t capin_to, capid_t cap_from, capid_t capin_from)
+cap_cpy(struct captbl *t, capid_t cap_to, capid_t capin_to, capid_t cap_from, capid_t capin_from, int ro)
 {
 	struct cap_header *ctto, *ctfrom;
 	int                sz, ret;
@@ -372,7 +374,11 @@ cap_cpy(struct captbl *t, capid_t cap_to, capid_t capin_to, capid_t cap_from, ca
 		/* Cannot copy frame, or kernel entry. */
 		if ((old_v & PGTBL_COSFRAME) || !(old_v & PGTBL_USER)) return -EPERM;
 		/* TODO: validate the type is appropriate given the value of *flags */
+		if (ro) flags &= ~(PGTBL_WRITABLE | PGTBL_COW);
+		ret = pgtbl_cow_frame_ref(old_v & PGTBL_FRAME_MASK);
+		if (ret) return ret;
 		ret = pgtbl_mapping_add(((struct cap_pgtbl *)ctto)->pgtbl, capin_to, old_v & PGTBL_FRAME_MASK, flags);
+		if (ret) pgtbl_cow_frame_deref(old_v & PGTBL_FRAME_MASK);
 	} else {
 		ret = -EINVAL;
 	}
@@ -1314,7 +1320,7 @@ static int __attribute__((noinline)) composite_syscall_slowpath(struct pt_regs *
 			capid_t dest_captbl = __userregs_get2(regs);
 			capid_t dest_cap    = __userregs_get3(regs);
 
-			ret = cap_cpy(ct, dest_captbl, dest_cap, from_captbl, from_cap);
+			ret = cap_cpy(ct, dest_captbl, dest_cap, from_captbl, from_cap, 0);
 			break;
 		}
 		case CAPTBL_OP_CONS: {
@@ -1371,8 +1377,9 @@ static int __attribute__((noinline)) composite_syscall_slowpath(struct pt_regs *
 			vaddr_t source_addr = __userregs_get1(regs);
 			capid_t dest_pt     = __userregs_get2(regs);
 			vaddr_t dest_addr   = __userregs_get3(regs);
+			int     ro          = __userregs_get4(regs);
 
-			ret = cap_cpy(ct, dest_pt, dest_addr, source_pt, source_addr);
+			ret = cap_cpy(ct, dest_pt, dest_addr, source_pt, source_addr, ro);
 
 			break;
 		}
@@ -1389,6 +1396,24 @@ static int __attribute__((noinline)) composite_syscall_slowpath(struct pt_regs *
 
 			break;
 		}
+		case CAPTBL_OP_MEMCOW: {
+			/* Shares a page copy-on-write with another
+			 * pgtbl.  Used to fork components. */
+			vaddr_t source_addr = __userregs_get1(regs);
+			capid_t dest_pt     = __userregs_get2(regs);
+			vaddr_t dest_addr   = __userregs_get3(regs);
+
+			ret = cap_memcow(ct, (struct cap_pgtbl *)ch, source_addr, dest_pt, dest_addr);
+
+			break;
+		}
+		case CAPTBL_OP_MEMCOW_DONATE: {
+			vaddr_t frame_addr = __userregs_get1(regs);
+
+			ret = pgtbl_cow_donate((struct cap_pgtbl *)ch, frame_addr);
+
+			break;
+		}
 		case CAPTBL_OP_CONS: {
 			vaddr_t pte_cap   = __userregs_get1(regs);
 			vaddr_t cons_addr = __userregs_get2(regs);
@@ -1454,6 +1479,7 @@ static int __attribute__((noinline)) composite_syscall_slowpath(struct pt_regs *
 
 			ret = pgtbl_get_cosframe(((struct cap_pgtbl *)ch)->pgtbl, frame_addr, &frame);
 			if (ret) cos_throw(err, ret);
+			if (pgtbl_cow_frame_pooled(frame)) cos_throw(err, -EPERM);
 
 			ret = retypetbl_retype2frame((void *)frame);
 
@@ -1572,6 +1598,54 @@ static int __attribute__((noinline)) composite_syscall_slowpath(struct pt_regs *
 
 			break;
 		}
+		case CAPTBL_OP_TCAP_REFILL: {
+			/* an array of refills in one page of our memory, returns the number done */
+			vaddr_t                 addr    = __userregs_get1(regs);
+			unsigned long           n       = __userregs_get2(regs);
+			struct cap_tcap *       tcapsrc = (struct cap_tcap *)ch;
+			struct cos_tcap_refill *r;
+			u32_t                   flags;
+			unsigned long           i;
+
+			if (unlikely(!n || n > TCAP_REFILL_MAX || addr % sizeof(struct cos_tcap_refill)
+			             || (addr & ~PAGE_MASK) + n * sizeof(struct cos_tcap_refill) > PAGE_SIZE)) {
+				cos_throw(err, -EINVAL);
+			}
+			r = (struct cos_tcap_refill *)pgtbl_lkup(ci->pgtbl, addr, &flags);
+			if (unlikely(!r || !(flags & PGTBL_PRESENT) || !(flags & PGTBL_USER))) cos_throw(err, -EINVAL);
+			r = (struct cos_tcap_refill *)((char *)r + (addr & ~PAGE_MASK));
+
+			for (i = 0; i < n; i++) {
+				/* the caller can change the array under us */
+				struct cos_tcap_refill refill = *(volatile struct cos_tcap_refill *)&r[i];
+				struct cap_arcv *      rcv;
+				struct tcap *          tc;
+
+				/* captbl_lkup wraps around */
+				if (unlikely(refill.rcv >= __captbl_maxid())) break;
+				rcv = (struct cap_arcv *)captbl_lkup(ci->captbl, refill.rcv);
+				if (unlikely(!CAP_TYPECHK_CORE(rcv, CAP_ARCV))) break;
+
+				tc = rcv->thd->rcvcap.rcvcap_tcap;
+				assert(tc);
+				if (unlikely(tcap_refill(tc, tcapsrc->tcap, refill.res))) break;
+			}
+			ret = (int)i;
+
+			if (tcap_expended(tcap_current(cos_info))) {
+				struct pt_regs *rregs;
+
+				ret = expended_process(regs, thd, ci, cos_info, 0);
+				if (unlikely(ret < 0)) cos_throw(err, ret);
+				/* the switch returns 0, but the caller needs the number of refills done */
+				rregs = thd_current(cos_info) == thd ? regs : &thd->regs;
+				__userregs_set(rregs, (int)i, __userregs_getsp(rregs), __userregs_getip(rregs));
+
+				*thd_switch = 1;
+			}
+
+			break;
+		}
 		case CAPTBL_OP_TCAP_MERGE: {
 			capid_t          tcaprem = __userregs_get1(regs);
 			struct cap_tcap *tcapdst = (struct cap_tcap *)ch;
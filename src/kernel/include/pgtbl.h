@@ -29,6 +29,13 @@ typedef enum {
 	PGTBL_ACCESSED = 1 << 5,
 	PGTBL_MODIFIED = 1 << 6,
 	PGTBL_SUPER    = 1 << 7, /* super-page (4MB on x86-32) */
+	/*
+	 * In (4KB) leaf entries, bit 7 is the PAT bit.  The PAT is
+	 * never reprogrammed, and its power-on entries 4-7 repeat 0-3,
+	 * so the bit doesn't change the memory type, and is ours:
+	 * present, read-only user mappings are copy-on-write.
+	 */
+	PGTBL_COW      = 1 << 7,
 	PGTBL_GLOBAL   = 1 << 8,
 	/* Composite defined bits next*/
 	PGTBL_COSFRAME   = 1 << 9,
@@ -391,6 +398,10 @@ pgtbl_mapping_mod(pgtbl_t pt, u32_t addr, u32_t flags, u32_t *prevflags)
 	                           orig_v);
 }
 
+int  pgtbl_cow_frame_pooled(unsigned long frame);
+int  pgtbl_cow_frame_ref(unsigned long frame);
+void pgtbl_cow_frame_deref(unsigned long frame);
+
 /* When we remove a mapping, we need to link the vas to a liv_id,
  * which tracks quiescence for us. */
 static int
@@ -424,6 +435,8 @@ pgtbl_mapping_del(pgtbl_t pt, u32_t addr, u32_t liv_id)
 	/* decrement ref cnt on the frame. */
 	ret = retypetbl_deref((void *)(orig_v & PGTBL_FRAME_MASK));
 	if (ret) cos_throw(done, ret);
+	/* frames copied on write go back to the pool with their last mapping */
+	pgtbl_cow_frame_deref(orig_v & PGTBL_FRAME_MASK);
 
 done:
 	return ret;
@@ -588,5 +601,8 @@ pgtbl_init(void)
 
 int cap_memactivate(struct captbl *ct, struct cap_pgtbl *pt, capid_t frame_cap, capid_t dest_pt, vaddr_t vaddr);
 int pgtbl_kmem_act(pgtbl_t pt, u32_t addr, unsigned long *kern_addr, unsigned long **pte);
+int cap_memcow(struct captbl *ct, struct cap_pgtbl *pt, vaddr_t src_addr, capid_t dest_pt, vaddr_t dest_addr);
+int pgtbl_cow_donate(struct cap_pgtbl *pt, vaddr_t frame_addr);
+int pgtbl_cow_fault(pgtbl_t pt, vaddr_t addr);
 
 #endif /* PGTBL_H */
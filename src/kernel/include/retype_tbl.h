@@ -111,5 +111,7 @@ void retype_tbl_init(void);
 int  retypetbl_ref(void *pa);
 int  retypetbl_kern_ref(void *pa);
 int  retypetbl_deref(void *pa);
+int  retypetbl_ref_sum(void *pa);
+int  retypetbl_last_unmap(void *pa, u64_t *last_unmap);
 
 #endif /* RETYPE_TBL_H */
@@ -111,12 +111,15 @@ typedef enum {
 	CAPTBL_OP_PGTBLDEACTIVATE_ROOT,
 	CAPTBL_OP_THDDEACTIVATE_ROOT,
 	CAPTBL_OP_MEMMOVE,
+	CAPTBL_OP_MEMCOW,
+	CAPTBL_OP_MEMCOW_DONATE,
 	CAPTBL_OP_INTROSPECT,
 	CAPTBL_OP_TCAP_ACTIVATE,
 	CAPTBL_OP_TCAP_TRANSFER,
 	CAPTBL_OP_TCAP_DELEGATE,
 	CAPTBL_OP_TCAP_MERGE,
 	CAPTBL_OP_TCAP_WAKEUP,
+	CAPTBL_OP_TCAP_REFILL,
 
 	CAPTBL_OP_HW_ACTIVATE,
 	CAPTBL_OP_HW_DEACTIVATE,
@@ -160,6 +163,17 @@ typedef unsigned long capid_t;
 #define TCAP_RES_IS_INF(r) (r == TCAP_RES_INF)
 typedef capid_t tcap_t;
 
+/*
+ * CAPTBL_OP_TCAP_REFILL's array (in one page of the caller's memory):
+ * the tcap of each end-point is topped up to its budget.  Aligned to
+ * its size, so that an entry never straddles pages.
+ */
+struct cos_tcap_refill {
+	capid_t    rcv;
+	tcap_res_t res;
+} __attribute__((aligned(2 * sizeof(unsigned long))));
+#define TCAP_REFILL_MAX (PAGE_SIZE / sizeof(struct cos_tcap_refill))
+
 #define ARCV_NOTIF_DEPTH 8
 
 #define QUIESCENCE_CHECK(curr, past, quiescence_period) (((curr) - (past)) > (quiescence_period))
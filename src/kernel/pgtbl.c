@@ -47,28 +47,38 @@ pgtbl_kmem_act(pgtbl_t pt, u32_t addr, unsigned long *kern_addr, unsigned long *
 	return 0;
 }
 
-/* Return 1 if quiescent past since input timestamp. 0 if not. */
-int
-tlb_quiescence_check(u64_t timestamp)
+/* Return 1 if quiescent past since input timestamp, 0 if not (and the core that isn't in *cpu). */
+static int
+__tlb_quiescent(u64_t timestamp, int *cpu)
 {
-	int i, quiescent = 1;
+	int i;
 
 	/* Did timer interrupt (which does tlb flush
 	 * periodically) happen after unmap? The periodic
 	 * flush happens on all cpus, thus only need to check
 	 * the time stamp of the current core for that case
 	 * (assuming consistent time stamp counters). */
-	if (timestamp > tlb_quiescence[get_cpuid()].last_periodic_flush) {
-		/* If no periodic flush done yet, did the
-		 * mandatory flush happen on all cores? */
-		for (i = 0; i < NUM_CPU_COS; i++) {
-			if (timestamp > tlb_quiescence[i].last_mandatory_flush) {
-				/* no go */
-				quiescent = 0;
-				break;
-			}
+	if (timestamp <= tlb_quiescence[get_cpuid()].last_periodic_flush) return 1;
+	/* If no periodic flush done yet, did the
+	 * mandatory flush happen on all cores? */
+	for (i = 0; i < NUM_CPU_COS; i++) {
+		if (timestamp > tlb_quiescence[i].last_mandatory_flush) {
+			/* no go */
+			*cpu = i;
+			return 0;
 		}
 	}
+
+	return 1;
+}
+
+/* Return 1 if quiescent past since input timestamp. 0 if not. */
+int
+tlb_quiescence_check(u64_t timestamp)
+{
+	int i = 0, quiescent;
+
+	quiescent = __tlb_quiescent(timestamp, &i);
 	if (quiescent == 0) {
 		printk("from cpu %d, t %llu: cpu %d last mandatory flush: %llu\n", get_cpuid(), timestamp, i,
 		       tlb_quiescence[i].last_mandatory_flush);
@@ -102,12 +112,322 @@ cap_memactivate(struct captbl *ct, struct cap_pgtbl *pt, capid_t frame_cap, capi
 
 	assert(!(orig_v & PGTBL_QUIESCENCE));
 	cosframe = orig_v & PGTBL_FRAME_MASK;
+	/* the frame was given to the copy-on-write pools */
+	if (pgtbl_cow_frame_pooled(cosframe)) return -EPERM;
 
 	ret = pgtbl_mapping_add(((struct cap_pgtbl *)dest_pt_h)->pgtbl, vaddr, cosframe, PGTBL_USER_DEF);
 
 	return ret;
 }
 
+/*
+ * Frames donated for resolving copy-on-write faults.  Each core only
+ * touches its own pool (donations, faults, and unmaps all happen on
+ * the local core), and the kernel is non-preemptive, so no
+ * synchronization is required.
+ *
+ * Frames also come back to the pool when their last mapping is
+ * removed, but other cores' TLBs can still hold those mappings, so a
+ * frame is only reused once TLB quiescence has passed since its last
+ * unmapping (as when memory is retyped).  The pool is a FIFO, so the
+ * frames that have been out of use the longest are tried first.
+ */
+#define PGTBL_COW_POOL_SZ 512
+
+struct pgtbl_cow_pool {
+	int           head, nframes;
+	unsigned long frames[PGTBL_COW_POOL_SZ];
+} CACHE_ALIGNED;
+
+static struct pgtbl_cow_pool pgtbl_cow_pool[NUM_CPU] CACHE_ALIGNED;
+
+static inline int
+pgtbl_cow_pool_put(struct pgtbl_cow_pool *pool, unsigned long frame)
+{
+	if (pool->nframes == PGTBL_COW_POOL_SZ) return -ENOMEM;
+	pool->frames[(pool->head + pool->nframes) % PGTBL_COW_POOL_SZ] = frame;
+	pool->nframes++;
+
+	return 0;
+}
+
+/* The first frame that can be reused, moved to the head of the pool, or 0. */
+static unsigned long
+pgtbl_cow_pool_first(struct pgtbl_cow_pool *pool)
+{
+	int i, cpu;
+
+	for (i = 0; i < pool->nframes; i++) {
+		unsigned long *f = &pool->frames[(pool->head + i) % PGTBL_COW_POOL_SZ], frame = *f;
+		u64_t          last_unmap;
+
+		if (retypetbl_last_unmap((void *)frame, &last_unmap)) continue;
+		if (!__tlb_quiescent(last_unmap, &cpu)) continue;
+
+		*f                        = pool->frames[pool->head];
+		pool->frames[pool->head] = frame;
+
+		return frame;
+	}
+
+	return 0;
+}
+
+static inline void
+pgtbl_cow_pool_take(struct pgtbl_cow_pool *pool)
+{
+	assert(pool->nframes);
+	pool->head = (pool->head + 1) % PGTBL_COW_POOL_SZ;
+	pool->nframes--;
+}
+
+/*
+ * For each user frame: whether it is pooled, and if so, how many
+ * mappings it has, so that it goes back to a pool when its last
+ * mapping is removed.  Frames are pooled when they come from a pool,
+ * and when they are first shared copy-on-write while mapped only by
+ * their owner (so that they aren't lost once all sharers have copied
+ * them).  Other frames belong to the donor of the memory and aren't
+ * tracked.
+ */
+#define PGTBL_COW_POOLED 0x80
+#define PGTBL_COW_REFS 0x7F
+
+static u8_t pgtbl_cow_frames[COS_MAX_MEMORY];
+
+static inline u8_t *
+pgtbl_cow_frame(unsigned long frame)
+{
+	if (frame < COS_MEM_START || frame >= COS_MEM_BOUND) return NULL;
+
+	return &pgtbl_cow_frames[(frame - COS_MEM_START) / PAGE_SIZE];
+}
+
+static inline int
+pgtbl_cow_frame_cas(u8_t *f, u8_t old, u8_t updated)
+{
+	char z;
+	__asm__ __volatile__("lock cmpxchgb %2, %0; setz %1"
+	                     : "+m"(*f), "=a"(z)
+	                     : "q"(updated), "a"(old)
+	                     : "memory", "cc");
+	return (int)z;
+}
+
+/* Is frame owned by the copy-on-write pools (and not by its donor)? */
+int
+pgtbl_cow_frame_pooled(unsigned long frame)
+{
+	u8_t *f = pgtbl_cow_frame(frame);
+
+	return f && (*(volatile u8_t *)f & PGTBL_COW_POOLED);
+}
+
+/* A new mapping of frame: returns 0, or an error if it can't be mapped again. */
+int
+pgtbl_cow_frame_ref(unsigned long frame)
+{
+	u8_t *f = pgtbl_cow_frame(frame), v;
+
+	if (!f) return 0;
+	do {
+		v = *(volatile u8_t *)f;
+		if (!(v & PGTBL_COW_POOLED)) return 0;
+		/* its last mapping was just removed */
+		if (!(v & PGTBL_COW_REFS)) return -EAGAIN;
+		if ((v & PGTBL_COW_REFS) == PGTBL_COW_REFS) return -EOVERFLOW;
+	} while (pgtbl_cow_frame_cas(f, v, v + 1) != CAS_SUCCESS);
+
+	return 0;
+}
+
+/* A mapping of frame was removed. */
+void
+pgtbl_cow_frame_deref(unsigned long frame)
+{
+	struct pgtbl_cow_pool *pool = &pgtbl_cow_pool[get_cpuid()];
+	u8_t *                 f    = pgtbl_cow_frame(frame), v;
+
+	if (!f) return;
+	do {
+		v = *(volatile u8_t *)f;
+		if (!(v & PGTBL_COW_POOLED)) return;
+		assert(v & PGTBL_COW_REFS);
+	} while (pgtbl_cow_frame_cas(f, v, v - 1) != CAS_SUCCESS);
+	if ((v & PGTBL_COW_REFS) != 1) return;
+
+	/* If the pool is full, the frame is lost. */
+	pgtbl_cow_pool_put(pool, frame);
+}
+
+/*
+ * Track an untracked frame that is about to be shared copy-on-write,
+ * if its only mapping is the one being shared, and it can be copied
+ * through the kernel mapping.
+ */
+static void
+pgtbl_cow_frame_adopt(unsigned long frame)
+{
+	u8_t *f = pgtbl_cow_frame(frame);
+
+	if (!f || *(volatile u8_t *)f || !chal_pa2va((paddr_t)frame)) return;
+	if (retypetbl_ref_sum((void *)frame) != 1) return;
+	pgtbl_cow_frame_cas(f, 0, PGTBL_COW_POOLED | 1);
+}
+
+/*
+ * Share the page at src_addr in pt with dest_pt at dest_addr.
+ * Writable pages are made read-only and copy-on-write in *both*
+ * page-tables, so that the first write by either side takes a private
+ * copy.  Read-only pages are simply shared.  The caller must ensure
+ * that the source is not executing on other cores during the fork
+ * (their TLBs may still hold the writable entry).
+ */
+int
+cap_memcow(struct captbl *ct, struct cap_pgtbl *pt, vaddr_t src_addr, capid_t dest_pt, vaddr_t dest_addr)
+{
+	unsigned long *    pte, orig_v, new_v, frame;
+	struct cap_header *dest_pt_h;
+	u32_t              flags;
+	int                ret;
+
+	if (unlikely(pt->lvl || (pt->refcnt_flags & CAP_MEM_FROZEN_FLAG))) return -EINVAL;
+
+	dest_pt_h = captbl_lkup(ct, dest_pt);
+	if (unlikely(!dest_pt_h || dest_pt_h->type != CAP_PGTBL)) return -EINVAL;
+	if (((struct cap_pgtbl *)dest_pt_h)->lvl) return -EINVAL;
+	if (((struct cap_pgtbl *)dest_pt_h)->refcnt_flags & CAP_MEM_FROZEN_FLAG) return -EINVAL;
+
+	pte = pgtbl_lkup_pte(pt->pgtbl, src_addr, &flags);
+	if (!pte) return -ENOENT;
+	orig_v = *pte;
+
+	if (!(orig_v & PGTBL_PRESENT)) return -ENOENT;
+	/* Cannot share frames, kernel memory, or kernel entries. */
+	if ((orig_v & (PGTBL_COSFRAME | PGTBL_COSKMEM)) || !(orig_v & PGTBL_USER)) return -EPERM;
+
+	new_v = orig_v;
+	if (orig_v & PGTBL_WRITABLE) new_v = (orig_v & ~PGTBL_WRITABLE) | PGTBL_COW;
+	frame = new_v & PGTBL_FRAME_MASK;
+
+	/* a private frame goes to the pool once all of its sharers have copied it */
+	if (new_v & PGTBL_COW) pgtbl_cow_frame_adopt(frame);
+	ret = pgtbl_cow_frame_ref(frame);
+	if (ret) return ret;
+	ret = pgtbl_mapping_add(((struct cap_pgtbl *)dest_pt_h)->pgtbl, dest_addr, frame, new_v & PGTBL_FLAG_MASK);
+	if (ret) {
+		pgtbl_cow_frame_deref(frame);
+		return ret;
+	}
+	if (new_v == orig_v) return 0;
+
+	if (cos_cas(pte, orig_v, new_v) != CAS_SUCCESS) {
+		/* the source changed underneath us; undo the child mapping */
+		pgtbl_mapping_del_direct(((struct cap_pgtbl *)dest_pt_h)->pgtbl, dest_addr);
+		retypetbl_deref((void *)frame);
+		pgtbl_cow_frame_deref(frame);
+		return -ECASFAIL;
+	}
+	chal_flush_tlb();
+
+	return 0;
+}
+
+/*
+ * Remove the frame at frame_addr from pt, and give it to this core's
+ * pool of frames used to resolve copy-on-write faults.  The frame
+ * must be kernel-accessible (we copy through the kernel mapping), and
+ * is consumed: the donor is trusted, as with memory activation, to
+ * not still have it mapped elsewhere.
+ */
+int
+pgtbl_cow_donate(struct cap_pgtbl *pt, vaddr_t frame_addr)
+{
+	struct pgtbl_cow_pool *pool = &pgtbl_cow_pool[get_cpuid()];
+	unsigned long *        pte, orig_v, frame;
+	u8_t *                 f;
+	u32_t                  flags;
+	int                    ret;
+
+	if (unlikely(pt->lvl || (pt->refcnt_flags & CAP_MEM_FROZEN_FLAG))) return -EINVAL;
+	if (pool->nframes == PGTBL_COW_POOL_SZ) return -ENOMEM;
+
+	pte = pgtbl_lkup_pte(pt->pgtbl, frame_addr, &flags);
+	if (!pte) return -EINVAL;
+	orig_v = *pte;
+
+	if (!(orig_v & PGTBL_COSFRAME) || (orig_v & PGTBL_COSKMEM)) return -EPERM;
+	frame = orig_v & PGTBL_FRAME_MASK;
+	f     = pgtbl_cow_frame(frame);
+	if (!f || !chal_pa2va((paddr_t)frame)) return -EINVAL;
+	if (*(volatile u8_t *)f & PGTBL_COW_POOLED) return -EPERM;
+
+	/* Only user memory can back user mappings. */
+	ret = retypetbl_retype2user((void *)frame);
+	if (ret && ret != -EEXIST) return -EPERM;
+
+	if (cos_cas(pte, orig_v, 0) != CAS_SUCCESS) return -ECASFAIL;
+	*f = PGTBL_COW_POOLED;
+	pgtbl_cow_pool_put(pool, frame);
+
+	return 0;
+}
+
+/*
+ * Resolve a write fault on a copy-on-write page by copying it into a
+ * frame from the local pool.  Returns 0 if the faulting access can be
+ * restarted: the fault was resolved, or had already been (by another
+ * core, or the entry in our TLB was stale).
+ */
+int
+pgtbl_cow_fault(pgtbl_t pt, vaddr_t addr)
+{
+	struct pgtbl_cow_pool *pool = &pgtbl_cow_pool[get_cpuid()];
+	unsigned long *        pte, orig_v, new_v, frame;
+	void *                 src, *dst;
+	u32_t                  flags;
+
+	pte = pgtbl_lkup_pte(pt, addr & PGTBL_FRAME_MASK, &flags);
+	if (!pte) return -ENOENT;
+	orig_v = *pte;
+
+	if ((orig_v & (PGTBL_PRESENT | PGTBL_USER)) != (PGTBL_PRESENT | PGTBL_USER)) return -EINVAL;
+	if (orig_v & PGTBL_WRITABLE) {
+		chal_flush_tlb();
+		return 0;
+	}
+	if (!(orig_v & PGTBL_COW)) return -EINVAL;
+
+	src = chal_pa2va((paddr_t)(orig_v & PGTBL_FRAME_MASK));
+	if (!src) return -EFAULT;
+	frame = pgtbl_cow_pool_first(pool);
+	if (!frame) return -ENOMEM;
+	dst = chal_pa2va((paddr_t)frame);
+	assert(dst);
+
+	if (retypetbl_ref((void *)frame)) return -EFAULT;
+	memcpy(dst, src, PAGE_SIZE);
+	new_v                   = frame | (orig_v & PGTBL_FLAG_MASK & ~PGTBL_COW) | PGTBL_WRITABLE;
+	*pgtbl_cow_frame(frame) = PGTBL_COW_POOLED | 1;
+	if (cos_cas(pte, orig_v, new_v) != CAS_SUCCESS) {
+		/* Another core resolved (or removed) it first: the frame stays in the pool. */
+		*pgtbl_cow_frame(frame) = PGTBL_COW_POOLED;
+		retypetbl_deref((void *)frame);
+		return 0;
+	}
+	pgtbl_cow_pool_take(pool);
+	/*
+	 * Our mapping of the original frame is gone: if it was the last
+	 * one, the (pooled) frame goes back to the pool, to be reused
+	 * after TLB quiescence.
+	 */
+	retypetbl_deref((void *)(orig_v & PGTBL_FRAME_MASK));
+	pgtbl_cow_frame_deref(orig_v & PGTBL_FRAME_MASK);
+	chal_flush_tlb();
+
+	return 0;
+}
+
 int
 pgtbl_activate(struct captbl *t, unsigned long cap, unsigned long capin, pgtbl_t pgtbl, u32_t lvl)
 {
@@ -71,6 +71,43 @@ retypetbl_deref(void *pa)
 	return mod_ref_cnt(pa, 0, -1);
 }
 
+/* The # of mappings of the memory set on all cores. */
+int
+retypetbl_ref_sum(void *pa)
+{
+	u32_t idx;
+	int   cpu, ref_sum = 0;
+
+	PA_BOUNDARY_CHECK();
+
+	idx = GET_MEM_IDX(pa);
+	assert(idx < N_MEM_SETS);
+	/* the per-core counts can be negative, only their sum is meaningful */
+	for (cpu = 0; cpu < NUM_CPU; cpu++) ref_sum += retype_tbl[cpu].mem_set[idx].refcnt_atom.ref_cnt;
+
+	return ref_sum;
+}
+
+/* The time of the last unmapping in the memory set, on any core (for TLB quiescence). */
+int
+retypetbl_last_unmap(void *pa, u64_t *last_unmap)
+{
+	u32_t idx;
+	int   cpu;
+
+	PA_BOUNDARY_CHECK();
+
+	idx = GET_MEM_IDX(pa);
+	assert(idx < N_MEM_SETS);
+	*last_unmap = 0;
+	for (cpu = 0; cpu < NUM_CPU; cpu++) {
+		if (*last_unmap < retype_tbl[cpu].mem_set[idx].last_unmap)
+			*last_unmap = retype_tbl[cpu].mem_set[idx].last_unmap;
+	}
+
+	return 0;
+}
+
 static inline int
 mod_mem_type(void *pa, const mem_type_t type)
 {
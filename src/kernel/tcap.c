@@ -220,6 +220,29 @@ tcap_merge(struct tcap *dst, struct tcap *rm)
 	return 0;
 }
 
+/*
+ * Top up dst's budget to cycles from src, so that a scheduler can
+ * replenish without first reading the budget.  The delegation keeps
+ * the priority that src's scheduler last gave dst, so src must have
+ * transferred to dst before.
+ */
+int
+tcap_refill(struct tcap *dst, struct tcap *src, tcap_res_t cycles)
+{
+	tcap_res_t left = tcap_left(dst);
+	tcap_uid_t s    = tcap_sched_info(src)->tcap_uid;
+	int        i;
+
+	if (unlikely(dst == src)) return -EINVAL;
+	for (i = 0; i < dst->ndelegs; i++) {
+		if (dst->delegations[i].tcap_uid == s) break;
+	}
+	if (unlikely(i == dst->ndelegs)) return -EINVAL;
+	if (TCAP_RES_IS_INF(left) || left >= cycles || tcap_cycles_same(left, cycles)) return 0;
+
+	return tcap_delegate(dst, src, cycles - left, dst->delegations[i].prio);
+}
+
 int
 tcap_wakeup(struct tcap *tc, tcap_prio_t prio, tcap_res_t budget, struct thread *thd, struct cos_cpu_local_info *cli)
 {
@@ -133,11 +133,21 @@ page_fault_handler(struct pt_regs *regs)
 	struct cos_cpu_local_info *ci    = cos_cpu_local_info();
 	thdid_t                    thdid = thd_current(ci)->tid;
 
-	print_regs_state(regs);
 	fault_addr = chal_cpu_fault_vaddr(regs);
 	errcode    = chal_cpu_fault_errcode(regs);
 	eip        = chal_cpu_fault_ip(regs);
 
+	/*
+	 * A write to a copy-on-write page, by user-level or by the kernel
+	 * (CR0.WP is set) into user memory? Copy, and restart the access.
+	 */
+	if ((errcode & (PGTBL_PRESENT | PGTBL_WRITABLE)) == (PGTBL_PRESENT | PGTBL_WRITABLE)
+	    && ((errcode & PGTBL_USER) || fault_addr < COS_MEM_KERN_START_VA)
+	    && !pgtbl_cow_fault(thd_current_pgtbl(thd_current(ci)), fault_addr)) {
+		return 1;
+	}
+
+	print_regs_state(regs);
 	die("FAULT: Page Fault in thd %d (%s %s %s %s %s) @ 0x%x, ip 0x%x\n", thdid,
 	    errcode & PGTBL_PRESENT ? "present" : "not-present",
 	    errcode & PGTBL_WRITABLE ? "write-fault" : "read-fault", errcode & PGTBL_USER ? "user-mode" : "system",
@@ -0,0 +1,4 @@
+#!/bin/sh
+
+cp llboot_test.o llboot.o
+./cos_linker "llboot.o, ;unit_cbuf.o, :" ./gen_client_stub
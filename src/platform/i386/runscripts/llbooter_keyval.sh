@@ -0,0 +1,4 @@
+#!/bin/sh
+
+cp llboot_test.o llboot.o
+./cos_linker "llboot.o, ;hkv.o, ;unit_keyval.o, :unit_keyval.o-hkv.o" ./gen_client_stub
@@ -0,0 +1,4 @@
+#!/bin/sh
+
+cp llboot_test.o llboot.o
+./cos_linker "llboot.o, ;unit_stacks_srv.o, ;unit_stacks.o, :unit_stacks.o-unit_stacks_srv.o" ./gen_client_stub
@@ -0,0 +1,293 @@
+/**
+ * Redistribution of this file is permitted under the GNU General
+ * Public License v2.
+ *
+ * Content-addressed cache for the linker's intermediate objects.
+ * Each output (a service linked with its stubs, or an ld output for a
+ * given script) is a pure function of its input files and a command
+ * string, so we key the outputs on a hash of those.  A one-line
+ * change in one component then only regenerates that component's
+ * objects.
+ *
+ * The cache directory is $COS_LINKER_CACHE (an empty value disables
+ * caching), and defaults to the cache/ directory next to the linker's
+ * sources.  Its contents are trusted as linker inputs, so it is only
+ * used if it is a directory owned by us that nobody else can write.
+ * It is pruned to $COS_LINKER_CACHE_MB megabytes (default 256),
+ * removing the least recently used outputs first.  The number of
+ * parallel workers is $COS_LINKER_JOBS, and defaults to the number of
+ * cpus.
+ */
+
+#include "cl_types.h"
+#include "cl_macros.h"
+#include "cl_globals.h"
+#include "cl_cache.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#ifndef CACHE_DEFAULT_DIR
+#define CACHE_DEFAULT_DIR "cache"
+#endif
+#define CACHE_DEFAULT_MB 256
+#define FNV64_INIT 0xcbf29ce484222325ULL
+#define FNV64_PRIME 0x100000001b3ULL
+
+struct cache_ent {
+	char   name[CACHE_KEY_LEN + 2];
+	time_t mtime;
+	off_t  sz;
+};
+
+static int
+cache_ent_cmp(const void *a, const void *b)
+{
+	const struct cache_ent *x = a, *y = b;
+
+	return (x->mtime > y->mtime) - (x->mtime < y->mtime);
+}
+
+/* Remove the least recently used outputs until we're under the size limit. */
+static void
+cache_prune(const char *dir)
+{
+	char              *env = getenv("COS_LINKER_CACHE_MB");
+	unsigned long long max = (env ? atol(env) : CACHE_DEFAULT_MB) * 1024ULL * 1024ULL, tot = 0;
+	struct cache_ent  *ents = NULL;
+	int                n = 0, cap = 0, i;
+	struct dirent     *d;
+	DIR               *dp;
+
+	dp = opendir(dir);
+	if (!dp) return;
+	while ((d = readdir(dp))) {
+		char        path[MAX_FILE_NAME_LEN];
+		struct stat st;
+		size_t      len = strlen(d->d_name);
+
+		/* only our outputs: a key, and ".o" */
+		if (len != CACHE_KEY_LEN + 1 || strcmp(d->d_name + CACHE_KEY_LEN - 1, ".o")) continue;
+		snprintf(path, MAX_FILE_NAME_LEN, "%s/%s", dir, d->d_name);
+		if (lstat(path, &st) || !S_ISREG(st.st_mode)) continue;
+		if (n == cap) {
+			cap  = cap ? cap * 2 : 64;
+			ents = realloc(ents, cap * sizeof(struct cache_ent));
+			if (!ents) break;
+		}
+		strcpy(ents[n].name, d->d_name);
+		ents[n].mtime = st.st_mtime;
+		ents[n].sz    = st.st_size;
+		tot += st.st_size;
+		n++;
+	}
+	closedir(dp);
+	if (!ents) return;
+
+	qsort(ents, n, sizeof(struct cache_ent), cache_ent_cmp);
+	for (i = 0; i < n && tot > max; i++) {
+		char path[MAX_FILE_NAME_LEN];
+
+		snprintf(path, MAX_FILE_NAME_LEN, "%s/%s", dir, ents[i].name);
+		if (!unlink(path)) tot -= ents[i].sz;
+	}
+	free(ents);
+}
+
+static const char *
+cache_dir(void)
+{
+	static const char *dir  = NULL;
+	static int         init = 0;
+	struct stat        st;
+
+	if (init) return dir;
+	init = 1;
+
+	dir = getenv("COS_LINKER_CACHE");
+	if (!dir) dir = CACHE_DEFAULT_DIR;
+	if (!strlen(dir)) {
+		dir = NULL;
+		return NULL;
+	}
+	if (mkdir(dir, 0700) && errno != EEXIST) {
+		printl(PRINT_HIGH, "Could not create linker cache %s, not caching.\n", dir);
+		dir = NULL;
+		return NULL;
+	}
+	/* Anyone who can write the cache can choose what we link. */
+	if (lstat(dir, &st) || !S_ISDIR(st.st_mode) || st.st_uid != getuid() || (st.st_mode & (S_IWGRP | S_IWOTH))) {
+		printl(PRINT_HIGH, "Linker cache %s is not a directory only we can write, not caching.\n", dir);
+		dir = NULL;
+		return NULL;
+	}
+	cache_prune(dir);
+
+	return dir;
+}
+
+int
+cache_enabled(void)
+{
+	return cache_dir() != NULL;
+}
+
+static unsigned long long
+hash_mem(unsigned long long h, const unsigned char *b, size_t sz)
+{
+	size_t i;
+
+	for (i = 0; i < sz; i++) {
+		h ^= b[i];
+		h *= FNV64_PRIME;
+	}
+
+	return h;
+}
+
+int
+cache_key(char *key, const char *files[], const char *extra)
+{
+	unsigned long long h = FNV64_INIT;
+	unsigned char      buf[4096];
+	int                i;
+
+	for (i = 0; files[i]; i++) {
+		ssize_t n;
+		int     fd = open(files[i], O_RDONLY);
+
+		if (fd < 0) return -1;
+		while ((n = read(fd, buf, sizeof(buf))) > 0) h = hash_mem(h, buf, n);
+		close(fd);
+		if (n < 0) return -1;
+		/* separate the files so that concatenations differ */
+		h = hash_mem(h, (const unsigned char *)"", 1);
+	}
+	if (extra) h = hash_mem(h, (const unsigned char *)extra, strlen(extra));
+	sprintf(key, "%016llx", h);
+
+	return 0;
+}
+
+static int
+copy_file(const char *src, const char *dest)
+{
+	char    buf[4096];
+	ssize_t n;
+	int     in, out, ret = 0;
+
+	in = open(src, O_RDONLY);
+	if (in < 0) return -1;
+	out = open(dest, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (out < 0) {
+		close(in);
+		return -1;
+	}
+	while ((n = read(in, buf, sizeof(buf))) > 0) {
+		if (write(out, buf, n) != n) {
+			ret = -1;
+			break;
+		}
+	}
+	if (n < 0) ret = -1;
+	close(in);
+	close(out);
+
+	return ret;
+}
+
+int
+cache_lookup(const char *key, const char *dest)
+{
+	const char *dir = cache_dir();
+	char        path[MAX_FILE_NAME_LEN];
+
+	if (!dir) return -1;
+	snprintf(path, MAX_FILE_NAME_LEN, "%s/%s.o", dir, key);
+	if (access(path, R_OK)) return -1;
+
+	unlink(dest);
+	/* the outputs are only read, so a link is enough */
+	if (link(path, dest) && copy_file(path, dest)) return -1;
+	/* the modification time orders pruning */
+	utimes(path, NULL);
+	printl(PRINT_DEBUG, "Linker cache hit %s -> %s\n", path, dest);
+
+	return 0;
+}
+
+void
+cache_insert(const char *key, const char *src)
+{
+	const char *dir = cache_dir();
+	char        path[MAX_FILE_NAME_LEN], tmp[MAX_FILE_NAME_LEN];
+
+	if (!dir) return;
+	snprintf(path, MAX_FILE_NAME_LEN, "%s/%s.o", dir, key);
+	snprintf(tmp, MAX_FILE_NAME_LEN, "%s/%s.o.%d", dir, key, getpid());
+
+	/* Write, then rename so that concurrent builds never see partial objects. */
+	if (copy_file(src, tmp) || rename(tmp, path)) unlink(tmp);
+}
+
+static int
+cache_njobs(void)
+{
+	char *env = getenv("COS_LINKER_JOBS");
+	long  n;
+
+	if (env) n = atol(env);
+	else     n = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n < 1) n = 1;
+
+	return (int)n;
+}
+
+int
+cache_parallel(int n, int (*fn)(int i, void *data), void *data)
+{
+	int   i, status, running = 0, failed = 0;
+	int   njobs = cache_njobs();
+	pid_t pid;
+
+	if (njobs == 1 || n == 1) {
+		for (i = 0; i < n; i++) failed += (fn(i, data) != 0);
+		return failed;
+	}
+
+	/* don't duplicate buffered output in the children */
+	fflush(stdout);
+	fflush(stderr);
+	for (i = 0; i < n; i++) {
+		if (running == njobs) {
+			if (wait(&status) > 0) {
+				running--;
+				if (!WIFEXITED(status) || WEXITSTATUS(status)) failed++;
+			}
+		}
+
+		pid = fork();
+		if (pid < 0) {
+			/* can't fork?  Do it ourself. */
+			failed += (fn(i, data) != 0);
+			continue;
+		}
+		if (pid == 0) _exit(fn(i, data) ? 1 : 0);
+		running++;
+	}
+	while (running > 0 && wait(&status) > 0) {
+		running--;
+		if (!WIFEXITED(status) || WEXITSTATUS(status)) failed++;
+	}
+
+	return failed;
+}
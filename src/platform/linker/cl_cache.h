@@ -0,0 +1,36 @@
+/**
+ * Redistribution of this file is permitted under the GNU General
+ * Public License v2.
+ *
+ * A content-addressed cache of the linker's intermediate objects
+ * (generated stubs, and per-service linked objects), and a simple
+ * process pool to generate them in parallel.
+ */
+
+#ifndef CL_CACHE_H
+#define CL_CACHE_H
+
+/* 64 bit hash as hex, and a terminating null */
+#define CACHE_KEY_LEN 17
+
+/* Is there a cache directory to use? */
+int cache_enabled(void);
+/*
+ * Compute the key for an output generated from the contents of the
+ * files in the null-terminated files array, and the extra string
+ * (e.g. a dependency or command string; might be NULL).  Returns -1
+ * if a file cannot be read.
+ */
+int cache_key(char *key, const char *files[], const char *extra);
+/* Produce dest from the cache.  Returns 0 on a hit. */
+int cache_lookup(const char *key, const char *dest);
+/* Add the output src to the cache under key. */
+void cache_insert(const char *key, const char *src);
+
+/*
+ * Run fn(i, data) for i in [0, n) in a pool of processes.  Returns
+ * the number of invocations that failed (non-zero return).
+ */
+int cache_parallel(int n, int (*fn)(int i, void *data), void *data);
+
+#endif /* CL_CACHE_H */
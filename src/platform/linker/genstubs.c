@@ -8,6 +8,7 @@
 #include "cl_types.h"
 #include "cl_macros.h"
 #include "cl_globals.h"
+#include "cl_cache.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -16,6 +17,63 @@
 #include <assert.h>
 #include <libgen.h>
 
+struct stub_job {
+	struct service_symbs *s;
+	char *                gen_stub_prog;
+	char                  tmp_name[256];
+	char                  key[CACHE_KEY_LEN];
+	int                   cached;
+};
+
+/* Generate, compile, and link the stubs for a single service. */
+static int
+gen_stub_and_link(int i, void *data)
+{
+	struct stub_job * job   = &((struct stub_job *)data)[i];
+	struct symb_type *symbs = &job->s->undef;
+	char *            tmp_name = job->tmp_name;
+	char              tmp_str[2048];
+	char              dest[256];
+	int               j, ret = 0;
+
+	if (job->cached) return 0;
+
+	/* make the command line for an invoke the stub generator */
+	strcpy(tmp_str, job->gen_stub_prog);
+
+	if (symbs->num_symbs > 0) {
+		strcat(tmp_str, " ");
+		strcat(tmp_str, symbs->symbs[0].name);
+	}
+	for (j = 1; j < symbs->num_symbs; j++) {
+		strcat(tmp_str, ",");
+		strcat(tmp_str, symbs->symbs[j].name);
+	}
+
+	/* invoke the stub generator */
+	sprintf(dest, " > %s_stub.S", tmp_name);
+	strcat(tmp_str, dest);
+	printl(PRINT_DEBUG, "%s\n", tmp_str);
+	ret |= system(tmp_str);
+
+	/* compile the stub */
+	sprintf(tmp_str, GCC_BIN " -m32 -c -o %s_stub.o %s_stub.S", tmp_name, tmp_name);
+	ret |= system(tmp_str);
+
+	/* link the stub to the service */
+	sprintf(tmp_str, LINKER_BIN " -m elf_i386 -r -o %s.o %s %s_stub.o", tmp_name, job->s->obj, tmp_name);
+	ret |= system(tmp_str);
+
+	sprintf(tmp_str, "rm %s_stub.o %s_stub.S", tmp_name, tmp_name);
+	system(tmp_str);
+
+	if (ret) return -1;
+	sprintf(tmp_str, "%s.o", tmp_name);
+	if (strlen(job->key)) cache_insert(job->key, tmp_str);
+
+	return 0;
+}
+
 /*
  * Produces a number of object files in /tmp named objname.o.pid.o
  * with no external dependencies.
@@ -23,78 +81,68 @@
  * gen_stub_prog is the address to the client stub generation prog
  * st_object is the address of the symmetric trust object.
  *
+ * Each service is independent, so they are generated in parallel,
+ * and the results are cached keyed on the service object, the stub
+ * generator, and the list of dependencies.
+ *
  * This is kind of a big hack.
  */
 void
 gen_stubs_and_link(char *gen_stub_prog, struct service_symbs *services)
 {
-	int  pid = getpid();
-	char tmp_str[2048];
-
-	while (services) {
-		int               i;
-		struct symb_type *symbs = &services->undef;
-		char              dest[256];
-		char              tmp_name[256];
-		char *            obj_name, *orig_name, *str;
-
-		orig_name = services->obj;
-		obj_name  = basename(services->obj);
-		sprintf(tmp_name, "/tmp/%s.%d", obj_name, pid);
-
-		/*		if (symbs->num_symbs == 0) {
-		                        sprintf(tmp_str, "cp %s %s.o",
-		                                orig_name, tmp_name);
-		                        system(tmp_str);
-
-		                        str = malloc(strlen(tmp_name)+3);
-		                        strcpy(str, tmp_name);
-		                        strcat(str, ".o");
-		                        free(services->obj);
-		                        services->obj = str;
-
-		                        services = services->next;
-		                        continue;
-		                }
-		*/
-		/* make the command line for an invoke the stub generator */
-		strcpy(tmp_str, gen_stub_prog);
-
-		if (symbs->num_symbs > 0) {
-			strcat(tmp_str, " ");
-			strcat(tmp_str, symbs->symbs[0].name);
-		}
-		for (i = 1; i < symbs->num_symbs; i++) {
-			strcat(tmp_str, ",");
-			strcat(tmp_str, symbs->symbs[i].name);
+	int                   pid = getpid();
+	int                   n, i;
+	struct service_symbs *s;
+	struct stub_job *     jobs;
+
+	for (n = 0, s = services; s; s = s->next) n++;
+	jobs = calloc(n, sizeof(struct stub_job));
+	assert(jobs);
+
+	for (i = 0, s = services; s; s = s->next, i++) {
+		struct stub_job * job   = &jobs[i];
+		struct symb_type *symbs = &s->undef;
+		const char *      files[] = {s->obj, gen_stub_prog, NULL};
+		char *            deps;
+		size_t            deps_sz = 1;
+		char              tmp_str[256];
+		int               j;
+
+		job->s             = s;
+		job->gen_stub_prog = gen_stub_prog;
+		sprintf(job->tmp_name, "/tmp/%s.%d", basename(s->obj), pid);
+
+		/* all of the dependencies are in the key: a prefix could match another service's */
+		for (j = 0; j < symbs->num_symbs; j++) deps_sz += strlen(symbs->symbs[j].name) + 1;
+		deps = malloc(deps_sz);
+		assert(deps);
+		deps[0] = '\0';
+		for (j = 0; j < symbs->num_symbs; j++) {
+			strcat(deps, symbs->symbs[j].name);
+			strcat(deps, ",");
 		}
+		if (cache_key(job->key, files, deps)) job->key[0] = '\0';
+		free(deps);
 
-		/* invoke the stub generator */
-		sprintf(dest, " > %s_stub.S", tmp_name);
-		strcat(tmp_str, dest);
-		printl(PRINT_DEBUG, "%s\n", tmp_str);
-		system(tmp_str);
+		sprintf(tmp_str, "%s.o", job->tmp_name);
+		if (strlen(job->key) && !cache_lookup(job->key, tmp_str)) job->cached = 1;
+	}
 
-		/* compile the stub */
-		sprintf(tmp_str, GCC_BIN " -m32 -c -o %s_stub.o %s_stub.S", tmp_name, tmp_name);
-		system(tmp_str);
+	if (cache_parallel(n, gen_stub_and_link, jobs)) {
+		printl(PRINT_HIGH, "Stub generation and linking failed.\n");
+	}
 
-		/* link the stub to the service */
-		sprintf(tmp_str, LINKER_BIN " -m elf_i386 -r -o %s.o %s %s_stub.o", tmp_name, orig_name, tmp_name);
-		system(tmp_str);
+	/* Make service names reflect their new linked versions */
+	for (i = 0; i < n; i++) {
+		char *str;
 
-		/* Make service names reflect their new linked versions */
-		str = malloc(strlen(tmp_name) + 3);
-		strcpy(str, tmp_name);
+		str = malloc(strlen(jobs[i].tmp_name) + 3);
+		strcpy(str, jobs[i].tmp_name);
 		strcat(str, ".o");
-		free(services->obj);
-		services->obj = str;
-
-		sprintf(tmp_str, "rm %s_stub.o %s_stub.S", tmp_name, tmp_name);
-		system(tmp_str);
-
-		services = services->next;
+		free(jobs[i].s->obj);
+		jobs[i].s->obj = str;
 	}
+	free(jobs);
 
 	return;
 }
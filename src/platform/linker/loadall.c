@@ -12,6 +12,7 @@
 #include "cl_macros.h"
 #include "cl_globals.h"
 #include "cl_inline.h"
+#include "cl_cache.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -235,15 +236,26 @@ emit_section(FILE *fp, char *sec)
 	fprintf(fp, "%s : { *(%s*) }\n", sec, sec);
 }
 
+/*
+ * The output is a function of only the object and the script's
+ * contents, so reuse previous links from the cache.
+ */
 void
 run_linker(char *input_obj, char *output_exe, char *script)
 {
 	char linker_cmd[256];
+	char key[CACHE_KEY_LEN];
+	const char *files[] = {input_obj, script, NULL};
+	int cacheable;
+
+	cacheable = !cache_key(key, files, LINKER_BIN " -m elf_i386 -T");
+	if (cacheable && !cache_lookup(key, output_exe)) return;
+
 	sprintf(linker_cmd, LINKER_BIN " -m elf_i386 -T %s -o %s %s", script, output_exe,
 			input_obj);
 	printl(PRINT_DEBUG, "%s\n", linker_cmd);
 	fflush(stdout);
-	system(linker_cmd);
+	if (!system(linker_cmd) && cacheable) cache_insert(key, output_exe);
 }
 
 
@@ -548,12 +560,59 @@ load_service(struct service_symbs *ret_data, unsigned long lower_addr, unsigned
  * (i.e. that gen_stubs_and_link has been called.)
  */
 
+struct prelink_info {
+	struct service_symbs **services;
+	char *script;
+};
+
+static int
+prelink_service(int i, void *data)
+{
+	struct prelink_info *pi = data;
+	char tmp_exec[128];
+
+	sprintf(tmp_exec, "/tmp/loader_prelink.%d.%d", getpid(), i);
+	run_linker(pi->services[i]->obj, tmp_exec, pi->script);
+	unlink(tmp_exec);
+
+	return 0;
+}
+
+/*
+ * The first, address-less, link of each service only depends on the
+ * service, so do them all in parallel up-front.  The cache then
+ * provides their outputs to load_service.  The second link depends on
+ * the addresses of all previous services, thus remains serial.
+ */
+static void
+prelink_all_services(struct service_symbs *services)
+{
+	struct prelink_info pi;
+	struct service_symbs *s;
+	char script[64], tmp_exec[128];
+	int n, i;
+
+	if (!cache_enabled()) return;
+
+	for (n = 0, s = services; s; s = s->next) n++;
+	pi.services = malloc(n * sizeof(struct service_symbs *));
+	assert(pi.services);
+	for (i = 0, s = services; s; s = s->next, i++) pi.services[i] = s;
+	section_info_init(&section_info[0]);
+	genscript(0, tmp_exec, script);
+	pi.script = script;
+
+	cache_parallel(n, prelink_service, &pi);
+	free(pi.services);
+}
+
 unsigned long
 load_all_services(struct service_symbs *services)
 {
 	unsigned long service_addr = BASE_SERVICE_ADDRESS + DEFAULT_SERVICE_SIZE;
 	long sz;
 
+	prelink_all_services(services);
 	while (services) {
 		sz = services->mem_size = load_service(services, service_addr, DEFAULT_SERVICE_SIZE);
 		if (!sz) return -1;
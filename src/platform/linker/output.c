@@ -692,6 +692,33 @@ make_spd_config_comp(struct service_symbs *c, struct service_symbs *all)
 	format_config_info(all, info);
 }
 
+/*
+ * Repack the service's cobj so that the booter can map its read-only
+ * sections rather than copy them (see cobj_pack).
+ */
+static struct cobj_header *
+pack_cobj(struct service_symbs *s, int compress)
+{
+	struct cobj_header *h;
+	void *mem;
+	u32_t sz = cobj_pack_size_req(s->cobj);
+
+	if (posix_memalign(&mem, PAGE_SIZE, sz)) {
+		printl(PRINT_HIGH, "Could not allocate memory to pack cobj for %s\n", s->obj);
+		exit(-1);
+	}
+	h = cobj_pack(s->cobj, mem, sz, compress);
+	if (!h) {
+		printl(PRINT_HIGH, "Could not pack cobj for %s\n", s->obj);
+		exit(-1);
+	}
+	printl(PRINT_HIGH, "Packed cobj for %s: %d -> %d bytes\n", s->obj, s->cobj->size, h->size);
+	free(s->cobj);
+	s->cobj = h;
+
+	return h;
+}
+
 void
 make_spd_llboot(struct service_symbs *boot, struct service_symbs *all)
 {
@@ -702,6 +729,8 @@ make_spd_llboot(struct service_symbs *boot, struct service_symbs *all)
 	u32_t obj_size;
 	struct cos_component_information *ci;
 	struct service_symbs *first = all;
+	/* "1": page-align the cobjs, "z": and compress read-only sections */
+	char *pack = getenv("COS_COBJ_PACK");
 
 	if (service_get_spdid(boot) != LLBOOT_COMPN) {
 		printf("Low-Level Booter component must be component number %d, but is %d instead.\n"
@@ -725,6 +754,8 @@ make_spd_llboot(struct service_symbs *boot, struct service_symbs *all)
 
 	heap_ptr = (volatile int **)get_heap_ptr(boot);
 	ci = (void *)get_symb_address(&boot->exported, COMP_INFO);
+	/* packed cobjs are page-aligned, and their sizes are multiples of pages */
+	if (pack) *heap_ptr = (int*)(round_up_to_page((int)*heap_ptr));
 	ci->cos_poly[0] = (vaddr_t)*heap_ptr;
 
 	for (all = first ; NULL != all ; all = all->next) {
@@ -738,6 +769,7 @@ make_spd_llboot(struct service_symbs *boot, struct service_symbs *all)
 		assert(is_booter_loaded(all));
 		h = all->cobj;
 		assert(h);
+		if (pack) h = pack_cobj(all, !strcmp(pack, "z"));
 
 		obj_size = round_up_to_cacheline(h->size);
 		map_addr = round_up_to_page(heap_ptr_val);
@@ -1,4 +1,7 @@
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <pthread.h>
+#include <time.h>
 #define LINUX_TEST
 #include <cslab.h>
 
@@ -14,6 +17,8 @@ CSLAB_CREATE(s, sizeof(struct small));
 CSLAB_CREATE(l, sizeof(struct larger));
 
 #define ITER 1024
+#define NTHDS_MAX 8
+#define BENCH_OPS (ITER * 16 * 10) /* alloc+free pairs per thread */
 
 void
 mark(char *c, int sz, char val)
@@ -35,30 +40,109 @@ chk(char *c, int sz, char val)
 	}
 }
 
-#define rdtscll(val) __asm__ __volatile__("rdtsc" : "=A"(val))
+static inline unsigned long long
+rdtsc(void)
+{
+	unsigned int lo, hi;
 
-int
-main(void)
+	__asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+
+	return ((unsigned long long)hi << 32) | lo;
+}
+
+/* Each thread allocates and frees batches of 10 objects. */
+void *
+bench(void *d)
 {
-	struct small *     s[ITER];
-	struct larger *    l[ITER];
+	struct larger *    l[10];
 	int                i, j;
-	unsigned long long start, end;
+	unsigned long long start;
 
-	printf("small per slab %d, large %d\n", slab_s_max_objs, slab_l_max_objs);
-	l[0] = cslab_alloc_l();
-	rdtscll(start);
-	for (j = 0; j < ITER; j++) {
+	start = rdtsc();
+	for (j = 0; j < ITER * 16; j++) {
 		for (i = 0; i < 10; i++) {
-			s[i] = cslab_alloc_l();
+			l[i] = cslab_alloc_l();
+			assert(l[i]);
 		}
 		for (i = 0; i < 10; i++) {
-			cslab_free_l(s[i]);
+			cslab_free_l(l[i]);
 		}
 	}
-	rdtscll(end);
-	end = (end - start) / (ITER * 10);
-	printf("Average cost of slab alloc+free: %lld\n", end);
+	*(unsigned long long *)d = (rdtsc() - start) / BENCH_OPS;
+
+	return NULL;
+}
+
+/*
+ * Objects allocated by one thread, and freed by another: the magazines
+ * filled by the freeing thread flow through the depot back to the
+ * allocating one.
+ */
+struct larger *xfer[ITER];
+volatile int   xfer_ready;
+
+void *
+xfer_free(void *d)
+{
+	int i;
+
+	(void)d;
+	while (!xfer_ready)
+		;
+	for (i = 0; i < ITER; i++) {
+		chk(xfer[i]->x, sizeof(struct larger), i);
+		cslab_free_l(xfer[i]);
+	}
+
+	return NULL;
+}
+
+void
+xfer_test(void)
+{
+	pthread_t t;
+	int       i, j;
+
+	for (j = 0; j < 16; j++) {
+		xfer_ready = 0;
+		assert(!pthread_create(&t, NULL, xfer_free, NULL));
+		for (i = 0; i < ITER; i++) {
+			xfer[i] = cslab_alloc_l();
+			mark(xfer[i]->x, sizeof(struct larger), i);
+		}
+		xfer_ready = 1;
+		pthread_join(t, NULL);
+	}
+	cslab_reap_l();
+}
+
+int
+main(void)
+{
+	struct small *     s[ITER];
+	struct larger *    l[ITER];
+	pthread_t          thds[NTHDS_MAX];
+	unsigned long long cost[NTHDS_MAX];
+	int                i, j, n;
+
+	printf("small per slab %d, large %d\n", slab_s_class.max_objs, slab_l_class.max_objs);
+	for (n = 1; n <= NTHDS_MAX; n *= 2) {
+		unsigned long long tot = 0, ns;
+		struct timespec    start, end;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < n; i++) assert(!pthread_create(&thds[i], NULL, bench, &cost[i]));
+		for (i = 0; i < n; i++) {
+			pthread_join(thds[i], NULL);
+			tot += cost[i];
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		ns = (end.tv_sec - start.tv_sec) * 1000000000ULL + end.tv_nsec - start.tv_nsec;
+		printf("Average cost of slab alloc+free with %d threads: %lld\n", n, tot / n);
+		/* all of the threads' operations over the wall-clock time */
+		printf("Total throughput with %d threads: %llu alloc+free per ms\n", n,
+		       (unsigned long long)n * BENCH_OPS * 1000000 / (ns ? ns : 1));
+	}
 
 	for (i = 0; i < ITER; i++) {
 		s[i] = cslab_alloc_s();
@@ -80,5 +164,7 @@ main(void)
 		chk(l[i]->x, sizeof(struct larger), i);
 		cslab_free_l(l[i]);
 	}
+	xfer_test();
+
 	return 0;
 }